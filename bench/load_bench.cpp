@@ -0,0 +1,716 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif !defined(__linux__)
+#include <sys/resource.h>
+#endif
+#include "../ply_decode.h"
+#include "../ply_reader.h"
+#include "../point_index.h"
+#include "../point_order.h"
+#include "../splat_radius.h"
+#include "../thread_pool.h"
+#include "synthetic_cloud.h"
+
+/* CPU benchmarks of loading and the load-time preprocessing, on deterministic synthetic clouds.
+ * Needs no GPU or window, so ingest regressions can be caught on any machine. */
+
+std::vector<std::uint64_t> pointCounts = { 1000000 };
+std::vector<SyntheticShape> shapes = { SyntheticShape::Sphere, SyntheticShape::Plane, SyntheticShape::Scan, SyntheticShape::Outliers };
+std::vector<std::string> formats = { "binary" };
+std::vector<std::string> selected;
+std::filesystem::path dataDirectory = std::filesystem::temp_directory_path() / "rll2008-bench";
+std::filesystem::path reportOutput;
+std::filesystem::path generateOutput;
+std::uint64_t seed = 1;
+int repetitions = 5;
+int threads = 0;
+
+namespace
+{
+  /* Every allocation, of any alignment, is placed after a header holding the malloc block and its
+   * size, so frees can keep a count of the live bytes and every form of delete frees the same way. */
+  struct AllocationHeader
+  {
+    void* block;
+    std::size_t size;
+  };
+  std::atomic<std::uint64_t> allocationCount(0);
+  std::atomic<std::uint64_t> allocatedBytes(0);
+  std::atomic<std::int64_t> liveBytes(0);
+  std::atomic<std::int64_t> peakLiveBytes(0);
+
+  void* countedAllocate(std::size_t size, std::size_t alignment) noexcept
+  {
+    alignment = std::max(alignment, alignof(std::max_align_t));
+    void* const block = std::malloc(size + sizeof(AllocationHeader) + alignment);
+    if (!block)
+    {
+      return nullptr;
+    }
+    std::uintptr_t const start = (std::uintptr_t)block + sizeof(AllocationHeader);
+    char* const pointer = (char*)((start + alignment - 1) / alignment * alignment);
+    ((AllocationHeader*)pointer)[-1] = { block, size };
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    std::int64_t const live = liveBytes.fetch_add((std::int64_t)size, std::memory_order_relaxed) + (std::int64_t)size;
+    std::int64_t peak = peakLiveBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+    {
+    }
+    return pointer;
+  }
+
+  void* countedNew(std::size_t size, std::size_t alignment)
+  {
+    void* const pointer = countedAllocate(size, alignment);
+    if (!pointer)
+    {
+      throw std::bad_alloc();
+    }
+    return pointer;
+  }
+
+  void countedFree(void* pointer) noexcept
+  {
+    if (!pointer)
+    {
+      return;
+    }
+    AllocationHeader const header = ((AllocationHeader*)pointer)[-1];
+    liveBytes.fetch_sub((std::int64_t)header.size, std::memory_order_relaxed);
+    std::free(header.block);
+  }
+}
+
+// Every replaceable form, so that no allocation escapes the counts or is freed by the wrong allocator.
+void* operator new(std::size_t size)
+{
+  return countedNew(size, 0);
+}
+
+void* operator new[](std::size_t size)
+{
+  return countedNew(size, 0);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+  return countedNew(size, (std::size_t)alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+  return countedNew(size, (std::size_t)alignment);
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept
+{
+  return countedAllocate(size, 0);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept
+{
+  return countedAllocate(size, 0);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept
+{
+  return countedAllocate(size, (std::size_t)alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept
+{
+  return countedAllocate(size, (std::size_t)alignment);
+}
+
+void operator delete(void* pointer) noexcept
+{
+  countedFree(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+  countedFree(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+  countedFree(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+  countedFree(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+  countedFree(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+  countedFree(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept
+{
+  countedFree(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept
+{
+  countedFree(pointer);
+}
+
+void operator delete(void* pointer, std::nothrow_t const&) noexcept
+{
+  countedFree(pointer);
+}
+
+void operator delete[](void* pointer, std::nothrow_t const&) noexcept
+{
+  countedFree(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, std::nothrow_t const&) noexcept
+{
+  countedFree(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, std::nothrow_t const&) noexcept
+{
+  countedFree(pointer);
+}
+
+// Linux can reset the peak resident set, so every benchmark reports its own; elsewhere it is the process's peak so far.
+void resetPeakResident()
+{
+#ifdef __linux__
+  std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+std::uint64_t peakResidentBytes()
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters = {};
+  GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+  return counters.PeakWorkingSetSize;
+#elif defined(__linux__)
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+  {
+    if (line.compare(0, 6, "VmHWM:") == 0)
+    {
+      return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+    }
+  }
+  return 0;
+#else
+  rusage usage = {};
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return (std::uint64_t)usage.ru_maxrss;
+#else
+  return (std::uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+/* One benchmark on one cloud. bytes is the input it consumes, for the throughput; the allocation
+ * counts are those of the last repetition, the peak heap above what was live before it. */
+struct BenchmarkResult
+{
+  std::string name;
+  std::string shape;
+  std::uint64_t points;
+  std::uint64_t bytes;
+  std::vector<double> milliseconds;
+  std::uint64_t allocations;
+  std::uint64_t allocatedBytes;
+  std::uint64_t peakHeapBytes;
+  std::uint64_t peakResidentBytes;
+};
+std::vector<BenchmarkResult> results;
+
+bool isSelected(std::string const& name)
+{
+  return selected.empty() || std::find(selected.begin(), selected.end(), name) != selected.end();
+}
+
+// Runs prepare untimed and then run, repetitions times.
+void measure(std::string const& name, SyntheticShape shape, std::uint64_t points, std::uint64_t bytes, std::function<void()> const& prepare, std::function<void()> const& run)
+{
+  BenchmarkResult result = { name, syntheticShapeName(shape), points, bytes, {}, 0, 0, 0, 0 };
+  resetPeakResident();
+  for (int repetition = 0; repetition < repetitions; ++repetition)
+  {
+    prepare();
+    std::uint64_t const allocationsBefore = allocationCount.load();
+    std::uint64_t const bytesBefore = allocatedBytes.load();
+    std::int64_t const liveBefore = liveBytes.load();
+    peakLiveBytes.store(liveBefore);
+    auto const start = std::chrono::steady_clock::now();
+    run();
+    result.milliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    result.allocations = allocationCount.load() - allocationsBefore;
+    result.allocatedBytes = allocatedBytes.load() - bytesBefore;
+    result.peakHeapBytes = (std::uint64_t)(peakLiveBytes.load() - liveBefore);
+  }
+  result.peakResidentBytes = peakResidentBytes();
+  std::cerr << name << " " << result.shape << " " << points << ": " << *std::min_element(result.milliseconds.begin(), result.milliseconds.end()) << " ms" << std::endl;
+  results.push_back(result);
+}
+
+// The cloud file of a shape, size and format, generated on first use; its name pins down its contents.
+std::filesystem::path cloudFile(SyntheticShape shape, std::uint64_t count, std::string const& format, ThreadPool& pool)
+{
+  std::filesystem::path const path = dataDirectory / (std::string(syntheticShapeName(shape)) + "_" + std::to_string(count) + "_" + std::to_string(seed) + "_" + format + ".ply");
+  if (std::filesystem::exists(path))
+  {
+    return path;
+  }
+  std::filesystem::create_directories(dataDirectory);
+  // Written under a temporary name, so an interrupted run never leaves a truncated cloud behind.
+  std::filesystem::path partial = path;
+  partial += ".partial";
+  auto const start = std::chrono::steady_clock::now();
+  writeSyntheticPly(partial, shape, count, format == "ascii", seed, pool);
+  std::filesystem::rename(partial, path);
+  std::cerr << "GENERATED " << path.string() << " IN " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " S" << std::endl;
+  return path;
+}
+
+void runBenchmarks(SyntheticShape shape, std::uint64_t count, ThreadPool& pool)
+{
+  for (std::string const& format : formats)
+  {
+    std::string const name = "read_ply_" + format;
+    if (!isSelected(name))
+    {
+      continue;
+    }
+    std::filesystem::path const path = cloudFile(shape, count, format, pool);
+    measure(name, shape, count, std::filesystem::file_size(path), [] {}, [&]
+    {
+      int stride = 0;
+      std::vector<float> const points = readPLY(path, stride, true, threads);
+    });
+  }
+
+  // The same points in memory, as the columns tinyply hands over and as the interleaved points the later stages take.
+  bool const needColumns = isSelected("decode_positions_float") || isSelected("decode_positions_double") || isSelected("color_interleave");
+  bool const needPoints = isSelected("stratify_points") || isSelected("splat_radii") || isSelected("point_index") || isSelected("point_index_query");
+  if (!needColumns && !needPoints)
+  {
+    return;
+  }
+  std::size_t const n = (std::size_t)count;
+  std::vector<float> positions(needColumns ? 3 * n : 0);
+  std::vector<double> farPositions(needColumns ? 3 * n : 0);
+  std::vector<std::uint8_t> colors(needColumns ? 3 * n : 0);
+  std::vector<float> points(needPoints ? 9 * n : 0);
+  int const blockCount = (int)((n + 65535) / 65536);
+  pool.parallelFor(blockCount, [&](int block, int)
+  {
+    for (std::size_t i = (std::size_t)block * 65536; i < std::min(n, (std::size_t)(block + 1) * 65536); ++i)
+    {
+      SyntheticPoint const point = syntheticPoint(shape, i, seed);
+      for (int axis = 0; axis < 3 && needColumns; ++axis)
+      {
+        positions[axis * n + i] = point.position[axis];
+        // Georeferenced coordinates: large offsets that only double keeps to the millimetre.
+        farPositions[axis * n + i] = 4e6 + point.position[axis];
+        colors[axis * n + i] = point.color[axis];
+      }
+      for (int axis = 0; axis < 3 && needPoints; ++axis)
+      {
+        points[i * 9 + axis] = point.position[axis];
+        points[i * 9 + 3 + axis] = point.normal[axis];
+        points[i * 9 + 6 + axis] = point.color[axis] / 255.f;
+      }
+    }
+  });
+
+  std::vector<float> decoded(needColumns ? 9 * n : 0);
+  if (isSelected("decode_positions_float"))
+  {
+    std::vector<PlyColumn> columns;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      columns.push_back({ PlyScalar::Float32, &positions[axis * n], axis, 0., 1. });
+    }
+    measure("decode_positions_float", shape, count, 12 * count, [] {}, [&]
+    {
+      decodePlyColumns(columns, n, 9, pool, decoded.data());
+    });
+  }
+  if (isSelected("decode_positions_double"))
+  {
+    std::vector<PlyColumn> columns;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      columns.push_back({ PlyScalar::Float64, &farPositions[axis * n], axis, 0., 1. });
+    }
+    // Includes the bounds pass that finds the origin, as readPLY does for double positions.
+    measure("decode_positions_double", shape, count, 24 * count, [] {}, [&]
+    {
+      for (PlyColumn& column : columns)
+      {
+        double lower = 0.;
+        double upper = 0.;
+        plyColumnBounds(column, n, pool, lower, upper);
+        column.offset = (lower + upper) / 2.;
+      }
+      decodePlyColumns(columns, n, 9, pool, decoded.data());
+    });
+  }
+  if (isSelected("color_interleave"))
+  {
+    std::vector<PlyColumn> columns;
+    for (int channel = 0; channel < 3; ++channel)
+    {
+      columns.push_back({ PlyScalar::UInt8, &colors[channel * n], 6 + channel, 0., 1. / plyScalarRange(PlyScalar::UInt8) });
+    }
+    measure("color_interleave", shape, count, 3 * count, [] {}, [&]
+    {
+      decodePlyColumns(columns, n, 9, pool, decoded.data());
+    });
+  }
+
+  std::vector<float> work;
+  auto const copyPoints = [&]
+  {
+    work = points;
+  };
+  if (isSelected("stratify_points"))
+  {
+    measure("stratify_points", shape, count, 36 * count, copyPoints, [&]
+    {
+      stratifyPoints(work, 9, 0, n);
+    });
+  }
+  if (isSelected("splat_radii"))
+  {
+    std::vector<float> radii(n);
+    measure("splat_radii", shape, count, 36 * count, [] {}, [&]
+    {
+      estimateSplatRadii(points.data(), 9, n, pool, radii.data());
+    });
+  }
+  if (isSelected("point_index"))
+  {
+    measure("point_index", shape, count, 36 * count, copyPoints, [&]
+    {
+      PointIndex const index(std::move(work), 9, pool);
+    });
+  }
+  if (isSelected("point_index_query"))
+  {
+    /* What one --pick click runs: a pick along a ray from outside the cloud towards one of its
+     * points, with the 5 pixel tolerance of a 45 degree, 1080 row view, then the 9 nearest points
+     * and the points within the pick radius. Its points are the picks, so points per second is picks per second. */
+    PointIndex const index(points, 9, pool);
+    glm::vec3 lower(std::numeric_limits<float>::max());
+    glm::vec3 upper(-std::numeric_limits<float>::max());
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      lower = glm::min(lower, index.position(i));
+      upper = glm::max(upper, index.position(i));
+    }
+    glm::vec3 const center = (lower + upper) * .5f;
+    float const distance = 2.f * glm::length(upper - lower) + 1.f;
+    float const tolerance = 5.f * 2.f * std::tan(glm::radians(22.5f)) / 1080.f;
+    std::size_t const picks = 1000;
+    std::size_t found = 0;
+    measure("point_index_query", shape, picks, 0, [] {}, [&]
+    {
+      for (std::size_t pick = 0; pick < picks; ++pick)
+      {
+        float const angle = 6.2831853f * pick / picks;
+        glm::vec3 const origin = center + distance * glm::vec3(std::cos(angle), .3f, std::sin(angle));
+        glm::vec3 const target = index.position((pick * 7919) % n);
+        std::int64_t const picked = index.pick(origin, target - origin, tolerance);
+        if (picked < 0)
+        {
+          continue;
+        }
+        glm::vec3 const position = index.position((std::size_t)picked);
+        found += index.nearest(position, 9).size();
+        found += index.withinRadius(position, tolerance * glm::distance(origin, position)).size();
+      }
+    });
+    std::cerr << "point_index_query " << syntheticShapeName(shape) << " FOUND " << found << " POINTS" << std::endl;
+  }
+}
+
+void writeReport(std::ostream& out, bool json, int threadCount)
+{
+  std::vector<std::pair<std::string, std::string>> const metadata = {
+    { "threads", std::to_string(threadCount) },
+    { "repetitions", std::to_string(repetitions) },
+    { "seed", std::to_string(seed) } };
+  out << std::fixed << std::setprecision(4);
+  if (json)
+  {
+    out << "{" << std::endl;
+    for (auto const& entry : metadata)
+    {
+      out << "  \"" << entry.first << "\": \"" << entry.second << "\"," << std::endl;
+    }
+    out << "  \"benchmarks\": [" << std::endl;
+  }
+  else
+  {
+    for (auto const& entry : metadata)
+    {
+      out << "# " << entry.first << ": " << entry.second << std::endl;
+    }
+    out << "benchmark,shape,points,bytes,samples,min_ms,p50_ms,points_per_second,megabytes_per_second,allocations,allocated_bytes,peak_heap_bytes,peak_rss_bytes" << std::endl;
+  }
+  for (std::size_t i = 0; i < results.size(); ++i)
+  {
+    BenchmarkResult const& result = results[i];
+    std::vector<double> sorted = result.milliseconds;
+    std::sort(sorted.begin(), sorted.end());
+    double const median = sorted[(sorted.size() - 1) / 2];
+    double const seconds = std::max(median, 1e-6) / 1000.;
+    std::uint64_t const pointsPerSecond = (std::uint64_t)(result.points / seconds);
+    double const megabytesPerSecond = result.bytes / seconds / 1e6;
+    if (json)
+    {
+      out << "    { \"name\": \"" << result.name << "\", \"shape\": \"" << result.shape << "\", \"points\": " << result.points
+        << ", \"bytes\": " << result.bytes << ", \"samples\": " << sorted.size() << ", \"min_ms\": " << sorted.front()
+        << ", \"p50_ms\": " << median << ", \"points_per_second\": " << pointsPerSecond << ", \"megabytes_per_second\": " << megabytesPerSecond
+        << ", \"allocations\": " << result.allocations << ", \"allocated_bytes\": " << result.allocatedBytes
+        << ", \"peak_heap_bytes\": " << result.peakHeapBytes << ", \"peak_rss_bytes\": " << result.peakResidentBytes
+        << " }" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    else
+    {
+      out << result.name << "," << result.shape << "," << result.points << "," << result.bytes << "," << sorted.size() << ","
+        << sorted.front() << "," << median << "," << pointsPerSecond << "," << megabytesPerSecond << "," << result.allocations << ","
+        << result.allocatedBytes << "," << result.peakHeapBytes << "," << result.peakResidentBytes << std::endl;
+    }
+  }
+  if (json)
+  {
+    out << "  ]" << std::endl << "}" << std::endl;
+  }
+}
+
+void printUsage(char const* program)
+{
+  std::cout << "usage: " << program << " [options]" << std::endl;
+  std::cout << "  --points N,...          cloud sizes, with an optional K, M or G suffix (default 1M)" << std::endl;
+  std::cout << "  --shapes S,...          sphere, plane, scan and/or outliers (default all)" << std::endl;
+  std::cout << "  --formats F,...         binary and/or ascii files for read_ply (default binary)" << std::endl;
+  std::cout << "  --benchmarks B,...      run only these of read_ply_binary, read_ply_ascii, decode_positions_float," << std::endl;
+  std::cout << "                          decode_positions_double, color_interleave, stratify_points, splat_radii, point_index," << std::endl;
+  std::cout << "                          point_index_query" << std::endl;
+  std::cout << "  --repetitions R         runs of every benchmark (default 5)" << std::endl;
+  std::cout << "  --threads N             worker threads (default one per core)" << std::endl;
+  std::cout << "  --seed S                seed of the synthetic clouds (default 1)" << std::endl;
+  std::cout << "  --data DIR              where generated clouds are kept for later runs (default a temporary directory)" << std::endl;
+  std::cout << "  --output FILE           write the report to FILE, as JSON if it ends in .json, else CSV" << std::endl;
+  std::cout << "  --generate FILE         only write the first shape, size and format to FILE" << std::endl;
+}
+
+std::vector<std::string> splitList(std::string const& list)
+{
+  std::vector<std::string> items;
+  std::istringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ','))
+  {
+    items.push_back(item);
+  }
+  return items;
+}
+
+bool parsePointCount(std::string const& text, std::uint64_t& count)
+{
+  char* end = nullptr;
+  double const value = std::strtod(text.c_str(), &end);
+  std::string const suffix(end);
+  double const scale = suffix.empty() ? 1. : suffix == "K" || suffix == "k" ? 1e3 : suffix == "M" || suffix == "m" ? 1e6 : suffix == "G" || suffix == "g" ? 1e9 : 0.;
+  if (end == text.c_str() || scale == 0. || value <= 0.)
+  {
+    return false;
+  }
+  count = (std::uint64_t)(value * scale + .5);
+  return count > 0;
+}
+
+// A whole decimal count of at least 1, with nothing after it.
+bool parsePositive(std::string const& text, int& value)
+{
+  char* end = nullptr;
+  errno = 0;
+  long const parsed = std::strtol(text.c_str(), &end, 10);
+  if (end == text.c_str() || *end != '\0' || errno == ERANGE || parsed < 1 || parsed > std::numeric_limits<int>::max())
+  {
+    return false;
+  }
+  value = (int)parsed;
+  return true;
+}
+
+bool parseArguments(int argc, char* argv[])
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string const arg = argv[i];
+    bool const hasValue = i + 1 < argc;
+    if (arg == "--points" && hasValue)
+    {
+      pointCounts.clear();
+      for (std::string const& item : splitList(argv[++i]))
+      {
+        std::uint64_t count = 0;
+        if (!parsePointCount(item, count))
+        {
+          return false;
+        }
+        pointCounts.push_back(count);
+      }
+    }
+    else if (arg == "--shapes" && hasValue)
+    {
+      shapes.clear();
+      for (std::string const& item : splitList(argv[++i]))
+      {
+        SyntheticShape shape;
+        if (!parseSyntheticShape(item, shape))
+        {
+          return false;
+        }
+        shapes.push_back(shape);
+      }
+    }
+    else if (arg == "--formats" && hasValue)
+    {
+      formats = splitList(argv[++i]);
+      for (std::string const& format : formats)
+      {
+        if (format != "binary" && format != "ascii")
+        {
+          return false;
+        }
+      }
+    }
+    else if (arg == "--benchmarks" && hasValue)
+    {
+      selected = splitList(argv[++i]);
+    }
+    else if (arg == "--repetitions" && hasValue)
+    {
+      if (!parsePositive(argv[++i], repetitions))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--threads" && hasValue)
+    {
+      if (!parsePositive(argv[++i], threads))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--seed" && hasValue)
+    {
+      seed = std::strtoull(argv[++i], nullptr, 10);
+    }
+    else if (arg == "--data" && hasValue)
+    {
+      dataDirectory = argv[++i];
+    }
+    else if (arg == "--output" && hasValue)
+    {
+      reportOutput = argv[++i];
+    }
+    else if (arg == "--generate" && hasValue)
+    {
+      generateOutput = argv[++i];
+    }
+    else
+    {
+      return false;
+    }
+  }
+  // Selecting a read benchmark of a format selects the format.
+  for (std::string const& name : selected)
+  {
+    if (name.compare(0, 9, "read_ply_") == 0 && std::find(formats.begin(), formats.end(), name.substr(9)) == formats.end())
+    {
+      formats.push_back(name.substr(9));
+    }
+  }
+  return repetitions > 0 && threads >= 0 && !pointCounts.empty() && !shapes.empty() && !formats.empty();
+}
+
+int main(int argc, char* argv[])
+{
+  if (!parseArguments(argc, argv))
+  {
+    printUsage(argv[0]);
+    return 1;
+  }
+  ThreadPool pool(threads);
+  try
+  {
+    if (!generateOutput.empty())
+    {
+      writeSyntheticPly(generateOutput, shapes.front(), pointCounts.front(), formats.front() == "ascii", seed, pool);
+      return 0;
+    }
+    for (std::uint64_t count : pointCounts)
+    {
+      for (SyntheticShape shape : shapes)
+      {
+        runBenchmarks(shape, count, pool);
+      }
+    }
+  }
+  catch (std::exception const& e)
+  {
+    std::cout << "BENCHMARK FAILED" << std::endl;
+    std::cerr << e.what() << std::endl;
+    return 2;
+  }
+  if (reportOutput.empty())
+  {
+    writeReport(std::cout, false, pool.getThreadCount());
+    return 0;
+  }
+  std::ofstream report(reportOutput);
+  if (report.fail())
+  {
+    std::cout << "COULD NOT WRITE BENCHMARK REPORT" << std::endl;
+    std::cerr << reportOutput.string() << " failed to open" << std::endl;
+    return 7;
+  }
+  writeReport(report, reportOutput.extension() == ".json", pool.getThreadCount());
+  return 0;
+}
@@ -0,0 +1,264 @@
+#include "synthetic_cloud.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+  std::uint64_t const blockPoints = 1 << 16;
+  double const pi = 3.14159265358979323846;
+
+  // splitmix64: every output bit depends on every input bit, so consecutive indices give independent streams.
+  std::uint64_t mix(std::uint64_t x)
+  {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+  }
+
+  class Random
+  {
+  public:
+    Random(std::uint64_t index, std::uint64_t seed)
+      : state(mix(seed) ^ index)
+    {
+    }
+    // Uniform in [0, 1).
+    double next()
+    {
+      state = mix(state);
+      return (state >> 11) * (1. / (1ull << 53));
+    }
+    double gaussian()
+    {
+      double const u = std::max(next(), std::numeric_limits<double>::min());
+      return std::sqrt(-2. * std::log(u)) * std::cos(2. * pi * next());
+    }
+  private:
+    std::uint64_t state;
+  };
+
+  std::uint8_t toByte(double value)
+  {
+    return (std::uint8_t)std::min(255., std::max(0., value * 255. + .5));
+  }
+
+  void sphere(Random& random, SyntheticPoint& point)
+  {
+    double const z = 2. * random.next() - 1.;
+    double const angle = 2. * pi * random.next();
+    double const ring = std::sqrt(std::max(0., 1. - z * z));
+    double const normal[3] = { ring * std::cos(angle), ring * std::sin(angle), z };
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      point.position[axis] = (float)normal[axis];
+      point.normal[axis] = (float)normal[axis];
+      point.color[axis] = toByte(normal[axis] * .5 + .5);
+    }
+  }
+
+  void plane(Random& random, SyntheticPoint& point)
+  {
+    double const x = 2. * random.next() - 1.;
+    double const z = 2. * random.next() - 1.;
+    // An 8x8 checkerboard, so neighbouring points differ in color.
+    bool const dark = ((int)std::floor(x * 4.) + (int)std::floor(z * 4.)) % 2 != 0;
+    point.position[0] = (float)x;
+    point.position[1] = 0.f;
+    point.position[2] = (float)z;
+    point.normal[0] = 0.f;
+    point.normal[1] = 1.f;
+    point.normal[2] = 0.f;
+    std::fill(point.color, point.color + 3, dark ? (std::uint8_t)64 : (std::uint8_t)192);
+  }
+
+  void scan(Random& random, SyntheticPoint& point)
+  {
+    double const origin[3] = { 0., 1.5, 0. };
+    double const lower[3] = { -10., 0., -10. };
+    double const upper[3] = { 10., 4., 10. };
+    double const pillar[3] = { 3., 1., 2. };
+    double const pillarRadius = 1.;
+    // Elevations from -60 to 90 degrees; the scanner's own mount hides the rest.
+    double const azimuth = 2. * pi * random.next();
+    double const elevation = pi * (random.next() * 150. - 60.) / 180.;
+    double const direction[3] = { std::cos(elevation) * std::cos(azimuth), std::sin(elevation), std::cos(elevation) * std::sin(azimuth) };
+    double range = std::numeric_limits<double>::max();
+    double normal[3] = {};
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (direction[axis] == 0.)
+      {
+        continue;
+      }
+      double const wall = direction[axis] > 0. ? upper[axis] : lower[axis];
+      double const distance = (wall - origin[axis]) / direction[axis];
+      if (distance < range)
+      {
+        range = distance;
+        std::fill(normal, normal + 3, 0.);
+        normal[axis] = direction[axis] > 0. ? -1. : 1.;
+      }
+    }
+    double toPillar[3];
+    double along = 0.;
+    double distanceSquared = 0.;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      toPillar[axis] = pillar[axis] - origin[axis];
+      along += toPillar[axis] * direction[axis];
+      distanceSquared += toPillar[axis] * toPillar[axis];
+    }
+    double const discriminant = along * along - distanceSquared + pillarRadius * pillarRadius;
+    if (discriminant >= 0. && along - std::sqrt(discriminant) > 0. && along - std::sqrt(discriminant) < range)
+    {
+      range = along - std::sqrt(discriminant);
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        normal[axis] = (origin[axis] + range * direction[axis] - pillar[axis]) / pillarRadius;
+      }
+    }
+    double const incidence = std::fabs(normal[0] * direction[0] + normal[1] * direction[1] + normal[2] * direction[2]);
+    double const measured = range + random.gaussian() * (.002 + .0005 * range);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      point.position[axis] = (float)(origin[axis] + measured * direction[axis]);
+      point.normal[axis] = (float)normal[axis];
+    }
+    std::fill(point.color, point.color + 3, toByte(incidence * (1. - range / 30.)));
+  }
+
+  void outliers(Random& random, SyntheticPoint& point, std::uint64_t index)
+  {
+    sphere(random, point);
+    if (index % 1000 != 999)
+    {
+      return;
+    }
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      point.position[axis] = (float)(2000. * random.next() - 1000.);
+    }
+    std::fill(point.color, point.color + 3, (std::uint8_t)128);
+  }
+
+  void formatBlock(SyntheticShape shape, std::uint64_t first, std::uint64_t count, bool ascii, std::uint64_t seed, std::string& text)
+  {
+    text.clear();
+    char line[160];
+    for (std::uint64_t i = first; i < first + count; ++i)
+    {
+      SyntheticPoint const point = syntheticPoint(shape, i, seed);
+      if (ascii)
+      {
+        int const length = std::snprintf(line, sizeof(line), "%.9g %.9g %.9g %.6g %.6g %.6g %d %d %d\n",
+          point.position[0], point.position[1], point.position[2], point.normal[0], point.normal[1], point.normal[2],
+          point.color[0], point.color[1], point.color[2]);
+        text.append(line, length);
+      }
+      else
+      {
+        // Binary PLY is little endian, like every platform this builds for.
+        std::memcpy(line, point.position, sizeof(point.position));
+        std::memcpy(line + 12, point.normal, sizeof(point.normal));
+        std::memcpy(line + 24, point.color, sizeof(point.color));
+        text.append(line, 27);
+      }
+    }
+  }
+}
+
+char const* syntheticShapeName(SyntheticShape shape)
+{
+  switch (shape)
+  {
+  case SyntheticShape::Sphere:
+    return "sphere";
+  case SyntheticShape::Plane:
+    return "plane";
+  case SyntheticShape::Scan:
+    return "scan";
+  case SyntheticShape::Outliers:
+    return "outliers";
+  }
+  return "unknown";
+}
+
+bool parseSyntheticShape(std::string const& name, SyntheticShape& shape)
+{
+  for (SyntheticShape candidate : { SyntheticShape::Sphere, SyntheticShape::Plane, SyntheticShape::Scan, SyntheticShape::Outliers })
+  {
+    if (name == syntheticShapeName(candidate))
+    {
+      shape = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+SyntheticPoint syntheticPoint(SyntheticShape shape, std::uint64_t index, std::uint64_t seed)
+{
+  Random random(index, seed);
+  SyntheticPoint point;
+  switch (shape)
+  {
+  case SyntheticShape::Sphere:
+    sphere(random, point);
+    break;
+  case SyntheticShape::Plane:
+    plane(random, point);
+    break;
+  case SyntheticShape::Scan:
+    scan(random, point);
+    break;
+  case SyntheticShape::Outliers:
+    outliers(random, point, index);
+    break;
+  }
+  return point;
+}
+
+void writeSyntheticPly(std::filesystem::path const& path, SyntheticShape shape, std::uint64_t count, bool ascii, std::uint64_t seed, ThreadPool& pool)
+{
+  std::ofstream out(path, std::ios::binary);
+  if (out.fail())
+  {
+    throw std::runtime_error(path.string() + " failed to open");
+  }
+  out << "ply\n"
+    << "format " << (ascii ? "ascii" : "binary_little_endian") << " 1.0\n"
+    << "comment synthetic " << syntheticShapeName(shape) << " seed " << seed << "\n"
+    << "element vertex " << count << "\n"
+    << "property float x\nproperty float y\nproperty float z\n"
+    << "property float nx\nproperty float ny\nproperty float nz\n"
+    << "property uchar red\nproperty uchar green\nproperty uchar blue\n"
+    << "end_header\n";
+  std::uint64_t const blockCount = (count + blockPoints - 1) / blockPoints;
+  std::uint64_t const batch = 4 * (std::uint64_t)pool.getThreadCount();
+  std::vector<std::string> blocks(batch);
+  for (std::uint64_t firstBlock = 0; firstBlock < blockCount; firstBlock += batch)
+  {
+    int const tasks = (int)std::min(batch, blockCount - firstBlock);
+    pool.parallelFor(tasks, [&](int task, int)
+    {
+      std::uint64_t const first = (firstBlock + task) * blockPoints;
+      formatBlock(shape, first, std::min(blockPoints, count - first), ascii, seed, blocks[task]);
+    });
+    for (int task = 0; task < tasks; ++task)
+    {
+      out.write(blocks[task].data(), blocks[task].size());
+    }
+  }
+  out.flush();
+  if (out.fail())
+  {
+    throw std::runtime_error(path.string() + " failed to write");
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include "../thread_pool.h"
+
+/* Point distributions of the synthetic clouds. Sphere and Plane sample a unit sphere and the
+ * square [-1,1]^2 at y = 0 uniformly. Scan imitates a terrestrial scanner in a 20 x 4 x 20 room
+ * with a pillar: uniform angular steps, so the density falls with the square of the range, range
+ * noise growing with distance and gray intensity from range and incidence. Outliers is the
+ * sphere with one point in a thousand thrown uniformly into a cube 2000 wide, like the stray
+ * long-range returns of real scans. */
+enum class SyntheticShape
+{
+  Sphere,
+  Plane,
+  Scan,
+  Outliers
+};
+
+struct SyntheticPoint
+{
+  float position[3];
+  float normal[3];
+  std::uint8_t color[3];
+};
+
+char const* syntheticShapeName(SyntheticShape shape);
+bool parseSyntheticShape(std::string const& name, SyntheticShape& shape);
+// The index-th point of a cloud. It depends on shape, index and seed only, so any range of points can be generated on its own.
+SyntheticPoint syntheticPoint(SyntheticShape shape, std::uint64_t index, std::uint64_t seed);
+/* Writes count points as float x y z nx ny nz and uchar red green blue, either ASCII or binary
+ * little endian. Blocks of points are generated and formatted in parallel and written in order,
+ * so clouds of any size stream through a few megabytes of memory. */
+void writeSyntheticPly(std::filesystem::path const& path, SyntheticShape shape, std::uint64_t count, bool ascii, std::uint64_t seed, ThreadPool& pool);
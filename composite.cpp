@@ -0,0 +1,354 @@
+#include "composite.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  char const helloMagic[4] = { 'R', 'L', 'C', 'W' };
+  char const frameMagic[4] = { 'R', 'L', 'C', 'F' };
+  char const planesMagic[4] = { 'R', 'L', 'C', 'G' };
+  // Rows merged per task; small enough that every core gets several strips of a 1080p frame.
+  int const stripRows = 16;
+
+  double millisecondsSince(std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  bool sendAll(int connection, void const* data, std::size_t size)
+  {
+#ifndef _WIN32
+    char const* bytes = (char const*)data;
+    std::size_t sent = 0;
+    while (sent < size)
+    {
+      ssize_t const n = send(connection, bytes + sent, size - sent, 0);
+      if (n <= 0)
+      {
+        return false;
+      }
+      sent += (std::size_t)n;
+    }
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  bool receiveAll(int connection, void* data, std::size_t size)
+  {
+#ifndef _WIN32
+    char* bytes = (char*)data;
+    std::size_t received = 0;
+    while (received < size)
+    {
+      ssize_t const n = recv(connection, bytes + received, size - received, 0);
+      if (n <= 0)
+      {
+        return false;
+      }
+      received += (std::size_t)n;
+    }
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void closeSocket(int connection)
+  {
+#ifndef _WIN32
+    if (connection >= 0)
+    {
+      close(connection);
+    }
+#endif
+  }
+
+  void disableNagle(int connection)
+  {
+#ifndef _WIN32
+    // Frames are small and answered at once; waiting to coalesce them only adds latency.
+    int const on = 1;
+    setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#endif
+  }
+}
+
+void GBufferPlanes::resize(std::size_t pixels)
+{
+  depth.resize(pixels);
+  position.resize(pixels * 4);
+  normal.resize(pixels * 3);
+  color.resize(pixels * 4);
+}
+
+Compositor::Compositor(int port, bool external, int width, int height)
+  : width(width),
+  height(height),
+  listenSocket(-1),
+  port(port),
+  gatherMilliseconds(0.),
+  compositeMilliseconds(0.)
+{
+#ifdef _WIN32
+  throw std::runtime_error("compositing needs POSIX sockets");
+#else
+  // A worker that exits early must not kill the compositor on the next send.
+  std::signal(SIGPIPE, SIG_IGN);
+  listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenSocket < 0)
+  {
+    throw std::runtime_error("could not create socket");
+  }
+  int const on = 1;
+  setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons((std::uint16_t)port);
+  address.sin_addr.s_addr = htonl(external ? INADDR_ANY : INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (bind(listenSocket, (sockaddr const*)&address, sizeof(address)) != 0 || listen(listenSocket, 64) != 0
+    || getsockname(listenSocket, (sockaddr*)&address, &length) != 0)
+  {
+    close(listenSocket);
+    throw std::runtime_error("could not listen on port " + std::to_string(port));
+  }
+  this->port = ntohs(address.sin_port);
+#endif
+}
+
+Compositor::~Compositor()
+{
+  CompositeFrame stop = {};
+  stop.frame = stopFrame;
+  for (int connection : connections)
+  {
+    if (connection >= 0)
+    {
+      sendAll(connection, frameMagic, sizeof(frameMagic));
+      sendAll(connection, &stop, sizeof(stop));
+      closeSocket(connection);
+    }
+  }
+  closeSocket(listenSocket);
+}
+
+int Compositor::getPort() const
+{
+  return port;
+}
+
+void Compositor::acceptWorkers(int workerCount, int timeoutMilliseconds)
+{
+#ifndef _WIN32
+  connections.assign(workerCount, -1);
+  planes.assign(workerCount, GBufferPlanes());
+  workerMilliseconds.assign(workerCount, 0.f);
+  for (GBufferPlanes& plane : planes)
+  {
+    plane.resize((std::size_t)width * height);
+  }
+  auto const start = std::chrono::steady_clock::now();
+  int accepted = 0;
+  while (accepted < workerCount)
+  {
+    int const remaining = timeoutMilliseconds - (int)millisecondsSince(start);
+    pollfd listening = { listenSocket, POLLIN, 0 };
+    if (remaining <= 0 || poll(&listening, 1, remaining) <= 0)
+    {
+      throw std::runtime_error("only " + std::to_string(accepted) + " of " + std::to_string(workerCount) + " workers connected");
+    }
+    int const connection = accept(listenSocket, nullptr, nullptr);
+    if (connection < 0)
+    {
+      continue;
+    }
+    char magic[4];
+    std::uint32_t partition = 0;
+    if (!receiveAll(connection, magic, sizeof(magic)) || std::memcmp(magic, helloMagic, sizeof(magic)) != 0
+      || !receiveAll(connection, &partition, sizeof(partition)) || partition >= (std::uint32_t)workerCount
+      || connections[partition] >= 0)
+    {
+      // Strays and duplicate partitions are dropped rather than trusted.
+      close(connection);
+      continue;
+    }
+    disableNagle(connection);
+    connections[partition] = connection;
+    ++accepted;
+  }
+#else
+  (void)workerCount;
+  (void)timeoutMilliseconds;
+#endif
+}
+
+bool Compositor::receivePlanes(int worker, std::uint32_t frame)
+{
+  int const connection = connections[worker];
+  char magic[4];
+  std::uint32_t header[3];
+  float renderMilliseconds = 0.f;
+  if (!receiveAll(connection, magic, sizeof(magic)) || std::memcmp(magic, planesMagic, sizeof(magic)) != 0
+    || !receiveAll(connection, header, sizeof(header)) || !receiveAll(connection, &renderMilliseconds, sizeof(renderMilliseconds))
+    || header[0] != frame || header[1] != (std::uint32_t)width || header[2] != (std::uint32_t)height)
+  {
+    return false;
+  }
+  GBufferPlanes& plane = planes[worker];
+  workerMilliseconds[worker] = renderMilliseconds;
+  return receiveAll(connection, plane.depth.data(), plane.depth.size() * sizeof(float))
+    && receiveAll(connection, plane.position.data(), plane.position.size())
+    && receiveAll(connection, plane.normal.data(), plane.normal.size() * sizeof(std::uint16_t))
+    && receiveAll(connection, plane.color.data(), plane.color.size());
+}
+
+bool Compositor::renderFrame(CompositeFrame const& frame, GBufferPlanes& merged)
+{
+  int const workerCount = (int)connections.size();
+  auto const gatherStart = std::chrono::steady_clock::now();
+  for (int worker = 0; worker < workerCount; ++worker)
+  {
+    if (!sendAll(connections[worker], frameMagic, sizeof(frameMagic)) || !sendAll(connections[worker], &frame, sizeof(frame)))
+    {
+      return false;
+    }
+  }
+  // Workers render concurrently, so their planes are read concurrently as they finish.
+  std::vector<char> received(workerCount, 0);
+  pool.parallelFor(workerCount, [&](int worker, int)
+    {
+      received[worker] = receivePlanes(worker, frame.frame) ? 1 : 0;
+    });
+  gatherMilliseconds = millisecondsSince(gatherStart);
+  if (std::find(received.begin(), received.end(), 0) != received.end())
+  {
+    return false;
+  }
+
+  auto const compositeStart = std::chrono::steady_clock::now();
+  merged.resize((std::size_t)width * height);
+  int const strips = (height + stripRows - 1) / stripRows;
+  pool.parallelFor(strips, [&](int strip, int)
+    {
+      std::size_t const begin = (std::size_t)strip * stripRows * width;
+      std::size_t const end = (std::size_t)std::min(height, (strip + 1) * stripRows) * width;
+      for (std::size_t pixel = begin; pixel < end; ++pixel)
+      {
+        // The lowest worker wins ties so the image does not depend on arrival order.
+        int nearest = 0;
+        for (int worker = 1; worker < workerCount; ++worker)
+        {
+          if (planes[worker].depth[pixel] < planes[nearest].depth[pixel])
+          {
+            nearest = worker;
+          }
+        }
+        GBufferPlanes const& source = planes[nearest];
+        merged.depth[pixel] = source.depth[pixel];
+        std::memcpy(&merged.position[pixel * 4], &source.position[pixel * 4], 4);
+        std::memcpy(&merged.normal[pixel * 3], &source.normal[pixel * 3], 3 * sizeof(std::uint16_t));
+        std::memcpy(&merged.color[pixel * 4], &source.color[pixel * 4], 4);
+      }
+    });
+  compositeMilliseconds = millisecondsSince(compositeStart);
+  return true;
+}
+
+int Compositor::getWorkerCount() const
+{
+  return (int)connections.size();
+}
+
+double Compositor::getGatherMilliseconds() const
+{
+  return gatherMilliseconds;
+}
+
+double Compositor::getCompositeMilliseconds() const
+{
+  return compositeMilliseconds;
+}
+
+double Compositor::getWorkerMilliseconds() const
+{
+  // The slowest worker bounds the frame, so it is the one worth reporting.
+  double slowest = 0.;
+  for (float milliseconds : workerMilliseconds)
+  {
+    slowest = std::max(slowest, (double)milliseconds);
+  }
+  return slowest;
+}
+
+CompositeWorker::CompositeWorker(std::string const& address, int partition)
+  : connection(-1)
+{
+#ifdef _WIN32
+  (void)address;
+  (void)partition;
+  throw std::runtime_error("compositing needs POSIX sockets");
+#else
+  std::size_t const split = address.rfind(':');
+  sockaddr_in target = {};
+  target.sin_family = AF_INET;
+  char* end = nullptr;
+  long const port = split == std::string::npos ? -1 : std::strtol(address.c_str() + split + 1, &end, 10);
+  if (port <= 0 || port > 65535 || *end != '\0' || inet_pton(AF_INET, address.substr(0, split).c_str(), &target.sin_addr) != 1)
+  {
+    throw std::runtime_error(address + " is not HOST:PORT");
+  }
+  target.sin_port = htons((std::uint16_t)port);
+  std::signal(SIGPIPE, SIG_IGN);
+  connection = socket(AF_INET, SOCK_STREAM, 0);
+  if (connection < 0 || connect(connection, (sockaddr const*)&target, sizeof(target)) != 0)
+  {
+    closeSocket(connection);
+    throw std::runtime_error("could not connect to " + address);
+  }
+  disableNagle(connection);
+  std::uint32_t const part = (std::uint32_t)partition;
+  if (!sendAll(connection, helloMagic, sizeof(helloMagic)) || !sendAll(connection, &part, sizeof(part)))
+  {
+    close(connection);
+    throw std::runtime_error("could not register with " + address);
+  }
+#endif
+}
+
+CompositeWorker::~CompositeWorker()
+{
+  closeSocket(connection);
+}
+
+bool CompositeWorker::receiveFrame(CompositeFrame& frame)
+{
+  char magic[4];
+  return receiveAll(connection, magic, sizeof(magic)) && std::memcmp(magic, frameMagic, sizeof(magic)) == 0
+    && receiveAll(connection, &frame, sizeof(frame)) && frame.frame != stopFrame;
+}
+
+bool CompositeWorker::sendPlanes(std::uint32_t frame, int width, int height, float renderMilliseconds, GBufferPlanes const& planes)
+{
+  std::uint32_t const header[3] = { frame, (std::uint32_t)width, (std::uint32_t)height };
+  return sendAll(connection, planesMagic, sizeof(planesMagic))
+    && sendAll(connection, header, sizeof(header))
+    && sendAll(connection, &renderMilliseconds, sizeof(renderMilliseconds))
+    && sendAll(connection, planes.depth.data(), planes.depth.size() * sizeof(float))
+    && sendAll(connection, planes.position.data(), planes.position.size())
+    && sendAll(connection, planes.normal.data(), planes.normal.size() * sizeof(std::uint16_t))
+    && sendAll(connection, planes.color.data(), planes.color.size());
+}
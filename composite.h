@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "thread_pool.h"
+
+/* The point pass output of one process: window depth as float, then the three G-buffer
+ * attachments as stored (RGBA8 position, RGB16F normal, RGBA8 color), bottom row first. */
+struct GBufferPlanes
+{
+  std::vector<float> depth;
+  std::vector<std::uint8_t> position;
+  std::vector<std::uint16_t> normal;
+  std::vector<std::uint8_t> color;
+  void resize(std::size_t pixels);
+};
+
+/* Sent to every worker for each frame; frame is stopFrame when the compositor shuts down. */
+struct CompositeFrame
+{
+  std::uint32_t frame;
+  float position[3];
+  float front[3];
+  float fov;
+};
+std::uint32_t const stopFrame = 0xFFFFFFFFu;
+
+/* Sort-last compositing over TCP. Every worker renders its partition's point pass and sends the
+ * planes; the compositor reads all connections at once and keeps, per pixel, the fragment of the
+ * worker with the smallest depth, merging row strips on all cores. Fields are sent in host byte
+ * order, so external workers must run on machines of the compositor's byte order:
+ *   worker hello:  char magic[4] = "RLCW"; uint32 partition
+ *   frame:         char magic[4] = "RLCF"; CompositeFrame
+ *   planes:        char magic[4] = "RLCG"; uint32 frame, width, height; float renderMilliseconds;
+ *                  then depth, position, normal and color as in GBufferPlanes */
+class Compositor
+{
+public:
+  // Listens on port (0 picks a free one), on the loopback interface unless external is set.
+  Compositor(int port, bool external, int width, int height);
+  ~Compositor();
+  Compositor(Compositor const&) = delete;
+  Compositor& operator=(Compositor const&) = delete;
+  int getPort() const;
+  // Waits for workers with partitions 0 to workerCount - 1.
+  void acceptWorkers(int workerCount, int timeoutMilliseconds);
+  bool renderFrame(CompositeFrame const& frame, GBufferPlanes& merged);
+  int getWorkerCount() const;
+  double getGatherMilliseconds() const;
+  double getCompositeMilliseconds() const;
+  double getWorkerMilliseconds() const;
+private:
+  bool receivePlanes(int worker, std::uint32_t frame);
+  int width;
+  int height;
+  int listenSocket;
+  int port;
+  std::vector<int> connections;
+  std::vector<GBufferPlanes> planes;
+  std::vector<float> workerMilliseconds;
+  ThreadPool pool;
+  double gatherMilliseconds;
+  double compositeMilliseconds;
+};
+
+class CompositeWorker
+{
+public:
+  // address is "HOST:PORT" with a numeric IPv4 host.
+  CompositeWorker(std::string const& address, int partition);
+  ~CompositeWorker();
+  CompositeWorker(CompositeWorker const&) = delete;
+  CompositeWorker& operator=(CompositeWorker const&) = delete;
+  // False once the compositor stops or disconnects.
+  bool receiveFrame(CompositeFrame& frame);
+  bool sendPlanes(std::uint32_t frame, int width, int height, float renderMilliseconds, GBufferPlanes const& planes);
+private:
+  int connection;
+};
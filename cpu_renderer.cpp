@@ -0,0 +1,630 @@
+#include "cpu_renderer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+  float const zeroTol = 1e-6f;
+  float const zFar = 100.f;
+  int const bandRows = 16;
+  int const tileSize = 64;
+  std::size_t const chunkPoints = 1 << 16;
+  std::uint32_t const culledPixel = 0xFFFFFFFFu;
+
+  float storeUnorm8(float value)
+  {
+    return std::nearbyint(std::min(std::max(value, 0.f), 1.f) * 255.f) / 255.f;
+  }
+  float storeHalf(float value)
+  {
+    // Round to nearest even at half precision, as an RGB16F attachment stores the value.
+    float const magnitude = std::abs(value);
+    if (magnitude >= 65504.f)
+    {
+      return std::copysign(65504.f, value);
+    }
+    if (magnitude < 6.103515625e-05f)
+    {
+      return std::nearbyint(value * 16777216.f) / 16777216.f;
+    }
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    bits = (bits + 0x0FFFu + ((bits >> 13) & 1u)) & ~0x1FFFu;
+    std::memcpy(&value, &bits, sizeof(bits));
+    return value;
+  }
+  double millisecondsSince(std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+}
+
+void CpuGBuffer::resize(int newWidth, int newHeight)
+{
+  width = newWidth;
+  height = newHeight;
+  stride = width + 2;
+  for (std::vector<float>& p : planes)
+  {
+    p.assign((std::size_t)stride * (height + 2), 0.f);
+  }
+}
+
+void CpuGBuffer::clear()
+{
+  for (std::vector<float>& p : planes)
+  {
+    std::fill(p.begin(), p.end(), 0.f);
+  }
+}
+
+void CpuGBuffer::refreshApron()
+{
+  for (std::vector<float>& p : planes)
+  {
+    float* data = p.data();
+    for (int y = 0; y < height; ++y)
+    {
+      float* row = data + index(0, y);
+      row[-1] = row[width - 1];
+      row[width] = row[0];
+    }
+    std::memcpy(data, data + (std::size_t)height * stride, sizeof(float) * stride);
+    std::memcpy(data + (std::size_t)(height + 1) * stride, data + stride, sizeof(float) * stride);
+  }
+}
+
+CpuRenderer::CpuRenderer(int width, int height, int threadCount)
+  : pool(threadCount),
+  width(width),
+  height(height),
+  currBuffer(0),
+  hasColor(false),
+  timing(false),
+  pointCount(0)
+{
+  gBuffer[0].resize(width, height);
+  gBuffer[1].resize(width, height);
+  pickScratch.assign(pool.getThreadCount(), std::vector<int>(width));
+  weightScratch.assign(pool.getThreadCount(), std::vector<float>((std::size_t)9 * width));
+}
+
+void CpuRenderer::load(std::vector<float> const& PLYdata, int pointStride)
+{
+  hasColor = pointStride > 6;
+  pointCount = PLYdata.size() / pointStride;
+  splatPixel.resize(pointCount);
+  splatDepth.resize(pointCount);
+  int const attributes = hasColor ? 9 : 6;
+  for (int a = 0; a < 9; ++a)
+  {
+    pointPlanes[a].assign(a < attributes ? pointCount : 0, 0.f);
+  }
+  for (std::size_t i = 0; i < pointCount; ++i)
+  {
+    for (int a = 0; a < attributes; ++a)
+    {
+      pointPlanes[a][i] = PLYdata[i * pointStride + a];
+    }
+  }
+}
+
+void CpuRenderer::render(glm::mat4 const& view, glm::mat4 const& projection, glm::vec3 const& viewPos, int backgroundIters, int occlusionIters, std::vector<std::uint8_t>& pixels)
+{
+  auto start = std::chrono::steady_clock::now();
+  illuminatePoints(view, projection, viewPos);
+  recordTiming("illuminate", millisecondsSince(start));
+  for (int i = 0; i < backgroundIters; ++i)
+  {
+    runPass("background_" + std::to_string(i), &CpuRenderer::fillBackgroundRows);
+  }
+  for (int i = 0; i < occlusionIters; ++i)
+  {
+    runPass("occlusion_" + std::to_string(i), &CpuRenderer::fillOcclusionRows);
+  }
+  runPass("smooth", &CpuRenderer::smoothRows);
+  runPass("aliasing", &CpuRenderer::aliasingRows);
+  start = std::chrono::steady_clock::now();
+  pixels.resize((std::size_t)width * height * 3);
+  CpuGBuffer& src = gBuffer[currBuffer];
+  src.refreshApron();
+  pool.parallelFor((height + bandRows - 1) / bandRows, [&](int task, int)
+  {
+    illustrateRows(src, pixels.data(), task * bandRows, std::min(height, (task + 1) * bandRows));
+  });
+  recordTiming("illustrate", millisecondsSince(start));
+}
+
+void CpuRenderer::setTiming(bool enable)
+{
+  timing = enable;
+}
+
+std::vector<TimingSeries> const& CpuRenderer::getTimings() const
+{
+  return timings;
+}
+
+CpuGBuffer const& CpuRenderer::getGBuffer() const
+{
+  return gBuffer[currBuffer];
+}
+
+int CpuRenderer::getThreadCount() const
+{
+  return pool.getThreadCount();
+}
+
+void CpuRenderer::runPass(std::string const& name, RowKernel kernel)
+{
+  auto const start = std::chrono::steady_clock::now();
+  CpuGBuffer& src = gBuffer[currBuffer];
+  CpuGBuffer& dst = gBuffer[currBuffer ^ 1];
+  src.refreshApron();
+  pool.parallelFor((height + bandRows - 1) / bandRows, [&](int task, int worker)
+  {
+    int const y0 = task * bandRows;
+    int const y1 = std::min(height, y0 + bandRows);
+    (this->*kernel)(src, dst, y0, y1, worker);
+    storeRows(dst, y0, y1);
+  });
+  currBuffer ^= 1;
+  recordTiming(name, millisecondsSince(start));
+}
+
+void CpuRenderer::recordTiming(std::string const& name, double milliseconds)
+{
+  if (!timing)
+  {
+    return;
+  }
+  for (TimingSeries& series : timings)
+  {
+    if (series.name == name)
+    {
+      series.milliseconds.push_back(milliseconds);
+      return;
+    }
+  }
+  timings.push_back({ name, { milliseconds } });
+}
+
+/* The point pass runs in two parallel phases. Chunks of points are transformed, back face
+ * culled and binned into screen tiles with a counting sort that keeps the submission order
+ * inside each tile, then every tile resolves its depth test against a tile sized z-buffer and
+ * shades only the surviving point of each pixel. The result matches drawing the points in
+ * order with GL_LESS, since a discarded fragment never touches the depth buffer. */
+void CpuRenderer::illuminatePoints(glm::mat4 const& view, glm::mat4 const& projection, glm::vec3 const& viewPos)
+{
+  auto const start = std::chrono::steady_clock::now();
+  glm::mat4 const viewProjection = projection * view;
+  float matrix[16];
+  for (int c = 0; c < 4; ++c)
+  {
+    for (int r = 0; r < 4; ++r)
+    {
+      matrix[c * 4 + r] = viewProjection[c][r];
+    }
+  }
+  int const tilesX = (width + tileSize - 1) / tileSize;
+  int const tileCount = tilesX * ((height + tileSize - 1) / tileSize);
+  int const chunkCount = (int)((pointCount + chunkPoints - 1) / chunkPoints);
+  tileCounts.assign((std::size_t)chunkCount * tileCount, 0);
+  pool.parallelFor(chunkCount, [&](int chunk, int)
+  {
+    transformChunk(matrix, viewPos, chunk, tilesX);
+  });
+  // Exclusive prefix sum in tile major, chunk minor order gives every chunk its scatter offset.
+  tileStart.resize(tileCount + 1);
+  std::uint32_t running = 0;
+  for (int tile = 0; tile < tileCount; ++tile)
+  {
+    tileStart[tile] = running;
+    for (int chunk = 0; chunk < chunkCount; ++chunk)
+    {
+      std::uint32_t& count = tileCounts[(std::size_t)chunk * tileCount + tile];
+      std::uint32_t const chunkFragments = count;
+      count = running;
+      running += chunkFragments;
+    }
+  }
+  tileStart[tileCount] = running;
+  fragments.resize(running);
+  pool.parallelFor(chunkCount, [&](int chunk, int)
+  {
+    scatterChunk(chunk, tilesX);
+  });
+  recordTiming("illuminate_bin", millisecondsSince(start));
+  auto const resolveStart = std::chrono::steady_clock::now();
+  pool.parallelFor(tileCount, [&](int tile, int)
+  {
+    resolveTile(tile, tilesX, viewPos);
+  });
+  recordTiming("illuminate_resolve", millisecondsSince(resolveStart));
+}
+
+void CpuRenderer::transformChunk(float const* m, glm::vec3 const& viewPos, int chunk, int tilesX)
+{
+  int const tileCount = tilesX * ((height + tileSize - 1) / tileSize);
+  std::uint32_t* counts = tileCounts.data() + (std::size_t)chunk * tileCount;
+  std::size_t const begin = chunk * chunkPoints;
+  std::size_t const end = std::min(pointCount, begin + chunkPoints);
+  float const* px = pointPlanes[0].data();
+  float const* py = pointPlanes[1].data();
+  float const* pz = pointPlanes[2].data();
+  float const* nx = pointPlanes[3].data();
+  float const* ny = pointPlanes[4].data();
+  float const* nz = pointPlanes[5].data();
+  int const block = 256;
+  float cx[block];
+  float cy[block];
+  float cz[block];
+  float cw[block];
+  float lambert[block];
+  for (std::size_t i = begin; i < end; i += block)
+  {
+    int const n = (int)std::min<std::size_t>(block, end - i);
+    // Straight 4x4 multiply over the SoA planes, vectorised by the compiler.
+    for (int k = 0; k < n; ++k)
+    {
+      float const x = px[i + k];
+      float const y = py[i + k];
+      float const z = pz[i + k];
+      cx[k] = m[0] * x + m[4] * y + m[8] * z + m[12];
+      cy[k] = m[1] * x + m[5] * y + m[9] * z + m[13];
+      cz[k] = m[2] * x + m[6] * y + m[10] * z + m[14];
+      cw[k] = m[3] * x + m[7] * y + m[11] * z + m[15];
+      float const lx = viewPos.x - x;
+      float const ly = viewPos.y - y;
+      float const lz = viewPos.z - z;
+      float const lInv = 1.f / std::sqrt(lx * lx + ly * ly + lz * lz);
+      float const nInv = 1.f / std::sqrt(nx[i + k] * nx[i + k] + ny[i + k] * ny[i + k] + nz[i + k] * nz[i + k]);
+      lambert[k] = nx[i + k] * nInv * (lx * lInv) + ny[i + k] * nInv * (ly * lInv) + nz[i + k] * nInv * (lz * lInv);
+    }
+    for (int k = 0; k < n; ++k)
+    {
+      std::uint32_t pixel = culledPixel;
+      float const w = cw[k];
+      if (!(lambert[k] < 0.f) && w > 0.f && std::abs(cx[k]) <= w && std::abs(cy[k]) <= w && std::abs(cz[k]) <= w)
+      {
+        int const x = (int)std::floor((cx[k] / w * .5f + .5f) * width);
+        int const y = (int)std::floor((cy[k] / w * .5f + .5f) * height);
+        if (x >= 0 && x < width && y >= 0 && y < height)
+        {
+          pixel = (std::uint32_t)y * width + x;
+          ++counts[(y / tileSize) * tilesX + x / tileSize];
+        }
+      }
+      splatPixel[i + k] = pixel;
+      splatDepth[i + k] = cz[k] / w * .5f + .5f;
+    }
+  }
+}
+
+void CpuRenderer::scatterChunk(int chunk, int tilesX)
+{
+  int const tileCount = tilesX * ((height + tileSize - 1) / tileSize);
+  std::uint32_t* offsets = tileCounts.data() + (std::size_t)chunk * tileCount;
+  std::size_t const begin = chunk * chunkPoints;
+  std::size_t const end = std::min(pointCount, begin + chunkPoints);
+  for (std::size_t i = begin; i < end; ++i)
+  {
+    std::uint32_t const pixel = splatPixel[i];
+    if (pixel == culledPixel)
+    {
+      continue;
+    }
+    int const x = (int)(pixel % width);
+    int const y = (int)(pixel / width);
+    fragments[offsets[(y / tileSize) * tilesX + x / tileSize]++] = { (std::uint32_t)i, pixel, splatDepth[i] };
+  }
+}
+
+void CpuRenderer::resolveTile(int tile, int tilesX, glm::vec3 const& viewPos)
+{
+  int const x0 = (tile % tilesX) * tileSize;
+  int const y0 = (tile / tilesX) * tileSize;
+  int const tileWidth = std::min(tileSize, width - x0);
+  int const tileHeight = std::min(tileSize, height - y0);
+  float tileDepth[tileSize * tileSize];
+  std::int64_t winner[tileSize * tileSize];
+  std::fill(tileDepth, tileDepth + tileSize * tileSize, 1.f);
+  std::fill(winner, winner + tileSize * tileSize, -1);
+  for (std::uint32_t f = tileStart[tile]; f < tileStart[tile + 1]; ++f)
+  {
+    SplatFragment const& fragment = fragments[f];
+    int const local = ((int)(fragment.pixel / width) - y0) * tileSize + (int)(fragment.pixel % width) - x0;
+    if (!(fragment.depth < tileDepth[local]))
+    {
+      continue;
+    }
+    tileDepth[local] = fragment.depth;
+    winner[local] = fragment.point;
+  }
+  CpuGBuffer& dst = gBuffer[currBuffer];
+  glm::vec3 const lightColor = hasColor ? glm::vec3(.1f, .1f, .1f) : glm::vec3(1.f, 1.f, 1.f);
+  for (int y = 0; y < tileHeight; ++y)
+  {
+    for (int x = 0; x < tileWidth; ++x)
+    {
+      int const p = dst.index(x0 + x, y0 + y);
+      std::int64_t const i = winner[y * tileSize + x];
+      if (i < 0)
+      {
+        for (int plane = 0; plane < CpuGBuffer::PlaneCount; ++plane)
+        {
+          dst.plane(plane)[p] = 0.f;
+        }
+        continue;
+      }
+      glm::vec3 const fragPos(pointPlanes[0][i], pointPlanes[1][i], pointPlanes[2][i]);
+      glm::vec3 const normal(pointPlanes[3][i], pointPlanes[4][i], pointPlanes[5][i]);
+      glm::vec3 const norm = glm::normalize(normal);
+      glm::vec3 const lightDir = glm::normalize(viewPos - fragPos);
+      float const lambert = glm::dot(norm, lightDir);
+      glm::vec3 const objectColor = hasColor ? glm::vec3(pointPlanes[6][i], pointPlanes[7][i], pointPlanes[8][i]) : glm::vec3(.6f, .6f, .9f);
+      glm::vec3 const reflectDir = 2.f * lambert * norm - lightDir;
+      float const spec = std::pow(std::max(glm::dot(lightDir, reflectDir), 0.f), 32.f);
+      glm::vec3 const color = ((.1f + lambert + .5f * spec) * lightColor) * objectColor;
+      dst.plane(CpuGBuffer::PositionX)[p] = storeUnorm8(fragPos.x);
+      dst.plane(CpuGBuffer::PositionY)[p] = storeUnorm8(fragPos.y);
+      dst.plane(CpuGBuffer::PositionZ)[p] = storeUnorm8(fragPos.z);
+      dst.plane(CpuGBuffer::Depth)[p] = storeUnorm8(glm::distance(fragPos, viewPos) / zFar);
+      dst.plane(CpuGBuffer::NormalX)[p] = storeHalf(normal.x);
+      dst.plane(CpuGBuffer::NormalY)[p] = storeHalf(normal.y);
+      dst.plane(CpuGBuffer::NormalZ)[p] = storeHalf(normal.z);
+      dst.plane(CpuGBuffer::ColorR)[p] = storeUnorm8(color.x);
+      dst.plane(CpuGBuffer::ColorG)[p] = storeUnorm8(color.y);
+      dst.plane(CpuGBuffer::ColorB)[p] = storeUnorm8(color.z);
+      dst.plane(CpuGBuffer::ColorA)[p] = 1.f;
+    }
+  }
+}
+
+/* The fill kernels decide per pixel which neighbour to copy from (-1 for a discarded
+ * fragment) and then gather every plane along the row in a separate, branch free loop. */
+void CpuRenderer::fillBackgroundRows(CpuGBuffer const& src, CpuGBuffer& dst, int y0, int y1, int worker)
+{
+  int* pick = pickScratch[worker].data();
+  float const* depth = src.plane(CpuGBuffer::Depth);
+  int const s = src.stride;
+  int const taps[9] = { s - 1, s, s + 1, -1, 0, 1, -s - 1, -s, -s + 1 };
+  for (int y = y0; y < y1; ++y)
+  {
+    int const row = src.index(0, y);
+    for (int x = 0; x < width; ++x)
+    {
+      int const p = row + x;
+      float t[9];
+      for (int i = 0; i < 9; ++i)
+      {
+        t[i] = depth[p + taps[i]];
+      }
+      if (std::abs(t[4]) > zeroTol)
+      {
+        pick[x] = p;
+        continue;
+      }
+      float const testProd = (t[1] + t[2] + t[4] + t[5] + t[7] + t[8]) * (t[0] + t[1] + t[2] + t[3] + t[4] + t[5])
+        * (t[0] + t[1] + t[3] + t[4] + t[6] + t[7]) * (t[3] + t[4] + t[5] + t[6] + t[7] + t[8])
+        * (t[0] + t[1] + t[2] + t[4] + t[5] + t[8]) * (t[0] + t[1] + t[2] + t[3] + t[4] + t[6])
+        * (t[0] + t[3] + t[4] + t[6] + t[7] + t[8]) * (t[2] + t[4] + t[5] + t[6] + t[7] + t[8]);
+      if (std::abs(testProd) < zeroTol)
+      {
+        pick[x] = -1;
+        continue;
+      }
+      float smallestDepth = 100000.f;
+      int smallestInd = 4;
+      for (int i = 0; i < 9; ++i)
+      {
+        if (std::abs(t[i]) > zeroTol && std::abs(t[i]) < smallestDepth)
+        {
+          smallestDepth = std::abs(t[i]);
+          smallestInd = i;
+        }
+      }
+      pick[x] = p + taps[smallestInd];
+    }
+    copyPicked(src, dst, y, pick);
+  }
+}
+
+void CpuRenderer::fillOcclusionRows(CpuGBuffer const& src, CpuGBuffer& dst, int y0, int y1, int worker)
+{
+  int* pick = pickScratch[worker].data();
+  float const* depth = src.plane(CpuGBuffer::Depth);
+  int const s = src.stride;
+  int const taps[9] = { s - 1, s, s + 1, -1, 0, 1, -s - 1, -s, -s + 1 };
+  for (int y = y0; y < y1; ++y)
+  {
+    int const row = src.index(0, y);
+    for (int x = 0; x < width; ++x)
+    {
+      int const p = row + x;
+      float t[9];
+      float behind[9];
+      for (int i = 0; i < 9; ++i)
+      {
+        t[i] = depth[p + taps[i]];
+      }
+      pick[x] = p;
+      if (std::abs(t[4]) < zeroTol)
+      {
+        continue;
+      }
+      for (int i = 0; i < 9; ++i)
+      {
+        behind[i] = t[4] < t[i] ? 0.f : 1.f;
+      }
+      float const* b = behind;
+      float const testProd = (b[1] + b[2] + b[4] + b[5] + b[7] + b[8]) * (b[0] + b[1] + b[2] + b[3] + b[4] + b[5])
+        * (b[0] + b[1] + b[3] + b[4] + b[6] + b[7]) * (b[3] + b[4] + b[5] + b[6] + b[7] + b[8])
+        * (b[0] + b[1] + b[2] + b[4] + b[5] + b[8]) * (b[0] + b[1] + b[2] + b[3] + b[4] + b[6])
+        * (b[0] + b[3] + b[4] + b[6] + b[7] + b[8]) * (b[2] + b[4] + b[5] + b[6] + b[7] + b[8]);
+      if (std::abs(testProd) < zeroTol)
+      {
+        continue;
+      }
+      float smallestDepth = 100000.f;
+      int smallestInd = 4;
+      for (int i = 0; i < 9; ++i)
+      {
+        float const depthDiff = t[4] - t[i];
+        if (depthDiff > zeroTol && depthDiff < smallestDepth)
+        {
+          smallestDepth = depthDiff;
+          smallestInd = i;
+        }
+      }
+      pick[x] = p + taps[smallestInd];
+    }
+    copyPicked(src, dst, y, pick);
+  }
+}
+
+void CpuRenderer::smoothRows(CpuGBuffer const& src, CpuGBuffer& dst, int y0, int y1, int worker)
+{
+  static float const alleviatedGaussian[9] = {
+    1.f / 16.f, 2.f / 16.f, 1.f / 16.f,
+    2.f / 16.f, 16.f / 28.f, 2.f / 16.f,
+    1.f / 16.f, 2.f / 16.f, 1.f / 16.f };
+  float* weights = weightScratch[worker].data();
+  float const* depth = src.plane(CpuGBuffer::Depth);
+  int const s = src.stride;
+  int const taps[9] = { s - 1, s, s + 1, -1, 0, 1, -s - 1, -s, -s + 1 };
+  for (int y = y0; y < y1; ++y)
+  {
+    int const row = src.index(0, y);
+    for (int x = 0; x < width; ++x)
+    {
+      int const p = row + x;
+      if (std::abs(depth[p]) < zeroTol)
+      {
+        for (int i = 0; i < 9; ++i)
+        {
+          weights[i * width + x] = i == 4 ? 1.f : 0.f;
+        }
+        continue;
+      }
+      float totalWeight = 0.f;
+      for (int i = 0; i < 9; ++i)
+      {
+        float const w = depth[p + taps[i]] < zeroTol ? 0.f : alleviatedGaussian[i];
+        weights[i * width + x] = w;
+        totalWeight += w;
+      }
+      for (int i = 0; i < 9; ++i)
+      {
+        weights[i * width + x] /= totalWeight;
+      }
+    }
+    for (int plane = 0; plane < CpuGBuffer::PlaneCount; ++plane)
+    {
+      float const* in = src.plane(plane) + row;
+      float* out = dst.plane(plane) + row;
+      for (int x = 0; x < width; ++x)
+      {
+        out[x] = 0.f;
+      }
+      for (int i = 0; i < 9; ++i)
+      {
+        float const* tap = in + taps[i];
+        float const* w = weights + i * width;
+        for (int x = 0; x < width; ++x)
+        {
+          out[x] += w[x] * tap[x];
+        }
+      }
+    }
+  }
+}
+
+void CpuRenderer::aliasingRows(CpuGBuffer const& src, CpuGBuffer& dst, int y0, int y1, int)
+{
+  // The high-pass draw covers every pixel, the low-pass draw then restores the centre
+  // wherever the source depth is set, leaving the Laplacian only on background pixels.
+  float const* depth = src.plane(CpuGBuffer::Depth);
+  int const s = src.stride;
+  for (int y = y0; y < y1; ++y)
+  {
+    int const row = src.index(0, y);
+    for (int plane = 0; plane < CpuGBuffer::PlaneCount; ++plane)
+    {
+      float const* in = src.plane(plane) + row;
+      float const* d = depth + row;
+      float* out = dst.plane(plane) + row;
+      for (int x = 0; x < width; ++x)
+      {
+        float const laplace = 4.f * in[x] - in[x - 1] - in[x + 1] - in[x - s] - in[x + s];
+        out[x] = d[x] < zeroTol ? laplace : in[x];
+      }
+    }
+  }
+}
+
+void CpuRenderer::illustrateRows(CpuGBuffer const& src, std::uint8_t* pixels, int y0, int y1)
+{
+  float const* depth = src.plane(CpuGBuffer::Depth);
+  float const* nx = src.plane(CpuGBuffer::NormalX);
+  float const* ny = src.plane(CpuGBuffer::NormalY);
+  float const* nz = src.plane(CpuGBuffer::NormalZ);
+  int const s = src.stride;
+  int const neighbours[8] = { s - 1, s, s + 1, -1, 1, -s - 1, -s, -s + 1 };
+  for (int y = y0; y < y1; ++y)
+  {
+    int const row = src.index(0, y);
+    std::uint8_t* out = pixels + (std::size_t)y * width * 3;
+    for (int x = 0; x < width; ++x)
+    {
+      int const p = row + x;
+      if (depth[p] < 1e-5f)
+      {
+        out[x * 3] = out[x * 3 + 1] = out[x * 3 + 2] = 255;
+        continue;
+      }
+      float curvature = 0.f;
+      for (int n : neighbours)
+      {
+        curvature += (nx[p + n] * nx[p] + ny[p + n] * ny[p] + nz[p + n] * nz[p]) / 8.f;
+      }
+      for (int c = 0; c < 3; ++c)
+      {
+        float const value = curvature > .975f ? src.plane(CpuGBuffer::ColorR + c)[p] : 0.f;
+        out[x * 3 + c] = (std::uint8_t)std::nearbyint(std::min(std::max(value, 0.f), 1.f) * 255.f);
+      }
+    }
+  }
+}
+
+void CpuRenderer::copyPicked(CpuGBuffer const& src, CpuGBuffer& dst, int y, int const* pick)
+{
+  int const row = dst.index(0, y);
+  for (int plane = 0; plane < CpuGBuffer::PlaneCount; ++plane)
+  {
+    float const* in = src.plane(plane);
+    float* out = dst.plane(plane) + row;
+    for (int x = 0; x < width; ++x)
+    {
+      out[x] = pick[x] < 0 ? 0.f : in[pick[x]];
+    }
+  }
+}
+
+void CpuRenderer::storeRows(CpuGBuffer& dst, int y0, int y1)
+{
+  for (int plane = 0; plane < CpuGBuffer::PlaneCount; ++plane)
+  {
+    bool const isNormal = plane >= CpuGBuffer::NormalX && plane <= CpuGBuffer::NormalZ;
+    for (int y = y0; y < y1; ++y)
+    {
+      float* out = dst.plane(plane) + dst.index(0, y);
+      for (int x = 0; x < width; ++x)
+      {
+        out[x] = isNormal ? storeHalf(out[x]) : storeUnorm8(out[x]);
+      }
+    }
+  }
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "third-party/glm/glm/glm.hpp"
+#include "gpu_timer.h"
+#include "thread_pool.h"
+
+/* Structure-of-arrays copy of one RenderWindow G-buffer. Every plane carries a one pixel
+ * apron holding the wrapped opposite edge, which reproduces the GL_REPEAT lookups of the
+ * filter shaders and lets the row kernels address neighbours without bounds checks. */
+struct CpuGBuffer
+{
+  enum Plane
+  {
+    PositionX,
+    PositionY,
+    PositionZ,
+    Depth,
+    NormalX,
+    NormalY,
+    NormalZ,
+    ColorR,
+    ColorG,
+    ColorB,
+    ColorA,
+    PlaneCount
+  };
+  void resize(int width, int height);
+  void clear();
+  void refreshApron();
+  int index(int x, int y) const
+  {
+    return (y + 1) * stride + x + 1;
+  }
+  float* plane(int p)
+  {
+    return planes[p].data();
+  }
+  float const* plane(int p) const
+  {
+    return planes[p].data();
+  }
+  int width = 0;
+  int height = 0;
+  int stride = 0;
+  std::vector<float> planes[PlaneCount];
+};
+
+/* CPU implementation of RenderWindow::drawFrame for hosts without a GPU. It runs the same
+ * passes on the same data and stores every pass result in the precision of the matching
+ * GL render target, so its output can be compared against the GL path pixel by pixel. */
+class CpuRenderer
+{
+public:
+  CpuRenderer(int width, int height, int threadCount = 0);
+  void load(std::vector<float> const& PLYdata, int pointStride);
+  void render(glm::mat4 const& view, glm::mat4 const& projection, glm::vec3 const& viewPos, int backgroundIters, int occlusionIters, std::vector<std::uint8_t>& pixels);
+  void setTiming(bool enable);
+  std::vector<TimingSeries> const& getTimings() const;
+  CpuGBuffer const& getGBuffer() const;
+  int getThreadCount() const;
+private:
+  typedef void (CpuRenderer::*RowKernel)(CpuGBuffer const& src, CpuGBuffer& dst, int y0, int y1, int worker);
+  void runPass(std::string const& name, RowKernel kernel);
+  void recordTiming(std::string const& name, double milliseconds);
+  void illuminatePoints(glm::mat4 const& view, glm::mat4 const& projection, glm::vec3 const& viewPos);
+  void transformChunk(float const* viewProjection, glm::vec3 const& viewPos, int chunk, int tilesX);
+  void scatterChunk(int chunk, int tilesX);
+  void resolveTile(int tile, int tilesX, glm::vec3 const& viewPos);
+  void fillBackgroundRows(CpuGBuffer const& src, CpuGBuffer& dst, int y0, int y1, int worker);
+  void fillOcclusionRows(CpuGBuffer const& src, CpuGBuffer& dst, int y0, int y1, int worker);
+  void smoothRows(CpuGBuffer const& src, CpuGBuffer& dst, int y0, int y1, int worker);
+  void aliasingRows(CpuGBuffer const& src, CpuGBuffer& dst, int y0, int y1, int worker);
+  void illustrateRows(CpuGBuffer const& src, std::uint8_t* pixels, int y0, int y1);
+  void copyPicked(CpuGBuffer const& src, CpuGBuffer& dst, int y, int const* pick);
+  void storeRows(CpuGBuffer& dst, int y0, int y1);
+  ThreadPool pool;
+  int width;
+  int height;
+  int currBuffer;
+  bool hasColor;
+  bool timing;
+  std::size_t pointCount;
+  std::vector<float> pointPlanes[9];
+  /* Point pass binning: per point window pixel (or culled) and depth, per chunk and tile
+   * fragment counts turned into scatter offsets, and the fragments grouped by tile. */
+  struct SplatFragment
+  {
+    std::uint32_t point;
+    std::uint32_t pixel;
+    float depth;
+  };
+  std::vector<std::uint32_t> splatPixel;
+  std::vector<float> splatDepth;
+  std::vector<std::uint32_t> tileCounts;
+  std::vector<std::uint32_t> tileStart;
+  std::vector<SplatFragment> fragments;
+  CpuGBuffer gBuffer[2];
+  std::vector<std::vector<int>> pickScratch;
+  std::vector<std::vector<float>> weightScratch;
+  std::vector<TimingSeries> timings;
+};
@@ -0,0 +1,252 @@
+#include "frame_capture.h"
+#include "trace.h"
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+VideoWriter::VideoWriter(std::filesystem::path const& videoPath, Format format, int width, int height, int fps)
+  : file(nullptr),
+  ownsFile(videoPath != "-"),
+  format(format),
+  width(width),
+  height(height),
+  closing(false),
+  failed(false)
+{
+  if (ownsFile)
+  {
+    file = std::fopen(videoPath.string().c_str(), "wb");
+    if (!file)
+    {
+      throw std::runtime_error(videoPath.string() + " failed to open");
+    }
+  }
+  else
+  {
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    file = stdout;
+  }
+  std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+  if (format == Format::Y4M)
+  {
+    std::string const header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) + " F" + std::to_string(fps) + ":1 Ip A1:1 C444\n";
+    std::fwrite(header.data(), 1, header.size(), file);
+    scratch.resize((std::size_t)width * height * 3);
+  }
+  writer = std::thread(&VideoWriter::writerLoop, this);
+}
+
+VideoWriter::~VideoWriter()
+{
+  try
+  {
+    close();
+  }
+  catch (...)
+  {
+  }
+}
+
+std::vector<std::uint8_t> VideoWriter::acquireFrame()
+{
+  std::vector<std::uint8_t> frame;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!freeFrames.empty())
+    {
+      frame = std::move(freeFrames.back());
+      freeFrames.pop_back();
+    }
+  }
+  frame.resize((std::size_t)width * height * 3);
+  return frame;
+}
+
+void VideoWriter::submitFrame(std::vector<std::uint8_t> bottomUpRGB)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  // A slow consumer (an encoder on the other end of a pipe) throttles rendering instead of growing the queue.
+  frameWritten.wait(lock, [this] { return queued.size() < maxQueuedFrames; });
+  queued.push_back(std::move(bottomUpRGB));
+  lock.unlock();
+  frameQueued.notify_one();
+}
+
+void VideoWriter::close()
+{
+  if (!writer.joinable())
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    closing = true;
+  }
+  frameQueued.notify_one();
+  writer.join();
+  if (std::fflush(file) != 0)
+  {
+    failed = true;
+  }
+  if (ownsFile && std::fclose(file) != 0)
+  {
+    failed = true;
+  }
+  file = nullptr;
+  if (failed)
+  {
+    throw std::runtime_error("failed to write video");
+  }
+}
+
+void VideoWriter::writerLoop()
+{
+  traceSetThreadName("capture");
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true)
+  {
+    frameQueued.wait(lock, [this] { return closing || !queued.empty(); });
+    if (queued.empty())
+    {
+      return;
+    }
+    std::vector<std::uint8_t> frame = std::move(queued.front());
+    queued.pop_front();
+    lock.unlock();
+    writeFrame(frame);
+    lock.lock();
+    freeFrames.push_back(std::move(frame));
+    frameWritten.notify_one();
+  }
+}
+
+void VideoWriter::writeFrame(std::vector<std::uint8_t> const& bottomUpRGB)
+{
+  if (failed)
+  {
+    return;
+  }
+  TraceZone zone("writeVideoFrame");
+  std::size_t const rowBytes = (std::size_t)width * 3;
+  bool ok = true;
+  if (format == Format::RGB)
+  {
+    for (int y = height - 1; y >= 0 && ok; --y)
+    {
+      ok = std::fwrite(bottomUpRGB.data() + y * rowBytes, 1, rowBytes, file) == rowBytes;
+    }
+  }
+  else
+  {
+    std::size_t const planeSize = (std::size_t)width * height;
+    std::uint8_t* yPlane = scratch.data();
+    std::uint8_t* uPlane = yPlane + planeSize;
+    std::uint8_t* vPlane = uPlane + planeSize;
+    for (int y = 0; y < height; ++y)
+    {
+      std::uint8_t const* rgb = bottomUpRGB.data() + (height - 1 - y) * rowBytes;
+      std::size_t const row = (std::size_t)y * width;
+      for (int x = 0; x < width; ++x)
+      {
+        int const r = rgb[x * 3];
+        int const g = rgb[x * 3 + 1];
+        int const b = rgb[x * 3 + 2];
+        yPlane[row + x] = (std::uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        uPlane[row + x] = (std::uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        vPlane[row + x] = (std::uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+      }
+    }
+    ok = std::fwrite("FRAME\n", 1, 6, file) == 6 && std::fwrite(scratch.data(), 1, scratch.size(), file) == scratch.size();
+  }
+  if (!ok)
+  {
+    failed = true;
+  }
+}
+
+FrameCapture::FrameCapture(VideoWriter& writer, int width, int height)
+  : writer(writer),
+  width(width),
+  height(height),
+  fences{},
+  frame(0)
+{
+  glGenBuffers(ringSize, pixelBuffers);
+  for (int slot = 0; slot < ringSize; ++slot)
+  {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 3, nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+FrameCapture::~FrameCapture()
+{
+  for (int slot = 0; slot < ringSize; ++slot)
+  {
+    if (fences[slot])
+    {
+      glDeleteSync(fences[slot]);
+    }
+  }
+  glDeleteBuffers(ringSize, pixelBuffers);
+}
+
+void FrameCapture::capture(GLuint framebuffer)
+{
+  TraceZone zone("capture");
+  int const slot = frame % ringSize;
+  if (fences[slot])
+  {
+    retrieve(slot);
+  }
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  ++frame;
+}
+
+void FrameCapture::finish()
+{
+  for (int i = 0; i < ringSize; ++i)
+  {
+    int const slot = (frame + i) % ringSize;
+    if (fences[slot])
+    {
+      retrieve(slot);
+    }
+  }
+}
+
+void FrameCapture::retrieve(int slot)
+{
+  // Normally signalled long ago; the flush only matters when finish() drains the newest reads.
+  while (glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+  {
+  }
+  glDeleteSync(fences[slot]);
+  fences[slot] = nullptr;
+  std::vector<std::uint8_t> pixels = writer.acquireFrame();
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[slot]);
+  void const* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)pixels.size(), GL_MAP_READ_BIT);
+  if (mapped)
+  {
+    std::memcpy(pixels.data(), mapped, pixels.size());
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if (mapped)
+  {
+    writer.submitFrame(std::move(pixels));
+  }
+}
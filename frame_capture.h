@@ -0,0 +1,70 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "build/third-party/glad/include/glad/glad.h"
+
+/* Streams 8-bit RGB frames to a file, or to stdout for the path "-", from its own thread.
+ * Y4M frames are converted to BT.601 4:4:4 YCbCr; RGB frames are packed rgb24, top row first. */
+class VideoWriter
+{
+public:
+  enum class Format
+  {
+    Y4M,
+    RGB
+  };
+  VideoWriter(std::filesystem::path const& videoPath, Format format, int width, int height, int fps);
+  ~VideoWriter();
+  VideoWriter(VideoWriter const&) = delete;
+  VideoWriter& operator=(VideoWriter const&) = delete;
+  std::vector<std::uint8_t> acquireFrame();
+  void submitFrame(std::vector<std::uint8_t> bottomUpRGB);
+  void close();
+private:
+  static constexpr std::size_t maxQueuedFrames = 8;
+  void writerLoop();
+  void writeFrame(std::vector<std::uint8_t> const& bottomUpRGB);
+  std::FILE* file;
+  bool ownsFile;
+  Format format;
+  int width;
+  int height;
+  std::vector<std::uint8_t> scratch;
+  std::deque<std::vector<std::uint8_t>> queued;
+  std::vector<std::vector<std::uint8_t>> freeFrames;
+  std::mutex mutex;
+  std::condition_variable frameQueued;
+  std::condition_variable frameWritten;
+  bool closing;
+  bool failed;
+  std::thread writer;
+};
+
+/* Reads the final framebuffer into a ring of pixel buffer objects. Each read is fenced and
+ * mapped ringSize - 1 frames later, by which time the copy has finished, so the render
+ * thread never waits on glReadPixels; the mapped frames are handed to a VideoWriter. */
+class FrameCapture
+{
+public:
+  FrameCapture(VideoWriter& writer, int width, int height);
+  ~FrameCapture();
+  FrameCapture(FrameCapture const&) = delete;
+  FrameCapture& operator=(FrameCapture const&) = delete;
+  void capture(GLuint framebuffer);
+  void finish();
+private:
+  static constexpr int ringSize = 4;
+  void retrieve(int slot);
+  VideoWriter& writer;
+  int width;
+  int height;
+  GLuint pixelBuffers[ringSize];
+  GLsync fences[ringSize];
+  int frame;
+};
@@ -0,0 +1,289 @@
+#include "gpu_timer.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+GpuTimer::GpuTimer()
+  : slotRecorded{},
+  frame(0),
+  stalledFrames(0),
+  recording(true)
+{
+}
+
+GpuTimer::~GpuTimer()
+{
+  for (int slot = 0; slot < frameLatency; ++slot)
+  {
+    if (!queryPool[slot].empty())
+    {
+      glDeleteQueries((GLsizei)queryPool[slot].size(), queryPool[slot].data());
+    }
+  }
+}
+
+void GpuTimer::beginFrame()
+{
+  int const slot = frame % frameLatency;
+  collect(slot, false);
+  slotRecorded[slot] = recording;
+}
+
+void GpuTimer::begin(std::string const& pass)
+{
+  int const slot = frame % frameLatency;
+  std::size_t const used = pending[slot].size();
+  if (used == queryPool[slot].size())
+  {
+    GLuint query;
+    glGenQueries(1, &query);
+    queryPool[slot].push_back(query);
+  }
+  GLuint const query = queryPool[slot][used];
+  pending[slot].push_back({ seriesIndex(pass), query });
+  glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+void GpuTimer::end()
+{
+  glEndQuery(GL_TIME_ELAPSED);
+}
+
+void GpuTimer::endFrame()
+{
+  ++frame;
+}
+
+void GpuTimer::finish()
+{
+  for (int i = 0; i < frameLatency; ++i)
+  {
+    collect((frame + i) % frameLatency, true);
+  }
+}
+
+void GpuTimer::setRecording(bool record)
+{
+  recording = record;
+}
+
+void GpuTimer::addSample(std::string const& name, double milliseconds)
+{
+  series[seriesIndex(name)].milliseconds.push_back(milliseconds);
+}
+
+std::vector<TimingSeries> const& GpuTimer::getSeries() const
+{
+  return series;
+}
+
+int GpuTimer::getStalledFrames() const
+{
+  return stalledFrames;
+}
+
+void GpuTimer::collect(int slot, bool wait)
+{
+  std::vector<PendingQuery>& queries = pending[slot];
+  if (queries.empty())
+  {
+    return;
+  }
+  if (!wait)
+  {
+    // Queries of one frame complete in submission order, so the last one tells whether reading them stalls.
+    GLint available = 0;
+    glGetQueryObjectiv(queries.back().query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available && slotRecorded[slot])
+    {
+      ++stalledFrames;
+    }
+  }
+  if (slotRecorded[slot])
+  {
+    double total = 0.0;
+    for (PendingQuery const& q : queries)
+    {
+      GLuint64 elapsed = 0;
+      glGetQueryObjectui64v(q.query, GL_QUERY_RESULT, &elapsed);
+      double const milliseconds = elapsed * 1e-6;
+      series[q.series].milliseconds.push_back(milliseconds);
+      total += milliseconds;
+    }
+    addSample("gpu_total", total);
+  }
+  queries.clear();
+}
+
+int GpuTimer::seriesIndex(std::string const& name)
+{
+  for (std::size_t i = 0; i < series.size(); ++i)
+  {
+    if (series[i].name == name)
+    {
+      return (int)i;
+    }
+  }
+  series.push_back({ name, {} });
+  return (int)series.size() - 1;
+}
+
+GpuTimeline::GpuTimeline()
+  : usedQueries{},
+  clockOffset(0),
+  track(traceCreateTrack("GPU")),
+  frame(0)
+{
+  GLint64 gpuNow = 0;
+  glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+  clockOffset = traceNow() - gpuNow;
+}
+
+GpuTimeline::~GpuTimeline()
+{
+  for (int slot = 0; slot < frameLatency; ++slot)
+  {
+    if (!queryPool[slot].empty())
+    {
+      glDeleteQueries((GLsizei)queryPool[slot].size(), queryPool[slot].data());
+    }
+  }
+}
+
+void GpuTimeline::beginFrame()
+{
+  int const slot = ++frame % frameLatency;
+  collect(slot);
+  usedQueries[slot] = 0;
+}
+
+void GpuTimeline::begin(char const* zone)
+{
+  int const slot = frame % frameLatency;
+  GLuint const query = nextQuery(slot);
+  pending[slot].push_back({ zone, query, 0 });
+  glQueryCounter(query, GL_TIMESTAMP);
+}
+
+void GpuTimeline::end()
+{
+  int const slot = frame % frameLatency;
+  GLuint const query = nextQuery(slot);
+  pending[slot].back().endQuery = query;
+  glQueryCounter(query, GL_TIMESTAMP);
+}
+
+std::vector<TimelineZone> const& GpuTimeline::getLastFrame() const
+{
+  return lastFrame;
+}
+
+GLuint GpuTimeline::nextQuery(int slot)
+{
+  if (usedQueries[slot] == queryPool[slot].size())
+  {
+    GLuint query;
+    glGenQueries(1, &query);
+    queryPool[slot].push_back(query);
+  }
+  return queryPool[slot][usedQueries[slot]++];
+}
+
+void GpuTimeline::collect(int slot)
+{
+  std::vector<PendingZone>& zones = pending[slot];
+  if (zones.empty())
+  {
+    return;
+  }
+  // The slot's queries are about to be reused, so a frame still in flight is waited for; dropping it would hide the slow frames.
+  lastFrame.clear();
+  GLuint64 frameStart = 0;
+  for (PendingZone const& zone : zones)
+  {
+    GLuint64 start = 0;
+    GLuint64 end = 0;
+    glGetQueryObjectui64v(zone.startQuery, GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(zone.endQuery, GL_QUERY_RESULT, &end);
+    frameStart = lastFrame.empty() ? start : frameStart;
+    traceRecord(zone.name, (std::int64_t)start + clockOffset, (std::int64_t)end + clockOffset, track);
+    lastFrame.push_back({ zone.name, (start - frameStart) * 1e-6, (end - start) * 1e-6 });
+  }
+  zones.clear();
+}
+
+namespace
+{
+  double percentile(std::vector<double> const& sorted, double p)
+  {
+    if (sorted.empty())
+    {
+      return 0.0;
+    }
+    std::size_t const rank = (std::size_t)std::ceil(p / 100.0 * sorted.size());
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+  }
+  std::string escapeJSON(std::string const& text)
+  {
+    std::string escaped;
+    for (char c : text)
+    {
+      if (c == '"' || c == '\\')
+      {
+        escaped += '\\';
+      }
+      escaped += c;
+    }
+    return escaped;
+  }
+}
+
+void writeTimingReport(std::ostream& out, bool json, std::vector<std::pair<std::string, std::string>> const& metadata, std::vector<TimingSeries> const& series)
+{
+  out << std::fixed << std::setprecision(4);
+  if (json)
+  {
+    out << "{" << std::endl;
+    for (auto const& entry : metadata)
+    {
+      out << "  \"" << escapeJSON(entry.first) << "\": \"" << escapeJSON(entry.second) << "\"," << std::endl;
+    }
+    out << "  \"passes\": [" << std::endl;
+  }
+  else
+  {
+    for (auto const& entry : metadata)
+    {
+      out << "# " << entry.first << ": " << entry.second << std::endl;
+    }
+    out << "pass,samples,mean_ms,p50_ms,p95_ms,p99_ms" << std::endl;
+  }
+  for (std::size_t i = 0; i < series.size(); ++i)
+  {
+    std::vector<double> sorted = series[i].milliseconds;
+    std::sort(sorted.begin(), sorted.end());
+    double mean = 0.0;
+    for (double value : sorted)
+    {
+      mean += value;
+    }
+    mean = sorted.empty() ? 0.0 : mean / sorted.size();
+    if (json)
+    {
+      out << "    { \"name\": \"" << escapeJSON(series[i].name) << "\", \"samples\": " << sorted.size()
+        << ", \"mean_ms\": " << mean << ", \"p50_ms\": " << percentile(sorted, 50.0)
+        << ", \"p95_ms\": " << percentile(sorted, 95.0) << ", \"p99_ms\": " << percentile(sorted, 99.0)
+        << " }" << (i + 1 < series.size() ? "," : "") << std::endl;
+    }
+    else
+    {
+      out << series[i].name << "," << sorted.size() << "," << mean << "," << percentile(sorted, 50.0) << ","
+        << percentile(sorted, 95.0) << "," << percentile(sorted, 99.0) << std::endl;
+    }
+  }
+  if (json)
+  {
+    out << "  ]" << std::endl << "}" << std::endl;
+  }
+}
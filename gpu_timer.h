@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "build/third-party/glad/include/glad/glad.h"
+
+struct TimingSeries
+{
+  std::string name;
+  std::vector<double> milliseconds;
+};
+
+/* Times GPU passes with GL_TIME_ELAPSED queries kept on a ring of frames. Results are
+ * collected frameLatency frames later, so the CPU normally never waits on the GPU. A frame
+ * whose queries are still in flight by then is waited for rather than dropped, since dropping
+ * the slowest frames would bias the percentiles low; such waits are counted as stalls. */
+class GpuTimer
+{
+public:
+  GpuTimer();
+  ~GpuTimer();
+  void beginFrame();
+  void begin(std::string const& pass);
+  void end();
+  void endFrame();
+  void finish();
+  void setRecording(bool record);
+  void addSample(std::string const& name, double milliseconds);
+  std::vector<TimingSeries> const& getSeries() const;
+  int getStalledFrames() const;
+private:
+  static constexpr int frameLatency = 4;
+  struct PendingQuery
+  {
+    int series;
+    GLuint query;
+  };
+  void collect(int slot, bool wait);
+  int seriesIndex(std::string const& name);
+  std::vector<GLuint> queryPool[frameLatency];
+  std::vector<PendingQuery> pending[frameLatency];
+  bool slotRecorded[frameLatency];
+  std::vector<TimingSeries> series;
+  int frame;
+  int stalledFrames;
+  bool recording;
+};
+
+struct TimelineZone
+{
+  char const* name;
+  double startMilliseconds;
+  double durationMilliseconds;
+};
+
+/* Brackets GPU passes with GL_TIMESTAMP queries and forwards the resolved zones to a trace
+ * track, shifted onto the CPU trace clock. Uses the same frame ring as GpuTimer and, like it,
+ * waits for a frame still in flight when its slot comes round again rather than dropping it. */
+class GpuTimeline
+{
+public:
+  GpuTimeline();
+  ~GpuTimeline();
+  void beginFrame();
+  void begin(char const* zone);
+  void end();
+  std::vector<TimelineZone> const& getLastFrame() const;
+private:
+  static constexpr int frameLatency = 4;
+  struct PendingZone
+  {
+    char const* name;
+    GLuint startQuery;
+    GLuint endQuery;
+  };
+  GLuint nextQuery(int slot);
+  void collect(int slot);
+  std::vector<GLuint> queryPool[frameLatency];
+  std::vector<PendingZone> pending[frameLatency];
+  std::size_t usedQueries[frameLatency];
+  std::vector<TimelineZone> lastFrame;
+  std::int64_t clockOffset;
+  int track;
+  int frame;
+};
+
+/* Writes count, mean and p50/p95/p99 of every series as CSV or JSON. */
+void writeTimingReport(std::ostream& out, bool json, std::vector<std::pair<std::string, std::string>> const& metadata, std::vector<TimingSeries> const& series);
@@ -0,0 +1,223 @@
+#include "image_writer.h"
+#include <array>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+
+namespace
+{
+  std::array<std::uint32_t, 256> const& crcTable()
+  {
+    static std::array<std::uint32_t, 256> const table = []()
+    {
+      std::array<std::uint32_t, 256> t{};
+      for (std::uint32_t n = 0; n < 256; ++n)
+      {
+        std::uint32_t c = n;
+        for (int k = 0; k < 8; ++k)
+        {
+          c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        t[n] = c;
+      }
+      return t;
+    }();
+    return table;
+  }
+  std::uint32_t updateCRC(std::uint32_t crc, std::uint8_t const* data, std::size_t size)
+  {
+    auto const& table = crcTable();
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+  }
+  void putBigEndian(std::uint8_t* out, std::uint32_t value)
+  {
+    out[0] = (std::uint8_t)(value >> 24);
+    out[1] = (std::uint8_t)(value >> 16);
+    out[2] = (std::uint8_t)(value >> 8);
+    out[3] = (std::uint8_t)value;
+  }
+}
+
+ImageWriter::ImageWriter(std::filesystem::path const& imagePath, Format format, int width, int height)
+  : ImageWriter(format, width, height)
+{
+  file.open(imagePath, std::ios::binary);
+  if (file.fail())
+  {
+    throw std::runtime_error(imagePath.string() + " failed to open");
+  }
+  stream = &file;
+  writeHeader();
+}
+
+ImageWriter::ImageWriter(std::ostream& out, Format format, int width, int height)
+  : ImageWriter(format, width, height)
+{
+  stream = &out;
+  writeHeader();
+}
+
+ImageWriter::ImageWriter(Format format, int width, int height)
+  : stream(nullptr),
+  format(format),
+  width(width),
+  height(height),
+  rowsWritten(0),
+  adlerA(1),
+  adlerB(0)
+{
+}
+
+void ImageWriter::writeHeader()
+{
+  if (format == Format::RAW)
+  {
+    return;
+  }
+  std::uint8_t const signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  stream->write((char const*)signature, sizeof(signature));
+  std::uint8_t header[13] = {};
+  putBigEndian(header, (std::uint32_t)width);
+  putBigEndian(header + 4, (std::uint32_t)height);
+  header[8] = 8; // bit depth
+  header[9] = 2; // truecolor
+  writeChunk("IHDR", header, sizeof(header));
+  // zlib stream header: deflate, 32K window, no preset dictionary, fastest level
+  std::uint8_t const zlibHeader[2] = { 0x78, 0x01 };
+  writeChunk("IDAT", zlibHeader, sizeof(zlibHeader));
+}
+
+ImageWriter::~ImageWriter()
+{
+  if (stream)
+  {
+    try
+    {
+      close();
+    }
+    catch (...)
+    {
+    }
+  }
+}
+
+void ImageWriter::writeRow(std::uint8_t const* rgbRow)
+{
+  std::size_t const rowBytes = (std::size_t)width * 3;
+  if (format == Format::RAW)
+  {
+    stream->write((char const*)rgbRow, rowBytes);
+    ++rowsWritten;
+    return;
+  }
+  // Each scanline is prefixed with filter type 0 and emitted as stored deflate blocks.
+  scratch.clear();
+  std::size_t remaining = rowBytes + 1;
+  std::size_t offset = 0;
+  while (remaining > 0)
+  {
+    std::size_t const blockSize = std::min<std::size_t>(remaining, 0xFFFF);
+    std::uint16_t const len = (std::uint16_t)blockSize;
+    std::uint16_t const nlen = (std::uint16_t)~len;
+    scratch.push_back(0);
+    scratch.push_back((std::uint8_t)(len & 0xFF));
+    scratch.push_back((std::uint8_t)(len >> 8));
+    scratch.push_back((std::uint8_t)(nlen & 0xFF));
+    scratch.push_back((std::uint8_t)(nlen >> 8));
+    for (std::size_t i = 0; i < blockSize; ++i)
+    {
+      std::size_t const pos = offset + i;
+      std::uint8_t const value = pos == 0 ? 0 : rgbRow[pos - 1];
+      scratch.push_back(value);
+      adlerA = (adlerA + value) % 65521u;
+      adlerB = (adlerB + adlerA) % 65521u;
+    }
+    offset += blockSize;
+    remaining -= blockSize;
+  }
+  writeChunk("IDAT", scratch.data(), scratch.size());
+  ++rowsWritten;
+}
+
+void ImageWriter::close()
+{
+  if (!stream)
+  {
+    return;
+  }
+  if (rowsWritten != height)
+  {
+    stream = nullptr;
+    file.close();
+    throw std::runtime_error("image closed after " + std::to_string(rowsWritten) + " of " + std::to_string(height) + " rows");
+  }
+  if (format == Format::PNG)
+  {
+    // Empty final stored block followed by the adler32 checksum of the scanlines.
+    std::uint8_t tail[9] = { 1, 0, 0, 0xFF, 0xFF };
+    putBigEndian(tail + 5, (adlerB << 16) | adlerA);
+    writeChunk("IDAT", tail, sizeof(tail));
+    writeChunk("IEND", nullptr, 0);
+  }
+  std::ostream& out = *stream;
+  stream = nullptr;
+  out.flush();
+  if (file.is_open())
+  {
+    file.close();
+  }
+  if (out.fail())
+  {
+    throw std::runtime_error("failed to write image");
+  }
+}
+
+void ImageWriter::writeChunk(char const* type, std::uint8_t const* data, std::size_t size)
+{
+  std::uint8_t lengthAndType[8];
+  putBigEndian(lengthAndType, (std::uint32_t)size);
+  std::memcpy(lengthAndType + 4, type, 4);
+  std::uint32_t crc = updateCRC(0xFFFFFFFFu, lengthAndType + 4, 4);
+  if (size > 0)
+  {
+    crc = updateCRC(crc, data, size);
+  }
+  std::uint8_t crcBytes[4];
+  putBigEndian(crcBytes, crc ^ 0xFFFFFFFFu);
+  stream->write((char const*)lengthAndType, sizeof(lengthAndType));
+  if (size > 0)
+  {
+    stream->write((char const*)data, size);
+  }
+  stream->write((char const*)crcBytes, sizeof(crcBytes));
+}
+
+namespace
+{
+  void writeRowsBottomUp(ImageWriter& writer, int width, int height, std::uint8_t const* bottomUpRGB)
+  {
+    std::size_t const rowBytes = (std::size_t)width * 3;
+    for (int row = height - 1; row >= 0; --row)
+    {
+      writer.writeRow(bottomUpRGB + rowBytes * row);
+    }
+    writer.close();
+  }
+}
+
+void writeImage(std::filesystem::path const& imagePath, ImageWriter::Format format, int width, int height, std::uint8_t const* bottomUpRGB)
+{
+  ImageWriter writer(imagePath, format, width, height);
+  writeRowsBottomUp(writer, width, height, bottomUpRGB);
+}
+
+void writeImage(std::ostream& out, ImageWriter::Format format, int width, int height, std::uint8_t const* bottomUpRGB)
+{
+  ImageWriter writer(out, format, width, height);
+  writeRowsBottomUp(writer, width, height, bottomUpRGB);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <vector>
+
+/* Streams an 8-bit RGB image to disk, or to any output stream, one row at a time, top row first. */
+class ImageWriter
+{
+public:
+  enum class Format
+  {
+    PNG,
+    RAW
+  };
+  ImageWriter(std::filesystem::path const& imagePath, Format format, int width, int height);
+  ImageWriter(std::ostream& out, Format format, int width, int height);
+  ~ImageWriter();
+  void writeRow(std::uint8_t const* rgbRow);
+  void close();
+private:
+  ImageWriter(Format format, int width, int height);
+  void writeHeader();
+  void writeChunk(char const* type, std::uint8_t const* data, std::size_t size);
+  std::ofstream file;
+  std::ostream* stream;
+  Format format;
+  int width;
+  int height;
+  int rowsWritten;
+  std::uint32_t adlerA;
+  std::uint32_t adlerB;
+  std::vector<std::uint8_t> scratch;
+};
+
+/* Writes a whole image whose rows are stored bottom-up, as returned by glReadPixels. */
+void writeImage(std::filesystem::path const& imagePath, ImageWriter::Format format, int width, int height, std::uint8_t const* bottomUpRGB);
+void writeImage(std::ostream& out, ImageWriter::Format format, int width, int height, std::uint8_t const* bottomUpRGB);
@@ -1,20 +1,93 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <filesystem>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
-#include "third-party/tinyply/source/tinyply.h"
 #include "build/third-party/glad/include/glad/glad.h"
 #include "third-party/glfw/include/GLFW/glfw3.h"
 #include "third-party/glm/glm/glm.hpp"
 #include "third-party/glm/glm/gtc/matrix_transform.hpp"
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#ifndef _WIN32
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include "composite.h"
+#include "cpu_renderer.h"
+#include "frame_capture.h"
+#include "gpu_timer.h"
+#include "image_writer.h"
+#include "ply_decode.h"
+#include "ply_reader.h"
+#include "point_index.h"
+#include "point_order.h"
+#include "point_stream.h"
+#include "render_graph.h"
+#include "render_server.h"
+#include "spsc_queue.h"
+#include "splat_radius.h"
+#include "thread_pool.h"
+#include "trace.h"
 
 bool firstMouse = true;
+bool headless = false;
+bool benchmark = false;
+bool vsync = true;
+bool cpuRendering = false;
+bool validateCpu = false;
+bool validateDeferred = false;
+bool traceOverlay = false;
+bool traceDumpRequested = false;
+bool shufflePoints = false;
+bool reloadRequested = false;
+bool adaptiveSplats = false;
+bool visibilityBuffer = false;
+bool deferredLighting = false;
+bool normalEstimation = false;
+bool fusedPost = false;
+bool illustration = true;
+bool pointPicking = false;
+bool pickRequested = false;
+bool pointFiltering = false;
+bool occlusionCulling = false;
+bool filterToggleRequested = false;
+int filterShiftRequested = 0;
+int orbitFrames = 0;
+int warmupFrames = 10;
+int traceFrames = 0;
+int cpuThreads = 0;
+int captureFps = 60;
+int pointBudget = 0;
+int streamWindow = 1 << 20;
 int backgroundFillIters = 1;
 int occlusionFillIters = 1;
 int pointStride = 6;
+int compositeWorkers = 0;
+int compositePort = 0;
+int workerPartition = 0;
+int workerPartitions = 1;
 int windowHeight = 512;
+int posterWidth = 0;
+int posterHeight = 0;
 int windowWidth = 512;
 float fov = 45.f;
+float smoothSigma = 0.f;
 float pitch = 0.f;
 float yaw = 0.f;
 float deltaTime = 0.0f;
@@ -22,13 +95,162 @@ float lastFrame = 0.0f;
 glm::vec3 viewPos = glm::vec3(0.f, 0.f, 0.f);
 glm::vec3 cameraFront = glm::vec3(0.f, 0.f, -1.f);
 glm::vec3 cameraUp = glm::vec3(0.f, 1.f, 0.f);
+std::filesystem::path cameraPathFile;
+std::filesystem::path outputDirectory = ".";
+ImageWriter::Format outputFormat = ImageWriter::Format::PNG;
+std::filesystem::path benchmarkOutput;
+std::filesystem::path recordPathFile;
+std::filesystem::path traceFile;
+std::filesystem::path captureFile;
+std::filesystem::path serverSocket;
+std::filesystem::path sceneFile;
+std::filesystem::path lightFile;
+std::string streamSource;
+std::string workerAddress;
+std::filesystem::path executablePath;
+std::filesystem::path droppedFile;
+VideoWriter::Format captureFormat = VideoWriter::Format::Y4M;
+
+struct CameraPose
+{
+  glm::vec3 position;
+  glm::vec3 front;
+  float fov;
+};
+
+/* Predicates of the GPU point filter; a point is drawn when it passes every enabled one. */
+struct PointFilter
+{
+  bool clip;
+  glm::vec3 clipLower;
+  glm::vec3 clipUpper;
+  bool band;
+  float bandLower;
+  float bandUpper;
+  bool colorRange;
+  glm::vec3 colorLower;
+  glm::vec3 colorUpper;
+  bool slice;
+  glm::vec3 sliceNormal;
+  float sliceLower;
+  float sliceUpper;
+};
+PointFilter pointFilter = {};
+
+PlyDecodeReport plyDecodeReport = {};
+
+/* A --lights point light. Its contribution falls off quadratically to zero at radius. */
+struct PointLight
+{
+  glm::vec3 position;
+  glm::vec3 color;
+  float radius;
+};
+// The light culling pass keeps one bit per light and tile.
+int const maxPointLights = 1024;
+std::vector<PointLight> pointLights;
+
+/* One cloud of a --scene, a range of the packed point buffer drawn with its own transform. */
+struct SceneDraw
+{
+  GLint first;
+  GLsizei count;
+  glm::mat4 model;
+  bool hasColor;
+};
+std::vector<SceneDraw> sceneDraws;
+
+/* A file read and uploaded by the BackgroundLoader, ready to draw once fence has signalled. */
+struct LoadedCloud
+{
+  std::filesystem::path path;
+  int stride;
+  GLsizei pointCount;
+  std::vector<SceneDraw> draws;
+  GLuint buffer;
+  GLuint radiusBuffer;
+  GLsync fence;
+  std::unique_ptr<PointIndex> index;
+};
+
+void poseMatrices(CameraPose const& pose, glm::mat4& view, glm::mat4& projection)
+{
+  view = glm::lookAt(pose.position, pose.position + pose.front, cameraUp);
+  projection = glm::perspective(glm::radians(pose.fov), (float)windowWidth / (float)windowHeight, .01f, 100.f);
+}
+
+// Taps on either side of the --smooth-sigma Gaussian, out to three sigma.
+int separableSmoothRadius()
+{
+  return std::min(32, (int)std::ceil(3.f * smoothSigma));
+}
+
+/* Splat radii for --adaptive-splats, one per point. Scene clouds are estimated one at a time
+ * since each has its own coordinates. */
+std::vector<float> splatRadii(std::vector<float> const& points, int stride, std::vector<SceneDraw> const& draws)
+{
+  TraceZone zone("splatRadii");
+  std::vector<float> radii(points.size() / stride);
+  ThreadPool pool(cpuThreads);
+  if (draws.empty())
+  {
+    estimateSplatRadii(points.data(), stride, radii.size(), pool, radii.data());
+  }
+  for (SceneDraw const& draw : draws)
+  {
+    estimateSplatRadii(points.data() + (std::size_t)draw.first * stride, stride, draw.count, pool, radii.data() + draw.first);
+  }
+  return radii;
+}
 
 void processInput(GLFWwindow* window)
 {
+  static bool dumpKeyDown = false;
+  static bool overlayKeyDown = false;
   if (glfwGetKey(window,GLFW_KEY_ESCAPE) == GLFW_PRESS)
   {
     glfwSetWindowShouldClose(window, GLFW_TRUE);
   }
+  bool const dumpKey = glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS;
+  if (dumpKey && !dumpKeyDown)
+  {
+    traceDumpRequested = true;
+  }
+  dumpKeyDown = dumpKey;
+  static bool reloadKeyDown = false;
+  bool const reloadKey = glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS;
+  if (reloadKey && !reloadKeyDown)
+  {
+    reloadRequested = true;
+  }
+  reloadKeyDown = reloadKey;
+  bool const overlayKey = glfwGetKey(window, GLFW_KEY_F11) == GLFW_PRESS;
+  if (overlayKey && !overlayKeyDown)
+  {
+    traceOverlay = !traceOverlay;
+  }
+  overlayKeyDown = overlayKey;
+  static bool pickButtonDown = false;
+  bool const pickButton = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+  if (pickButton && !pickButtonDown)
+  {
+    pickRequested = true;
+  }
+  pickButtonDown = pickButton;
+  static bool filterKeyDown = false;
+  bool const filterKey = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+  if (filterKey && !filterKeyDown)
+  {
+    filterToggleRequested = true;
+  }
+  filterKeyDown = filterKey;
+  static int filterShiftKeyDown = 0;
+  int const filterShiftKey = glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS ? 1 : glfwGetKey(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS ? -1 : 0;
+  if (filterShiftKey != 0 && filterShiftKey != filterShiftKeyDown)
+  {
+    filterShiftRequested += filterShiftKey;
+  }
+  filterShiftKeyDown = filterShiftKey;
   float cameraSpeed = 2.5f * deltaTime;
   if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
   {
@@ -80,42 +302,162 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
   fov = std::min(fov, 45.f);
   fov = std::max(fov, 1.f);
 }
+void drop_callback(GLFWwindow* window, int count, const char** paths)
+{
+  if (count > 0)
+  {
+    droppedFile = paths[0];
+  }
+}
+
 void error_callback(int code, const char* description)
 {
   std::cerr << "GLFW CODE: " << code << std::endl;
   std::cerr << description << std::endl;
 }
+void dumpTrace()
+{
+  try
+  {
+    writeChromeTrace(traceFile);
+    std::cout << "TRACE WRITTEN TO " << traceFile.string() << std::endl;
+  }
+  catch (std::exception const& e)
+  {
+    std::cout << "COULD NOT WRITE TRACE" << std::endl;
+    std::cerr << e.what() << std::endl;
+  }
+}
 
 class RenderWindow
 {
 public:
   RenderWindow()
     : failState(false),
+    window(nullptr),
     pointCount(0),
-    currBuffer(0),
     model(glm::mat4(1.0)),
     view(glm::mat4(1.0)),
     projection(glm::mat4(1.0)),
-    lightPos(glm::vec3(0.0,2.0,0.0))
+    lightPos(glm::vec3(0.0,2.0,0.0)),
+    pointVAO(0),
+    pointVBO(0),
+    splatRadiusVBO(0),
+    visibilityPointVertShader(0),
+    visibilityPointFragShader(0),
+    visibilityPointProgram(0),
+    backgroundVisibilityFragShader(0),
+    backgroundVisibilityProgram(0),
+    occlusionVisibilityFragShader(0),
+    occlusionVisibilityProgram(0),
+    resolveFragShader(0),
+    resolveProgram(0),
+    lightCullShader(0),
+    lightCullProgram(0),
+    lightingFragShader(0),
+    lightingProgram(0),
+    lightBuffer(0),
+    tileLightBuffer(0),
+    separableSmoothFragShader(0),
+    separableSmoothProgram(0),
+    normalsFragShader(0),
+    normalsProgram(0),
+    fusedPostShader(0),
+    fusedPostProgram(0),
+    filterCountShader(0),
+    filterCountProgram(0),
+    filterScanShader(0),
+    filterScanProgram(0),
+    filterScatterShader(0),
+    filterScatterProgram(0),
+    filterParameterBuffer(0),
+    filterBlockBuffer(0),
+    filterElementBuffer(0),
+    filterCommandBuffer(0),
+    filterActive(pointFiltering),
+    filterDirty(false),
+    filterReport(false),
+    cullShader(0),
+    cullProgram(0),
+    pyramidBaseShader(0),
+    pyramidBaseProgram(0),
+    pyramidReduceShader(0),
+    pyramidReduceProgram(0),
+    depthPyramid(0),
+    pyramidLevels(0),
+    chunkBuffer(0),
+    chunkVisibleBuffer(0),
+    chunkCommandBuffer(0),
+    chunkStatisticsBuffer(0),
+    chunkCount(0),
+    cullPhase(-1),
+    cullStatisticsPending(false),
+    outputBuffer(0),
+    outputColorBuffer(0),
+    outputDepthBuffer(0),
+    sceneObjectIDs(0),
+    sceneObjectBuffer(0),
+    sceneDrawBuffer(0),
+    lastView(glm::mat4(1.0)),
+    lastProjection(glm::mat4(1.0)),
+    loaderContext(nullptr),
+    pointsDrawn(0),
+    sceneFraction(1.f),
+    frameIndex(0),
+    streamReportTime(0.0),
+    streamReportPoints(0),
+    passStart(0),
+    frameStart(0),
+    currentPass(nullptr),
+    compositor(nullptr),
+    hasPick(false),
+    lastPick(glm::vec3(0.f))
   {
-    window = setupWindow();
-    if (window)
+    if (headless)
     {
+      if (!setupHeadlessContext())
+      {
+        std::cerr << "HEADLESS CONTEXT COULD NOT BE CREATED" << std::endl;
+        failState = true;
+        return;
+      }
       setupShaders();
+      setupOutputBuffer();
+    }
+    else
+    {
+      window = setupWindow();
+      if (window)
+      {
+        setupShaders();
+      }
+    }
+    if ((headless || window) && !failState && traceEnabled)
+    {
+      gpuTimeline = std::make_unique<GpuTimeline>();
     }
   }
   ~RenderWindow()
   {
+    frameCapture.reset();
+    streamRing.reset();
+    renderGraph.reset();
+    if (!readbackBuffers.empty())
+    {
+      glDeleteBuffers((GLsizei)readbackBuffers.size(), readbackBuffers.data());
+    }
     glDeleteVertexArrays(1, &pointVAO);
     glDeleteBuffers(1, &pointVBO);
+    glDeleteBuffers(1, &splatRadiusVBO);
+    glDeleteBuffers(1, &sceneObjectIDs);
+    glDeleteBuffers(1, &sceneObjectBuffer);
+    glDeleteBuffers(1, &sceneDrawBuffer);
     glDeleteProgram(pointProgram);
     glDeleteShader(pointVertShader);
     glDeleteShader(pointFragShader);
-    glDeleteFramebuffers(2, &gBuffer[0]);
-    glDeleteTextures(2, &positionTexture[0]);
-    glDeleteTextures(2, &normalTexture[0]);
-    glDeleteTextures(2, &colorTexture[0]);
-    glDeleteRenderbuffers(3, &depthRenderBuffer[0]);
+    glDeleteProgram(visibilityPointProgram);
+    glDeleteShader(visibilityPointVertShader);
+    glDeleteShader(visibilityPointFragShader);
     glDeleteVertexArrays(1, &fboVAO);
     glDeleteBuffers(1, &fboVBO);
     glDeleteProgram(backgroundProgram);
@@ -127,6 +469,12 @@ public:
     glDeleteProgram(smoothProgram);
     glDeleteShader(smoothVertShader);
     glDeleteShader(smoothFragShader);
+    glDeleteProgram(separableSmoothProgram);
+    glDeleteShader(separableSmoothFragShader);
+    glDeleteProgram(normalsProgram);
+    glDeleteShader(normalsFragShader);
+    glDeleteProgram(fusedPostProgram);
+    glDeleteShader(fusedPostShader);
     glDeleteProgram(aaHighProgram);
     glDeleteShader(aaVertShader);
     glDeleteShader(aaHighProgram);
@@ -135,17 +483,110 @@ public:
     glDeleteProgram(illustrateProgram);
     glDeleteShader(illustrateVertShader);
     glDeleteShader(illustrateFragShader);
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    glDeleteProgram(backgroundVisibilityProgram);
+    glDeleteShader(backgroundVisibilityFragShader);
+    glDeleteProgram(occlusionVisibilityProgram);
+    glDeleteShader(occlusionVisibilityFragShader);
+    glDeleteProgram(resolveProgram);
+    glDeleteShader(resolveFragShader);
+    glDeleteProgram(lightCullProgram);
+    glDeleteShader(lightCullShader);
+    glDeleteProgram(lightingProgram);
+    glDeleteShader(lightingFragShader);
+    glDeleteBuffers(1, &lightBuffer);
+    glDeleteBuffers(1, &tileLightBuffer);
+    glDeleteProgram(filterCountProgram);
+    glDeleteShader(filterCountShader);
+    glDeleteProgram(filterScanProgram);
+    glDeleteShader(filterScanShader);
+    glDeleteProgram(filterScatterProgram);
+    glDeleteShader(filterScatterShader);
+    glDeleteBuffers(1, &filterParameterBuffer);
+    glDeleteBuffers(1, &filterBlockBuffer);
+    glDeleteBuffers(1, &filterElementBuffer);
+    glDeleteBuffers(1, &filterCommandBuffer);
+    glDeleteProgram(cullProgram);
+    glDeleteShader(cullShader);
+    glDeleteProgram(pyramidBaseProgram);
+    glDeleteShader(pyramidBaseShader);
+    glDeleteProgram(pyramidReduceProgram);
+    glDeleteShader(pyramidReduceShader);
+    glDeleteTextures(1, &depthPyramid);
+    glDeleteBuffers(1, &chunkBuffer);
+    glDeleteBuffers(1, &chunkVisibleBuffer);
+    glDeleteBuffers(1, &chunkCommandBuffer);
+    glDeleteBuffers(1, &chunkStatisticsBuffer);
+    glDeleteFramebuffers(1, &outputBuffer);
+    glDeleteRenderbuffers(1, &outputColorBuffer);
+    glDeleteRenderbuffers(1, &outputDepthBuffer);
+#ifdef HEADLESS_EGL
+    if (eglDisplay != EGL_NO_DISPLAY)
+    {
+      eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+      if (eglSurface != EGL_NO_SURFACE)
+      {
+        eglDestroySurface(eglDisplay, eglSurface);
+      }
+      if (eglContext != EGL_NO_CONTEXT)
+      {
+        eglDestroyContext(eglDisplay, eglContext);
+      }
+      eglTerminate(eglDisplay);
+    }
+#endif
+    if (loaderContext)
+    {
+      glfwDestroyWindow(loaderContext);
+    }
+    if (window)
+    {
+      glfwDestroyWindow(window);
+      glfwTerminate();
+    }
   }
   void load(std::vector<float> PLYData)
   {
+    // Occlusion culling draws the index's nodes as chunks, so the points are indexed first.
+    if (occlusionCulling && sceneDraws.empty())
+    {
+      ThreadPool pool(cpuThreads);
+      load(std::make_unique<PointIndex>(std::move(PLYData), pointStride, pool));
+      return;
+    }
+    uploadPoints(PLYData);
+  }
+  // Draws the index's reordered points and answers picks from it.
+  void load(std::unique_ptr<PointIndex> index)
+  {
+    pointIndex = std::move(index);
+    uploadPoints(pointIndex->getPoints());
+    uploadChunks();
+  }
+  void uploadPoints(std::vector<float> const& PLYData)
+  {
+    if (failState)
+    {
+      return;
+    }
+    TraceZone zone("load");
     pointCount = (int)PLYData.size() / pointStride;
-    glGenVertexArrays(1, &pointVAO);
-    glBindVertexArray(pointVAO);
     glGenBuffers(1, &pointVBO);
     glBindBuffer(GL_ARRAY_BUFFER, pointVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * PLYData.size(), PLYData.data(), GL_STATIC_DRAW);
+    if (adaptiveSplats)
+    {
+      std::vector<float> const radii = splatRadii(PLYData, pointStride, sceneDraws);
+      glGenBuffers(1, &splatRadiusVBO);
+      glBindBuffer(GL_ARRAY_BUFFER, splatRadiusVBO);
+      glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * radii.size(), radii.data(), GL_STATIC_DRAW);
+    }
+    setupPointArray();
+  }
+  void setupPointArray()
+  {
+    glGenVertexArrays(1, &pointVAO);
+    glBindVertexArray(pointVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, pointVBO);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * pointStride, (GLvoid*)0);
     glEnableVertexAttribArray(1);
@@ -155,8 +596,174 @@ public:
       glEnableVertexAttribArray(2);
       glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(float) * pointStride, (GLvoid*)(sizeof(float) * 6));
     }
+    if (splatRadiusVBO)
+    {
+      glBindBuffer(GL_ARRAY_BUFFER, splatRadiusVBO);
+      glEnableVertexAttribArray(4);
+      glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(float), (GLvoid*)0);
+    }
+    if (!sceneDraws.empty())
+    {
+      loadScene();
+    }
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (visibilityBuffer && pointCount > maxVisibilityPoints)
+    {
+      std::cout << "TOO MANY POINTS FOR THE VISIBILITY BUFFER, USING THE G-BUFFER" << std::endl;
+    }
+    if (filterCountProgram)
+    {
+      resizeFilter();
+    }
+  }
+  /* Hidden window whose context shares objects with the render context, for the
+   * BackgroundLoader thread to make current. Windows can only be created here on the main thread. */
+  GLFWwindow* createLoaderContext()
+  {
+    if (!window || failState)
+    {
+      return nullptr;
+    }
+    if (!loaderContext)
+    {
+      glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+      loaderContext = glfwCreateWindow(1, 1, "loader", NULL, window);
+      glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    }
+    return loaderContext;
+  }
+  /* Swaps in a cloud from the BackgroundLoader once the GPU has finished its upload, until then
+   * the current cloud stays on screen. Vertex arrays are not shared between contexts, so the
+   * array around the loaded buffer is built here. */
+  bool adoptCloud(LoadedCloud& cloud)
+  {
+    if (glClientWaitSync(cloud.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+    {
+      return false;
+    }
+    TraceZone zone("adoptCloud");
+    glDeleteSync(cloud.fence);
+    glDeleteVertexArrays(1, &pointVAO);
+    glDeleteBuffers(1, &pointVBO);
+    glDeleteBuffers(1, &splatRadiusVBO);
+    glDeleteBuffers(1, &sceneObjectIDs);
+    glDeleteBuffers(1, &sceneObjectBuffer);
+    glDeleteBuffers(1, &sceneDrawBuffer);
+    sceneObjectIDs = 0;
+    sceneObjectBuffer = 0;
+    sceneDrawBuffer = 0;
+    bool const layoutChanged = cloud.stride != pointStride || cloud.draws.empty() != sceneDraws.empty();
+    pointStride = cloud.stride;
+    sceneDraws = std::move(cloud.draws);
+    pointCount = cloud.pointCount;
+    pointVBO = cloud.buffer;
+    splatRadiusVBO = cloud.radiusBuffer;
+    pointIndex = std::move(cloud.index);
+    hasPick = false;
+    setupPointArray();
+    uploadChunks();
+    if (filterCountProgram)
+    {
+      resizeFilter();
+    }
+    if (layoutChanged)
+    {
+      glDeleteProgram(pointProgram);
+      glDeleteShader(pointVertShader);
+      glDeleteShader(pointFragShader);
+      glDeleteProgram(visibilityPointProgram);
+      glDeleteShader(visibilityPointVertShader);
+      glDeleteShader(visibilityPointFragShader);
+      setupPointProgram();
+    }
+    return true;
+  }
+  /* Draws the most recent streamWindow points received from streamSource instead of a loaded cloud. */
+  void openStream()
+  {
+    if (failState)
+    {
+      return;
+    }
+    try
+    {
+      streamRing = std::make_unique<StreamRing>(streamSource, (std::size_t)streamWindow);
+    }
+    catch (std::exception const& e)
+    {
+      std::cout << "COULD NOT OPEN POINT STREAM" << std::endl;
+      std::cerr << e.what() << std::endl;
+      failState = true;
+      return;
+    }
+    pointCount = streamWindow;
+    streamReportTime = glfwGetTime();
+  }
+  bool getStreamCounters(StreamCounters& counters) const
+  {
+    if (!streamRing)
+    {
+      return false;
+    }
+    counters = streamRing->getCounters();
+    return true;
+  }
+  /* Scene draws share the point buffer and are issued with one indirect multi-draw. Each
+   * command's baseInstance selects its entry of a per-instance object index attribute, which
+   * indexes the transforms in a storage buffer (gl_DrawID would need GL 4.6). */
+  void loadScene()
+  {
+    struct SceneObject
+    {
+      glm::mat4 model;
+      glm::mat4 normalMatrix;
+      glm::vec4 objectColor;
+      glm::uvec4 points;
+    };
+    std::vector<GLuint> objectIDs;
+    std::vector<SceneObject> objects;
+    for (std::size_t i = 0; i < sceneDraws.size(); ++i)
+    {
+      SceneDraw const& draw = sceneDraws[i];
+      objectIDs.push_back((GLuint)i);
+      objects.push_back({ draw.model, glm::mat4(glm::transpose(glm::inverse(glm::mat3(draw.model)))), glm::vec4(.6f, .6f, .9f, draw.hasColor ? 1.f : 0.f),
+        glm::uvec4((GLuint)draw.first, (GLuint)draw.count, 0, 0) });
+    }
+    glGenBuffers(1, &sceneObjectIDs);
+    glBindBuffer(GL_ARRAY_BUFFER, sceneObjectIDs);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * objectIDs.size(), objectIDs.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(3);
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)0);
+    glVertexAttribDivisor(3, 1);
+    glGenBuffers(1, &sceneObjectBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sceneObjectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(SceneObject) * objects.size(), objects.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glGenBuffers(1, &sceneDrawBuffer);
+    uploadSceneCommands(1.f);
+  }
+  // Draws the leading fraction of every cloud; with shuffled points that is a uniform subsample of each.
+  void uploadSceneCommands(float fraction)
+  {
+    struct DrawCommand
+    {
+      GLuint count;
+      GLuint instanceCount;
+      GLuint first;
+      GLuint baseInstance;
+    };
+    std::vector<DrawCommand> commands;
+    for (std::size_t i = 0; i < sceneDraws.size(); ++i)
+    {
+      SceneDraw const& draw = sceneDraws[i];
+      GLuint const count = fraction < 1.f ? (GLuint)std::ceil(draw.count * fraction) : (GLuint)draw.count;
+      commands.push_back({ count, 1, (GLuint)draw.first, (GLuint)i });
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, sceneDrawBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawCommand) * commands.size(), commands.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    sceneFraction = fraction;
   }
   bool render()
   {
@@ -168,396 +775,1022 @@ public:
     {
       return false;
     }
-    glClearColor(1.f, 1.f, 1.f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    TraceZone zone("frame");
     processCamera();
-    illuminatePoints();
-    for (int i = 0; i < backgroundFillIters; ++i)
+    if (pickRequested)
+    {
+      pickRequested = false;
+      pickPoint();
+    }
+    if (filterToggleRequested || filterShiftRequested != 0)
     {
-      fillBackground();
+      updateFilter();
     }
-    for (int i = 0; i < occlusionFillIters; ++i)
+    drawFrame();
+    if (streamRing)
     {
-      fillOcclusion();
+      reportStream();
     }
-    smooth();
-    aliasing();
-    illustrateEffect();
+    traceBegin("swapBuffers");
     glfwSwapBuffers(window);
+    traceEnd();
+    traceBegin("pollEvents");
     glfwPollEvents();
+    traceEnd();
     return true;
   }
-private:
-  void aliasing()
+  bool renderPose(CameraPose const& pose)
   {
-    int nextBuffer = currBuffer ^ 1;
-    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer[nextBuffer]);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(aaHighProgram);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, positionTexture[currBuffer]);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normalTexture[currBuffer]);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, colorTexture[currBuffer]);
-    glBindVertexArray(fboVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
-    glClear(GL_DEPTH_BUFFER_BIT);
-    glUseProgram(aaLowProgram);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, positionTexture[currBuffer]);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normalTexture[currBuffer]);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, colorTexture[currBuffer]);
-    glBindVertexArray(fboVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    currBuffer = nextBuffer;
+    if (failState || (window && glfwWindowShouldClose(window)))
+    {
+      return false;
+    }
+    viewPos = pose.position;
+    cameraFront = glm::normalize(pose.front);
+    fov = pose.fov;
+    TraceZone zone("frame");
+    updateCamera();
+    drawFrame();
+    if (!headless)
+    {
+      traceBegin("swapBuffers");
+      glfwSwapBuffers(window);
+      traceEnd();
+      glfwPollEvents();
+    }
+    return true;
   }
-  bool assignShaderUniform(GLuint programID, GLint& locID, const GLchar* locName)
+  // Renders pose through tileProjection, a part of the pose's frustum, instead of the window's own.
+  bool renderTile(CameraPose const& pose, glm::mat4 const& tileProjection)
   {
-    locID = glGetUniformLocation(programID, locName);
-    if (locID < 0)
+    if (failState)
     {
-      failState = true;
-      std::cerr << "COULD NOT ASSIGN UNIFORM " << locName << std::endl;
+      return false;
     }
-    return locID >= 0;
+    viewPos = pose.position;
+    cameraFront = glm::normalize(pose.front);
+    fov = pose.fov;
+    TraceZone zone("tile");
+    updateCamera();
+    projection = tileProjection;
+    drawFrame();
+    return true;
   }
-  bool checkShaderCompile(GLuint shaderID, const char* shaderName)
+  void readPixels(std::vector<std::uint8_t>& pixels)
   {
-    GLint isCompiled = 0;
-    glGetShaderiv(shaderID, GL_COMPILE_STATUS, &isCompiled);
-    if (isCompiled == GL_FALSE)
+    pixels.resize((std::size_t)windowWidth * windowHeight * 3);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, outputBuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, windowWidth, windowHeight, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  }
+  // Batched readback: queue a copy of the output into a pixel buffer per slot, then map
+  // them once the whole batch is submitted so the GPU is only waited on once.
+  void queueReadback(std::size_t slot)
+  {
+    GLsizeiptr const size = (GLsizeiptr)windowWidth * windowHeight * 3;
+    while (readbackBuffers.size() <= slot)
     {
-      GLint maxLength = 0;
-      glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &maxLength);
-      std::string errorLog;
-      errorLog.resize(maxLength);
-      glGetShaderInfoLog(shaderID, maxLength, &maxLength, &errorLog[0]);
-      std::cout << shaderName << " FAILED TO COMPILE" << std::endl;
-      std::cerr << errorLog << std::endl;
-      failState = true;
+      GLuint buffer;
+      glGenBuffers(1, &buffer);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+      glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+      readbackBuffers.push_back(buffer);
     }
-    return isCompiled != GL_FALSE;
-  } 
-  void fillBackground()
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, outputBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[slot]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, windowWidth, windowHeight, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+  }
+  bool collectReadback(std::size_t slot, std::vector<std::uint8_t>& pixels)
   {
-    int nextBuffer = currBuffer ^ 1;
-    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer[nextBuffer]);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(backgroundProgram);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, positionTexture[currBuffer]);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normalTexture[currBuffer]);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, colorTexture[currBuffer]);
-    glBindVertexArray(fboVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    currBuffer = nextBuffer;
+    pixels.resize((std::size_t)windowWidth * windowHeight * 3);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[slot]);
+    void const* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)pixels.size(), GL_MAP_READ_BIT);
+    if (mapped)
+    {
+      std::memcpy(pixels.data(), mapped, pixels.size());
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return mapped != nullptr;
   }
-  void fillOcclusion()
+  GpuTimer* enablePassTimer()
   {
-    int nextBuffer = currBuffer ^ 1;
-    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer[nextBuffer]);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(occlusionProgram);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, positionTexture[currBuffer]);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normalTexture[currBuffer]);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, colorTexture[currBuffer]);
-    glBindVertexArray(fboVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    currBuffer = nextBuffer;
+    if (!passTimer)
+    {
+      passTimer = std::make_unique<GpuTimer>();
+    }
+    return passTimer.get();
   }
-  void illuminatePoints()
+  void enableCapture(VideoWriter& writer)
   {
-    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer[currBuffer]);
-    glClearColor(0.f, 0.f, 0.f, 0.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(pointProgram);
-    glUniformMatrix4fv(pointModelLoc, 1, GL_FALSE, &model[0][0]);
-    glUniformMatrix4fv(pointViewLoc, 1, GL_FALSE, &view[0][0]);
-    glUniformMatrix4fv(pointProjectionLoc, 1, GL_FALSE, &projection[0][0]);
-    glUniform3fv(pointLightPosLoc, 1, &viewPos[0]);
-    glUniform3fv(pointViewPosLoc, 1, &viewPos[0]);
-    glEnable(GL_DEPTH_TEST);
-    glUseProgram(pointProgram);
-    glBindVertexArray(pointVAO);
-    glDrawArrays(GL_POINTS, 0, pointCount);
-    glBindVertexArray(0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!failState)
+    {
+      frameCapture = std::make_unique<FrameCapture>(writer, windowWidth, windowHeight);
+    }
   }
-  void illustrateEffect()
+  void finishCapture()
   {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glClearColor(1.f, 1.f, 1.f, 1.f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(illustrateProgram);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, positionTexture[currBuffer]);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normalTexture[currBuffer]);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, colorTexture[currBuffer]);
-    glBindVertexArray(fboVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
+    if (frameCapture)
+    {
+      frameCapture->finish();
+    }
   }
-  void processCamera()
+  // While set, every frame composites the workers' point passes instead of drawing points.
+  void setCompositor(Compositor* workers)
   {
-    float currentFrame = (float)glfwGetTime();
-    deltaTime = currentFrame - lastFrame;
-    lastFrame = currentFrame;
-    processInput(window);
-    view = glm::lookAt(viewPos, viewPos + cameraFront, cameraUp);
-    projection = glm::perspective(glm::radians(fov), (float)windowWidth / (float)windowHeight, .01f, 100.f);
+    compositor = workers;
   }
-  void setupShaders()
+  bool hasFailed() const
   {
-    /* Processing Buffers */
+    return failState;
+  }
+  void invalidateFilter()
+  {
+    filterDirty = true;
+  }
+  // Points kept by the last filter compaction, or -1 when the filter is off.
+  std::int64_t getFilteredPointCount()
+  {
+    if (!usePointFilter() || filterDirty)
     {
-      glGenFramebuffers(2, &gBuffer[0]);
-      glGenTextures(2, &positionTexture[0]);
-      glGenTextures(2, &normalTexture[0]);
-      glGenTextures(2, &colorTexture[0]);
-      glGenRenderbuffers(2, &depthRenderBuffer[0]);
-      for (int i = 0; i < 2; ++i)
-      {
-        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer[i]);
-        glBindTexture(GL_TEXTURE_2D, positionTexture[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, windowWidth, windowHeight, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, positionTexture[i], 0);
-        glBindTexture(GL_TEXTURE_2D, normalTexture[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, windowWidth, windowHeight, 0, GL_RGB, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture[i], 0);
-        glBindTexture(GL_TEXTURE_2D, colorTexture[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, windowWidth, windowHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, colorTexture[i], 0);
-        GLuint attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-        glDrawBuffers(3, attachments);
-        glBindRenderbuffer(GL_RENDERBUFFER, depthRenderBuffer[i]);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, windowWidth, windowHeight);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderBuffer[i]);
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        {
-          std::cerr << "PROCESSING BUFFER COULD NOT BE CREATED" << std::endl;
-          failState = true;
-          return;
-        }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-      }
-      glGenVertexArrays(1, &fboVAO);
-      glBindVertexArray(fboVAO);
-      glGenBuffers(1, &fboVBO);
-      glBindBuffer(GL_ARRAY_BUFFER, fboVBO);
-      float const quadVertices[] = { -1.0f, 1.0f, 0.0f, 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 1.0f, -1.0f, 1.0f, 0.0f,
-
-        -1.0f, 1.0f, 0.0f, 1.0f, 1.0f, -1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f };
-      glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
-      glEnableVertexAttribArray(0);
-      glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
-      glEnableVertexAttribArray(1);
-      glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
-      glBindVertexArray(0);
+      return -1;
     }
-
-    /* Point Vertex Shader */
+    GLuint count = 0;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, filterCommandBuffer);
+    glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(count), &count);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    return count;
+  }
+  // Points drawn by each frame's early and late pass together, oldest frame first.
+  std::vector<std::uint32_t> const& getChunkPointsDrawn()
+  {
+    collectCullStatistics();
+    return chunkPointsDrawn;
+  }
+  GLsizei getChunkCount() const
+  {
+    return chunkCount;
+  }
+  // Compositing worker: only the point pass, read back exactly as it sits in the G-buffer.
+  bool renderPlanes(CameraPose const& pose, GBufferPlanes& planes)
+  {
+    if (failState)
     {
-      const GLchar* pointVertText = pointStride > 6 ? R"foo(
-#version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec3 aColor;
-
-out vec3 FragPos;
-out vec3 Normal;
-out vec3 Color;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main()
-{
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
-    Color = aColor;
-    gl_Position = projection * view * vec4(FragPos, 1.0);
-}
-)foo" : R"foo(
-#version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
-
-out vec3 FragPos;
-out vec3 Normal;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main()
-{
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
-    
-    gl_Position = projection * view * vec4(FragPos, 1.0);
-}
-)foo";
-      pointVertShader = glCreateShader(GL_VERTEX_SHADER);
-      glShaderSource(pointVertShader, 1, &pointVertText, 0);
-      glCompileShader(pointVertShader);
-      if (!checkShaderCompile(pointVertShader, "ILLUMINATE VERTEX"))
-      {
-        return;
-      }
+      return false;
     }
-    
-    /* Point Fragment Shader*/
+    viewPos = pose.position;
+    cameraFront = glm::normalize(pose.front);
+    fov = pose.fov;
+    updateCamera();
+    pointsDrawn = pointCount;
+    renderGraph->reset(windowWidth, windowHeight);
+    GBufferImages const points = createGBuffer();
+    RenderGraph::Resource const depth = renderGraph->createImage(GL_DEPTH_COMPONENT24);
+    addPointPass("illuminate", points, depth, -1);
+    markOutput(points);
+    renderGraph->markOutput(depth);
+    if (!executeGraph())
     {
-      const char* pointFragText = pointStride > 6 ? R"foo(
-#version 330 core
-
-in vec3 Normal;  
-in vec3 FragPos;
-in vec3 Color;
-
-layout (location = 0) out vec4 positionTexture;
-layout (location = 1) out vec3 normalTexture;
-layout (location = 2) out vec4 colorTexture;
-uniform vec3 lightPos; 
-uniform vec3 viewPos;
-
-void main()
-{
-    vec3 lightColor = vec3(.1,.1,.1);
-    vec3 objectColor = Color;
-    // ambient
-    float ambientStrength = 0.1;
-    vec3 ambient = ambientStrength * lightColor;
-  	
-    // diffuse 
-    vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(lightPos - FragPos);
-    if(dot(lightDir,norm) < 0.0) discard;
-    float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * lightColor;
-    
-    // specular
-    float specularStrength = 0.5;
-    vec3 viewDir = normalize(viewPos - FragPos);
-    vec3 reflectDir = reflect(-lightDir, norm);  
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-    vec3 specular = specularStrength * spec * lightColor;  
-    
-    float zFar = 100.0;  
-    normalTexture = Normal;
-    colorTexture.rgba = vec4((ambient + diffuse + specular) * objectColor, 1.0);
-    positionTexture.xyz = FragPos;
-    positionTexture.a =  distance(FragPos, viewPos) / zFar;
-} 
-)foo" : R"foo(
-#version 330 core
-
-in vec3 Normal;  
-in vec3 FragPos;  
-
-layout (location = 0) out vec4 positionTexture;
-layout (location = 1) out vec3 normalTexture;
-layout (location = 2) out vec4 colorTexture;
-uniform vec3 lightPos; 
-uniform vec3 viewPos;
-
-void main()
-{
-    vec3 lightColor = vec3(1.0,1.0,1.0);
-    vec3 objectColor = vec3(.6,.6,.9);
-    // ambient
-    float ambientStrength = 0.1;
-    vec3 ambient = ambientStrength * lightColor;
-  	
-    // diffuse 
-    vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(lightPos - FragPos);
-    if(dot(lightDir,norm) < 0.0) discard;
-    float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * lightColor;
-    
-    // specular
-    float specularStrength = 0.5;
-    vec3 viewDir = normalize(viewPos - FragPos);
-    vec3 reflectDir = reflect(-lightDir, norm);  
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-    vec3 specular = specularStrength * spec * lightColor;  
-    
-    float zFar = 100.0;
-    normalTexture = Normal;
-    colorTexture.rgba = vec4((ambient + diffuse + specular) * objectColor, 1.0);
-    positionTexture.xyz = FragPos;
-    positionTexture.a =  distance(FragPos, viewPos) / zFar;
-} 
-)foo";
-      pointFragShader = glCreateShader(GL_FRAGMENT_SHADER);
-      glShaderSource(pointFragShader, 1, &pointFragText, 0);
-      glCompileShader(pointFragShader);
-      if (!checkShaderCompile(pointFragShader, "ILLUMINATE FRAGMENT"))
-      {
-        return;
-      }
+      return false;
     }
-
-    /* Point Program */
+    planes.resize((std::size_t)windowWidth * windowHeight);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, renderGraph->framebuffer({ points.position, points.normal, points.color }, depth));
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, windowWidth, windowHeight, GL_RGBA, GL_UNSIGNED_BYTE, planes.position.data());
+    glReadBuffer(GL_COLOR_ATTACHMENT1);
+    glReadPixels(0, 0, windowWidth, windowHeight, GL_RGB, GL_HALF_FLOAT, planes.normal.data());
+    glReadBuffer(GL_COLOR_ATTACHMENT2);
+    glReadPixels(0, 0, windowWidth, windowHeight, GL_RGBA, GL_UNSIGNED_BYTE, planes.color.data());
+    glReadPixels(0, 0, windowWidth, windowHeight, GL_DEPTH_COMPONENT, GL_FLOAT, planes.depth.data());
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    return true;
+  }
+  RenderGraph const& getRenderGraph() const
+  {
+    return *renderGraph;
+  }
+private:
+  // One version of the G-buffer's attachments in the frame's render graph.
+  struct GBufferImages
+  {
+    RenderGraph::Resource position;
+    RenderGraph::Resource normal;
+    RenderGraph::Resource color;
+  };
+  // The high-pass writes every pixel, then the low-pass puts the filled pixels back.
+  void aliasing(GBufferImages const& source)
+  {
+    drawScreenPass(aaHighProgram, source);
+    drawScreenPass(aaLowProgram, source);
+  }
+  char const* passName(std::vector<char const*>& names, char const* prefix, int iteration)
+  {
+    // Interned on first use, since server requests can change the iteration counts per frame.
+    while ((int)names.size() <= iteration)
     {
-      pointProgram = glCreateProgram();
-      glAttachShader(pointProgram, pointVertShader);
-      glAttachShader(pointProgram, pointFragShader);
-      glLinkProgram(pointProgram);
-      glUseProgram(pointProgram);
-      if (!assignShaderUniform(pointProgram, pointModelLoc, "model"))
-      {
-        return;
-      }
-      if (!assignShaderUniform(pointProgram, pointViewLoc, "view"))
+      names.push_back(traceIntern(prefix + std::to_string(names.size())));
+    }
+    return names[iteration];
+  }
+  void beginPass(char const* pass)
+  {
+    if (passTimer)
+    {
+      passTimer->begin(pass);
+    }
+    if (gpuTimeline)
+    {
+      gpuTimeline->begin(pass);
+    }
+    if (traceEnabled.load(std::memory_order_relaxed))
+    {
+      currentPass = pass;
+      passStart = traceNow();
+    }
+  }
+  void endPass()
+  {
+    if (passTimer)
+    {
+      passTimer->end();
+    }
+    if (gpuTimeline)
+    {
+      gpuTimeline->end();
+    }
+    if (currentPass)
+    {
+      std::int64_t const passEnd = traceNow();
+      traceRecord(currentPass, passStart, passEnd);
+      cpuFrame.push_back({ currentPass, (passStart - frameStart) * 1e-6, (passEnd - passStart) * 1e-6 });
+      currentPass = nullptr;
+    }
+  }
+  void drawTimelineRow(std::vector<TimelineZone> const& zones, int y, float pixelsPerMillisecond)
+  {
+    static float const palette[6][3] = {
+      { .90f, .30f, .25f }, { .95f, .65f, .20f }, { .35f, .75f, .35f },
+      { .25f, .55f, .90f }, { .60f, .40f, .85f }, { .30f, .80f, .80f } };
+    for (std::size_t i = 0; i < zones.size(); ++i)
+    {
+      float const* color = palette[i % 6];
+      int const x = (int)(zones[i].startMilliseconds * pixelsPerMillisecond);
+      int const width = std::max(1, (int)(zones[i].durationMilliseconds * pixelsPerMillisecond));
+      glScissor(x, y, width, 10);
+      glClearColor(color[0], color[1], color[2], 1.f);
+      glClear(GL_COLOR_BUFFER_BIT);
+    }
+  }
+  void drawTraceOverlay()
+  {
+    // One bar per pass, GPU timeline on top and CPU submission below, 33.3 ms across the window.
+    float const pixelsPerMillisecond = windowWidth / 33.3f;
+    glBindFramebuffer(GL_FRAMEBUFFER, outputBuffer);
+    glEnable(GL_SCISSOR_TEST);
+    drawTimelineRow(gpuTimeline->getLastFrame(), windowHeight - 12, pixelsPerMillisecond);
+    drawTimelineRow(cpuFrame, windowHeight - 24, pixelsPerMillisecond);
+    glScissor((int)(16.67f * pixelsPerMillisecond), windowHeight - 26, 1, 26);
+    glClearColor(0.f, 0.f, 0.f, 1.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+    if (frameIndex % 30 == 0)
+    {
+      double gpuTotal = 0.0;
+      for (TimelineZone const& zone : gpuTimeline->getLastFrame())
       {
-        return;
+        gpuTotal += zone.durationMilliseconds;
       }
-      if (!assignShaderUniform(pointProgram, pointProjectionLoc, "projection"))
+      double cpuTotal = 0.0;
+      for (TimelineZone const& zone : cpuFrame)
       {
-        return;
+        cpuTotal += zone.durationMilliseconds;
       }
-      if (!assignShaderUniform(pointProgram, pointLightPosLoc, "lightPos"))
+      std::ostringstream title;
+      title << std::fixed << std::setprecision(2) << "Rosenthal-Linsen-Lars-2008 | gpu " << gpuTotal << " ms | cpu " << cpuTotal << " ms";
+      glfwSetWindowTitle(window, title.str().c_str());
+    }
+  }
+  void reportStream()
+  {
+    // Once a second, unless the trace overlay is using the title.
+    double const now = glfwGetTime();
+    if (now - streamReportTime < 1.0 || (gpuTimeline && traceOverlay))
+    {
+      return;
+    }
+    std::uint64_t const written = streamRing->getPointsWritten();
+    StreamCounters const counters = streamRing->getCounters();
+    std::ostringstream title;
+    title << std::fixed << std::setprecision(2) << "Rosenthal-Linsen-Lars-2008 | stream " << (written - streamReportPoints) / (now - streamReportTime) / 1e6
+      << " Mpoints/s | " << std::min<std::uint64_t>(written, streamWindow) << " points | " << counters.droppedPackets << " dropped | " << counters.malformedPackets << " malformed";
+    glfwSetWindowTitle(window, title.str().c_str());
+    streamReportTime = now;
+    streamReportPoints = written;
+  }
+  // Point indices share a 32-bit texel with an 8-bit depth, and 0 marks an empty pixel.
+  static constexpr int maxVisibilityPoints = (1 << 24) - 1;
+  // Filter blocks are dispatched as a 2D grid; the guaranteed limit per dimension is 65535.
+  static constexpr GLuint maxFilterGroups = 32768;
+  bool useVisibilityBuffer() const
+  {
+    return visibilityBuffer && !streamRing && pointCount <= maxVisibilityPoints;
+  }
+  bool useOcclusionCulling() const
+  {
+    return chunkCount > 0 && !streamRing && sceneDraws.empty();
+  }
+  // Filters index into one cloud's points, so scenes and streams always draw everything.
+  bool usePointFilter() const
+  {
+    return filterCountProgram && filterActive && sceneDraws.empty() && !streamRing && pointCount > 0;
+  }
+  void drawFrame()
+  {
+    cpuFrame.clear();
+    frameStart = traceNow();
+    if (passTimer)
+    {
+      passTimer->beginFrame();
+    }
+    if (gpuTimeline)
+    {
+      gpuTimeline->beginFrame();
+    }
+    // While the camera moves only the point budget is drawn; the subsample's point spacing grows
+    // by 1/sqrt(fraction), so the fills get that many extra iterations to close the wider gaps.
+    bool const moving = view != lastView || projection != lastProjection;
+    lastView = view;
+    lastProjection = projection;
+    pointsDrawn = moving && pointBudget > 0 && pointBudget < pointCount && !streamRing ? pointBudget : pointCount;
+    float const fraction = pointCount > 0 ? (float)pointsDrawn / pointCount : 1.f;
+    int const extraFillIters = std::min(16, (int)std::ceil(1.f / std::sqrt(fraction)) - 1);
+    int const backgroundIters = backgroundFillIters + extraFillIters;
+    int const occlusionIters = occlusionFillIters + extraFillIters;
+    bool const visibilityPass = useVisibilityBuffer();
+    renderGraph->reset(windowWidth, windowHeight);
+    if (filterDirty && usePointFilter())
+    {
+      renderGraph->addPass("filter", [this] { compactPoints(); }).keep();
+    }
+    GBufferImages current = {};
+    RenderGraph::Resource visibility = -1;
+    if (compositor)
+    {
+      current = createGBuffer();
+      renderGraph->addPass("composite", [this, current] { compositePlanes(current); })
+        .write(current.position).write(current.normal).write(current.color);
+    }
+    else if (useOcclusionCulling())
+    {
+      current = createGBuffer();
+      RenderGraph::Resource const depth = renderGraph->createImage(GL_DEPTH_COMPONENT24);
+      RenderGraph::Resource const commands = renderGraph->importResource();
+      RenderGraph::Resource const pyramid = renderGraph->importResource();
+      renderGraph->addPass("cull_early", [this] { cullChunks(0); }).write(commands);
+      addPointPass("illuminate", current, depth, 0).read(commands);
+      renderGraph->addPass("depth_pyramid", [this, current] { buildDepthPyramid(current.position); }).read(current.position).write(pyramid);
+      // The late pass also marks the chunks the next frame's early pass draws.
+      renderGraph->addPass("cull_late", [this] { cullChunks(1); }).read(pyramid).write(commands).keep();
+      addPointPass("illuminate_late", current, depth, 1).read(commands);
+    }
+    else if (visibilityPass)
+    {
+      visibility = renderGraph->createImage(GL_R32UI);
+      renderGraph->addPass("illuminate", [this] { writeVisibility(); })
+        .color(0, visibility, false).depth(renderGraph->createImage(GL_DEPTH_COMPONENT24), false);
+    }
+    else
+    {
+      current = createGBuffer();
+      addPointPass("illuminate", current, renderGraph->createImage(GL_DEPTH_COMPONENT24), -1);
+    }
+    for (int i = 0; i < backgroundIters; ++i)
+    {
+      addFillPass(passName(backgroundPassNames, "background_", i), backgroundProgram, backgroundVisibilityProgram, current, visibility);
+    }
+    for (int i = 0; i < occlusionIters; ++i)
+    {
+      addFillPass(passName(occlusionPassNames, "occlusion_", i), occlusionProgram, occlusionVisibilityProgram, current, visibility);
+    }
+    if (visibilityPass)
+    {
+      current = createGBuffer();
+      RenderGraph::PassBuilder pass = renderGraph->addPass("resolve", [this, visibility] { resolveVisibility(visibility); });
+      pass.read(visibility);
+      writeGBuffer(pass, current, false);
+    }
+    if (normalEstimation)
+    {
+      // Only the normals change, so the pass writes only them.
+      GBufferImages const estimated = { current.position, renderGraph->createImage(GL_RGB16F), current.color };
+      renderGraph->addPass("normals", [this, current] { estimateNormals(current); })
+        .read(current.position).color(1, estimated.normal, true);
+      current = estimated;
+    }
+    if (smoothSigma > 0.f)
+    {
+      current = addScreenPass("smooth_x", current, [this, current] { smoothSeparable(current, 1, 0); });
+      current = addScreenPass("smooth_y", current, [this, current] { smoothSeparable(current, 0, 1); });
+    }
+    else if (!fusedPost)
+    {
+      current = addScreenPass("smooth", current, [this, current] { drawScreenPass(smoothProgram, current); });
+    }
+    float const white[4] = { 1.f, 1.f, 1.f, 1.f };
+    RenderGraph::Resource const output = renderGraph->importFramebuffer(outputBuffer, white);
+    renderGraph->markOutput(output);
+    if (fusedPost)
+    {
+      RenderGraph::Resource const fused = renderGraph->createImage(GL_RGBA8);
+      RenderGraph::PassBuilder pass = renderGraph->addPass("post", [this, current, fused] { fusedPostProcess(current, fused); });
+      readGBuffer(pass, current);
+      pass.write(fused).color(0, output, true);
+    }
+    else
+    {
+      // Anti-aliasing only changes empty pixels, which only the feature lines look at; without them it is culled.
+      GBufferImages const aliased = addScreenPass("aliasing", current, [this, current] { aliasing(current); });
+      if (illustration)
       {
-        return;
+        current = aliased;
       }
-      if (!assignShaderUniform(pointProgram, pointViewPosLoc, "viewPos"))
+      if (deferredLighting)
       {
-        return;
+        RenderGraph::Resource const tileLights = renderGraph->importResource();
+        if (!pointLights.empty())
+        {
+          renderGraph->addPass("cull_lights", [this, current] { cullLights(current.position); }).read(current.position).write(tileLights);
+        }
+        GBufferImages const lit = createGBuffer();
+        RenderGraph::PassBuilder pass = renderGraph->addPass("lighting", [this, current] { lightPixels(current); });
+        readGBuffer(pass, current);
+        pass.read(tileLights);
+        writeGBuffer(pass, lit, true);
+        current = lit;
       }
+      RenderGraph::PassBuilder pass = renderGraph->addPass("illustrate", [this, current] { drawScreenPass(illustrateProgram, current); });
+      readGBuffer(pass, current);
+      pass.color(0, output, false);
     }
-
-    /* Background Pixel Vertex Shader */
+    executeGraph();
+    if (passTimer)
     {
-      const GLchar* backgroundVertText = R"foo(
-#version 330 core
-
-layout (location = 0) in vec2 aPos;
+      passTimer->endFrame();
+    }
+    if (frameCapture)
+    {
+      frameCapture->capture(outputBuffer);
+    }
+    if (gpuTimeline && traceOverlay && !headless)
+    {
+      drawTraceOverlay();
+    }
+    ++frameIndex;
+    if (traceEnabled && (traceDumpRequested || frameIndex == traceFrames))
+    {
+      traceDumpRequested = false;
+      dumpTrace();
+    }
+  }
+  GBufferImages createGBuffer()
+  {
+    // Estimated normals take differences of neighbouring positions and deferred lighting lights them, both at full precision.
+    return { renderGraph->createImage(normalEstimation || deferredLighting ? GL_RGBA32F : GL_RGBA8), renderGraph->createImage(GL_RGB16F), renderGraph->createImage(GL_RGBA8) };
+  }
+  void markOutput(GBufferImages const& images)
+  {
+    renderGraph->markOutput(images.position);
+    renderGraph->markOutput(images.normal);
+    renderGraph->markOutput(images.color);
+  }
+  void readGBuffer(RenderGraph::PassBuilder pass, GBufferImages const& source)
+  {
+    pass.read(source.position).read(source.normal).read(source.color);
+  }
+  void writeGBuffer(RenderGraph::PassBuilder pass, GBufferImages const& target, bool coversAll)
+  {
+    pass.color(0, target.position, coversAll).color(1, target.normal, coversAll).color(2, target.color, coversAll);
+  }
+  // The point pass of the given occlusion culling phase, or of all points at -1; the late phase adds to the early one's targets.
+  RenderGraph::PassBuilder addPointPass(char const* name, GBufferImages const& target, RenderGraph::Resource depth, int phase)
+  {
+    RenderGraph::PassBuilder pass = renderGraph->addPass(name, [this, phase]
+    {
+      cullPhase = phase;
+      illuminatePoints();
+      cullPhase = -1;
+    });
+    writeGBuffer(pass, target, false);
+    pass.depth(depth, false);
+    return pass;
+  }
+  // A screen pass from source that writes every pixel of a new G-buffer, which it returns.
+  GBufferImages addScreenPass(char const* name, GBufferImages const& source, std::function<void()> run)
+  {
+    GBufferImages const target = createGBuffer();
+    RenderGraph::PassBuilder pass = renderGraph->addPass(name, std::move(run));
+    readGBuffer(pass, source);
+    writeGBuffer(pass, target, true);
+    return target;
+  }
+  // One fill iteration, on the packed indices while visibility is set and on the G-buffer otherwise.
+  void addFillPass(char const* name, GLuint program, GLuint visibilityProgram, GBufferImages& current, RenderGraph::Resource& visibility)
+  {
+    if (visibility < 0)
+    {
+      GBufferImages const source = current;
+      current = addScreenPass(name, source, [this, program, source] { drawScreenPass(program, source); });
+      return;
+    }
+    RenderGraph::Resource const source = visibility;
+    visibility = renderGraph->createImage(GL_R32UI);
+    renderGraph->addPass(name, [this, visibilityProgram, source] { fillVisibility(visibilityProgram, source); })
+      .read(source).color(0, visibility, true);
+  }
+  bool executeGraph()
+  {
+    if (renderGraph->execute([this](char const* pass) { beginPass(pass); }, [this] { endPass(); }))
+    {
+      return true;
+    }
+    std::cerr << "PROCESSING BUFFER COULD NOT BE CREATED" << std::endl;
+    failState = true;
+    return false;
+  }
+  void bindGBuffer(GBufferImages const& source)
+  {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, renderGraph->texture(source.position));
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, renderGraph->texture(source.normal));
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, renderGraph->texture(source.color));
+  }
+  // Draws the screen quad with program, sampling source; the render graph has bound and cleared the targets.
+  void drawScreenPass(GLuint program, GBufferImages const& source)
+  {
+    glUseProgram(program);
+    bindGBuffer(source);
+    glBindVertexArray(fboVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindVertexArray(0);
+  }
+  bool assignShaderUniform(GLuint programID, GLint& locID, const GLchar* locName)
+  {
+    locID = glGetUniformLocation(programID, locName);
+    if (locID < 0)
+    {
+      failState = true;
+      std::cerr << "COULD NOT ASSIGN UNIFORM " << locName << std::endl;
+    }
+    return locID >= 0;
+  }
+  bool checkShaderCompile(GLuint shaderID, const char* shaderName)
+  {
+    GLint isCompiled = 0;
+    glGetShaderiv(shaderID, GL_COMPILE_STATUS, &isCompiled);
+    if (isCompiled == GL_FALSE)
+    {
+      GLint maxLength = 0;
+      glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &maxLength);
+      std::string errorLog;
+      errorLog.resize(maxLength);
+      glGetShaderInfoLog(shaderID, maxLength, &maxLength, &errorLog[0]);
+      std::cout << shaderName << " FAILED TO COMPILE" << std::endl;
+      std::cerr << errorLog << std::endl;
+      failState = true;
+    }
+    return isCompiled != GL_FALSE;
+  } 
+  // The fills on the visibility buffer copy the packed index of the neighbour the G-buffer fills would copy.
+  void fillVisibility(GLuint program, RenderGraph::Resource source)
+  {
+    glUseProgram(program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, renderGraph->texture(source));
+    glBindVertexArray(fboVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindVertexArray(0);
+  }
+  // Shades every filled pixel's point into the G-buffer, which the smoothing passes read as usual.
+  void resolveVisibility(RenderGraph::Resource visibility)
+  {
+    glUseProgram(resolveProgram);
+    glUniformMatrix4fv(resolveModelLoc, 1, GL_FALSE, &model[0][0]);
+    glUniform3fv(resolveLightPosLoc, 1, &viewPos[0]);
+    glUniform3fv(resolveViewPosLoc, 1, &viewPos[0]);
+    glUniform1i(resolvePointStrideLoc, pointStride);
+    glUniform1i(resolveSceneObjectCountLoc, (GLint)sceneDraws.size());
+    glUniform1i(resolveDeferredLightingLoc, deferredLighting);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, renderGraph->texture(visibility));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sceneObjectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, pointVBO);
+    glBindVertexArray(fboVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindVertexArray(0);
+  }
+  /* Uploads the bounds of the point index's chunks. Every chunk starts out hidden, so the first
+   * frame's early pass draws nothing and its late pass draws every chunk in view. */
+  void uploadChunks()
+  {
+    if (!cullProgram || !pointIndex)
+    {
+      return;
+    }
+    struct ChunkBounds
+    {
+      glm::vec4 lower;
+      glm::vec4 upper;
+      glm::uvec4 points;
+    };
+    std::vector<PointIndex::Chunk> const chunks = pointIndex->chunks(cullChunkPoints);
+    std::vector<ChunkBounds> bounds(chunks.size());
+    for (std::size_t i = 0; i < chunks.size(); ++i)
+    {
+      bounds[i] = { glm::vec4(chunks[i].lower, 0.f), glm::vec4(chunks[i].upper, 0.f), glm::uvec4((GLuint)chunks[i].first, (GLuint)chunks[i].count, 0u, 0u) };
+    }
+    chunkCount = (GLsizei)chunks.size();
+    glDeleteBuffers(1, &chunkBuffer);
+    glDeleteBuffers(1, &chunkVisibleBuffer);
+    glDeleteBuffers(1, &chunkCommandBuffer);
+    glGenBuffers(1, &chunkBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, chunkBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(ChunkBounds) * std::max<std::size_t>(bounds.size(), 1), bounds.data(), GL_STATIC_DRAW);
+    std::vector<GLuint> const hidden(std::max<std::size_t>(bounds.size(), 1), 0u);
+    glGenBuffers(1, &chunkVisibleBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, chunkVisibleBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * hidden.size(), hidden.data(), GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &chunkCommandBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, chunkCommandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 8 * sizeof(GLuint) * hidden.size(), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  }
+  // Writes the early (phase 0) or late (phase 1) draw commands.
+  void cullChunks(int phase)
+  {
+    if (phase == 0)
+    {
+      // The counts are only read back for benchmarks, a frame late, when the GPU is done with them.
+      if (passTimer)
+      {
+        collectCullStatistics();
+        cullStatisticsPending = true;
+      }
+      GLuint const zero[2] = { 0u, 0u };
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, chunkStatisticsBuffer);
+      glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), zero);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+    glm::mat4 const viewProjection = projection * view;
+    glUseProgram(cullProgram);
+    glUniformMatrix4fv(cullModelLoc, 1, GL_FALSE, &model[0][0]);
+    glUniformMatrix4fv(cullViewProjectionLoc, 1, GL_FALSE, &viewProjection[0][0]);
+    glUniform3fv(cullViewPosLoc, 1, &viewPos[0]);
+    glUniform1i(cullPhaseLoc, phase);
+    glUniform1i(cullChunkCountLoc, chunkCount);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, depthPyramid);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, chunkBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, chunkVisibleBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, chunkCommandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, chunkStatisticsBuffer);
+    glDispatchCompute((GLuint)(chunkCount + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+  }
+  // Farthest depth of the early pass's points per pyramid texel, level 0 at full resolution.
+  void buildDepthPyramid(RenderGraph::Resource positions)
+  {
+    glUseProgram(pyramidBaseProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, renderGraph->texture(positions));
+    glBindImageTexture(0, depthPyramid, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glDispatchCompute((windowWidth + 15) / 16, (windowHeight + 15) / 16, 1);
+    glUseProgram(pyramidReduceProgram);
+    for (int level = 1; level < pyramidLevels; ++level)
+    {
+      glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+      int const width = std::max(1, windowWidth >> level);
+      int const height = std::max(1, windowHeight >> level);
+      glBindImageTexture(0, depthPyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+      glBindImageTexture(1, depthPyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+      glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  }
+  void collectCullStatistics()
+  {
+    if (!cullStatisticsPending)
+    {
+      return;
+    }
+    cullStatisticsPending = false;
+    GLuint drawn[2] = { 0u, 0u };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, chunkStatisticsBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(drawn), drawn);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    chunkPointsDrawn.push_back(drawn[0] + drawn[1]);
+  }
+  /* Compacts the indices of the points passing the filter into filterElementBuffer: every block of
+   * 256 points counts its survivors, one workgroup scans the counts into block offsets and writes
+   * the draw commands, then every block writes its survivors' indices in order from its offset. */
+  void compactPoints()
+  {
+    filterDirty = false;
+    struct FilterParameters
+    {
+      glm::vec4 clipLower;
+      glm::vec4 clipUpper;
+      glm::vec4 band;
+      glm::vec4 colorLower;
+      glm::vec4 colorUpper;
+      glm::vec4 sliceNormal;
+      glm::vec4 slice;
+      glm::vec4 budget;
+      glm::uvec4 pointLayout;
+    };
+    FilterParameters parameters;
+    parameters.clipLower = glm::vec4(pointFilter.clipLower, pointFilter.clip ? 1.f : 0.f);
+    parameters.clipUpper = glm::vec4(pointFilter.clipUpper, 0.f);
+    parameters.band = glm::vec4(pointFilter.bandLower, pointFilter.bandUpper, pointFilter.band ? 1.f : 0.f, 0.f);
+    parameters.colorLower = glm::vec4(pointFilter.colorLower, pointFilter.colorRange ? 1.f : 0.f);
+    parameters.colorUpper = glm::vec4(pointFilter.colorUpper, 0.f);
+    parameters.sliceNormal = glm::vec4(pointFilter.sliceNormal, pointFilter.slice ? 1.f : 0.f);
+    parameters.slice = glm::vec4(pointFilter.sliceLower, pointFilter.sliceUpper, 0.f, 0.f);
+    parameters.budget = glm::vec4(pointBudget > 0 && pointBudget < pointCount ? (float)pointBudget / pointCount : 1.f, 0.f, 0.f, 0.f);
+    parameters.pointLayout = glm::uvec4((GLuint)pointCount, (GLuint)pointStride, 0u, 0u);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, filterParameterBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(parameters), &parameters);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    GLuint const blocks = (GLuint)(pointCount + 255) / 256;
+    GLuint const groupsX = std::min<GLuint>(blocks, maxFilterGroups);
+    GLuint const groupsY = (blocks + groupsX - 1) / groupsX;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, filterParameterBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, pointVBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, filterBlockBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, filterElementBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, filterCommandBuffer);
+    glUseProgram(filterCountProgram);
+    glDispatchCompute(groupsX, groupsY, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUseProgram(filterScanProgram);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUseProgram(filterScatterProgram);
+    glDispatchCompute(groupsX, groupsY, 1);
+    glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    if (filterReport)
+    {
+      filterReport = false;
+      std::cout << "FILTER KEEPS " << getFilteredPointCount() << " OF " << pointCount << " POINTS" << std::endl;
+    }
+  }
+  // F turns the filter on and off, [ and ] move the height band and the slice by a tenth of their width.
+  void updateFilter()
+  {
+    if (filterToggleRequested)
+    {
+      filterActive = !filterActive;
+      std::cout << (filterActive ? "FILTER ON" : "FILTER OFF") << std::endl;
+    }
+    float const bandShift = .1f * filterShiftRequested * (pointFilter.bandUpper - pointFilter.bandLower);
+    float const sliceShift = .1f * filterShiftRequested * (pointFilter.sliceUpper - pointFilter.sliceLower);
+    pointFilter.bandLower += bandShift;
+    pointFilter.bandUpper += bandShift;
+    pointFilter.sliceLower += sliceShift;
+    pointFilter.sliceUpper += sliceShift;
+    filterDirty = filterDirty || filterShiftRequested != 0;
+    filterReport = filterActive;
+    filterToggleRequested = false;
+    filterShiftRequested = 0;
+  }
+  void resizeFilter()
+  {
+    GLuint const blocks = (GLuint)(pointCount + 255) / 256;
+    glDeleteBuffers(1, &filterBlockBuffer);
+    glDeleteBuffers(1, &filterElementBuffer);
+    glGenBuffers(1, &filterBlockBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, filterBlockBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * std::max<GLuint>(blocks, 1), nullptr, GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &filterElementBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, filterElementBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * std::max(pointCount, 1), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    filterDirty = true;
+  }
+  // Marks the --lights reaching each tile's filled pixels, for lightPixels to loop over.
+  void cullLights(RenderGraph::Resource positions)
+  {
+    glUseProgram(lightCullProgram);
+    glUniform1i(lightCullLightCountLoc, (GLint)pointLights.size());
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, renderGraph->texture(positions));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, lightBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, tileLightBuffer);
+    glDispatchCompute((windowWidth + 15) / 16, (windowHeight + 15) / 16, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  }
+  void lightPixels(GBufferImages const& source)
+  {
+    glUseProgram(lightingProgram);
+    glUniform1i(lightingLightCountLoc, (GLint)pointLights.size());
+    glUniform3fv(lightingViewPosLoc, 1, &viewPos[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, lightBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, tileLightBuffer);
+    drawScreenPass(lightingProgram, source);
+  }
+  void illuminatePoints()
+  {
+    glUseProgram(pointProgram);
+    glUniform1i(pointDeferredLightingLoc, deferredLighting);
+    glUniform1i(pointEstimatedNormalsLoc, normalEstimation);
+    drawPoints(pointModelLoc, pointViewLoc, pointProjectionLoc, pointLightPosLoc, pointViewPosLoc, pointSplatScaleLoc);
+  }
+  /* Picks the point along the view direction, through the window's centre, within pickTolerance
+   * pixels, and reports its neighbourhood and its distance to the previous pick. */
+  void pickPoint()
+  {
+    if (!pointIndex)
+    {
+      return;
+    }
+    TraceZone zone("pickPoint");
+    auto const start = std::chrono::steady_clock::now();
+    float const tolerance = pickTolerance * 2.f * std::tan(glm::radians(fov) * .5f) / windowHeight;
+    std::int64_t const picked = pointIndex->pick(viewPos, cameraFront, tolerance);
+    if (picked < 0)
+    {
+      std::cout << "NO POINT AT WINDOW CENTRE" << std::endl;
+      return;
+    }
+    glm::vec3 const position = pointIndex->position((std::size_t)picked);
+    // Mean distance to the nearest neighbours, and the points a pick at this depth could have hit.
+    std::vector<std::size_t> const neighbours = pointIndex->nearest(position, pickNeighbours + 1);
+    float spacing = 0.f;
+    for (std::size_t neighbour : neighbours)
+    {
+      spacing += glm::distance(position, pointIndex->position(neighbour));
+    }
+    spacing /= std::max<std::size_t>(1, neighbours.size() - 1);
+    float const pickRadius = tolerance * glm::dot(position - viewPos, glm::normalize(cameraFront));
+    std::size_t const candidates = pointIndex->withinRadius(position, pickRadius).size();
+    double const milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "PICKED " << position.x << " " << position.y << " " << position.z << " SPACING " << spacing
+      << " POINTS WITHIN " << pickRadius << " " << candidates << " IN " << milliseconds << " MS" << std::endl;
+    if (hasPick)
+    {
+      std::cout << "DISTANCE TO PREVIOUS PICK " << glm::distance(position, lastPick) << std::endl;
+    }
+    lastPick = position;
+    hasPick = true;
+  }
+  /* Sort-last compositing: the merged point passes of all workers take the place of this
+   * process's own, so the fills and post-processing run once on the composited G-buffer. */
+  void compositePlanes(GBufferImages const& target)
+  {
+    CompositeFrame frame = { (std::uint32_t)frameIndex, { viewPos.x, viewPos.y, viewPos.z }, { cameraFront.x, cameraFront.y, cameraFront.z }, fov };
+    if (!compositor->renderFrame(frame, compositedPlanes))
+    {
+      std::cout << "COMPOSITING FAILED" << std::endl;
+      failState = true;
+      return;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, renderGraph->texture(target.position));
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, windowWidth, windowHeight, GL_RGBA, GL_UNSIGNED_BYTE, compositedPlanes.position.data());
+    glBindTexture(GL_TEXTURE_2D, renderGraph->texture(target.normal));
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, windowWidth, windowHeight, GL_RGB, GL_HALF_FLOAT, compositedPlanes.normal.data());
+    glBindTexture(GL_TEXTURE_2D, renderGraph->texture(target.color));
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, windowWidth, windowHeight, GL_RGBA, GL_UNSIGNED_BYTE, compositedPlanes.color.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  }
+  /* Visibility buffer point pass: only an index and a depth per pixel, so overdrawn fragments
+   * cost a single 32-bit write instead of three shaded attachments. */
+  void writeVisibility()
+  {
+    glUseProgram(visibilityPointProgram);
+    drawPoints(visibilityModelLoc, visibilityViewLoc, visibilityProjectionLoc, visibilityLightPosLoc, visibilityViewPosLoc, visibilitySplatScaleLoc);
+  }
+  void drawPoints(GLint modelLoc, GLint viewLoc, GLint projectionLoc, GLint lightPosLoc, GLint viewPosLoc, GLint splatScaleLoc)
+  {
+    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &model[0][0]);
+    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &view[0][0]);
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, &projection[0][0]);
+    glUniform3fv(lightPosLoc, 1, &viewPos[0]);
+    glUniform3fv(viewPosLoc, 1, &viewPos[0]);
+    // Pixels per unit of radius at distance 1; the shader divides by the clip space w.
+    glUniform1f(splatScaleLoc, adaptiveSplats ? projection[1][1] * windowHeight : 0.f);
+    if (adaptiveSplats)
+    {
+      glEnable(GL_PROGRAM_POINT_SIZE);
+    }
+    glEnable(GL_DEPTH_TEST);
+    if (streamRing)
+    {
+      streamRing->draw();
+    }
+    else if (cullPhase >= 0)
+    {
+      // One command per chunk, with no points for the culled ones.
+      glBindVertexArray(pointVAO);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, chunkCommandBuffer);
+      glMultiDrawArraysIndirect(GL_POINTS, (GLvoid*)((std::size_t)cullPhase * chunkCount * 4 * sizeof(GLuint)), chunkCount, 0);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    else if (usePointFilter())
+    {
+      // The second command draws the budget's share of the kept points while the camera moves.
+      glBindVertexArray(pointVAO);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, filterElementBuffer);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, filterCommandBuffer);
+      glDrawElementsIndirect(GL_POINTS, GL_UNSIGNED_INT, (GLvoid*)(pointsDrawn < pointCount ? 5 * sizeof(GLuint) : 0));
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    else if (sceneDraws.empty())
+    {
+      glBindVertexArray(pointVAO);
+      glDrawArrays(GL_POINTS, 0, pointsDrawn);
+    }
+    else
+    {
+      float const fraction = (float)pointsDrawn / pointCount;
+      if (fraction != sceneFraction)
+      {
+        uploadSceneCommands(fraction);
+      }
+      glBindVertexArray(pointVAO);
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sceneObjectBuffer);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, sceneDrawBuffer);
+      glMultiDrawArraysIndirect(GL_POINTS, (GLvoid*)0, (GLsizei)sceneDraws.size(), 0);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+  // A compute shader cannot write the window's framebuffer, so the kernel's image is blitted to the output.
+  void fusedPostProcess(GBufferImages const& source, RenderGraph::Resource fused)
+  {
+    glUseProgram(fusedPostProgram);
+    glUniform1i(fusedPostSmoothLoc, smoothSigma > 0.f ? 0 : 1);
+    bindGBuffer(source);
+    glBindImageTexture(0, renderGraph->texture(fused), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    glDispatchCompute((windowWidth + 15) / 16, (windowHeight + 15) / 16, 1);
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, renderGraph->framebuffer({ fused }, -1));
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, outputBuffer);
+    glBlitFramebuffer(0, 0, windowWidth, windowHeight, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  }
+  void processCamera()
+  {
+    TraceZone zone("processCamera");
+    float currentFrame = (float)glfwGetTime();
+    deltaTime = currentFrame - lastFrame;
+    lastFrame = currentFrame;
+    processInput(window);
+    updateCamera();
+  }
+  void updateCamera()
+  {
+    poseMatrices({ viewPos, cameraFront, fov }, view, projection);
+  }
+  void setupShaders()
+  {
+    /* Processing Buffers */
+    {
+      renderGraph = std::make_unique<RenderGraph>();
+      glGenVertexArrays(1, &fboVAO);
+      glBindVertexArray(fboVAO);
+      glGenBuffers(1, &fboVBO);
+      glBindBuffer(GL_ARRAY_BUFFER, fboVBO);
+      float const quadVertices[] = { -1.0f, 1.0f, 0.0f, 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 1.0f, -1.0f, 1.0f, 0.0f,
+
+        -1.0f, 1.0f, 0.0f, 1.0f, 1.0f, -1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+      glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
+      glEnableVertexAttribArray(0);
+      glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+      glEnableVertexAttribArray(1);
+      glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+      glBindVertexArray(0);
+    }
+
+    setupPointProgram();
+    if (failState)
+    {
+      return;
+    }
+
+    /* Background Pixel Vertex Shader */
+    {
+      const GLchar* backgroundVertText = R"foo(
+#version 330 core
+
+layout (location = 0) in vec2 aPos;
 layout (location = 1) in vec2 aTexCoords;
 
 out vec2 TexCoords;
@@ -683,7 +1916,14 @@ float kernel8[9] = float[](
 for(int i = 0; i < 9; i++)
         sum8 += sampleTex[i] * kernel8[i];
   float testProd = sum1*sum2*sum3*sum4*sum5*sum6*sum7*sum8;
-if(abs(testProd) < zeroTol) discard;
+// Written empty rather than discarded, so the pass covers every pixel and its target needs no clear.
+if(abs(testProd) < zeroTol)
+{
+  positionTextureOut = vec4(0.0);
+  normalTextureOut = vec3(0.0);
+  colorTextureOut = vec4(0.0);
+  return;
+}
   float smallestDepth = 100000.0;
   int smallestInd = 4;
   for(int i = 0; i < 9; i++)
@@ -851,537 +2091,4542 @@ for(int i = 0; i < 9; i++)
   float testProd = sum1*sum2*sum3*sum4*sum5*sum6*sum7*sum8;
   if(abs(testProd) < zeroTol) 
 {
-  positionTextureOut = texture(positionTextureIn, TexCoords.st);
-  normalTextureOut = texture(normalTextureIn, TexCoords.st).xyz;
-  colorTextureOut = texture(colorTextureIn, TexCoords.st);
+  positionTextureOut = texture(positionTextureIn, TexCoords.st);
+  normalTextureOut = texture(normalTextureIn, TexCoords.st).xyz;
+  colorTextureOut = texture(colorTextureIn, TexCoords.st);
+}
+else
+{
+  float smallestDepth = 100000.0;
+  int smallestInd = 4;
+  for(int i = 0; i < 9; i++)
+  {
+     float depthDiff = (sampleTex[4] - sampleTex[i]);
+     if(depthDiff > zeroTol && depthDiff < smallestDepth)
+     {
+       smallestDepth = depthDiff;
+       smallestInd = i;
+     }
+  }
+  positionTextureOut = texture(positionTextureIn, TexCoords.st + offsets[smallestInd]);
+  normalTextureOut = texture(normalTextureIn, TexCoords.st + offsets[smallestInd]).xyz;
+  colorTextureOut = texture(colorTextureIn, TexCoords.st + offsets[smallestInd]);
+}
+}
+} 
+)foo";
+      occlusionFragShader = glCreateShader(GL_FRAGMENT_SHADER);
+      glShaderSource(occlusionFragShader, 1, &occlusionFragText, 0);
+      glCompileShader(occlusionFragShader);
+      if (!checkShaderCompile(occlusionFragShader, "OCCLUSION FILL FRAGMENT"))
+      {
+        return;
+      }
+    }
+
+    /* Occlusion Pixel Program */
+    {
+      occlusionProgram = glCreateProgram();
+      glAttachShader(occlusionProgram, occlusionVertShader);
+      glAttachShader(occlusionProgram, occlusionFragShader);
+      glLinkProgram(occlusionProgram);
+      glUseProgram(occlusionProgram);
+    }
+
+    /* Smoothing Vertex Shader */
+    {
+      const GLchar* smoothVertText = R"foo(
+#version 330 core
+
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aTexCoords;
+
+out vec2 TexCoords;
+
+void main()
+{
+  TexCoords = aTexCoords;
+  gl_Position = vec4(aPos.x, aPos.y, 0.0, 1.0); 
+}
+)foo";
+      smoothVertShader = glCreateShader(GL_VERTEX_SHADER);
+      glShaderSource(smoothVertShader, 1, &smoothVertText, 0);
+      glCompileShader(smoothVertShader);
+      if (!checkShaderCompile(smoothVertShader, "SMOOTHING VERTEX"))
+      {
+        return;
+      }
+    }
+
+    /* Smoothing Fragment Shader */
+    {
+      const char* smoothFragText = R"foo(
+#version 420
+
+in vec2 TexCoords;
+
+layout (location = 0) out vec4 positionTextureOut;
+layout (location = 1) out vec3 normalTextureOut;
+layout (location = 2) out vec4 colorTextureOut;
+layout(binding=0) uniform sampler2D positionTextureIn;
+layout(binding=1) uniform sampler2D normalTextureIn;
+layout(binding=2) uniform sampler2D colorTextureIn;
+const float zeroTol = 1e-6;
+
+void main()
+{
+ivec2 texSize = textureSize(positionTextureIn, 0);
+vec2 stepSize = 1.0/vec2(float(texSize.x), float(texSize.y));
+vec2 offsets[9] = vec2[](
+        vec2(-stepSize.x,  stepSize.y), // top-left
+        vec2( 0.0f,    stepSize.y), // top-center
+        vec2( stepSize.x,  stepSize.y), // top-right
+        vec2(-stepSize.x,  0.0f),   // center-left
+        vec2( 0.0f,    0.0f),   // center-center
+        vec2( stepSize.x,  0.0f),   // center-right
+        vec2(-stepSize.x, -stepSize.y), // bottom-left
+        vec2( 0.0f,   -stepSize.y), // bottom-center
+        vec2( stepSize.x, -stepSize.y)  // bottom-right    
+    );
+float sampleTex[9];
+    for(int i = 0; i < 9; i++)
+        sampleTex[i] = texture(positionTextureIn, TexCoords.st + offsets[i]).a;
+if(abs(sampleTex[4]) < zeroTol)
+{
+  positionTextureOut = texture(positionTextureIn, TexCoords.st);
+  normalTextureOut = texture(normalTextureIn, TexCoords.st).xyz;
+  colorTextureOut = texture(colorTextureIn, TexCoords.st);
+}
+else
+{
+float alleviatedGaussian[9] = float[](
+        1.0/16.0, 2.0/16.0, 1.0/16.0,
+        2.0/16.0, 16.0/28.0, 2.0/16.0,
+        1.0/16.0, 2.0/16.0, 1.0/16.0
+    );
+float totalWeight = 0.0;
+for(int i = 0; i < 9; i++)
+{
+  alleviatedGaussian[i] *= step(zeroTol, sampleTex[i]);
+  totalWeight += alleviatedGaussian[i];
+}
+for(int i = 0; i < 9; i++)
+{
+  positionTextureOut += (alleviatedGaussian[i] / totalWeight) * texture(positionTextureIn, TexCoords.st + offsets[i]);
+  normalTextureOut += (alleviatedGaussian[i] / totalWeight) * texture(normalTextureIn, TexCoords.st + offsets[i]).xyz;
+  colorTextureOut += (alleviatedGaussian[i] / totalWeight) * texture(colorTextureIn, TexCoords.st + offsets[i]);
+}
+}
+}
+)foo";
+      smoothFragShader = glCreateShader(GL_FRAGMENT_SHADER);
+      glShaderSource(smoothFragShader, 1, &smoothFragText, 0);
+      glCompileShader(smoothFragShader);
+      if (!checkShaderCompile(smoothFragShader, "SMOOTHING FRAGMENT"))
+      {
+        return;
+      }
+    }
+
+    /* Smoothing Program */
+    {
+      smoothProgram = glCreateProgram();
+      glAttachShader(smoothProgram, smoothVertShader);
+      glAttachShader(smoothProgram, smoothFragShader);
+      glLinkProgram(smoothProgram);
+      glUseProgram(smoothProgram);
+    }
+
+    /* Separable Smoothing Fragment Shader */
+    if (smoothSigma > 0.f)
+    {
+      const char* separableSmoothFragText = R"foo(
+#version 430 core
+
+layout (location = 0) out vec4 positionTextureOut;
+layout (location = 1) out vec3 normalTextureOut;
+layout (location = 2) out vec4 colorTextureOut;
+layout(binding=0) uniform sampler2D positionTextureIn;
+layout(binding=1) uniform sampler2D normalTextureIn;
+layout(binding=2) uniform sampler2D colorTextureIn;
+uniform ivec2 direction;
+uniform int radius;
+uniform float weights[33];
+const float zeroTol = 1e-6;
+
+void main()
+{
+  ivec2 texSize = textureSize(positionTextureIn, 0);
+  ivec2 center = ivec2(gl_FragCoord.xy);
+  vec4 position = texelFetch(positionTextureIn, center, 0);
+if(abs(position.a) < zeroTol)
+{
+  // Empty pixels pass through, so both passes keep the coverage of the fills.
+  positionTextureOut = position;
+  normalTextureOut = texelFetch(normalTextureIn, center, 0).xyz;
+  colorTextureOut = texelFetch(colorTextureIn, center, 0);
+  return;
+}
+  positionTextureOut = vec4(0.0);
+  normalTextureOut = vec3(0.0);
+  colorTextureOut = vec4(0.0);
+  float totalWeight = 0.0;
+  for(int i = -radius; i <= radius; i++)
+  {
+    // Wraps at the borders like the repeating texture lookups of the 3x3 filter.
+    ivec2 tap = (center + i * direction + radius * texSize) % texSize;
+    vec4 tapPosition = texelFetch(positionTextureIn, tap, 0);
+    float weight = weights[abs(i)] * step(zeroTol, tapPosition.a);
+    totalWeight += weight;
+    positionTextureOut += weight * tapPosition;
+    normalTextureOut += weight * texelFetch(normalTextureIn, tap, 0).xyz;
+    colorTextureOut += weight * texelFetch(colorTextureIn, tap, 0);
+  }
+  positionTextureOut /= totalWeight;
+  normalTextureOut /= totalWeight;
+  colorTextureOut /= totalWeight;
+}
+)foo";
+      separableSmoothFragShader = glCreateShader(GL_FRAGMENT_SHADER);
+      glShaderSource(separableSmoothFragShader, 1, &separableSmoothFragText, 0);
+      glCompileShader(separableSmoothFragShader);
+      if (!checkShaderCompile(separableSmoothFragShader, "SEPARABLE SMOOTHING FRAGMENT"))
+      {
+        return;
+      }
+    }
+
+    /* Separable Smoothing Program */
+    if (smoothSigma > 0.f)
+    {
+      separableSmoothProgram = glCreateProgram();
+      glAttachShader(separableSmoothProgram, smoothVertShader);
+      glAttachShader(separableSmoothProgram, separableSmoothFragShader);
+      glLinkProgram(separableSmoothProgram);
+      glUseProgram(separableSmoothProgram);
+      GLint radiusLoc;
+      GLint weightsLoc;
+      if (!assignShaderUniform(separableSmoothProgram, separableSmoothDirectionLoc, "direction") ||
+        !assignShaderUniform(separableSmoothProgram, radiusLoc, "radius") ||
+        !assignShaderUniform(separableSmoothProgram, weightsLoc, "weights"))
+      {
+        return;
+      }
+      // Gaussian weights out to three sigma; the shader normalizes by the weight of the valid taps.
+      int const radius = separableSmoothRadius();
+      float weights[33];
+      for (int i = 0; i <= radius; ++i)
+      {
+        weights[i] = std::exp(-.5f * i * i / (smoothSigma * smoothSigma));
+      }
+      glUniform1i(radiusLoc, radius);
+      glUniform1fv(weightsLoc, radius + 1, weights);
+    }
+
+    /* Normal Estimation Fragment Shader */
+    if (normalEstimation)
+    {
+      const char* normalsFragText = R"foo(
+#version 420
+
+// Positions and colors stay as they are, so only the normal attachment is written.
+layout (location = 1) out vec3 normalTextureOut;
+layout(binding=0) uniform sampler2D positionTextureIn;
+uniform vec3 viewPos;
+const float zeroTol = 1e-6;
+
+vec4 positionAt(ivec2 at)
+{
+    ivec2 texSize = textureSize(positionTextureIn, 0);
+    if(any(lessThan(at, ivec2(0))) || any(greaterThanEqual(at, texSize)))
+        return vec4(0.0);
+    return texelFetch(positionTextureIn, at, 0);
+}
+
+// The difference to the neighbour along step whose depth is closer to the center's, so that
+// the tangent does not reach across a silhouette; without either neighbour it is zero.
+vec3 tangent(ivec2 center, ivec2 step, vec4 position)
+{
+    vec4 forward = positionAt(center + step);
+    vec4 backward = positionAt(center - step);
+    bool hasForward = forward.a > zeroTol;
+    bool hasBackward = backward.a > zeroTol;
+    if(hasForward && (!hasBackward || abs(forward.a - position.a) <= abs(backward.a - position.a)))
+        return forward.xyz - position.xyz;
+    if(hasBackward)
+        return position.xyz - backward.xyz;
+    return vec3(0.0);
+}
+
+void main()
+{
+    ivec2 center = ivec2(gl_FragCoord.xy);
+    vec4 position = positionAt(center);
+    normalTextureOut = vec3(0.0);
+    if(position.a < zeroTol)
+        return;
+    vec3 normal = cross(tangent(center, ivec2(1, 0), position), tangent(center, ivec2(0, 1), position));
+    // Isolated pixels face the viewer.
+    vec3 toViewer = viewPos - position.xyz;
+    if(dot(normal, normal) < zeroTol * zeroTol * dot(toViewer, toViewer))
+        normal = toViewer;
+    normal = normalize(normal);
+    normalTextureOut = dot(normal, toViewer) < 0.0 ? -normal : normal;
+}
+)foo";
+      normalsFragShader = glCreateShader(GL_FRAGMENT_SHADER);
+      glShaderSource(normalsFragShader, 1, &normalsFragText, 0);
+      glCompileShader(normalsFragShader);
+      if (!checkShaderCompile(normalsFragShader, "NORMAL ESTIMATION FRAGMENT"))
+      {
+        return;
+      }
+    }
+
+    /* Normal Estimation Program */
+    if (normalEstimation)
+    {
+      normalsProgram = glCreateProgram();
+      glAttachShader(normalsProgram, smoothVertShader);
+      glAttachShader(normalsProgram, normalsFragShader);
+      glLinkProgram(normalsProgram);
+      glUseProgram(normalsProgram);
+      if (!assignShaderUniform(normalsProgram, normalsViewPosLoc, "viewPos"))
+      {
+        return;
+      }
+    }
+
+    /* Anti-Aliasing Vertex Shader */
+    {
+      const GLchar* aaVertText = R"foo(
+#version 330 core
+
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aTexCoords;
+
+out vec2 TexCoords;
+
+void main()
+{
+  TexCoords = aTexCoords;
+  gl_Position = vec4(aPos.x, aPos.y, 0.0, 1.0); 
+}
+)foo";
+      aaVertShader = glCreateShader(GL_VERTEX_SHADER);
+      glShaderSource(aaVertShader, 1, &aaVertText, 0);
+      glCompileShader(aaVertShader);
+      if (!checkShaderCompile(aaVertShader, "ANTI ALIASING VERTEX"))
+      {
+        return;
+      }
+    }
+
+    /* Anti-Aliasing Fragment Shader */
+    {
+      const char* aaFragHighText = R"foo(
+#version 420
+
+in vec2 TexCoords;
+
+layout (location = 0) out vec4 positionTextureOut;
+layout (location = 1) out vec3 normalTextureOut;
+layout (location = 2) out vec4 colorTextureOut;
+layout(binding=0) uniform sampler2D positionTextureIn;
+layout(binding=1) uniform sampler2D normalTextureIn;
+layout(binding=2) uniform sampler2D colorTextureIn;
+
+void main()
+{
+ivec2 texSize = textureSize(positionTextureIn, 0);
+vec2 stepSize = 1.0/vec2(float(texSize.x), float(texSize.y));
+vec2 offsets[9] = vec2[](
+        vec2(-stepSize.x,  stepSize.y), // top-left
+        vec2( 0.0f,    stepSize.y), // top-center
+        vec2( stepSize.x,  stepSize.y), // top-right
+        vec2(-stepSize.x,  0.0f),   // center-left
+        vec2( 0.0f,    0.0f),   // center-center
+        vec2( stepSize.x,  0.0f),   // center-right
+        vec2(-stepSize.x, -stepSize.y), // bottom-left
+        vec2( 0.0f,   -stepSize.y), // bottom-center
+        vec2( stepSize.x, -stepSize.y)  // bottom-right    
+    );
+float laplaceFilter[9] = float[](
+        0.0, -1.0, 0.0,
+        -1.0, 4.0, -1.0,
+        0.0, -1.0, 0.0
+    );
+for(int i = 0; i < 9; i++)
+{
+  positionTextureOut += laplaceFilter[i] * texture(positionTextureIn, TexCoords.st + offsets[i]);
+  normalTextureOut += laplaceFilter[i] * texture(normalTextureIn, TexCoords.st + offsets[i]).xyz;
+  colorTextureOut += laplaceFilter[i] * texture(colorTextureIn, TexCoords.st + offsets[i]);
+}
+}
+)foo";
+      aaFragHighShader = glCreateShader(GL_FRAGMENT_SHADER);
+      glShaderSource(aaFragHighShader, 1, &aaFragHighText, 0);
+      glCompileShader(aaFragHighShader);
+      if (!checkShaderCompile(aaFragHighShader, "ANTI ALIASING HIGH-PASS FRAGMENT"))
+      {
+        return;
+      }
+      const char* aaFragLowText = R"foo(
+#version 420
+
+in vec2 TexCoords;
+
+layout (location = 0) out vec4 positionTextureOut;
+layout (location = 1) out vec3 normalTextureOut;
+layout (location = 2) out vec4 colorTextureOut;
+layout(binding=0) uniform sampler2D positionTextureIn;
+layout(binding=1) uniform sampler2D normalTextureIn;
+layout(binding=2) uniform sampler2D colorTextureIn;
+const float zeroTol = 1e-6;
+
+void main()
+{
+  float fragPosDepth = texture(positionTextureIn, TexCoords.st).a;
+if(fragPosDepth < zeroTol) discard;
+  positionTextureOut = texture(positionTextureIn, TexCoords.st);
+  normalTextureOut = texture(normalTextureIn, TexCoords.st).xyz;
+  colorTextureOut = texture(colorTextureIn, TexCoords.st);
+} 
+)foo";
+      aaFragLowShader = glCreateShader(GL_FRAGMENT_SHADER);
+      glShaderSource(aaFragLowShader, 1, &aaFragLowText, 0);
+      glCompileShader(aaFragLowShader);
+      if (!checkShaderCompile(aaFragLowShader, "ANTI ALIASING LOW-PASS FRAGMENT"))
+      {
+        return;
+      }
+    }
+
+    /* Anti-Aliasing Program */
+    {
+      aaHighProgram = glCreateProgram();
+      glAttachShader(aaHighProgram, aaVertShader);
+      glAttachShader(aaHighProgram, aaFragHighShader);
+      glLinkProgram(aaHighProgram);
+      glUseProgram(aaHighProgram);
+      aaLowProgram = glCreateProgram();
+      glAttachShader(aaLowProgram, aaVertShader);
+      glAttachShader(aaLowProgram, aaFragLowShader);
+      glLinkProgram(aaLowProgram);
+      glUseProgram(aaLowProgram);
+    }
+
+    /* Illustration Effect Vertex Shader */
+    {
+      const GLchar* illustrateVertText = R"foo(
+#version 330 core
+
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aTexCoords;
+
+out vec2 TexCoords;
+
+void main()
+{
+  TexCoords = aTexCoords;
+  gl_Position = vec4(aPos.x, aPos.y, 0.0, 1.0); 
+}
+)foo";
+      illustrateVertShader = glCreateShader(GL_VERTEX_SHADER);
+      glShaderSource(illustrateVertShader, 1, &illustrateVertText, 0);
+      glCompileShader(illustrateVertShader);
+      if (!checkShaderCompile(illustrateVertShader, "ILLUSTRATE VERTEX"))
+      {
+        return;
+      }
+    }
+
+    /* Illustration Effect Fragment Shader */
+    {
+      const char* illustrateHighText = R"foo(
+#version 420
+
+out vec4 FragColor;
+in vec2 TexCoords;
+
+layout(binding=0) uniform sampler2D positionTextureIn;
+layout(binding=1) uniform sampler2D normalTextureIn;
+layout(binding=2) uniform sampler2D colorTextureIn;
+// Off for --no-illustration, which shows the colors only.
+uniform bool featureLines;
+
+void main()
+{
+float fragPosDepth = texture(positionTextureIn, TexCoords.st).a;
+if(fragPosDepth < 1e-5) discard;
+if(!featureLines)
+{
+  FragColor = texture(colorTextureIn, TexCoords.st);
+  return;
+}
+ivec2 texSize = textureSize(positionTextureIn, 0);
+vec2 stepSize = 1.0/vec2(float(texSize.x), float(texSize.y));
+vec2 offsets[9] = vec2[](
+        vec2(-stepSize.x,  stepSize.y), // top-left
+        vec2( 0.0f,    stepSize.y), // top-center
+        vec2( stepSize.x,  stepSize.y), // top-right
+        vec2(-stepSize.x,  0.0f),   // center-left
+        vec2( 0.0f,    0.0f),   // center-center
+        vec2( stepSize.x,  0.0f),   // center-right
+        vec2(-stepSize.x, -stepSize.y), // bottom-left
+        vec2( 0.0f,   -stepSize.y), // bottom-center
+        vec2( stepSize.x, -stepSize.y)  // bottom-right    
+    );
+float featureFilter[9] = float[](
+        1.0/8.0,1.0/8.0, 1.0/8.0,
+        1.0/8.0, 0.0, 1.0/8.0,
+        1.0/8.0, 1.0/8.0, 1.0/8.0
+    );
+vec3 centerNormal = texture(normalTextureIn, TexCoords.st).xyz;
+float curvature = 0.0;
+for(int i = 0; i < 9; i++)
+{
+  curvature += featureFilter[i] * dot(texture(normalTextureIn, TexCoords.st + offsets[i]).xyz, centerNormal);
+}
+if(curvature > .975) 
+{
+  FragColor = texture(colorTextureIn, TexCoords.st);
+}
+else
+{
+  FragColor = vec4(0.0,0.0,0.0,1.0);
+}
+}
+)foo";
+      illustrateFragShader = glCreateShader(GL_FRAGMENT_SHADER);
+      glShaderSource(illustrateFragShader, 1, &illustrateHighText, 0);
+      glCompileShader(illustrateFragShader);
+      if (!checkShaderCompile(illustrateFragShader, "ILLUSTRATION FRAGMENT"))
+      {
+        return;
+      }
+    }
+
+    /* Illustration Effect Program */
+    {
+      illustrateProgram = glCreateProgram();
+      glAttachShader(illustrateProgram, illustrateVertShader);
+      glAttachShader(illustrateProgram, illustrateFragShader);
+      glLinkProgram(illustrateProgram);
+      glUseProgram(illustrateProgram);
+      if (!assignShaderUniform(illustrateProgram, illustrateFeatureLinesLoc, "featureLines"))
+      {
+        return;
+      }
+      glUniform1i(illustrateFeatureLinesLoc, illustration);
+    }
+
+    if (visibilityBuffer)
+    {
+      setupVisibilityBuffer();
+    }
+    if (deferredLighting && !failState)
+    {
+      setupDeferredLighting();
+    }
+    if (fusedPost && !failState)
+    {
+      setupFusedPost();
+    }
+    if (pointFiltering && !failState)
+    {
+      setupPointFilter();
+    }
+    if (occlusionCulling && !failState)
+    {
+      setupOcclusionCulling();
+    }
+  }
+  /* The fills on packed point indices and the resolve pass; their targets come from the render
+   * graph like the G-buffer's. The fills and the resolve draw the same screen quad as the G-buffer passes, so they reuse the
+   * background fill's vertex shader. */
+  void setupVisibilityBuffer()
+  {
+    /* Background Visibility Fragment Shader */
+    {
+      const char* backgroundVisibilityFragText = R"foo(
+#version 430 core
+
+layout (location = 0) out uint visibilityOut;
+layout(binding=0) uniform usampler2D visibilityIn;
+const float zeroTol = 1e-6;
+// The eight half-plane kernels of the background fill, one row of 3x3 weights each.
+const float kernels[72] = float[](
+        0, 1, 1,  0, 1, 1,  0, 1, 1,
+        1, 1, 1,  1, 1, 1,  0, 0, 0,
+        1, 1, 0,  1, 1, 0,  1, 1, 0,
+        0, 0, 0,  1, 1, 1,  1, 1, 1,
+        1, 1, 1,  0, 1, 1,  0, 0, 1,
+        1, 1, 1,  1, 1, 0,  1, 0, 0,
+        1, 0, 0,  1, 1, 0,  1, 1, 1,
+        0, 0, 1,  0, 1, 1,  1, 1, 1
+    );
+
+void main()
+{
+ivec2 texSize = textureSize(visibilityIn, 0);
+ivec2 center = ivec2(gl_FragCoord.xy);
+ivec2 offsets[9] = ivec2[](
+        ivec2(-1,  1), ivec2( 0,  1), ivec2( 1,  1),
+        ivec2(-1,  0), ivec2( 0,  0), ivec2( 1,  0),
+        ivec2(-1, -1), ivec2( 0, -1), ivec2( 1, -1)
+    );
+uint samples[9];
+float sampleTex[9];
+    for(int i = 0; i < 9; i++)
+    {
+        // Wraps at the borders like the repeating G-buffer textures.
+        samples[i] = texelFetch(visibilityIn, (center + offsets[i] + texSize) % texSize, 0).r;
+        sampleTex[i] = float(samples[i] >> 24) / 255.0;
+    }
+if(abs(sampleTex[4]) > zeroTol)
+{
+  visibilityOut = samples[4];
+  return;
+}
+  float testProd = 1.0;
+  for(int k = 0; k < 8; k++)
+  {
+    float sum = 0;
+    for(int i = 0; i < 9; i++)
+        sum += sampleTex[i] * kernels[k * 9 + i];
+    testProd *= sum;
+  }
+if(abs(testProd) < zeroTol)
+{
+  visibilityOut = 0u;
+  return;
+}
+  float smallestDepth = 100000.0;
+  int smallestInd = 4;
+  for(int i = 0; i < 9; i++)
+  {
+     if(abs(sampleTex[i]) > zeroTol && abs(sampleTex[i]) < smallestDepth)
+     {
+       smallestDepth = abs(sampleTex[i]);
+       smallestInd = i;
+     }
+  }
+  visibilityOut = samples[smallestInd];
+}
+)foo";
+      backgroundVisibilityFragShader = glCreateShader(GL_FRAGMENT_SHADER);
+      glShaderSource(backgroundVisibilityFragShader, 1, &backgroundVisibilityFragText, 0);
+      glCompileShader(backgroundVisibilityFragShader);
+      if (!checkShaderCompile(backgroundVisibilityFragShader, "BACKGROUND VISIBILITY FILL FRAGMENT"))
+      {
+        return;
+      }
+    }
+
+    /* Background Visibility Program */
+    {
+      backgroundVisibilityProgram = glCreateProgram();
+      glAttachShader(backgroundVisibilityProgram, backgroundVertShader);
+      glAttachShader(backgroundVisibilityProgram, backgroundVisibilityFragShader);
+      glLinkProgram(backgroundVisibilityProgram);
+      glUseProgram(backgroundVisibilityProgram);
+    }
+
+    /* Occlusion Visibility Fragment Shader */
+    {
+      const char* occlusionVisibilityFragText = R"foo(
+#version 430 core
+
+layout (location = 0) out uint visibilityOut;
+layout(binding=0) uniform usampler2D visibilityIn;
+const float zeroTol = 1e-6;
+// The eight half-plane kernels of the occlusion fill, one row of 3x3 weights each.
+const float kernels[72] = float[](
+        0, 1, 1,  0, 1, 1,  0, 1, 1,
+        1, 1, 1,  1, 1, 1,  0, 0, 0,
+        1, 1, 0,  1, 1, 0,  1, 1, 0,
+        0, 0, 0,  1, 1, 1,  1, 1, 1,
+        1, 1, 1,  0, 1, 1,  0, 0, 1,
+        1, 1, 1,  1, 1, 0,  1, 0, 0,
+        1, 0, 0,  1, 1, 0,  1, 1, 1,
+        0, 0, 1,  0, 1, 1,  1, 1, 1
+    );
+
+void main()
+{
+ivec2 texSize = textureSize(visibilityIn, 0);
+ivec2 center = ivec2(gl_FragCoord.xy);
+ivec2 offsets[9] = ivec2[](
+        ivec2(-1,  1), ivec2( 0,  1), ivec2( 1,  1),
+        ivec2(-1,  0), ivec2( 0,  0), ivec2( 1,  0),
+        ivec2(-1, -1), ivec2( 0, -1), ivec2( 1, -1)
+    );
+uint samples[9];
+float sampleTex[9];
+    for(int i = 0; i < 9; i++)
+    {
+        // Wraps at the borders like the repeating G-buffer textures.
+        samples[i] = texelFetch(visibilityIn, (center + offsets[i] + texSize) % texSize, 0).r;
+        sampleTex[i] = float(samples[i] >> 24) / 255.0;
+    }
+visibilityOut = samples[4];
+if(abs(sampleTex[4]) < zeroTol) return;
+  float testProd = 1.0;
+  for(int k = 0; k < 8; k++)
+  {
+    float sum = 0;
+    for(int i = 0; i < 9; i++)
+        sum += step(sampleTex[i], sampleTex[4]) * kernels[k * 9 + i];
+    testProd *= sum;
+  }
+if(abs(testProd) < zeroTol) return;
+  float smallestDepth = 100000.0;
+  int smallestInd = 4;
+  for(int i = 0; i < 9; i++)
+  {
+     float depthDiff = (sampleTex[4] - sampleTex[i]);
+     if(depthDiff > zeroTol && depthDiff < smallestDepth)
+     {
+       smallestDepth = depthDiff;
+       smallestInd = i;
+     }
+  }
+  visibilityOut = samples[smallestInd];
+}
+)foo";
+      occlusionVisibilityFragShader = glCreateShader(GL_FRAGMENT_SHADER);
+      glShaderSource(occlusionVisibilityFragShader, 1, &occlusionVisibilityFragText, 0);
+      glCompileShader(occlusionVisibilityFragShader);
+      if (!checkShaderCompile(occlusionVisibilityFragShader, "OCCLUSION VISIBILITY FILL FRAGMENT"))
+      {
+        return;
+      }
+    }
+
+    /* Occlusion Visibility Program */
+    {
+      occlusionVisibilityProgram = glCreateProgram();
+      glAttachShader(occlusionVisibilityProgram, occlusionVertShader);
+      glAttachShader(occlusionVisibilityProgram, occlusionVisibilityFragShader);
+      glLinkProgram(occlusionVisibilityProgram);
+      glUseProgram(occlusionVisibilityProgram);
+    }
+
+    /* Resolve Fragment Shader */
+    {
+      const char* resolveFragText = R"foo(
+#version 430 core
+
+layout (location = 0) out vec4 positionTexture;
+layout (location = 1) out vec3 normalTexture;
+layout (location = 2) out vec4 colorTexture;
+layout(binding=0) uniform usampler2D visibilityTexture;
+
+struct SceneObject
+{
+    mat4 model;
+    mat4 normalMatrix;
+    vec4 objectColor; // rgb for clouds without colors, a is 1 when the cloud has them
+    uvec4 points; // first point and point count in the shared buffer
+};
+layout (std430, binding = 0) readonly buffer SceneObjects
+{
+    SceneObject objects[];
+};
+// The point vertex buffer, pointStride floats per point.
+layout (std430, binding = 1) readonly buffer Points
+{
+    float points[];
+};
+
+uniform mat4 model;
+uniform vec3 lightPos;
+uniform vec3 viewPos;
+uniform int pointStride;
+uniform int sceneObjectCount;
+uniform bool deferredLighting;
+
+vec3 pointAttribute(uint point, int offset)
+{
+    int first = int(point) * pointStride + offset;
+    return vec3(points[first], points[first + 1], points[first + 2]);
+}
+
+void main()
+{
+    uint point = texelFetch(visibilityTexture, ivec2(gl_FragCoord.xy), 0).r & 0xFFFFFFu;
+    if (point == 0u) discard;
+    point -= 1u;
+    vec3 aPos = pointAttribute(point, 0);
+    vec3 aNormal = pointAttribute(point, 3);
+    // The same transforms and colors as the point shaders of the G-buffer pass.
+    vec3 FragPos;
+    vec3 Normal;
+    bool hasColor;
+    vec3 objectColor;
+    if (sceneObjectCount > 0)
+    {
+        int objectIndex = 0;
+        while (objectIndex < sceneObjectCount - 1 && point >= objects[objectIndex].points.x + objects[objectIndex].points.y)
+        {
+            ++objectIndex;
+        }
+        SceneObject object = objects[objectIndex];
+        FragPos = vec3(model * object.model * vec4(aPos, 1.0));
+        Normal = mat3(transpose(inverse(model))) * mat3(object.normalMatrix) * aNormal;
+        hasColor = object.objectColor.a > 0.5;
+        objectColor = hasColor ? pointAttribute(point, 6) : object.objectColor.rgb;
+    }
+    else
+    {
+        FragPos = vec3(model * vec4(aPos, 1.0));
+        Normal = mat3(transpose(inverse(model))) * aNormal;
+        hasColor = pointStride > 6;
+        objectColor = hasColor ? pointAttribute(point, 6) : vec3(.6,.6,.9);
+    }
+    // Colored clouds are lit dimmer, as in the point shaders.
+    vec3 lightColor = hasColor ? vec3(.1,.1,.1) : vec3(1.0,1.0,1.0);
+    // ambient
+    float ambientStrength = 0.1;
+    vec3 ambient = ambientStrength * lightColor;
+
+    // diffuse
+    vec3 norm = normalize(Normal);
+    vec3 lightDir = normalize(lightPos - FragPos);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = diff * lightColor;
+
+    // specular
+    float specularStrength = 0.5;
+    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+    vec3 specular = specularStrength * spec * lightColor;
+
+    float zFar = 100.0;
+    normalTexture = Normal;
+    // Deferred lighting shades after the fills, from the unlit color and the light's brightness.
+    colorTexture.rgba = deferredLighting ? vec4(objectColor, lightColor.r) : vec4((ambient + diffuse + specular) * objectColor, 1.0);
+    positionTexture.xyz = FragPos;
+    positionTexture.a =  distance(FragPos, viewPos) / zFar;
+}
+)foo";
+      resolveFragShader = glCreateShader(GL_FRAGMENT_SHADER);
+      glShaderSource(resolveFragShader, 1, &resolveFragText, 0);
+      glCompileShader(resolveFragShader);
+      if (!checkShaderCompile(resolveFragShader, "RESOLVE FRAGMENT"))
+      {
+        return;
+      }
+    }
+
+    /* Resolve Program */
+    {
+      resolveProgram = glCreateProgram();
+      glAttachShader(resolveProgram, backgroundVertShader);
+      glAttachShader(resolveProgram, resolveFragShader);
+      glLinkProgram(resolveProgram);
+      glUseProgram(resolveProgram);
+      if (!assignShaderUniform(resolveProgram, resolveModelLoc, "model"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(resolveProgram, resolveLightPosLoc, "lightPos"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(resolveProgram, resolveViewPosLoc, "viewPos"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(resolveProgram, resolvePointStrideLoc, "pointStride"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(resolveProgram, resolveSceneObjectCountLoc, "sceneObjectCount"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(resolveProgram, resolveDeferredLightingLoc, "deferredLighting"))
+      {
+        return;
+      }
+    }
+  }
+  /* Deferred lighting: a compute pass culls the --lights point lights against the bounding box
+   * of each 16x16 tile's filled positions, then one full screen pass lights every pixel with the
+   * camera headlight and the lights of its tile. */
+  void setupDeferredLighting()
+  {
+    /* Light Buffers */
+    {
+      glGenBuffers(1, &lightBuffer);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+      // Position and radius, then color; an empty buffer cannot be bound, so it holds at least one.
+      std::vector<glm::vec4> lights;
+      for (PointLight const& light : pointLights)
+      {
+        lights.push_back(glm::vec4(light.position, light.radius));
+        lights.push_back(glm::vec4(light.color, 0.f));
+      }
+      lights.resize(std::max<std::size_t>(lights.size(), 2), glm::vec4(0.f));
+      glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec4) * lights.size(), lights.data(), GL_STATIC_DRAW);
+      std::size_t const tiles = (std::size_t)((windowWidth + 15) / 16) * ((windowHeight + 15) / 16);
+      std::size_t const lightWords = std::max<std::size_t>((pointLights.size() + 31) / 32, 1);
+      glGenBuffers(1, &tileLightBuffer);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, tileLightBuffer);
+      glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * tiles * lightWords, nullptr, GL_DYNAMIC_DRAW);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    /* Light Culling Compute Shader */
+    {
+      const char* lightCullText = R"foo(
+#version 430 core
+layout (local_size_x = 16, local_size_y = 16) in;
+
+struct Light
+{
+    vec4 positionRadius;
+    vec4 color;
+};
+layout (std430, binding = 0) readonly buffer Lights
+{
+    Light lights[];
+};
+// One bit per light for every tile, (lightCount + 31) / 32 words per tile.
+layout (std430, binding = 1) writeonly buffer TileLights
+{
+    uint tileLights[];
+};
+layout(binding=0) uniform sampler2D positionTextureIn;
+uniform int lightCount;
+const float zeroTol = 1e-6;
+
+shared vec3 boxMin[256];
+shared vec3 boxMax[256];
+shared uint lightMask[32];
+
+void main()
+{
+    ivec2 texSize = textureSize(positionTextureIn, 0);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    uint local = gl_LocalInvocationIndex;
+    boxMin[local] = vec3(1e30);
+    boxMax[local] = vec3(-1e30);
+    if (all(lessThan(pixel, texSize)))
+    {
+        vec4 position = texelFetch(positionTextureIn, pixel, 0);
+        if (position.a > zeroTol)
+        {
+            boxMin[local] = position.xyz;
+            boxMax[local] = position.xyz;
+        }
+    }
+    if (local < 32u)
+    {
+        lightMask[local] = 0u;
+    }
+    barrier();
+    for (uint stride = 128u; stride > 0u; stride >>= 1)
+    {
+        if (local < stride)
+        {
+            boxMin[local] = min(boxMin[local], boxMin[local + stride]);
+            boxMax[local] = max(boxMax[local], boxMax[local + stride]);
+        }
+        barrier();
+    }
+    vec3 tileMin = boxMin[0];
+    vec3 tileMax = boxMax[0];
+    if (all(lessThanEqual(tileMin, tileMax)))
+    {
+        for (int i = int(local); i < lightCount; i += 256)
+        {
+            vec3 center = lights[i].positionRadius.xyz;
+            float radius = lights[i].positionRadius.w;
+            vec3 closest = clamp(center, tileMin, tileMax);
+            if (dot(closest - center, closest - center) < radius * radius)
+            {
+                atomicOr(lightMask[i >> 5], 1u << (i & 31));
+            }
+        }
+    }
+    barrier();
+    uint lightWords = uint(lightCount + 31) / 32u;
+    uint tile = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    if (local < lightWords)
+    {
+        tileLights[tile * lightWords + local] = lightMask[local];
+    }
+}
+)foo";
+      lightCullShader = glCreateShader(GL_COMPUTE_SHADER);
+      glShaderSource(lightCullShader, 1, &lightCullText, 0);
+      glCompileShader(lightCullShader);
+      if (!checkShaderCompile(lightCullShader, "LIGHT CULLING COMPUTE"))
+      {
+        return;
+      }
+    }
+
+    /* Light Culling Program */
+    {
+      lightCullProgram = glCreateProgram();
+      glAttachShader(lightCullProgram, lightCullShader);
+      glLinkProgram(lightCullProgram);
+      glUseProgram(lightCullProgram);
+      if (!assignShaderUniform(lightCullProgram, lightCullLightCountLoc, "lightCount"))
+      {
+        return;
+      }
+    }
+
+    /* Lighting Fragment Shader */
+    {
+      const char* lightingFragText = R"foo(
+#version 430 core
+
+in vec2 TexCoords;
+
+layout (location = 0) out vec4 positionTextureOut;
+layout (location = 1) out vec3 normalTextureOut;
+layout (location = 2) out vec4 colorTextureOut;
+layout(binding=0) uniform sampler2D positionTextureIn;
+layout(binding=1) uniform sampler2D normalTextureIn;
+layout(binding=2) uniform sampler2D colorTextureIn;
+
+struct Light
+{
+    vec4 positionRadius;
+    vec4 color;
+};
+layout (std430, binding = 0) readonly buffer Lights
+{
+    Light lights[];
+};
+layout (std430, binding = 1) readonly buffer TileLights
+{
+    uint tileLights[];
+};
+uniform int lightCount;
+uniform vec3 viewPos;
+const float zeroTol = 1e-6;
+
+// Diffuse and specular terms of the point shaders.
+vec3 shade(vec3 norm, vec3 lightDir, vec3 viewDir, vec3 lightColor)
+{
+    float diff = max(dot(norm, lightDir), 0.0);
+    float specularStrength = 0.5;
+    vec3 reflectDir = reflect(-lightDir, norm);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+    return (diff + specularStrength * spec) * lightColor;
+}
+
+void main()
+{
+  vec4 position = texture(positionTextureIn, TexCoords.st);
+  vec3 normal = texture(normalTextureIn, TexCoords.st).xyz;
+  vec4 color = texture(colorTextureIn, TexCoords.st);
+  positionTextureOut = position;
+  normalTextureOut = normal;
+  // Empty pixels pass through unlit, keeping the normals anti-aliasing spread into them for the feature lines.
+  if(position.a < zeroTol)
+  {
+    colorTextureOut = color;
+    return;
+  }
+  // Alpha holds the headlight brightness the point pass chose, .1 for colored clouds.
+  vec3 lightColor = vec3(color.a > 0.5 ? 1.0 : 0.1);
+  vec3 FragPos = position.xyz;
+  vec3 norm = normalize(normal);
+  vec3 viewDir = normalize(viewPos - FragPos);
+  float ambientStrength = 0.1;
+  vec3 light = ambientStrength * lightColor + shade(norm, viewDir, viewDir, lightColor);
+  ivec2 tileCount = (textureSize(positionTextureIn, 0) + 15) / 16;
+  ivec2 tile = ivec2(gl_FragCoord.xy) / 16;
+  int lightWords = (lightCount + 31) / 32;
+  int first = (tile.y * tileCount.x + tile.x) * lightWords;
+  for (int word = 0; word < lightWords; ++word)
+  {
+    uint mask = tileLights[first + word];
+    while (mask != 0u)
+    {
+      int i = word * 32 + findLSB(mask);
+      mask &= mask - 1u;
+      vec3 toLight = lights[i].positionRadius.xyz - FragPos;
+      float attenuation = clamp(1.0 - length(toLight) / lights[i].positionRadius.w, 0.0, 1.0);
+      light += shade(norm, normalize(toLight), viewDir, lights[i].color.rgb * attenuation * attenuation);
+    }
+  }
+  colorTextureOut = vec4(light * color.rgb, 1.0);
+}
+)foo";
+      lightingFragShader = glCreateShader(GL_FRAGMENT_SHADER);
+      glShaderSource(lightingFragShader, 1, &lightingFragText, 0);
+      glCompileShader(lightingFragShader);
+      if (!checkShaderCompile(lightingFragShader, "LIGHTING FRAGMENT"))
+      {
+        return;
+      }
+    }
+
+    /* Lighting Program */
+    {
+      lightingProgram = glCreateProgram();
+      glAttachShader(lightingProgram, backgroundVertShader);
+      glAttachShader(lightingProgram, lightingFragShader);
+      glLinkProgram(lightingProgram);
+      glUseProgram(lightingProgram);
+      if (!assignShaderUniform(lightingProgram, lightingLightCountLoc, "lightCount"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(lightingProgram, lightingViewPosLoc, "viewPos"))
+      {
+        return;
+      }
+    }
+  }
+  /* The three compaction passes of the point filter. They share the predicate, which reads the
+   * point straight from the vertex buffer bound as a storage buffer. */
+  void setupPointFilter()
+  {
+    /* Filter Buffers */
+    {
+      glGenBuffers(1, &filterParameterBuffer);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, filterParameterBuffer);
+      glBufferData(GL_SHADER_STORAGE_BUFFER, 8 * sizeof(glm::vec4) + sizeof(glm::uvec4), nullptr, GL_DYNAMIC_DRAW);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+      // Two DrawElementsIndirectCommands, written by the scan pass.
+      glGenBuffers(1, &filterCommandBuffer);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, filterCommandBuffer);
+      glBufferData(GL_DRAW_INDIRECT_BUFFER, 10 * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    std::string const filterCommonText = R"foo(
+#version 430 core
+
+layout (std430, binding = 0) readonly buffer Filter
+{
+    vec4 clipLower; // w is 1 when the clip box is enabled
+    vec4 clipUpper;
+    vec4 band; // lower and upper height, z is 1 when the band is enabled
+    vec4 colorLower; // w is 1 when the color range is enabled
+    vec4 colorUpper;
+    vec4 sliceNormal; // w is 1 when the slice is enabled
+    vec4 slice; // lower and upper distance along the normal
+    vec4 budget; // x is the fraction of points drawn while the camera moves
+    uvec4 pointLayout; // point count and floats per point
+};
+// The point vertex buffer, pointLayout.y floats per point.
+layout (std430, binding = 1) readonly buffer Points
+{
+    float points[];
+};
+// Survivors per block of 256 points, replaced by the scan with each block's first element.
+layout (std430, binding = 2) buffer BlockOffsets
+{
+    uint blockOffsets[];
+};
+
+bool keep(uint point)
+{
+    uint first = point * pointLayout.y;
+    vec3 position = vec3(points[first], points[first + 1u], points[first + 2u]);
+    if (clipLower.w > 0.0 && (any(lessThan(position, clipLower.xyz)) || any(greaterThan(position, clipUpper.xyz))))
+    {
+        return false;
+    }
+    if (band.z > 0.0 && (position.y < band.x || position.y > band.y))
+    {
+        return false;
+    }
+    if (colorLower.w > 0.0 && pointLayout.y > 6u)
+    {
+        vec3 color = vec3(points[first + 6u], points[first + 7u], points[first + 8u]);
+        if (any(lessThan(color, colorLower.xyz)) || any(greaterThan(color, colorUpper.xyz)))
+        {
+            return false;
+        }
+    }
+    float along = dot(position, sliceNormal.xyz);
+    return sliceNormal.w <= 0.0 || (along >= slice.x && along <= slice.y);
+}
+
+uint blockIndex()
+{
+    return gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+}
+)foo";
+    std::string const filterCountText = filterCommonText + R"foo(
+layout (local_size_x = 256) in;
+
+shared uint blockCount;
+
+void main()
+{
+    uint block = blockIndex();
+    if (block >= (pointLayout.x + 255u) / 256u)
+    {
+        return;
+    }
+    if (gl_LocalInvocationIndex == 0u)
+    {
+        blockCount = 0u;
+    }
+    barrier();
+    uint point = block * 256u + gl_LocalInvocationIndex;
+    if (point < pointLayout.x && keep(point))
+    {
+        atomicAdd(blockCount, 1u);
+    }
+    barrier();
+    if (gl_LocalInvocationIndex == 0u)
+    {
+        blockOffsets[block] = blockCount;
+    }
+}
+)foo";
+    std::string const filterScanText = filterCommonText + R"foo(
+layout (local_size_x = 1024) in;
+
+layout (std430, binding = 4) writeonly buffer Commands
+{
+    uint commands[];
+};
+
+shared uint sums[1024];
+
+void main()
+{
+    uint local = gl_LocalInvocationIndex;
+    uint blocks = (pointLayout.x + 255u) / 256u;
+    uint carry = 0u;
+    for (uint chunk = 0u; chunk < blocks; chunk += 1024u)
+    {
+        uint block = chunk + local;
+        uint count = block < blocks ? blockOffsets[block] : 0u;
+        sums[local] = count;
+        barrier();
+        for (uint offset = 1u; offset < 1024u; offset <<= 1)
+        {
+            uint add = local >= offset ? sums[local - offset] : 0u;
+            barrier();
+            sums[local] += add;
+            barrier();
+        }
+        if (block < blocks)
+        {
+            blockOffsets[block] = carry + sums[local] - count;
+        }
+        carry += sums[1023];
+        barrier();
+    }
+    if (local == 0u)
+    {
+        // Every kept point, then the budget's share of them; both start at the first element.
+        uint budgetCount = min(carry, uint(float(carry) * budget.x));
+        commands[0] = carry;
+        commands[1] = 1u;
+        commands[2] = 0u;
+        commands[3] = 0u;
+        commands[4] = 0u;
+        commands[5] = budgetCount;
+        commands[6] = 1u;
+        commands[7] = 0u;
+        commands[8] = 0u;
+        commands[9] = 0u;
+    }
+}
+)foo";
+    std::string const filterScatterText = filterCommonText + R"foo(
+layout (local_size_x = 256) in;
+
+layout (std430, binding = 3) writeonly buffer Elements
+{
+    uint elements[];
+};
+
+shared uint kept[256];
+
+void main()
+{
+    uint block = blockIndex();
+    if (block >= (pointLayout.x + 255u) / 256u)
+    {
+        return;
+    }
+    uint local = gl_LocalInvocationIndex;
+    uint point = block * 256u + local;
+    bool keeps = point < pointLayout.x && keep(point);
+    kept[local] = keeps ? 1u : 0u;
+    barrier();
+    for (uint offset = 1u; offset < 256u; offset <<= 1)
+    {
+        uint add = local >= offset ? kept[local - offset] : 0u;
+        barrier();
+        kept[local] += add;
+        barrier();
+    }
+    if (keeps)
+    {
+        elements[blockOffsets[block] + kept[local] - 1u] = point;
+    }
+}
+)foo";
+
+    /* Filter Programs */
+    {
+      auto buildProgram = [this](std::string const& source, char const* name, GLuint& shader, GLuint& program)
+      {
+        char const* text = source.c_str();
+        shader = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(shader, 1, &text, 0);
+        glCompileShader(shader);
+        if (!checkShaderCompile(shader, name))
+        {
+          return false;
+        }
+        program = glCreateProgram();
+        glAttachShader(program, shader);
+        glLinkProgram(program);
+        return true;
+      };
+      if (!buildProgram(filterCountText, "FILTER COUNT COMPUTE", filterCountShader, filterCountProgram)
+        || !buildProgram(filterScanText, "FILTER SCAN COMPUTE", filterScanShader, filterScanProgram)
+        || !buildProgram(filterScatterText, "FILTER SCATTER COMPUTE", filterScatterShader, filterScatterProgram))
+      {
+        return;
+      }
+    }
+  }
+  /* Occlusion culling of the point index's nodes as chunks. The early pass draws the chunks that
+   * were visible last frame, a pyramid of the farthest depth per texel is reduced from their
+   * G-buffer, and the late pass tests every chunk's screen bounds against it, draws the newly
+   * visible ones and remembers which chunks are visible for the next frame. */
+  void setupOcclusionCulling()
+  {
+    /* Depth Pyramid */
+    {
+      pyramidLevels = 1;
+      while ((std::max(windowWidth, windowHeight) >> pyramidLevels) > 0)
+      {
+        ++pyramidLevels;
+      }
+      glGenTextures(1, &depthPyramid);
+      glBindTexture(GL_TEXTURE_2D, depthPyramid);
+      glTexStorage2D(GL_TEXTURE_2D, pyramidLevels, GL_R32F, windowWidth, windowHeight);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, pyramidLevels - 1);
+      glBindTexture(GL_TEXTURE_2D, 0);
+      glGenBuffers(1, &chunkStatisticsBuffer);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, chunkStatisticsBuffer);
+      glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    std::string const pyramidBaseText = R"foo(
+#version 430 core
+layout (local_size_x = 16, local_size_y = 16) in;
+
+layout(binding=0) uniform sampler2D positionTextureIn;
+layout (r32f, binding = 0) writeonly uniform image2D pyramidBase;
+const float zeroTol = 1e-6;
+
+float depthAt(ivec2 at)
+{
+    ivec2 texSize = textureSize(positionTextureIn, 0);
+    if(any(lessThan(at, ivec2(0))) || any(greaterThanEqual(at, texSize)))
+        return 0.0;
+    return texelFetch(positionTextureIn, at, 0).a;
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if(any(greaterThanEqual(pixel, textureSize(positionTextureIn, 0))))
+        return;
+    float depth = depthAt(pixel);
+    if(depth < zeroTol)
+    {
+        // A gap between points on opposite sides is one the background fill closes, so it
+        // occludes as the nearer of its neighbours. Other empty pixels are open to the far plane.
+        const ivec2 sides[4] = ivec2[](ivec2(1, 0), ivec2(0, 1), ivec2(1, 1), ivec2(1, -1));
+        depth = 1.0;
+        bool gap = false;
+        for(int i = 0; i < 4; i++)
+        {
+            float forward = depthAt(pixel + sides[i]);
+            float backward = depthAt(pixel - sides[i]);
+            if(forward > zeroTol && backward > zeroTol)
+            {
+                gap = true;
+                depth = min(depth, min(forward, backward));
+            }
+        }
+        depth = gap ? depth : 1.0;
+    }
+    imageStore(pyramidBase, pixel, vec4(depth));
+}
+)foo";
+    std::string const pyramidReduceText = R"foo(
+#version 430 core
+layout (local_size_x = 16, local_size_y = 16) in;
+
+layout (r32f, binding = 0) readonly uniform image2D source;
+layout (r32f, binding = 1) writeonly uniform image2D destination;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(destination);
+    if(any(greaterThanEqual(texel, size)))
+        return;
+    // The last column and row also cover the leftover texels of an odd source.
+    ivec2 sourceSize = imageSize(source);
+    ivec2 first = texel * 2;
+    ivec2 last = first + 1;
+    if(texel.x == size.x - 1)
+        last.x = sourceSize.x - 1;
+    if(texel.y == size.y - 1)
+        last.y = sourceSize.y - 1;
+    last = min(last, sourceSize - 1);
+    float farthest = 0.0;
+    for(int y = first.y; y <= last.y; y++)
+        for(int x = first.x; x <= last.x; x++)
+            farthest = max(farthest, imageLoad(source, ivec2(x, y)).r);
+    imageStore(destination, texel, vec4(farthest));
+}
+)foo";
+    std::string const cullText = R"foo(
+#version 430 core
+layout (local_size_x = 64) in;
+
+struct Chunk
+{
+    vec4 lower;
+    vec4 upper;
+    uvec4 points; // first point and point count
+};
+layout (std430, binding = 0) readonly buffer Chunks
+{
+    Chunk chunks[];
+};
+// 1 for the chunks the late pass found visible.
+layout (std430, binding = 1) buffer Visible
+{
+    uint visible[];
+};
+// A DrawArraysIndirectCommand per chunk for the early pass, then one per chunk for the late pass.
+layout (std430, binding = 2) writeonly buffer Commands
+{
+    uint commands[];
+};
+layout (std430, binding = 3) buffer Statistics
+{
+    uint pointsDrawn[2];
+};
+layout(binding=0) uniform sampler2D depthPyramid;
+
+uniform mat4 model;
+uniform mat4 viewProjection;
+uniform vec3 viewPos;
+uniform int phase;
+uniform int chunkCount;
+// Depth as the point shaders store it, rounded to the 8 bits of the position texture's alpha.
+const float zFar = 100.0;
+const float depthMargin = 1.0 / 255.0;
+
+bool isVisible(Chunk chunk, bool testOcclusion)
+{
+    vec3 worldLower = vec3(1e30);
+    vec3 worldUpper = vec3(-1e30);
+    vec2 screenLower = vec2(1.0);
+    vec2 screenUpper = vec2(-1.0);
+    uint outside = 63u;
+    bool behind = false;
+    for(int i = 0; i < 8; i++)
+    {
+        vec3 corner = mix(chunk.lower.xyz, chunk.upper.xyz, vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+        vec3 world = vec3(model * vec4(corner, 1.0));
+        worldLower = min(worldLower, world);
+        worldUpper = max(worldUpper, world);
+        vec4 clip = viewProjection * vec4(world, 1.0);
+        uint planes = (clip.x < -clip.w ? 1u : 0u) | (clip.x > clip.w ? 2u : 0u) | (clip.y < -clip.w ? 4u : 0u)
+            | (clip.y > clip.w ? 8u : 0u) | (clip.z < -clip.w ? 16u : 0u) | (clip.z > clip.w ? 32u : 0u);
+        outside &= planes;
+        if(clip.w <= 0.0)
+        {
+            behind = true;
+        }
+        else
+        {
+            screenLower = min(screenLower, clip.xy / clip.w);
+            screenUpper = max(screenUpper, clip.xy / clip.w);
+        }
+    }
+    // Outside one frustum plane with every corner.
+    if(outside != 0u)
+        return false;
+    // Bounds reaching behind the camera have no screen rectangle to test.
+    if(!testOcclusion || behind)
+        return true;
+    vec2 size = vec2(textureSize(depthPyramid, 0));
+    vec2 pixelLower = clamp((screenLower * 0.5 + 0.5) * size, vec2(0.0), size - 1.0);
+    vec2 pixelUpper = clamp((screenUpper * 0.5 + 0.5) * size, vec2(0.0), size - 1.0);
+    // The level where the rectangle spans at most 2x2 texels.
+    vec2 extent = pixelUpper - pixelLower;
+    int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, textureQueryLevels(depthPyramid) - 1);
+    ivec2 last = textureSize(depthPyramid, level) - 1;
+    ivec2 lowerTexel = min(ivec2(pixelLower) >> level, last);
+    ivec2 upperTexel = min(ivec2(pixelUpper) >> level, last);
+    float farthest = 0.0;
+    for(int y = lowerTexel.y; y <= upperTexel.y; y++)
+        for(int x = lowerTexel.x; x <= upperTexel.x; x++)
+            farthest = max(farthest, texelFetch(depthPyramid, ivec2(x, y), level).r);
+    float nearest = length(max(max(worldLower - viewPos, viewPos - worldUpper), vec3(0.0))) / zFar;
+    return nearest <= farthest + depthMargin;
+}
+
+void main()
+{
+    uint chunk = gl_GlobalInvocationID.x;
+    if(chunk >= uint(chunkCount))
+        return;
+    Chunk bounds = chunks[chunk];
+    bool draw;
+    if(phase == 0)
+    {
+        // Last frame's visible chunks are drawn untested; they are the occluders.
+        draw = visible[chunk] != 0u && isVisible(bounds, false);
+    }
+    else
+    {
+        bool nowVisible = isVisible(bounds, true);
+        draw = nowVisible && visible[chunk] == 0u;
+        visible[chunk] = nowVisible ? 1u : 0u;
+    }
+    uint command = (uint(phase) * uint(chunkCount) + chunk) * 4u;
+    commands[command] = draw ? bounds.points.y : 0u;
+    commands[command + 1u] = 1u;
+    commands[command + 2u] = bounds.points.x;
+    commands[command + 3u] = 0u;
+    if(draw)
+        atomicAdd(pointsDrawn[phase], bounds.points.y);
+}
+)foo";
+
+    /* Occlusion Culling Programs */
+    {
+      auto buildProgram = [this](std::string const& source, char const* name, GLuint& shader, GLuint& program)
+      {
+        char const* text = source.c_str();
+        shader = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(shader, 1, &text, 0);
+        glCompileShader(shader);
+        if (!checkShaderCompile(shader, name))
+        {
+          return false;
+        }
+        program = glCreateProgram();
+        glAttachShader(program, shader);
+        glLinkProgram(program);
+        return true;
+      };
+      if (!buildProgram(pyramidBaseText, "DEPTH PYRAMID BASE COMPUTE", pyramidBaseShader, pyramidBaseProgram)
+        || !buildProgram(pyramidReduceText, "DEPTH PYRAMID REDUCE COMPUTE", pyramidReduceShader, pyramidReduceProgram)
+        || !buildProgram(cullText, "CHUNK CULL COMPUTE", cullShader, cullProgram))
+      {
+        return;
+      }
+      if (!assignShaderUniform(cullProgram, cullModelLoc, "model") ||
+        !assignShaderUniform(cullProgram, cullViewProjectionLoc, "viewProjection") ||
+        !assignShaderUniform(cullProgram, cullViewPosLoc, "viewPos") ||
+        !assignShaderUniform(cullProgram, cullPhaseLoc, "phase") ||
+        !assignShaderUniform(cullProgram, cullChunkCountLoc, "chunkCount"))
+      {
+        return;
+      }
+    }
+  }
+  /* Fused post-processing: one compute kernel per 16x16 tile does the smoothing, the anti-aliasing
+   * and the feature line test of the unfused passes on a shared memory copy of the filled G-buffer,
+   * rounding every intermediate to the format of the attachment it would have been stored in. */
+  void setupFusedPost()
+  {
+    /* Fused Post Compute Shader */
+    {
+      const char* fusedPostText = R"foo(
+#version 430 core
+layout (local_size_x = 16, local_size_y = 16) in;
+
+layout(binding=0) uniform sampler2D positionTextureIn;
+layout(binding=1) uniform sampler2D normalTextureIn;
+layout(binding=2) uniform sampler2D colorTextureIn;
+layout(rgba8, binding=0) writeonly uniform image2D outputImage;
+uniform bool smoothTile;
+const float zeroTol = 1e-6;
+
+// The filled G-buffer three pixels around the tile, since smoothing, the Laplacian and the
+// curvature test each reach one pixel further. Normals are kept as half floats and colors as
+// 8-bit, which is what the G-buffer attachments store.
+shared float filledDepth[22 * 22];
+shared uvec2 filledNormal[22 * 22];
+shared uint filledColor[22 * 22];
+shared uvec2 smoothNormal[20 * 20];
+shared bool smoothValid[20 * 20];
+shared uvec2 aliasedNormal[18 * 18];
+
+const ivec2 offsets[9] = ivec2[](
+        ivec2(-1,  1), ivec2( 0,  1), ivec2( 1,  1),
+        ivec2(-1,  0), ivec2( 0,  0), ivec2( 1,  0),
+        ivec2(-1, -1), ivec2( 0, -1), ivec2( 1, -1)
+    );
+const float alleviatedGaussian[9] = float[](
+        1.0/16.0, 2.0/16.0, 1.0/16.0,
+        2.0/16.0, 16.0/28.0, 2.0/16.0,
+        1.0/16.0, 2.0/16.0, 1.0/16.0
+    );
+const float laplaceFilter[9] = float[](
+        0.0, -1.0, 0.0,
+        -1.0, 4.0, -1.0,
+        0.0, -1.0, 0.0
+    );
+const float featureFilter[9] = float[](
+        1.0/8.0,1.0/8.0, 1.0/8.0,
+        1.0/8.0, 0.0, 1.0/8.0,
+        1.0/8.0, 1.0/8.0, 1.0/8.0
+    );
+
+uvec2 toHalf(vec3 v)
+{
+    return uvec2(packHalf2x16(v.xy), packHalf2x16(vec2(v.z, 0.0)));
+}
+
+vec3 fromHalf(uvec2 h)
+{
+    return vec3(unpackHalf2x16(h.x), unpackHalf2x16(h.y).x);
+}
+
+// The smoothing pass at a pixel of the 22x22 tile, in the same order of operations.
+void smoothTexel(ivec2 at, out vec3 normal, out vec4 color)
+{
+    int center = at.y * 22 + at.x;
+    float sampleTex[9];
+    for(int i = 0; i < 9; i++)
+        sampleTex[i] = filledDepth[center + offsets[i].y * 22 + offsets[i].x];
+    if(!smoothTile || abs(sampleTex[4]) < zeroTol)
+    {
+        normal = fromHalf(filledNormal[center]);
+        color = unpackUnorm4x8(filledColor[center]);
+        return;
+    }
+    float weights[9];
+    float totalWeight = 0.0;
+    for(int i = 0; i < 9; i++)
+    {
+        weights[i] = alleviatedGaussian[i] * step(zeroTol, sampleTex[i]);
+        totalWeight += weights[i];
+    }
+    normal = vec3(0.0);
+    color = vec4(0.0);
+    for(int i = 0; i < 9; i++)
+    {
+        int tap = center + offsets[i].y * 22 + offsets[i].x;
+        normal += (weights[i] / totalWeight) * fromHalf(filledNormal[tap]);
+        color += (weights[i] / totalWeight) * unpackUnorm4x8(filledColor[tap]);
+    }
+}
+
+void main()
+{
+    ivec2 texSize = textureSize(positionTextureIn, 0);
+    ivec2 tileOrigin = ivec2(gl_WorkGroupID.xy) * 16;
+    int local = int(gl_LocalInvocationIndex);
+    for(int i = local; i < 22 * 22; i += 256)
+    {
+        // Wraps at the borders like the repeating texture lookups of the unfused passes.
+        ivec2 texel = (tileOrigin + ivec2(i % 22, i / 22) - 3 + texSize) % texSize;
+        filledDepth[i] = texelFetch(positionTextureIn, texel, 0).a;
+        filledNormal[i] = toHalf(texelFetch(normalTextureIn, texel, 0).xyz);
+        filledColor[i] = packUnorm4x8(texelFetch(colorTextureIn, texel, 0));
+    }
+    barrier();
+    // Smoothing; a pixel stays covered exactly when it was covered after the fills.
+    for(int i = local; i < 20 * 20; i += 256)
+    {
+        ivec2 at = ivec2(i % 20, i / 20) + 1;
+        vec3 normal;
+        vec4 color;
+        smoothTexel(at, normal, color);
+        smoothNormal[i] = toHalf(normal);
+        smoothValid[i] = filledDepth[at.y * 22 + at.x] >= zeroTol;
+    }
+    barrier();
+    // Anti-aliasing keeps covered pixels and puts the Laplacian into the empty ones.
+    for(int i = local; i < 18 * 18; i += 256)
+    {
+        ivec2 at = ivec2(i % 18, i / 18) + 1;
+        int center = at.y * 20 + at.x;
+        if(smoothValid[center])
+        {
+            aliasedNormal[i] = smoothNormal[center];
+        }
+        else
+        {
+            vec3 normal = vec3(0.0);
+            for(int j = 0; j < 9; j++)
+                normal += laplaceFilter[j] * fromHalf(smoothNormal[center + offsets[j].y * 20 + offsets[j].x]);
+            aliasedNormal[i] = toHalf(normal);
+        }
+    }
+    barrier();
+    ivec2 pixel = tileOrigin + ivec2(gl_LocalInvocationID.xy);
+    if(any(greaterThanEqual(pixel, texSize)))
+    {
+        return;
+    }
+    // Illustration; uncovered pixels keep the white the output is cleared to.
+    ivec2 at = ivec2(gl_LocalInvocationID.xy) + 1;
+    vec4 fragColor = vec4(1.0);
+    if(smoothValid[(at.y + 1) * 20 + at.x + 1])
+    {
+        int center = at.y * 18 + at.x;
+        vec3 centerNormal = fromHalf(aliasedNormal[center]);
+        float curvature = 0.0;
+        for(int i = 0; i < 9; i++)
+            curvature += featureFilter[i] * dot(fromHalf(aliasedNormal[center + offsets[i].y * 18 + offsets[i].x]), centerNormal);
+        if(curvature > .975)
+        {
+            vec3 normal;
+            vec4 color;
+            smoothTexel(at + 2, normal, color);
+            fragColor = unpackUnorm4x8(packUnorm4x8(color));
+        }
+        else
+        {
+            fragColor = vec4(0.0,0.0,0.0,1.0);
+        }
+    }
+    imageStore(outputImage, pixel, fragColor);
+}
+)foo";
+      fusedPostShader = glCreateShader(GL_COMPUTE_SHADER);
+      glShaderSource(fusedPostShader, 1, &fusedPostText, 0);
+      glCompileShader(fusedPostShader);
+      if (!checkShaderCompile(fusedPostShader, "FUSED POST COMPUTE"))
+      {
+        return;
+      }
+    }
+
+    /* Fused Post Program */
+    {
+      fusedPostProgram = glCreateProgram();
+      glAttachShader(fusedPostProgram, fusedPostShader);
+      glLinkProgram(fusedPostProgram);
+      glUseProgram(fusedPostProgram);
+      if (!assignShaderUniform(fusedPostProgram, fusedPostSmoothLoc, "smoothTile"))
+      {
+        return;
+      }
+    }
+  }
+  /* The point program depends on the layout of the loaded points, so it is rebuilt when a
+   * newly loaded cloud changes it. */
+  void setupPointProgram()
+  {
+    /* Point Vertex Shader */
+    {
+      const GLchar* pointVertText = pointStride > 6 ? R"foo(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec3 aColor;
+layout (location = 4) in float aRadius;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec3 Color;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform float splatScale;
+
+void main()
+{
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    Color = aColor;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+    // Projected splat diameter in pixels; splatScale is 0 without adaptive splats.
+    gl_PointSize = clamp(aRadius * splatScale / gl_Position.w, 1.0, 16.0);
+}
+)foo" : R"foo(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 4) in float aRadius;
+
+out vec3 FragPos;
+out vec3 Normal;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform float splatScale;
+
+void main()
+{
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+    // Projected splat diameter in pixels; splatScale is 0 without adaptive splats.
+    gl_PointSize = clamp(aRadius * splatScale / gl_Position.w, 1.0, 16.0);
+}
+)foo";
+      if (!sceneDraws.empty())
+      {
+        pointVertText = R"foo(
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec3 aColor;
+layout (location = 3) in uint aObject;
+layout (location = 4) in float aRadius;
+
+struct SceneObject
+{
+    mat4 model;
+    mat4 normalMatrix;
+    vec4 objectColor; // rgb for clouds without colors, a is 1 when the cloud has them
+    uvec4 points; // first point and point count in the shared buffer
+};
+layout (std430, binding = 0) readonly buffer SceneObjects
+{
+    SceneObject objects[];
+};
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec3 Color;
+flat out float HasColor;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform float splatScale;
+
+void main()
+{
+    SceneObject object = objects[aObject];
+    FragPos = vec3(model * object.model * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(model))) * mat3(object.normalMatrix) * aNormal;
+    Color = object.objectColor.a > 0.5 ? aColor : object.objectColor.rgb;
+    HasColor = object.objectColor.a;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+    // Projected splat diameter in pixels; splatScale is 0 without adaptive splats.
+    gl_PointSize = clamp(aRadius * length(object.model[0].xyz) * splatScale / gl_Position.w, 1.0, 16.0);
+}
+)foo";
+      }
+      pointVertShader = glCreateShader(GL_VERTEX_SHADER);
+      glShaderSource(pointVertShader, 1, &pointVertText, 0);
+      glCompileShader(pointVertShader);
+      if (!checkShaderCompile(pointVertShader, "ILLUMINATE VERTEX"))
+      {
+        return;
+      }
+    }
+    
+    /* Point Fragment Shader*/
+    {
+      const char* pointFragText = pointStride > 6 ? R"foo(
+#version 330 core
+
+in vec3 Normal;  
+in vec3 FragPos;
+in vec3 Color;
+
+layout (location = 0) out vec4 positionTexture;
+layout (location = 1) out vec3 normalTexture;
+layout (location = 2) out vec4 colorTexture;
+uniform vec3 lightPos; 
+uniform vec3 viewPos;
+uniform bool deferredLighting;
+uniform bool estimatedNormals;
+
+void main()
+{
+    // Round splats; a 1 pixel point samples the center.
+    vec2 fromCenter = gl_PointCoord - vec2(0.5);
+    if (dot(fromCenter, fromCenter) > 0.25) discard;
+    vec3 lightColor = vec3(.1,.1,.1);
+    vec3 objectColor = Color;
+    // ambient
+    float ambientStrength = 0.1;
+    vec3 ambient = ambientStrength * lightColor;
+  	
+    // diffuse 
+    vec3 norm = normalize(Normal);
+    vec3 lightDir = normalize(lightPos - FragPos);
+    // Points without normals are all kept; their normals come from the filled G-buffer.
+    if(!estimatedNormals && dot(lightDir,norm) < 0.0) discard;
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = diff * lightColor;
+    
+    // specular
+    float specularStrength = 0.5;
+    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);  
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+    vec3 specular = specularStrength * spec * lightColor;  
+    
+    float zFar = 100.0;  
+    normalTexture = Normal;
+    // Deferred lighting shades after the fills, from the unlit color and the light's brightness.
+    colorTexture.rgba = deferredLighting ? vec4(objectColor, lightColor.r) : vec4((ambient + diffuse + specular) * objectColor, 1.0);
+    positionTexture.xyz = FragPos;
+    positionTexture.a =  distance(FragPos, viewPos) / zFar;
+} 
+)foo" : R"foo(
+#version 330 core
+
+in vec3 Normal;  
+in vec3 FragPos;  
+
+layout (location = 0) out vec4 positionTexture;
+layout (location = 1) out vec3 normalTexture;
+layout (location = 2) out vec4 colorTexture;
+uniform vec3 lightPos; 
+uniform vec3 viewPos;
+uniform bool deferredLighting;
+uniform bool estimatedNormals;
+
+void main()
+{
+    // Round splats; a 1 pixel point samples the center.
+    vec2 fromCenter = gl_PointCoord - vec2(0.5);
+    if (dot(fromCenter, fromCenter) > 0.25) discard;
+    vec3 lightColor = vec3(1.0,1.0,1.0);
+    vec3 objectColor = vec3(.6,.6,.9);
+    // ambient
+    float ambientStrength = 0.1;
+    vec3 ambient = ambientStrength * lightColor;
+  	
+    // diffuse 
+    vec3 norm = normalize(Normal);
+    vec3 lightDir = normalize(lightPos - FragPos);
+    // Points without normals are all kept; their normals come from the filled G-buffer.
+    if(!estimatedNormals && dot(lightDir,norm) < 0.0) discard;
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = diff * lightColor;
+    
+    // specular
+    float specularStrength = 0.5;
+    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);  
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+    vec3 specular = specularStrength * spec * lightColor;  
+    
+    float zFar = 100.0;
+    normalTexture = Normal;
+    // Deferred lighting shades after the fills, from the unlit color and the light's brightness.
+    colorTexture.rgba = deferredLighting ? vec4(objectColor, lightColor.r) : vec4((ambient + diffuse + specular) * objectColor, 1.0);
+    positionTexture.xyz = FragPos;
+    positionTexture.a =  distance(FragPos, viewPos) / zFar;
+} 
+)foo";
+      if (!sceneDraws.empty())
+      {
+        pointFragText = R"foo(
+#version 430 core
+
+in vec3 Normal;
+in vec3 FragPos;
+in vec3 Color;
+flat in float HasColor;
+
+layout (location = 0) out vec4 positionTexture;
+layout (location = 1) out vec3 normalTexture;
+layout (location = 2) out vec4 colorTexture;
+uniform vec3 lightPos;
+uniform vec3 viewPos;
+uniform bool deferredLighting;
+uniform bool estimatedNormals;
+
+void main()
+{
+    // Round splats; a 1 pixel point samples the center.
+    vec2 fromCenter = gl_PointCoord - vec2(0.5);
+    if (dot(fromCenter, fromCenter) > 0.25) discard;
+    // Colored clouds are lit dimmer, as in the single cloud shaders.
+    vec3 lightColor = HasColor > 0.5 ? vec3(.1,.1,.1) : vec3(1.0,1.0,1.0);
+    vec3 objectColor = Color;
+    // ambient
+    float ambientStrength = 0.1;
+    vec3 ambient = ambientStrength * lightColor;
+
+    // diffuse
+    vec3 norm = normalize(Normal);
+    vec3 lightDir = normalize(lightPos - FragPos);
+    // Points without normals are all kept; their normals come from the filled G-buffer.
+    if(!estimatedNormals && dot(lightDir,norm) < 0.0) discard;
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = diff * lightColor;
+
+    // specular
+    float specularStrength = 0.5;
+    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+    vec3 specular = specularStrength * spec * lightColor;
+
+    float zFar = 100.0;
+    normalTexture = Normal;
+    // Deferred lighting shades after the fills, from the unlit color and the light's brightness.
+    colorTexture.rgba = deferredLighting ? vec4(objectColor, lightColor.r) : vec4((ambient + diffuse + specular) * objectColor, 1.0);
+    positionTexture.xyz = FragPos;
+    positionTexture.a =  distance(FragPos, viewPos) / zFar;
+}
+)foo";
+      }
+      pointFragShader = glCreateShader(GL_FRAGMENT_SHADER);
+      glShaderSource(pointFragShader, 1, &pointFragText, 0);
+      glCompileShader(pointFragShader);
+      if (!checkShaderCompile(pointFragShader, "ILLUMINATE FRAGMENT"))
+      {
+        return;
+      }
+    }
+
+    /* Point Program */
+    {
+      pointProgram = glCreateProgram();
+      glAttachShader(pointProgram, pointVertShader);
+      glAttachShader(pointProgram, pointFragShader);
+      glLinkProgram(pointProgram);
+      glUseProgram(pointProgram);
+      if (!assignShaderUniform(pointProgram, pointModelLoc, "model"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(pointProgram, pointViewLoc, "view"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(pointProgram, pointProjectionLoc, "projection"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(pointProgram, pointLightPosLoc, "lightPos"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(pointProgram, pointViewPosLoc, "viewPos"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(pointProgram, pointSplatScaleLoc, "splatScale"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(pointProgram, pointDeferredLightingLoc, "deferredLighting"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(pointProgram, pointEstimatedNormalsLoc, "estimatedNormals"))
+      {
+        return;
+      }
+    }
+
+    if (!visibilityBuffer)
+    {
+      return;
+    }
+
+    /* Visibility Point Vertex Shader */
+    {
+      const GLchar* visibilityPointVertText = R"foo(
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 4) in float aRadius;
+
+out vec3 FragPos;
+out vec3 Normal;
+flat out uint PointIndex;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform float splatScale;
+
+void main()
+{
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(model))) * aNormal;
+    PointIndex = uint(gl_VertexID);
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+    // Projected splat diameter in pixels; splatScale is 0 without adaptive splats.
+    gl_PointSize = clamp(aRadius * splatScale / gl_Position.w, 1.0, 16.0);
+}
+)foo";
+      if (!sceneDraws.empty())
+      {
+        visibilityPointVertText = R"foo(
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 3) in uint aObject;
+layout (location = 4) in float aRadius;
+
+struct SceneObject
+{
+    mat4 model;
+    mat4 normalMatrix;
+    vec4 objectColor; // rgb for clouds without colors, a is 1 when the cloud has them
+    uvec4 points; // first point and point count in the shared buffer
+};
+layout (std430, binding = 0) readonly buffer SceneObjects
+{
+    SceneObject objects[];
+};
+
+out vec3 FragPos;
+out vec3 Normal;
+flat out uint PointIndex;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform float splatScale;
+
+void main()
+{
+    SceneObject object = objects[aObject];
+    FragPos = vec3(model * object.model * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(model))) * mat3(object.normalMatrix) * aNormal;
+    // gl_VertexID counts from the draw's first point, so it indexes the shared buffer.
+    PointIndex = uint(gl_VertexID);
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+    // Projected splat diameter in pixels; splatScale is 0 without adaptive splats.
+    gl_PointSize = clamp(aRadius * length(object.model[0].xyz) * splatScale / gl_Position.w, 1.0, 16.0);
+}
+)foo";
+      }
+      visibilityPointVertShader = glCreateShader(GL_VERTEX_SHADER);
+      glShaderSource(visibilityPointVertShader, 1, &visibilityPointVertText, 0);
+      glCompileShader(visibilityPointVertShader);
+      if (!checkShaderCompile(visibilityPointVertShader, "VISIBILITY VERTEX"))
+      {
+        return;
+      }
+    }
+
+    /* Visibility Point Fragment Shader */
+    {
+      const char* visibilityPointFragText = R"foo(
+#version 430 core
+
+in vec3 Normal;
+in vec3 FragPos;
+flat in uint PointIndex;
+
+layout (location = 0) out uint visibility;
+uniform vec3 lightPos;
+uniform vec3 viewPos;
+
+void main()
+{
+    // The splat shape and back face test of the G-buffer pass, so the same fragments survive.
+    vec2 fromCenter = gl_PointCoord - vec2(0.5);
+    if (dot(fromCenter, fromCenter) > 0.25) discard;
+    vec3 norm = normalize(Normal);
+    vec3 lightDir = normalize(lightPos - FragPos);
+    if(dot(lightDir,norm) < 0.0) discard;
+
+    // The depth keeps the 8 bits of the position texture's alpha, so the fills compare the same values.
+    float zFar = 100.0;
+    uint depth = uint(round(clamp(distance(FragPos, viewPos) / zFar, 0.0, 1.0) * 255.0));
+    visibility = (depth << 24) | (PointIndex + 1u);
+}
+)foo";
+      visibilityPointFragShader = glCreateShader(GL_FRAGMENT_SHADER);
+      glShaderSource(visibilityPointFragShader, 1, &visibilityPointFragText, 0);
+      glCompileShader(visibilityPointFragShader);
+      if (!checkShaderCompile(visibilityPointFragShader, "VISIBILITY FRAGMENT"))
+      {
+        return;
+      }
+    }
+
+    /* Visibility Point Program */
+    {
+      visibilityPointProgram = glCreateProgram();
+      glAttachShader(visibilityPointProgram, visibilityPointVertShader);
+      glAttachShader(visibilityPointProgram, visibilityPointFragShader);
+      glLinkProgram(visibilityPointProgram);
+      glUseProgram(visibilityPointProgram);
+      if (!assignShaderUniform(visibilityPointProgram, visibilityModelLoc, "model"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(visibilityPointProgram, visibilityViewLoc, "view"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(visibilityPointProgram, visibilityProjectionLoc, "projection"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(visibilityPointProgram, visibilityLightPosLoc, "lightPos"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(visibilityPointProgram, visibilityViewPosLoc, "viewPos"))
+      {
+        return;
+      }
+      if (!assignShaderUniform(visibilityPointProgram, visibilitySplatScaleLoc, "splatScale"))
+      {
+        return;
+      }
+    }
+  }
+  bool setupHeadlessContext()
+  {
+#ifdef HEADLESS_EGL
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+    {
+      eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (eglDisplay == EGL_NO_DISPLAY)
+    {
+      eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, NULL, NULL))
+    {
+      std::cerr << "EGL DISPLAY COULD NOT BE INITIALIZED" << std::endl;
+      return false;
+    }
+    // Prefer a pbuffer config; surfaceless displays may only offer configs without surfaces.
+    EGLint configAttribs[] = {
+      EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_RED_SIZE, 8,
+      EGL_GREEN_SIZE, 8,
+      EGL_BLUE_SIZE, 8,
+      EGL_DEPTH_SIZE, 24,
+      EGL_NONE };
+    EGLConfig config;
+    EGLint configCount = 0;
+    bool const hasPbuffer = eglChooseConfig(eglDisplay, configAttribs, &config, 1, &configCount) && configCount > 0;
+    if (!hasPbuffer)
+    {
+      configAttribs[1] = EGL_DONT_CARE;
+      if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &configCount) || configCount == 0)
+      {
+        std::cerr << "NO SUITABLE EGL CONFIG" << std::endl;
+        return false;
+      }
+    }
+    eglBindAPI(EGL_OPENGL_API);
+    EGLint const contextAttribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION, 4,
+      EGL_CONTEXT_MINOR_VERSION, 4,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_NONE };
+    eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+    if (eglContext == EGL_NO_CONTEXT)
+    {
+      std::cerr << "EGL CONTEXT COULD NOT BE CREATED" << std::endl;
+      return false;
+    }
+    if (hasPbuffer)
+    {
+      // Rendering goes to outputBuffer, the pbuffer only has to make the context current.
+      EGLint const pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+      eglSurface = eglCreatePbufferSurface(eglDisplay, config, pbufferAttribs);
+    }
+    if (!eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext))
+    {
+      std::cerr << "EGL CONTEXT COULD NOT BE MADE CURRENT" << std::endl;
+      return false;
+    }
+    return gladLoadGLLoader((GLADloadproc)eglGetProcAddress) != 0;
+#else
+    glfwSetErrorCallback(error_callback);
+    if (!glfwInit())
+    {
+      return false;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    window = glfwCreateWindow(windowWidth, windowHeight, "Rosenthal-Linsen-Lars-2008", NULL, NULL);
+    if (!window)
+    {
+      return false;
+    }
+    glfwMakeContextCurrent(window);
+    return gladLoadGLLoader((GLADloadproc)glfwGetProcAddress) != 0;
+#endif
+  }
+  void setupOutputBuffer()
+  {
+    if (failState)
+    {
+      return;
+    }
+    glGenFramebuffers(1, &outputBuffer);
+    glGenRenderbuffers(1, &outputColorBuffer);
+    glGenRenderbuffers(1, &outputDepthBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, outputBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, outputColorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, windowWidth, windowHeight);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, outputColorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, outputDepthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, windowWidth, windowHeight);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, outputDepthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+      std::cerr << "OUTPUT BUFFER COULD NOT BE CREATED" << std::endl;
+      failState = true;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // The viewport starts at the size of the surface the context was made current on, a 1x1 pbuffer or none at all.
+    glViewport(0, 0, windowWidth, windowHeight);
+  }
+  GLFWwindow* setupWindow()
+  {
+    glfwSetErrorCallback(error_callback);
+    if (!glfwInit())
+    {
+      return nullptr;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+    GLFWwindow* window = glfwCreateWindow(windowWidth, windowHeight, "Rosenthal-Linsen-Lars-2008", NULL, NULL);
+    glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+    glfwSetDropCallback(window, drop_callback);
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    glfwMakeContextCurrent(window);
+    gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+    glfwSwapInterval(vsync ? 1 : 0);
+    return window;
+  }
+  // Replaces the normals of the filled G-buffer with ones from its positions, for --estimate-normals.
+  void estimateNormals(GBufferImages const& source)
+  {
+    glUseProgram(normalsProgram);
+    glUniform3fv(normalsViewPosLoc, 1, &viewPos[0]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, renderGraph->texture(source.position));
+    glBindVertexArray(fboVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindVertexArray(0);
+  }
+  // One direction of --smooth-sigma, 2 * radius + 1 taps per pixel instead of a square kernel's (2 * radius + 1)^2.
+  void smoothSeparable(GBufferImages const& source, int x, int y)
+  {
+    glUseProgram(separableSmoothProgram);
+    glUniform2i(separableSmoothDirectionLoc, x, y);
+    drawScreenPass(separableSmoothProgram, source);
+  }
+  bool failState;
+  GLFWwindow* window;
+  
+  int pointCount;
+  glm::mat4 model;
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::vec3 lightPos;
+  GLuint pointVAO;
+  GLuint pointVBO;
+  GLuint splatRadiusVBO;
+  GLuint pointVertShader;
+  GLuint pointFragShader;
+  GLuint pointProgram;
+  GLuint visibilityPointVertShader;
+  GLuint visibilityPointFragShader;
+  GLuint visibilityPointProgram;
+  GLuint backgroundVisibilityFragShader;
+  GLuint backgroundVisibilityProgram;
+  GLuint occlusionVisibilityFragShader;
+  GLuint occlusionVisibilityProgram;
+  GLuint resolveFragShader;
+  GLuint resolveProgram;
+  GLuint lightCullShader;
+  GLuint lightCullProgram;
+  GLuint lightingFragShader;
+  GLuint lightingProgram;
+  GLuint lightBuffer;
+  GLuint tileLightBuffer;
+  GLuint fboVAO;
+  GLuint fboVBO;
+  GLuint backgroundVertShader;
+  GLuint backgroundFragShader;
+  GLuint backgroundProgram;
+  GLuint occlusionVertShader;
+  GLuint occlusionFragShader;
+  GLuint occlusionProgram;
+  GLuint smoothVertShader;
+  GLuint smoothFragShader;
+  GLuint smoothProgram;
+  GLuint separableSmoothFragShader;
+  GLuint separableSmoothProgram;
+  GLint separableSmoothDirectionLoc;
+  GLuint normalsFragShader;
+  GLuint normalsProgram;
+  GLint normalsViewPosLoc;
+  GLuint fusedPostShader;
+  GLuint fusedPostProgram;
+  GLint fusedPostSmoothLoc;
+  GLuint filterCountShader;
+  GLuint filterCountProgram;
+  GLuint filterScanShader;
+  GLuint filterScanProgram;
+  GLuint filterScatterShader;
+  GLuint filterScatterProgram;
+  GLuint filterParameterBuffer;
+  GLuint filterBlockBuffer;
+  GLuint filterElementBuffer;
+  GLuint filterCommandBuffer;
+  bool filterActive;
+  bool filterDirty;
+  bool filterReport;
+  static int const cullChunkPoints = 4096;
+  GLuint cullShader;
+  GLuint cullProgram;
+  GLuint pyramidBaseShader;
+  GLuint pyramidBaseProgram;
+  GLuint pyramidReduceShader;
+  GLuint pyramidReduceProgram;
+  GLuint depthPyramid;
+  int pyramidLevels;
+  GLuint chunkBuffer;
+  GLuint chunkVisibleBuffer;
+  GLuint chunkCommandBuffer;
+  GLuint chunkStatisticsBuffer;
+  GLsizei chunkCount;
+  int cullPhase;
+  bool cullStatisticsPending;
+  std::vector<std::uint32_t> chunkPointsDrawn;
+  GLint cullModelLoc;
+  GLint cullViewProjectionLoc;
+  GLint cullViewPosLoc;
+  GLint cullPhaseLoc;
+  GLint cullChunkCountLoc;
+  GLuint aaVertShader;
+  GLuint aaFragHighShader;
+  GLuint aaFragLowShader;
+  GLuint aaHighProgram;
+  GLuint aaLowProgram;
+  GLuint illustrateVertShader;
+  GLuint illustrateFragShader;
+  GLuint illustrateProgram;
+  GLint illustrateFeatureLinesLoc;
+  GLint pointModelLoc;
+  GLint pointViewLoc;
+  GLint pointProjectionLoc;
+  GLint pointLightPosLoc;
+  GLint pointViewPosLoc;
+  GLint pointSplatScaleLoc;
+  GLint pointDeferredLightingLoc;
+  GLint pointEstimatedNormalsLoc;
+  GLint visibilityModelLoc;
+  GLint visibilityViewLoc;
+  GLint visibilityProjectionLoc;
+  GLint visibilityLightPosLoc;
+  GLint visibilityViewPosLoc;
+  GLint visibilitySplatScaleLoc;
+  GLint resolveModelLoc;
+  GLint resolveLightPosLoc;
+  GLint resolveViewPosLoc;
+  GLint resolvePointStrideLoc;
+  GLint resolveSceneObjectCountLoc;
+  GLint resolveDeferredLightingLoc;
+  GLint lightCullLightCountLoc;
+  GLint lightingLightCountLoc;
+  GLint lightingViewPosLoc;
+  std::unique_ptr<RenderGraph> renderGraph;
+  GLuint outputBuffer;
+  GLuint outputColorBuffer;
+  GLuint outputDepthBuffer;
+  std::unique_ptr<GpuTimer> passTimer;
+  std::unique_ptr<GpuTimeline> gpuTimeline;
+  std::unique_ptr<FrameCapture> frameCapture;
+  std::unique_ptr<StreamRing> streamRing;
+  std::vector<GLuint> readbackBuffers;
+  GLuint sceneObjectIDs;
+  GLuint sceneObjectBuffer;
+  GLuint sceneDrawBuffer;
+  glm::mat4 lastView;
+  glm::mat4 lastProjection;
+  GLFWwindow* loaderContext;
+  int pointsDrawn;
+  float sceneFraction;
+  std::vector<char const*> backgroundPassNames;
+  std::vector<char const*> occlusionPassNames;
+  std::vector<TimelineZone> cpuFrame;
+  int frameIndex;
+  double streamReportTime;
+  std::uint64_t streamReportPoints;
+  std::int64_t passStart;
+  std::int64_t frameStart;
+  char const* currentPass;
+  Compositor* compositor;
+  GBufferPlanes compositedPlanes;
+  static constexpr float pickTolerance = 5.f;
+  static int const pickNeighbours = 8;
+  std::unique_ptr<PointIndex> pointIndex;
+  bool hasPick;
+  glm::vec3 lastPick;
+#ifdef HEADLESS_EGL
+  EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+  EGLContext eglContext = EGL_NO_CONTEXT;
+  EGLSurface eglSurface = EGL_NO_SURFACE;
+#endif
+};
+
+std::vector<CameraPose> readCameraPath(std::filesystem::path const& pathFile)
+{
+  if (!std::filesystem::exists(pathFile))
+  {
+    throw std::invalid_argument(pathFile.string() + " does not exist");
+  }
+  std::ifstream ss(pathFile);
+  if (ss.fail())
+  {
+    throw std::runtime_error(pathFile.string() + " failed to open");
+  }
+  std::vector<CameraPose> poses;
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(ss, line))
+  {
+    ++lineNumber;
+    line = line.substr(0, line.find('#'));
+    std::istringstream lineStream(line);
+    lineStream >> std::ws;
+    if (lineStream.eof())
+    {
+      continue;
+    }
+    CameraPose pose;
+    lineStream >> pose.position.x >> pose.position.y >> pose.position.z >> pose.front.x >> pose.front.y >> pose.front.z >> pose.fov;
+    if (lineStream.fail() || glm::length(pose.front) < 1e-6f || pose.fov <= 0.f || pose.fov >= 180.f)
+    {
+      throw std::invalid_argument(pathFile.string() + " line " + std::to_string(lineNumber) + " is not \"px py pz fx fy fz fov\"");
+    }
+    poses.push_back(pose);
+  }
+  if (poses.empty())
+  {
+    throw std::invalid_argument(pathFile.string() + " contains no camera poses");
+  }
+  return poses;
+}
+
+void writeCameraPath(std::filesystem::path const& pathFile, std::vector<CameraPose> const& poses)
+{
+  std::ofstream ss(pathFile);
+  if (ss.fail())
+  {
+    throw std::runtime_error(pathFile.string() + " failed to open");
+  }
+  ss << "# px py pz fx fy fz fov" << std::endl;
+  ss << std::setprecision(9);
+  for (CameraPose const& pose : poses)
+  {
+    ss << pose.position.x << " " << pose.position.y << " " << pose.position.z << " "
+      << pose.front.x << " " << pose.front.y << " " << pose.front.z << " " << pose.fov << std::endl;
+  }
+  if (ss.fail())
+  {
+    throw std::runtime_error(pathFile.string() + " failed to write");
+  }
+}
+
+std::vector<PointLight> readLights(std::filesystem::path const& lightFile)
+{
+  if (!std::filesystem::exists(lightFile))
+  {
+    throw std::invalid_argument(lightFile.string() + " does not exist");
+  }
+  std::ifstream ss(lightFile);
+  if (ss.fail())
+  {
+    throw std::runtime_error(lightFile.string() + " failed to open");
+  }
+  std::vector<PointLight> lights;
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(ss, line))
+  {
+    ++lineNumber;
+    line = line.substr(0, line.find('#'));
+    std::istringstream lineStream(line);
+    lineStream >> std::ws;
+    if (lineStream.eof())
+    {
+      continue;
+    }
+    PointLight light;
+    lineStream >> light.position.x >> light.position.y >> light.position.z >> light.color.x >> light.color.y >> light.color.z >> light.radius;
+    if (lineStream.fail() || light.radius <= 0.f)
+    {
+      throw std::invalid_argument(lightFile.string() + " line " + std::to_string(lineNumber) + " is not \"px py pz r g b radius\"");
+    }
+    lights.push_back(light);
+  }
+  if (lights.size() > (std::size_t)maxPointLights)
+  {
+    throw std::invalid_argument(lightFile.string() + " has more than " + std::to_string(maxPointLights) + " lights");
+  }
+  return lights;
+}
+
+std::vector<std::pair<std::filesystem::path, glm::mat4>> readScene(std::filesystem::path const& sceneFile)
+{
+  if (!std::filesystem::exists(sceneFile))
+  {
+    throw std::invalid_argument(sceneFile.string() + " does not exist");
+  }
+  std::ifstream ss(sceneFile);
+  if (ss.fail())
+  {
+    throw std::runtime_error(sceneFile.string() + " failed to open");
+  }
+  std::vector<std::pair<std::filesystem::path, glm::mat4>> objects;
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(ss, line))
+  {
+    ++lineNumber;
+    line = line.substr(0, line.find('#'));
+    std::istringstream lineStream(line);
+    lineStream >> std::ws;
+    if (lineStream.eof())
+    {
+      continue;
+    }
+    std::string path;
+    lineStream >> std::quoted(path);
+    // The optional model matrix is written row by row; glm stores it column major.
+    glm::mat4 model(1.f);
+    lineStream >> std::ws;
+    if (!lineStream.eof())
+    {
+      for (int row = 0; row < 4; ++row)
+      {
+        for (int column = 0; column < 4; ++column)
+        {
+          lineStream >> model[column][row];
+        }
+      }
+      lineStream >> std::ws;
+    }
+    if (path.empty() || lineStream.fail() || !lineStream.eof())
+    {
+      throw std::invalid_argument(sceneFile.string() + " line " + std::to_string(lineNumber) + " is not \"PLY PATH\" [16 matrix values, row major]");
+    }
+    std::filesystem::path objectPath = path;
+    if (objectPath.is_relative())
+    {
+      objectPath = sceneFile.parent_path() / objectPath;
+    }
+    objects.push_back({ objectPath, model });
+  }
+  if (objects.empty())
+  {
+    throw std::invalid_argument(sceneFile.string() + " contains no point clouds");
+  }
+  return objects;
+}
+
+/* Reads every cloud of a scene into one buffer of position, normal and color, filling in
+ * zero colors for clouds without them, and records each cloud's range and transform. The
+ * buffer always has a stride of 9 floats. A cloud re-centered while decoding is moved back by
+ * its transform. */
+std::vector<float> loadScene(std::vector<std::pair<std::filesystem::path, glm::mat4>> const& objects, std::vector<SceneDraw>& draws)
+{
+  std::vector<float> sceneData;
+  for (auto const& object : objects)
+  {
+    int stride = 0;
+    PlyDecodeReport report = {};
+    std::vector<float> const PLYdata = readPLY(object.first, stride, !normalEstimation, cpuThreads, &report);
+    std::size_t const points = PLYdata.size() / stride;
+    glm::mat4 const model = glm::translate(object.second, glm::vec3((float)report.origin[0], (float)report.origin[1], (float)report.origin[2]));
+    draws.push_back({ (GLint)(sceneData.size() / 9), (GLsizei)points, model, stride > 6 });
+    sceneData.reserve(sceneData.size() + points * 9);
+    for (std::size_t i = 0; i < points; ++i)
+    {
+      float const* point = PLYdata.data() + i * stride;
+      sceneData.insert(sceneData.end(), point, point + stride);
+      sceneData.insert(sceneData.end(), 9 - stride, 0.f);
+    }
+  }
+  return sceneData;
+}
+
+/* Reads a PLY file, or a scene file when it does not start with the PLY magic, prepared the way
+ * main prepares the startup file. */
+std::vector<float> readPointFile(std::filesystem::path const& path, int& stride, std::vector<SceneDraw>& draws)
+{
+  char magic[3] = {};
+  std::ifstream(path, std::ios::binary).read(magic, sizeof(magic));
+  std::vector<float> points;
+  if (std::string(magic, sizeof(magic)) == "ply")
+  {
+    points = readPLY(path, stride, !normalEstimation, cpuThreads);
+  }
+  else
+  {
+    points = loadScene(readScene(path), draws);
+    stride = 9;
+  }
+  if (shufflePoints)
+  {
+    if (draws.empty())
+    {
+      stratifyPoints(points, stride, 0, points.size() / stride);
+    }
+    for (SceneDraw const& draw : draws)
+    {
+      stratifyPoints(points, stride, draw.first, draw.count);
+    }
+  }
+  return points;
+}
+
+// Widens lower and upper to hold the given points.
+void boundPoints(std::vector<float> const& PLYdata, glm::vec3& lower, glm::vec3& upper)
+{
+  // Scene clouds are bounded in world space, a single cloud in its own coordinates.
+  std::vector<SceneDraw> draws = sceneDraws;
+  if (draws.empty())
+  {
+    draws.push_back({ 0, (GLsizei)(PLYdata.size() / pointStride), glm::mat4(1.f), pointStride > 6 });
+  }
+  for (SceneDraw const& draw : draws)
+  {
+    for (std::size_t i = draw.first; i < (std::size_t)draw.first + draw.count; ++i)
+    {
+      glm::vec3 const point = glm::vec3(draw.model * glm::vec4(PLYdata[i * pointStride], PLYdata[i * pointStride + 1], PLYdata[i * pointStride + 2], 1.f));
+      lower = glm::min(lower, point);
+      upper = glm::max(upper, point);
+    }
+  }
+}
+
+std::vector<CameraPose> generateOrbit(glm::vec3 lower, glm::vec3 upper, int frames)
+{
+  glm::vec3 const center = (lower + upper) * .5f;
+  float const radius = std::max(glm::length(upper - lower) * .5f, 1e-3f);
+  float const orbitFov = 45.f;
+  float const elevation = glm::radians(20.f);
+  float const distance = radius / std::sin(glm::radians(orbitFov * .5f));
+  std::vector<CameraPose> poses;
+  for (int frame = 0; frame < frames; ++frame)
+  {
+    float const angle = glm::radians(360.f * frame / frames);
+    CameraPose pose;
+    pose.position = center + distance * glm::vec3(std::cos(elevation) * std::cos(angle), std::sin(elevation), std::cos(elevation) * std::sin(angle));
+    pose.front = center - pose.position;
+    pose.fov = orbitFov;
+    poses.push_back(pose);
+  }
+  return poses;
+}
+
+std::vector<CameraPose> generateOrbit(std::vector<float> const& PLYdata, int frames)
+{
+  glm::vec3 lower(std::numeric_limits<float>::max());
+  glm::vec3 upper(-std::numeric_limits<float>::max());
+  boundPoints(PLYdata, lower, upper);
+  return generateOrbit(lower, upper, frames);
+}
+
+int loadCameraPath(std::vector<float> const& PLYdata, std::vector<CameraPose>& cameraPath)
+{
+  if (cameraPathFile.empty())
+  {
+    cameraPath = generateOrbit(PLYdata, orbitFrames > 0 ? orbitFrames : 360);
+    return 0;
+  }
+  try
+  {
+    cameraPath = readCameraPath(cameraPathFile);
+  }
+  catch (std::exception const& e)
+  {
+    std::cout << "BAD CAMERA PATH FILE" << std::endl;
+    std::cerr << e.what() << std::endl;
+    return 5;
+  }
+  return 0;
+}
+
+void displayHelp()
+{
+  std::cout << "Usage: Rosenthal-Linsen-Lars-2008 [OPTIONS] \"PLY PATH\"" << std::endl;
+  std::cout << "       Rosenthal-Linsen-Lars-2008 [OPTIONS] --scene FILE" << std::endl;
+  std::cout << "       Rosenthal-Linsen-Lars-2008 [OPTIONS] --stream udp:PORT|PIPE" << std::endl;
+  std::cout << "  --width N               framebuffer width (default 512)" << std::endl;
+  std::cout << "  --height N              framebuffer height (default 512)" << std::endl;
+  std::cout << "  --background-iters N    background fill iterations (default 1)" << std::endl;
+  std::cout << "  --occlusion-iters N     occlusion fill iterations (default 1)" << std::endl;
+  std::cout << "  --headless              render offscreen without a window" << std::endl;
+  std::cout << "  --camera-path FILE      poses for --headless, one \"px py pz fx fy fz fov\" per line" << std::endl;
+  std::cout << "  --output DIR            directory for headless frames (default .)" << std::endl;
+  std::cout << "  --format png|raw        headless frame format, raw is packed 8-bit RGB (default png)" << std::endl;
+  std::cout << "  --orbit N               use an N frame orbit around the cloud instead of --camera-path" << std::endl;
+  std::cout << "  --poster WxH            render each pose as a W by H image in tiles of --width by --height, implies --headless" << std::endl;
+  std::cout << "  --benchmark             play the camera path without vsync and report per-pass GPU times" << std::endl;
+  std::cout << "  --warmup N              benchmark frames rendered before timing starts (default 10)" << std::endl;
+  std::cout << "  --benchmark-output FILE benchmark report, JSON if FILE ends in .json, CSV otherwise (default stdout)" << std::endl;
+  std::cout << "  --record FILE           write the interactive camera path to FILE on exit" << std::endl;
+  std::cout << "  --no-vsync              do not wait for vertical sync" << std::endl;
+  std::cout << "  --cpu                   render on the CPU instead of OpenGL, with --headless or --benchmark" << std::endl;
+  std::cout << "  --threads N             CPU renderer threads (default all cores)" << std::endl;
+  std::cout << "  --validate-cpu          render the camera path with OpenGL and the CPU and compare the frames" << std::endl;
+  std::cout << "  --validate-deferred     render the camera path with forward and deferred lighting and compare the frames" << std::endl;
+  std::cout << "  --trace FILE            record trace zones, written as Chrome trace JSON on F12 and on exit" << std::endl;
+  std::cout << "  --trace-frames N        write the trace after N frames instead of on exit" << std::endl;
+  std::cout << "  --trace-overlay         show the per-pass timeline overlay, F11 toggles it, needs --trace" << std::endl;
+  std::cout << "  --scene FILE            render the clouds listed in FILE, one \"PLY PATH\" and optional row major 4x4 model matrix per line" << std::endl;
+  std::cout << "  --adaptive-splats       draw points as discs sized from the local point spacing" << std::endl;
+  std::cout << "  --visibility-buffer     write point indices in the point pass and fetch attributes after the fills" << std::endl;
+  std::cout << "  --deferred-lighting     light the filled and smoothed G-buffer once per pixel" << std::endl;
+  std::cout << "  --estimate-normals      ignore point normals and estimate them from the filled G-buffer, implies --deferred-lighting" << std::endl;
+  std::cout << "  --lights FILE           point lights for --deferred-lighting, one \"px py pz r g b radius\" per line" << std::endl;
+  std::cout << "  --smooth-sigma S        smooth with a separable Gaussian of S pixels (at most 10) instead of the 3x3 filter" << std::endl;
+  std::cout << "  --fused-post            smooth, anti-alias and illustrate in one compute pass" << std::endl;
+  std::cout << "  --no-illustration       show the shaded colors without feature lines, which skips anti-aliasing" << std::endl;
+  std::cout << "  --composite M           split the cloud over M worker processes and depth composite their point passes" << std::endl;
+  std::cout << "  --composite-port P      wait on TCP port P for M external workers instead of starting them" << std::endl;
+  std::cout << "  --worker HOST:PORT      render one partition for the compositor at HOST:PORT, with --partition" << std::endl;
+  std::cout << "  --partition I/M         the part of the points a worker reads and renders, I counted from 0" << std::endl;
+  std::cout << "  --clip-box X0,Y0,Z0,X1,Y1,Z1 draw only the points inside the box" << std::endl;
+  std::cout << "  --height-band Y0,Y1     draw only the points with Y0 <= y <= Y1" << std::endl;
+  std::cout << "  --color-range R0,G0,B0,R1,G1,B1 draw only the points with colors in the range, in [0,1]" << std::endl;
+  std::cout << "  --slice NX,NY,NZ,D0,D1  draw only the points with D0 <= dot(N, p) <= D1" << std::endl;
+  std::cout << "  --pick                  index the cloud; a left click prints the point at the window centre and its distance to the last pick" << std::endl;
+  std::cout << "  --occlusion-culling     index the cloud and skip chunks hidden behind the last frame's visible points" << std::endl;
+  std::cout << "  --shuffle-points        reorder points so that every prefix is a uniform subsample" << std::endl;
+  std::cout << "  --point-budget N        draw at most N points while the camera moves, implies --shuffle-points, interactive only" << std::endl;
+  std::cout << "  --stream udp:PORT|PIPE  render points received on a local UDP port or read from a named pipe" << std::endl;
+  std::cout << "  --stream-window N       draw the N most recently received points (default 1048576)" << std::endl;
+  std::cout << "  --serve SOCKET          keep the cloud loaded and render requests from a Unix domain socket" << std::endl;
+  std::cout << "  --capture FILE          stream every rendered frame to FILE, - for stdout" << std::endl;
+  std::cout << "  --capture-format y4m|rgb capture as Y4M 4:4:4 or packed 8-bit RGB (default y4m)" << std::endl;
+  std::cout << "  --capture-fps N         frame rate written to the Y4M header (default 60)" << std::endl;
+}
+
+bool parseCount(char const* text, int minimum, int& value)
+{
+  char* end = nullptr;
+  long const parsed = std::strtol(text, &end, 10);
+  if (end == text || *end != '\0' || parsed < minimum || parsed > 1 << 20)
+  {
+    return false;
+  }
+  value = (int)parsed;
+  return true;
+}
+
+// count comma separated finite floats, as in "1,2.5,-3".
+bool parseFloats(char const* text, int count, float* values)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    char* end = nullptr;
+    values[i] = std::strtof(text, &end);
+    if (end == text || *end != (i + 1 < count ? ',' : '\0') || !std::isfinite(values[i]))
+    {
+      return false;
+    }
+    text = end + 1;
+  }
+  return true;
+}
+
+bool parseArguments(int argc, char* argv[], std::filesystem::path& PLYpath)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string const arg = argv[i];
+    bool const hasValue = i + 1 < argc;
+    if (arg == "--headless")
+    {
+      headless = true;
+    }
+    else if (arg == "--benchmark")
+    {
+      benchmark = true;
+      vsync = false;
+    }
+    else if (arg == "--no-vsync")
+    {
+      vsync = false;
+    }
+    else if (arg == "--orbit" && hasValue)
+    {
+      if (!parseCount(argv[++i], 1, orbitFrames))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--warmup" && hasValue)
+    {
+      if (!parseCount(argv[++i], 0, warmupFrames))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--benchmark-output" && hasValue)
+    {
+      benchmarkOutput = argv[++i];
+    }
+    else if (arg == "--record" && hasValue)
+    {
+      recordPathFile = argv[++i];
+    }
+    else if (arg == "--cpu")
+    {
+      cpuRendering = true;
+    }
+    else if (arg == "--threads" && hasValue)
+    {
+      if (!parseCount(argv[++i], 1, cpuThreads))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--validate-cpu")
+    {
+      validateCpu = true;
+      headless = true;
+    }
+    else if (arg == "--validate-deferred")
+    {
+      validateDeferred = true;
+      deferredLighting = true;
+      headless = true;
+    }
+    else if (arg == "--trace" && hasValue)
+    {
+      traceFile = argv[++i];
+    }
+    else if (arg == "--trace-frames" && hasValue)
+    {
+      if (!parseCount(argv[++i], 1, traceFrames))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--trace-overlay")
+    {
+      traceOverlay = true;
+    }
+    else if (arg == "--scene" && hasValue && PLYpath.empty())
+    {
+      sceneFile = argv[++i];
+      PLYpath = sceneFile;
+    }
+    else if (arg == "--stream" && hasValue && PLYpath.empty())
+    {
+      streamSource = argv[++i];
+      PLYpath = streamSource;
+    }
+    else if (arg == "--stream-window" && hasValue)
+    {
+      if (!parseCount(argv[++i], 1, streamWindow))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--adaptive-splats")
+    {
+      adaptiveSplats = true;
+    }
+    else if (arg == "--visibility-buffer")
+    {
+      visibilityBuffer = true;
+    }
+    else if (arg == "--deferred-lighting")
+    {
+      deferredLighting = true;
+    }
+    else if (arg == "--lights" && hasValue)
+    {
+      lightFile = argv[++i];
+      deferredLighting = true;
+    }
+    else if (arg == "--estimate-normals")
+    {
+      // Normals only exist once the G-buffer is filled, so the points are lit afterwards.
+      normalEstimation = true;
+      deferredLighting = true;
+    }
+    else if (arg == "--smooth-sigma" && hasValue)
+    {
+      char* end = nullptr;
+      float const parsed = std::strtof(argv[++i], &end);
+      if (end == argv[i] || *end != '\0' || !(parsed > 0.f && parsed <= 10.f))
+      {
+        return false;
+      }
+      smoothSigma = parsed;
+    }
+    else if (arg == "--fused-post")
+    {
+      fusedPost = true;
+    }
+    else if (arg == "--no-illustration")
+    {
+      illustration = false;
+    }
+    else if (arg == "--composite" && hasValue)
+    {
+      if (!parseCount(argv[++i], 1, compositeWorkers))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--composite-port" && hasValue)
+    {
+      if (!parseCount(argv[++i], 1, compositePort) || compositePort > 65535)
+      {
+        return false;
+      }
+    }
+    else if (arg == "--worker" && hasValue)
+    {
+      workerAddress = argv[++i];
+      headless = true;
+    }
+    else if (arg == "--partition" && hasValue)
+    {
+      // I/M: render the I-th of M equal runs of the cloud's points.
+      std::string const partition = argv[++i];
+      std::size_t const split = partition.find('/');
+      if (split == std::string::npos || !parseCount(partition.substr(0, split).c_str(), 0, workerPartition)
+        || !parseCount(partition.substr(split + 1).c_str(), 1, workerPartitions) || workerPartition >= workerPartitions)
+      {
+        return false;
+      }
+    }
+    else if (arg == "--clip-box" && hasValue)
+    {
+      float box[6];
+      if (!parseFloats(argv[++i], 6, box) || box[0] > box[3] || box[1] > box[4] || box[2] > box[5])
+      {
+        return false;
+      }
+      pointFilter.clip = true;
+      pointFilter.clipLower = glm::vec3(box[0], box[1], box[2]);
+      pointFilter.clipUpper = glm::vec3(box[3], box[4], box[5]);
+      pointFiltering = true;
+    }
+    else if (arg == "--height-band" && hasValue)
+    {
+      float band[2];
+      if (!parseFloats(argv[++i], 2, band) || band[0] > band[1])
+      {
+        return false;
+      }
+      pointFilter.band = true;
+      pointFilter.bandLower = band[0];
+      pointFilter.bandUpper = band[1];
+      pointFiltering = true;
+    }
+    else if (arg == "--color-range" && hasValue)
+    {
+      float range[6];
+      if (!parseFloats(argv[++i], 6, range) || range[0] > range[3] || range[1] > range[4] || range[2] > range[5])
+      {
+        return false;
+      }
+      pointFilter.colorRange = true;
+      pointFilter.colorLower = glm::vec3(range[0], range[1], range[2]);
+      pointFilter.colorUpper = glm::vec3(range[3], range[4], range[5]);
+      pointFiltering = true;
+    }
+    else if (arg == "--slice" && hasValue)
+    {
+      float slice[5];
+      if (!parseFloats(argv[++i], 5, slice) || slice[3] > slice[4] || glm::length(glm::vec3(slice[0], slice[1], slice[2])) == 0.f)
+      {
+        return false;
+      }
+      pointFilter.slice = true;
+      pointFilter.sliceNormal = glm::normalize(glm::vec3(slice[0], slice[1], slice[2]));
+      pointFilter.sliceLower = slice[3];
+      pointFilter.sliceUpper = slice[4];
+      pointFiltering = true;
+    }
+    else if (arg == "--pick")
+    {
+      pointPicking = true;
+    }
+    else if (arg == "--occlusion-culling")
+    {
+      occlusionCulling = true;
+    }
+    else if (arg == "--shuffle-points")
+    {
+      shufflePoints = true;
+    }
+    else if (arg == "--point-budget" && hasValue)
+    {
+      // parseCount caps at 2^20; budgets are point counts, so they get a wider range.
+      char* end = nullptr;
+      long long const parsed = std::strtoll(argv[++i], &end, 10);
+      if (end == argv[i] || *end != '\0' || parsed < 1 || parsed > std::numeric_limits<int>::max())
+      {
+        return false;
+      }
+      pointBudget = (int)parsed;
+      shufflePoints = true;
+    }
+    else if (arg == "--serve" && hasValue)
+    {
+      serverSocket = argv[++i];
+      headless = true;
+    }
+    else if (arg == "--capture" && hasValue)
+    {
+      captureFile = argv[++i];
+    }
+    else if (arg == "--capture-format" && hasValue)
+    {
+      std::string const format = argv[++i];
+      if (format == "y4m")
+      {
+        captureFormat = VideoWriter::Format::Y4M;
+      }
+      else if (format == "rgb")
+      {
+        captureFormat = VideoWriter::Format::RGB;
+      }
+      else
+      {
+        return false;
+      }
+    }
+    else if (arg == "--capture-fps" && hasValue)
+    {
+      if (!parseCount(argv[++i], 1, captureFps))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--width" && hasValue)
+    {
+      if (!parseCount(argv[++i], 1, windowWidth))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--height" && hasValue)
+    {
+      if (!parseCount(argv[++i], 1, windowHeight))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--background-iters" && hasValue)
+    {
+      if (!parseCount(argv[++i], 0, backgroundFillIters))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--occlusion-iters" && hasValue)
+    {
+      if (!parseCount(argv[++i], 0, occlusionFillIters))
+      {
+        return false;
+      }
+    }
+    else if (arg == "--camera-path" && hasValue)
+    {
+      cameraPathFile = argv[++i];
+    }
+    else if (arg == "--output" && hasValue)
+    {
+      outputDirectory = argv[++i];
+    }
+    else if (arg == "--poster" && hasValue)
+    {
+      std::string const size = argv[++i];
+      std::size_t const split = size.find('x');
+      if (split == std::string::npos || !parseCount(size.substr(0, split).c_str(), 1, posterWidth)
+        || !parseCount(size.substr(split + 1).c_str(), 1, posterHeight))
+      {
+        return false;
+      }
+      headless = true;
+    }
+    else if (arg == "--format" && hasValue)
+    {
+      std::string const format = argv[++i];
+      if (format == "png")
+      {
+        outputFormat = ImageWriter::Format::PNG;
+      }
+      else if (format == "raw")
+      {
+        outputFormat = ImageWriter::Format::RAW;
+      }
+      else
+      {
+        return false;
+      }
+    }
+    else if (arg.rfind("--", 0) == 0 || !PLYpath.empty())
+    {
+      return false;
+    }
+    else
+    {
+      PLYpath = arg;
+    }
+  }
+  if (headless && !benchmark && !validateCpu && !validateDeferred && serverSocket.empty() && workerAddress.empty() && posterWidth == 0 && cameraPathFile.empty() && orbitFrames == 0)
+  {
+    return false;
+  }
+  if (posterWidth > 0 && (benchmark || validateCpu || cpuRendering || !serverSocket.empty() || compositeWorkers > 0
+    || !workerAddress.empty() || !streamSource.empty() || !captureFile.empty()))
+  {
+    return false;
+  }
+  // Every output frame of these modes has a new pose, or a new poster tile projection, so the camera never settles.
+  if (pointBudget > 0 && (headless || benchmark || validateCpu))
+  {
+    return false;
+  }
+  // Workers only run the G-buffer point pass of one part of a single cloud.
+  if (!workerAddress.empty() && (benchmark || validateCpu || cpuRendering || !serverSocket.empty() || !sceneFile.empty()
+    || !streamSource.empty() || visibilityBuffer))
+  {
+    return false;
+  }
+  // The compositor draws no points of its own, so everything tied to its point pass is out.
+  if (compositePort > 0 && compositeWorkers == 0)
+  {
+    return false;
+  }
+  if (compositeWorkers > 0 && ((headless && !benchmark) || validateCpu || cpuRendering || !serverSocket.empty()
+    || !sceneFile.empty() || !streamSource.empty() || !workerAddress.empty() || visibilityBuffer || pointBudget > 0))
+  {
+    return false;
+  }
+  if (cpuRendering && !headless && !benchmark)
+  {
+    return false;
+  }
+  // The overlay draws the zones tracing records.
+  if (traceOverlay && traceFile.empty())
+  {
+    return false;
+  }
+  if (!sceneFile.empty() && (cpuRendering || validateCpu))
+  {
+    return false;
+  }
+  // The CPU renderer draws one pixel points, so it cannot validate splats.
+  if (adaptiveSplats && validateCpu)
+  {
+    return false;
+  }
+  // The CPU renderer lights every point before the fills and only has the 3x3 smoothing filter.
+  if ((deferredLighting || smoothSigma > 0.f) && validateCpu)
+  {
+    return false;
+  }
+  // Deferred validation compares against forward shading, which only has the headlight.
+  if (validateDeferred && (benchmark || cpuRendering || !serverSocket.empty() || posterWidth > 0 || !streamSource.empty()
+    || !lightFile.empty() || normalEstimation))
+  {
+    return false;
+  }
+  // Worker planes carry 8-bit positions, too coarse for the compositor to light.
+  if (deferredLighting && (compositeWorkers > 0 || !workerAddress.empty()))
+  {
+    return false;
+  }
+  // Estimated normals need the G-buffer's positions, which the visibility buffer, the CPU renderer,
+  // the compositor's planes and the stream shaders do not provide at full precision.
+  if (normalEstimation && (visibilityBuffer || cpuRendering || validateCpu || compositeWorkers > 0 || !workerAddress.empty() || !streamSource.empty()))
+  {
+    return false;
+  }
+  // Deferred lighting runs between anti-aliasing and illustration, which the fused pass merges.
+  if (fusedPost && deferredLighting)
+  {
+    return false;
+  }
+  // The fused pass and the CPU renderer always draw the feature lines.
+  if (!illustration && (fusedPost || cpuRendering || validateCpu))
+  {
+    return false;
+  }
+  // Picking is interactive; the index reorders the points, which would undo a shuffled order.
+  if (pointPicking && (headless || benchmark || compositeWorkers > 0 || !sceneFile.empty() || !streamSource.empty() || shufflePoints))
+  {
+    return false;
+  }
+  /* Culling draws the chunks of one indexed cloud from the G-buffer's depth. The index's order
+   * would undo a shuffled one, and the visibility buffer, the filter and the point budget draw
+   * their own subsets of the points. */
+  if (occlusionCulling && (cpuRendering || validateCpu || !sceneFile.empty() || !streamSource.empty() || compositeWorkers > 0 || !workerAddress.empty()
+    || visibilityBuffer || pointFiltering || pointBudget > 0 || shufflePoints))
+  {
+    return false;
+  }
+  // The filter compacts indices into one cloud's vertex buffer on the GPU.
+  if (pointFiltering && (cpuRendering || validateCpu || !sceneFile.empty() || !streamSource.empty() || compositeWorkers > 0 || !workerAddress.empty()))
+  {
+    return false;
+  }
+  // A stream has no fixed cloud to render offscreen, benchmark or serve.
+  if (!streamSource.empty() && (headless || benchmark || cpuRendering))
+  {
+    return false;
+  }
+  // Stream points live in a ring whose slots are reused, so their indices cannot be resolved later.
+  if (!streamSource.empty() && visibilityBuffer)
+  {
+    return false;
+  }
+  return !PLYpath.empty();
+}
+
+bool writeFrame(std::size_t frame, std::vector<std::uint8_t> const& pixels)
+{
+  std::ostringstream frameName;
+  frameName << "frame_" << std::setw(5) << std::setfill('0') << frame << (outputFormat == ImageWriter::Format::PNG ? ".png" : ".rgb");
+  try
+  {
+    writeImage(outputDirectory / frameName.str(), outputFormat, windowWidth, windowHeight, pixels.data());
+  }
+  catch (std::exception const& e)
+  {
+    std::cout << "ENCOUNTERED ERROR WRITING FRAME" << std::endl;
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+  return true;
 }
-else
+
+bool openCapture(std::unique_ptr<VideoWriter>& writer)
 {
-  float smallestDepth = 100000.0;
-  int smallestInd = 4;
-  for(int i = 0; i < 9; i++)
+  if (captureFile.empty())
   {
-     float depthDiff = (sampleTex[4] - sampleTex[i]);
-     if(depthDiff > zeroTol && depthDiff < smallestDepth)
-     {
-       smallestDepth = depthDiff;
-       smallestInd = i;
-     }
+    return true;
   }
-  positionTextureOut = texture(positionTextureIn, TexCoords.st + offsets[smallestInd]);
-  normalTextureOut = texture(normalTextureIn, TexCoords.st + offsets[smallestInd]).xyz;
-  colorTextureOut = texture(colorTextureIn, TexCoords.st + offsets[smallestInd]);
+  try
+  {
+    writer = std::make_unique<VideoWriter>(captureFile, captureFormat, windowWidth, windowHeight, captureFps);
+  }
+  catch (std::exception const& e)
+  {
+    std::cout << "COULD NOT OPEN CAPTURE FILE" << std::endl;
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+  return true;
 }
+
+bool closeCapture(std::unique_ptr<VideoWriter>& writer)
+{
+  if (!writer)
+  {
+    return true;
+  }
+  try
+  {
+    writer->close();
+  }
+  catch (std::exception const& e)
+  {
+    std::cout << "ENCOUNTERED ERROR WRITING CAPTURE" << std::endl;
+    std::cerr << e.what() << std::endl;
+    return false;
+  }
+  return true;
 }
-} 
-)foo";
-      occlusionFragShader = glCreateShader(GL_FRAGMENT_SHADER);
-      glShaderSource(occlusionFragShader, 1, &occlusionFragText, 0);
-      glCompileShader(occlusionFragShader);
-      if (!checkShaderCompile(occlusionFragShader, "OCCLUSION FILL FRAGMENT"))
+
+int renderHeadless(std::vector<float> PLYdata)
+{
+  std::vector<CameraPose> cameraPath;
+  int const pathStatus = loadCameraPath(PLYdata, cameraPath);
+  if (pathStatus != 0)
+  {
+    return pathStatus;
+  }
+  // With --capture the frames go to the video stream instead of one image file each.
+  std::unique_ptr<VideoWriter> capture;
+  if (!openCapture(capture))
+  {
+    return 7;
+  }
+  if (!capture)
+  {
+    std::error_code ec;
+    std::filesystem::create_directories(outputDirectory, ec);
+  }
+  std::vector<std::uint8_t> pixels;
+  if (cpuRendering)
+  {
+    CpuRenderer renderer(windowWidth, windowHeight, cpuThreads);
+    renderer.load(PLYdata, pointStride);
+    for (std::size_t frame = 0; frame < cameraPath.size(); ++frame)
+    {
+      glm::mat4 view;
+      glm::mat4 projection;
+      poseMatrices(cameraPath[frame], view, projection);
+      if (capture)
       {
-        return;
+        pixels = capture->acquireFrame();
+      }
+      renderer.render(view, projection, cameraPath[frame].position, backgroundFillIters, occlusionFillIters, pixels);
+      if (capture)
+      {
+        capture->submitFrame(std::move(pixels));
+      }
+      else if (!writeFrame(frame, pixels))
+      {
+        return 7;
       }
     }
-
-    /* Occlusion Pixel Program */
+    return closeCapture(capture) ? 0 : 7;
+  }
+  RenderWindow viewWindow;
+  viewWindow.load(std::move(PLYdata));
+  if (capture)
+  {
+    viewWindow.enableCapture(*capture);
+  }
+  for (std::size_t frame = 0; frame < cameraPath.size(); ++frame)
+  {
+    if (!viewWindow.renderPose(cameraPath[frame]))
     {
-      occlusionProgram = glCreateProgram();
-      glAttachShader(occlusionProgram, occlusionVertShader);
-      glAttachShader(occlusionProgram, occlusionFragShader);
-      glLinkProgram(occlusionProgram);
-      glUseProgram(occlusionProgram);
+      std::cout << "HEADLESS RENDER FAILED" << std::endl;
+      return 6;
     }
-
-    /* Smoothing Vertex Shader */
+    if (capture)
     {
-      const GLchar* smoothVertText = R"foo(
-#version 330 core
-
-layout (location = 0) in vec2 aPos;
-layout (location = 1) in vec2 aTexCoords;
+      continue;
+    }
+    viewWindow.readPixels(pixels);
+    if (!writeFrame(frame, pixels))
+    {
+      return 7;
+    }
+  }
+  viewWindow.finishCapture();
+  return closeCapture(capture) ? 0 : 7;
+}
 
-out vec2 TexCoords;
+/* Pixels by which the passes after the point pass carry content across a tile border: one for
+ * every 3x3 fill, normal estimation, smoothing, anti-aliasing and illustration pass, the separable smoothing radius
+ * and the largest splat radius. The G-buffer textures repeat, so the apron also keeps the far
+ * side of a tile out of its kept pixels. */
+int posterApron()
+{
+  int const smoothRadius = smoothSigma > 0.f ? separableSmoothRadius() : 1;
+  return backgroundFillIters + occlusionFillIters + (normalEstimation ? 1 : 0) + smoothRadius + 2 + (adaptiveSplats ? 8 : 0);
+}
 
-void main()
+// The part of the poster's projection covering the window sized region whose lower left pixel is (x, y).
+glm::mat4 tileProjection(glm::mat4 const& projection, int x, int y)
 {
-  TexCoords = aTexCoords;
-  gl_Position = vec4(aPos.x, aPos.y, 0.0, 1.0); 
+  float const scaleX = (float)posterWidth / windowWidth;
+  float const scaleY = (float)posterHeight / windowHeight;
+  float const centerX = (2.f * x + windowWidth) / posterWidth - 1.f;
+  float const centerY = (2.f * y + windowHeight) / posterHeight - 1.f;
+  glm::mat4 region(1.f);
+  region[0][0] = scaleX;
+  region[1][1] = scaleY;
+  region[3][0] = -centerX * scaleX;
+  region[3][1] = -centerY * scaleY;
+  return region * projection;
 }
-)foo";
-      smoothVertShader = glCreateShader(GL_VERTEX_SHADER);
-      glShaderSource(smoothVertShader, 1, &smoothVertText, 0);
-      glCompileShader(smoothVertShader);
-      if (!checkShaderCompile(smoothVertShader, "SMOOTHING VERTEX"))
+
+/* Renders each camera pose, or one orbit view without a path, as a posterWidth x posterHeight
+ * image. The image is cut into tiles that each render as one window sized frame through an
+ * off-axis part of the frustum, with an apron around the pixels that are kept. A band of one
+ * tile row is stitched on the host and streamed to the image writer, so neither the GPU nor
+ * the host holds the whole poster. */
+int renderPoster(std::vector<float> PLYdata)
+{
+  std::vector<CameraPose> cameraPath;
+  if (cameraPathFile.empty() && orbitFrames == 0)
+  {
+    cameraPath = generateOrbit(PLYdata, 1);
+  }
+  else
+  {
+    int const pathStatus = loadCameraPath(PLYdata, cameraPath);
+    if (pathStatus != 0)
+    {
+      return pathStatus;
+    }
+  }
+  int const apron = posterApron();
+  int const tileWidth = windowWidth - 2 * apron;
+  int const tileHeight = windowHeight - 2 * apron;
+  if (tileWidth < 1 || tileHeight < 1)
+  {
+    std::cout << "WINDOW TOO SMALL FOR A " << apron << " PIXEL POSTER APRON" << std::endl;
+    return 1;
+  }
+  std::error_code ec;
+  std::filesystem::create_directories(outputDirectory, ec);
+  RenderWindow viewWindow;
+  viewWindow.load(std::move(PLYdata));
+  int const columns = (posterWidth + tileWidth - 1) / tileWidth;
+  int const rows = (posterHeight + tileHeight - 1) / tileHeight;
+  std::vector<std::uint8_t> pixels;
+  std::vector<std::uint8_t> band((std::size_t)posterWidth * tileHeight * 3);
+  for (std::size_t frame = 0; frame < cameraPath.size(); ++frame)
+  {
+    CameraPose const& pose = cameraPath[frame];
+    glm::mat4 const projection = glm::perspective(glm::radians(pose.fov), (float)posterWidth / (float)posterHeight, .01f, 100.f);
+    std::ostringstream posterName;
+    posterName << "poster_" << std::setw(5) << std::setfill('0') << frame << (outputFormat == ImageWriter::Format::PNG ? ".png" : ".rgb");
+    auto const start = std::chrono::steady_clock::now();
+    try
+    {
+      ImageWriter writer(outputDirectory / posterName.str(), outputFormat, posterWidth, posterHeight);
+      for (int row = 0; row < rows; ++row)
       {
-        return;
+        // Tile rows go top down like the image rows, while y counts from the bottom as in OpenGL.
+        int const top = posterHeight - row * tileHeight;
+        int const height = std::min(tileHeight, top);
+        int const bottom = top - height;
+        for (int column = 0; column < columns; ++column)
+        {
+          int const left = column * tileWidth;
+          int const width = std::min(tileWidth, posterWidth - left);
+          if (!viewWindow.renderTile(pose, tileProjection(projection, left - apron, bottom - apron)))
+          {
+            std::cout << "HEADLESS RENDER FAILED" << std::endl;
+            return 6;
+          }
+          viewWindow.readPixels(pixels);
+          for (int y = 0; y < height; ++y)
+          {
+            std::copy_n(&pixels[((std::size_t)(apron + y) * windowWidth + apron) * 3], (std::size_t)width * 3,
+              &band[((std::size_t)(height - 1 - y) * posterWidth + left) * 3]);
+          }
+        }
+        for (int y = 0; y < height; ++y)
+        {
+          writer.writeRow(&band[(std::size_t)y * posterWidth * 3]);
+        }
       }
+      writer.close();
     }
-
-    /* Smoothing Fragment Shader */
+    catch (std::exception const& e)
     {
-      const char* smoothFragText = R"foo(
-#version 420
-
-in vec2 TexCoords;
-
-layout (location = 0) out vec4 positionTextureOut;
-layout (location = 1) out vec3 normalTextureOut;
-layout (location = 2) out vec4 colorTextureOut;
-layout(binding=0) uniform sampler2D positionTextureIn;
-layout(binding=1) uniform sampler2D normalTextureIn;
-layout(binding=2) uniform sampler2D colorTextureIn;
-const float zeroTol = 1e-6;
+      std::cout << "ENCOUNTERED ERROR WRITING POSTER" << std::endl;
+      std::cerr << e.what() << std::endl;
+      return 7;
+    }
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double const megapixels = (double)posterWidth * posterHeight / 1e6;
+    std::cout << "POSTER " << posterName.str() << " " << posterWidth << "x" << posterHeight << " IN " << rows * columns << " TILES, "
+      << seconds << " S, " << megapixels / seconds << " MEGAPIXELS PER SECOND" << std::endl;
+  }
+  return 0;
+}
 
-void main()
-{
-ivec2 texSize = textureSize(positionTextureIn, 0);
-vec2 stepSize = 1.0/vec2(float(texSize.x), float(texSize.y));
-vec2 offsets[9] = vec2[](
-        vec2(-stepSize.x,  stepSize.y), // top-left
-        vec2( 0.0f,    stepSize.y), // top-center
-        vec2( stepSize.x,  stepSize.y), // top-right
-        vec2(-stepSize.x,  0.0f),   // center-left
-        vec2( 0.0f,    0.0f),   // center-center
-        vec2( stepSize.x,  0.0f),   // center-right
-        vec2(-stepSize.x, -stepSize.y), // bottom-left
-        vec2( 0.0f,   -stepSize.y), // bottom-center
-        vec2( stepSize.x, -stepSize.y)  // bottom-right    
-    );
-float sampleTex[9];
-    for(int i = 0; i < 9; i++)
-        sampleTex[i] = texture(positionTextureIn, TexCoords.st + offsets[i]).a;
-if(abs(sampleTex[4]) < zeroTol)
+/* Prints how far two RGB frames of the window's size differ. A pixel mismatches when any channel
+ * differs by more than channelTolerance; the frame fails when more than frameTolerance of its pixels mismatch. */
+bool compareFrames(std::size_t frame, std::vector<std::uint8_t> const& pixels, std::vector<std::uint8_t> const& reference)
 {
-  positionTextureOut = texture(positionTextureIn, TexCoords.st);
-  normalTextureOut = texture(normalTextureIn, TexCoords.st).xyz;
-  colorTextureOut = texture(colorTextureIn, TexCoords.st);
+  int const channelTolerance = 8;
+  double const frameTolerance = .01;
+  std::size_t mismatched = 0;
+  double totalDifference = 0.0;
+  for (std::size_t i = 0; i < pixels.size(); i += 3)
+  {
+    int largest = 0;
+    for (int c = 0; c < 3; ++c)
+    {
+      int const difference = std::abs((int)pixels[i + c] - (int)reference[i + c]);
+      largest = std::max(largest, difference);
+      totalDifference += difference;
+    }
+    mismatched += largest > channelTolerance ? 1 : 0;
+  }
+  double const mismatchFraction = (double)mismatched / (windowWidth * windowHeight);
+  bool const failed = mismatchFraction > frameTolerance;
+  std::cout << "FRAME " << frame << (failed ? " FAILED" : " OK") << " mismatched pixels " << 100.0 * mismatchFraction
+    << "% mean abs difference " << totalDifference / pixels.size() << std::endl;
+  return !failed;
 }
-else
-{
-float alleviatedGaussian[9] = float[](
-        1.0/16.0, 2.0/16.0, 1.0/16.0,
-        2.0/16.0, 16.0/28.0, 2.0/16.0,
-        1.0/16.0, 2.0/16.0, 1.0/16.0
-    );
-float totalWeight = 0.0;
-for(int i = 0; i < 9; i++)
+
+int runCpuValidation(std::vector<float> PLYdata)
 {
-  alleviatedGaussian[i] *= step(zeroTol, sampleTex[i]);
-  totalWeight += alleviatedGaussian[i];
+  std::vector<CameraPose> cameraPath;
+  int const pathStatus = loadCameraPath(PLYdata, cameraPath);
+  if (pathStatus != 0)
+  {
+    return pathStatus;
+  }
+  CpuRenderer renderer(windowWidth, windowHeight, cpuThreads);
+  renderer.load(PLYdata, pointStride);
+  RenderWindow viewWindow;
+  viewWindow.load(std::move(PLYdata));
+  std::vector<std::uint8_t> glPixels;
+  std::vector<std::uint8_t> cpuPixels;
+  int failedFrames = 0;
+  for (std::size_t frame = 0; frame < cameraPath.size(); ++frame)
+  {
+    if (!viewWindow.renderPose(cameraPath[frame]))
+    {
+      std::cout << "HEADLESS RENDER FAILED" << std::endl;
+      return 6;
+    }
+    viewWindow.readPixels(glPixels);
+    glm::mat4 view;
+    glm::mat4 projection;
+    poseMatrices(cameraPath[frame], view, projection);
+    renderer.render(view, projection, cameraPath[frame].position, backgroundFillIters, occlusionFillIters, cpuPixels);
+    failedFrames += compareFrames(frame, glPixels, cpuPixels) ? 0 : 1;
+  }
+  std::cout << failedFrames << " OF " << cameraPath.size() << " FRAMES OUTSIDE TOLERANCE" << std::endl;
+  return failedFrames > 0 ? 8 : 0;
 }
-for(int i = 0; i < 9; i++)
+
+/* Renders every pose with the points lit in the point pass and in the deferred lighting pass and
+ * compares the frames. The lighting programs only exist when deferred lighting is on at setup, so
+ * the flag is switched off and on again around each pose. */
+int runDeferredValidation(std::vector<float> PLYdata)
 {
-  positionTextureOut += (alleviatedGaussian[i] / totalWeight) * texture(positionTextureIn, TexCoords.st + offsets[i]);
-  normalTextureOut += (alleviatedGaussian[i] / totalWeight) * texture(normalTextureIn, TexCoords.st + offsets[i]).xyz;
-  colorTextureOut += (alleviatedGaussian[i] / totalWeight) * texture(colorTextureIn, TexCoords.st + offsets[i]);
+  std::vector<CameraPose> cameraPath;
+  int const pathStatus = loadCameraPath(PLYdata, cameraPath);
+  if (pathStatus != 0)
+  {
+    return pathStatus;
+  }
+  RenderWindow viewWindow;
+  viewWindow.load(std::move(PLYdata));
+  std::vector<std::uint8_t> forwardPixels;
+  std::vector<std::uint8_t> deferredPixels;
+  int failedFrames = 0;
+  for (std::size_t frame = 0; frame < cameraPath.size(); ++frame)
+  {
+    deferredLighting = false;
+    bool const forward = viewWindow.renderPose(cameraPath[frame]);
+    viewWindow.readPixels(forwardPixels);
+    deferredLighting = true;
+    if (!forward || !viewWindow.renderPose(cameraPath[frame]))
+    {
+      std::cout << "HEADLESS RENDER FAILED" << std::endl;
+      return 6;
+    }
+    viewWindow.readPixels(deferredPixels);
+    failedFrames += compareFrames(frame, deferredPixels, forwardPixels) ? 0 : 1;
+  }
+  std::cout << failedFrames << " OF " << cameraPath.size() << " FRAMES OUTSIDE TOLERANCE" << std::endl;
+  return failedFrames > 0 ? 8 : 0;
 }
+
+int writeBenchmarkReport(std::vector<std::pair<std::string, std::string>> const& metadata, std::vector<TimingSeries> const& series)
+{
+  bool const json = benchmarkOutput.extension() == ".json";
+  if (benchmarkOutput.empty())
+  {
+    writeTimingReport(std::cout, json, metadata, series);
+    return 0;
+  }
+  std::ofstream report(benchmarkOutput);
+  if (report.fail())
+  {
+    std::cout << "COULD NOT WRITE BENCHMARK REPORT" << std::endl;
+    std::cerr << benchmarkOutput.string() << " failed to open" << std::endl;
+    return 7;
+  }
+  writeTimingReport(report, json, metadata, series);
+  return 0;
 }
+
+std::vector<std::pair<std::string, std::string>> benchmarkMetadata(std::filesystem::path const& PLYpath, std::size_t points, std::size_t frames)
+{
+  return {
+    { "dataset", PLYpath.string() },
+    { "points", std::to_string(points) },
+    { "width", std::to_string(windowWidth) },
+    { "height", std::to_string(windowHeight) },
+    { "background_iters", std::to_string(backgroundFillIters) },
+    { "occlusion_iters", std::to_string(occlusionFillIters) },
+    { "frames", std::to_string(frames) },
+    { "ply_types", plyDecodeReport.types },
+    { "ply_decode_ms", std::to_string(plyDecodeReport.milliseconds) },
+    { "ply_decode_points_per_second", std::to_string(plyDecodeReport.milliseconds > 0. ? (std::uint64_t)(plyDecodeReport.points / (plyDecodeReport.milliseconds / 1000.)) : 0) } };
 }
-)foo";
-      smoothFragShader = glCreateShader(GL_FRAGMENT_SHADER);
-      glShaderSource(smoothFragShader, 1, &smoothFragText, 0);
-      glCompileShader(smoothFragShader);
-      if (!checkShaderCompile(smoothFragShader, "SMOOTHING FRAGMENT"))
+
+int runCpuBenchmark(std::filesystem::path const& PLYpath, std::vector<float> const& PLYdata, std::vector<CameraPose> const& cameraPath)
+{
+  CpuRenderer renderer(windowWidth, windowHeight, cpuThreads);
+  renderer.load(PLYdata, pointStride);
+  std::vector<std::uint8_t> pixels;
+  TimingSeries frameTimes = { "frame_cpu", {} };
+  int const totalFrames = warmupFrames + (int)cameraPath.size();
+  for (int frame = 0; frame < totalFrames; ++frame)
+  {
+    bool const measured = frame >= warmupFrames;
+    renderer.setTiming(measured);
+    CameraPose const& pose = cameraPath[measured ? frame - warmupFrames : frame % cameraPath.size()];
+    glm::mat4 view;
+    glm::mat4 projection;
+    poseMatrices(pose, view, projection);
+    auto const frameStart = std::chrono::steady_clock::now();
+    renderer.render(view, projection, pose.position, backgroundFillIters, occlusionFillIters, pixels);
+    if (measured)
+    {
+      frameTimes.milliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+    }
+  }
+  std::vector<TimingSeries> series = renderer.getTimings();
+  series.push_back(frameTimes);
+  std::size_t const points = PLYdata.size() / pointStride;
+  double illuminateMilliseconds = 0.;
+  for (TimingSeries const& pass : series)
+  {
+    if (pass.name == "illuminate")
+    {
+      for (double milliseconds : pass.milliseconds)
       {
-        return;
+        illuminateMilliseconds += milliseconds;
       }
     }
+  }
+  auto metadata = benchmarkMetadata(PLYpath, points, cameraPath.size());
+  metadata.push_back({ "renderer", "cpu" });
+  metadata.push_back({ "threads", std::to_string(renderer.getThreadCount()) });
+  if (illuminateMilliseconds > 0.)
+  {
+    metadata.push_back({ "points_per_second", std::to_string((std::uint64_t)(points * cameraPath.size() / (illuminateMilliseconds / 1000.))) });
+  }
+  return writeBenchmarkReport(metadata, series);
+}
 
-    /* Smoothing Program */
+int runBenchmark(std::filesystem::path const& PLYpath, std::vector<float> PLYdata)
+{
+  std::vector<CameraPose> cameraPath;
+  int const pathStatus = loadCameraPath(PLYdata, cameraPath);
+  if (pathStatus != 0)
+  {
+    return pathStatus;
+  }
+  if (cpuRendering)
+  {
+    return runCpuBenchmark(PLYpath, PLYdata, cameraPath);
+  }
+  std::unique_ptr<VideoWriter> capture;
+  if (!openCapture(capture))
+  {
+    return 7;
+  }
+  std::size_t const points = PLYdata.size() / pointStride;
+  RenderWindow viewWindow;
+  viewWindow.load(std::move(PLYdata));
+  if (capture)
+  {
+    viewWindow.enableCapture(*capture);
+  }
+  GpuTimer* timer = viewWindow.enablePassTimer();
+  int const totalFrames = warmupFrames + (int)cameraPath.size();
+  auto lastFrameEnd = std::chrono::steady_clock::now();
+  for (int frame = 0; frame < totalFrames; ++frame)
+  {
+    bool const measured = frame >= warmupFrames;
+    timer->setRecording(measured);
+    CameraPose const& pose = cameraPath[measured ? frame - warmupFrames : frame % cameraPath.size()];
+    // Compacting every frame times what each change of the filter costs.
+    viewWindow.invalidateFilter();
+    if (!viewWindow.renderPose(pose))
     {
-      smoothProgram = glCreateProgram();
-      glAttachShader(smoothProgram, smoothVertShader);
-      glAttachShader(smoothProgram, smoothFragShader);
-      glLinkProgram(smoothProgram);
-      glUseProgram(smoothProgram);
+      std::cout << "BENCHMARK RENDER FAILED" << std::endl;
+      return 6;
     }
-
-    /* Anti-Aliasing Vertex Shader */
+    auto const frameEnd = std::chrono::steady_clock::now();
+    if (measured)
     {
-      const GLchar* aaVertText = R"foo(
-#version 330 core
-
-layout (location = 0) in vec2 aPos;
-layout (location = 1) in vec2 aTexCoords;
-
-out vec2 TexCoords;
+      timer->addSample("frame_cpu", std::chrono::duration<double, std::milli>(frameEnd - lastFrameEnd).count());
+    }
+    lastFrameEnd = frameEnd;
+  }
+  timer->finish();
+  viewWindow.finishCapture();
+  if (!closeCapture(capture))
+  {
+    return 7;
+  }
+  auto metadata = benchmarkMetadata(PLYpath, points, cameraPath.size());
+  metadata.push_back({ "stalled_frames", std::to_string(timer->getStalledFrames()) });
+  metadata.push_back({ "headless", headless ? "true" : "false" });
+  metadata.push_back({ "adaptive_splats", adaptiveSplats ? "true" : "false" });
+  metadata.push_back({ "visibility_buffer", visibilityBuffer ? "true" : "false" });
+  metadata.push_back({ "deferred_lighting", deferredLighting ? "true" : "false" });
+  metadata.push_back({ "point_lights", std::to_string(pointLights.size()) });
+  metadata.push_back({ "smooth_sigma", std::to_string(smoothSigma) });
+  metadata.push_back({ "fused_post", fusedPost ? "true" : "false" });
+  metadata.push_back({ "filtered_points", std::to_string(viewWindow.getFilteredPointCount()) });
+  metadata.push_back({ "occlusion_culling", occlusionCulling ? "true" : "false" });
+  if (viewWindow.getChunkCount() > 0)
+  {
+    // The warm-up frames come first, so the measured frames are the last ones.
+    std::vector<std::uint32_t> const& drawn = viewWindow.getChunkPointsDrawn();
+    std::size_t const measuredFrames = std::min(drawn.size(), cameraPath.size());
+    double meanDrawn = 0.;
+    for (std::size_t i = drawn.size() - measuredFrames; i < drawn.size(); ++i)
+    {
+      meanDrawn += drawn[i];
+    }
+    meanDrawn = measuredFrames > 0 ? meanDrawn / measuredFrames : (double)points;
+    metadata.push_back({ "chunks", std::to_string(viewWindow.getChunkCount()) });
+    metadata.push_back({ "mean_points_drawn", std::to_string((std::uint64_t)meanDrawn) });
+    metadata.push_back({ "culled_percent", std::to_string(points > 0 ? 100. * (1. - meanDrawn / points) : 0.) });
+  }
+  // Of the last frame; the camera path's frames all run the same passes unless the point budget adds fills.
+  RenderGraph const& graph = viewWindow.getRenderGraph();
+  metadata.push_back({ "illustration", illustration ? "true" : "false" });
+  metadata.push_back({ "graph_passes", std::to_string(graph.getPassCount()) });
+  metadata.push_back({ "graph_culled_passes", std::to_string(graph.getCulledPasses()) });
+  metadata.push_back({ "graph_texture_bytes", std::to_string(graph.getTextureBytes()) });
+  metadata.push_back({ "graph_cleared_bytes_per_frame", std::to_string(graph.getClearedBytes()) });
+  metadata.push_back({ "renderer", (char const*)glGetString(GL_RENDERER) });
+  metadata.push_back({ "gl_version", (char const*)glGetString(GL_VERSION) });
+  return writeBenchmarkReport(metadata, timer->getSeries());
+}
 
-void main()
+/* Opens and reloads files while the window keeps rendering. The loader thread owns a context
+ * that shares objects with the render context; it parses a file, uploads its points into a new
+ * buffer and hands the buffer with a fence to the render thread through a lock-free queue. */
+class BackgroundLoader
 {
-  TexCoords = aTexCoords;
-  gl_Position = vec4(aPos.x, aPos.y, 0.0, 1.0); 
-}
-)foo";
-      aaVertShader = glCreateShader(GL_VERTEX_SHADER);
-      glShaderSource(aaVertShader, 1, &aaVertText, 0);
-      glCompileShader(aaVertShader);
-      if (!checkShaderCompile(aaVertShader, "ANTI ALIASING VERTEX"))
+public:
+  explicit BackgroundLoader(GLFWwindow* context)
+    : context(context),
+    finished(4),
+    stopping(false)
+  {
+    loader = std::thread(&BackgroundLoader::loadLoop, this);
+  }
+  ~BackgroundLoader()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    requestReady.notify_one();
+    loader.join();
+    LoadedCloud cloud;
+    while (finished.tryPop(cloud))
+    {
+      glDeleteSync(cloud.fence);
+      glDeleteBuffers(1, &cloud.buffer);
+      glDeleteBuffers(1, &cloud.radiusBuffer);
+    }
+  }
+  BackgroundLoader(BackgroundLoader const&) = delete;
+  BackgroundLoader& operator=(BackgroundLoader const&) = delete;
+  // Requests arriving during a load replace each other, only the latest is loaded next.
+  void request(std::filesystem::path const& path)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      requested = path;
+    }
+    requestReady.notify_one();
+  }
+  bool poll(LoadedCloud& cloud)
+  {
+    return finished.tryPop(cloud);
+  }
+private:
+  void loadLoop()
+  {
+    traceSetThreadName("loader");
+    glfwMakeContextCurrent(context);
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+      requestReady.wait(lock, [this] { return stopping || !requested.empty(); });
+      if (stopping)
       {
-        return;
+        break;
       }
+      std::filesystem::path const path = std::move(requested);
+      requested.clear();
+      lock.unlock();
+      load(path);
+      lock.lock();
     }
-
-    /* Anti-Aliasing Fragment Shader */
+    lock.unlock();
+    glfwMakeContextCurrent(NULL);
+  }
+  void load(std::filesystem::path const& path)
+  {
+    TraceZone zone("backgroundLoad");
+    LoadedCloud cloud = {};
+    cloud.path = path;
+    std::vector<float> points;
+    try
     {
-      const char* aaFragHighText = R"foo(
-#version 420
-
-in vec2 TexCoords;
-
-layout (location = 0) out vec4 positionTextureOut;
-layout (location = 1) out vec3 normalTextureOut;
-layout (location = 2) out vec4 colorTextureOut;
-layout(binding=0) uniform sampler2D positionTextureIn;
-layout(binding=1) uniform sampler2D normalTextureIn;
-layout(binding=2) uniform sampler2D colorTextureIn;
-
-void main()
-{
-ivec2 texSize = textureSize(positionTextureIn, 0);
-vec2 stepSize = 1.0/vec2(float(texSize.x), float(texSize.y));
-vec2 offsets[9] = vec2[](
-        vec2(-stepSize.x,  stepSize.y), // top-left
-        vec2( 0.0f,    stepSize.y), // top-center
-        vec2( stepSize.x,  stepSize.y), // top-right
-        vec2(-stepSize.x,  0.0f),   // center-left
-        vec2( 0.0f,    0.0f),   // center-center
-        vec2( stepSize.x,  0.0f),   // center-right
-        vec2(-stepSize.x, -stepSize.y), // bottom-left
-        vec2( 0.0f,   -stepSize.y), // bottom-center
-        vec2( stepSize.x, -stepSize.y)  // bottom-right    
-    );
-float laplaceFilter[9] = float[](
-        0.0, -1.0, 0.0,
-        -1.0, 4.0, -1.0,
-        0.0, -1.0, 0.0
-    );
-for(int i = 0; i < 9; i++)
-{
-  positionTextureOut += laplaceFilter[i] * texture(positionTextureIn, TexCoords.st + offsets[i]);
-  normalTextureOut += laplaceFilter[i] * texture(normalTextureIn, TexCoords.st + offsets[i]).xyz;
-  colorTextureOut += laplaceFilter[i] * texture(colorTextureIn, TexCoords.st + offsets[i]);
-}
-}
-)foo";
-      aaFragHighShader = glCreateShader(GL_FRAGMENT_SHADER);
-      glShaderSource(aaFragHighShader, 1, &aaFragHighText, 0);
-      glCompileShader(aaFragHighShader);
-      if (!checkShaderCompile(aaFragHighShader, "ANTI ALIASING HIGH-PASS FRAGMENT"))
+      points = readPointFile(path, cloud.stride, cloud.draws);
+    }
+    catch (std::exception const& e)
+    {
+      std::cout << "ENCOUNTERED ERROR LOADING " << path.string() << std::endl;
+      std::cerr << e.what() << std::endl;
+      return;
+    }
+    cloud.pointCount = (GLsizei)(points.size() / cloud.stride);
+    // Scenes place each cloud with its own model matrix, which the index does not know about.
+    if ((pointPicking || occlusionCulling) && cloud.draws.empty())
+    {
+      ThreadPool pool(cpuThreads);
+      cloud.index = std::make_unique<PointIndex>(std::move(points), cloud.stride, pool);
+    }
+    std::vector<float> const& uploaded = cloud.index ? cloud.index->getPoints() : points;
+    glGenBuffers(1, &cloud.buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, cloud.buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * uploaded.size(), uploaded.data(), GL_STATIC_DRAW);
+    if (adaptiveSplats)
+    {
+      std::vector<float> const radii = splatRadii(uploaded, cloud.stride, cloud.draws);
+      glGenBuffers(1, &cloud.radiusBuffer);
+      glBindBuffer(GL_ARRAY_BUFFER, cloud.radiusBuffer);
+      glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * radii.size(), radii.data(), GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    cloud.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // This context never swaps, so the fence only reaches the GPU with an explicit flush.
+    glFlush();
+    while (!finished.tryPush(std::move(cloud)))
+    {
+      if (stopping)
       {
+        glDeleteSync(cloud.fence);
+        glDeleteBuffers(1, &cloud.buffer);
+        glDeleteBuffers(1, &cloud.radiusBuffer);
         return;
       }
-      const char* aaFragLowText = R"foo(
-#version 420
-
-in vec2 TexCoords;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  GLFWwindow* context;
+  SpscQueue<LoadedCloud> finished;
+  std::mutex mutex;
+  std::condition_variable requestReady;
+  std::filesystem::path requested;
+  std::atomic<bool> stopping;
+  std::thread loader;
+};
 
-layout (location = 0) out vec4 positionTextureOut;
-layout (location = 1) out vec3 normalTextureOut;
-layout (location = 2) out vec4 colorTextureOut;
-layout(binding=0) uniform sampler2D positionTextureIn;
-layout(binding=1) uniform sampler2D normalTextureIn;
-layout(binding=2) uniform sampler2D colorTextureIn;
-const float zeroTol = 1e-6;
+int runInteractive(std::vector<float> PLYdata, std::filesystem::path const& PLYpath)
+{
+  std::unique_ptr<VideoWriter> capture;
+  if (!openCapture(capture))
+  {
+    return 7;
+  }
+  RenderWindow viewWindow;
+  if (pointPicking)
+  {
+    ThreadPool pool(cpuThreads);
+    viewWindow.load(std::make_unique<PointIndex>(std::move(PLYdata), pointStride, pool));
+  }
+  else if (streamSource.empty())
+  {
+    viewWindow.load(std::move(PLYdata));
+  }
+  else
+  {
+    viewWindow.openStream();
+  }
+  if (capture)
+  {
+    viewWindow.enableCapture(*capture);
+  }
+  std::unique_ptr<BackgroundLoader> loader;
+  GLFWwindow* loaderContext = streamSource.empty() ? viewWindow.createLoaderContext() : nullptr;
+  if (loaderContext)
+  {
+    loader = std::make_unique<BackgroundLoader>(loaderContext);
+  }
+  std::filesystem::path currentPath = PLYpath;
+  LoadedCloud loaded = {};
+  bool hasLoaded = false;
+  std::vector<CameraPose> recordedPath;
+  while (viewWindow.render())
+  {
+    if (!recordPathFile.empty())
+    {
+      recordedPath.push_back({ viewPos, cameraFront, fov });
+    }
+    if (!loader)
+    {
+      continue;
+    }
+    // F5 reloads the current file, dropping a file onto the window opens it.
+    if (!droppedFile.empty())
+    {
+      currentPath = droppedFile;
+      droppedFile.clear();
+      reloadRequested = true;
+    }
+    if (reloadRequested)
+    {
+      reloadRequested = false;
+      loader->request(currentPath);
+    }
+    if (!hasLoaded)
+    {
+      hasLoaded = loader->poll(loaded);
+    }
+    if (hasLoaded && viewWindow.adoptCloud(loaded))
+    {
+      hasLoaded = false;
+      std::cout << "LOADED " << loaded.path.string() << " (" << loaded.pointCount << " POINTS)" << std::endl;
+    }
+  }
+  if (hasLoaded)
+  {
+    glDeleteSync(loaded.fence);
+    glDeleteBuffers(1, &loaded.buffer);
+    glDeleteBuffers(1, &loaded.radiusBuffer);
+  }
+  loader.reset();
+  viewWindow.finishCapture();
+  StreamCounters counters;
+  if (viewWindow.getStreamCounters(counters))
+  {
+    std::cout << "STREAM RECEIVED " << counters.packets << " PACKETS, " << counters.points << " POINTS, DROPPED " << counters.droppedPackets << ", MALFORMED " << counters.malformedPackets << std::endl;
+  }
+  if (!closeCapture(capture))
+  {
+    return 7;
+  }
+  if (!recordPathFile.empty())
+  {
+    try
+    {
+      writeCameraPath(recordPathFile, recordedPath);
+    }
+    catch (std::exception const& e)
+    {
+      std::cout << "COULD NOT WRITE CAMERA PATH" << std::endl;
+      std::cerr << e.what() << std::endl;
+      return 7;
+    }
+  }
+  return 0;
+}
 
-void main()
+int runServer(std::vector<float> PLYdata)
 {
-  float fragPosDepth = texture(positionTextureIn, TexCoords.st).a;
-if(fragPosDepth < zeroTol) discard;
-  positionTextureOut = texture(positionTextureIn, TexCoords.st);
-  normalTextureOut = texture(normalTextureIn, TexCoords.st).xyz;
-  colorTextureOut = texture(colorTextureIn, TexCoords.st);
-} 
-)foo";
-      aaFragLowShader = glCreateShader(GL_FRAGMENT_SHADER);
-      glShaderSource(aaFragLowShader, 1, &aaFragLowText, 0);
-      glCompileShader(aaFragLowShader);
-      if (!checkShaderCompile(aaFragLowShader, "ANTI ALIASING LOW-PASS FRAGMENT"))
+  std::unique_ptr<RenderServer> server;
+  try
+  {
+    server = std::make_unique<RenderServer>(serverSocket, windowWidth, windowHeight);
+  }
+  catch (std::exception const& e)
+  {
+    std::cout << "COULD NOT START RENDER SERVER" << std::endl;
+    std::cerr << e.what() << std::endl;
+    return 9;
+  }
+  std::unique_ptr<CpuRenderer> cpuRenderer;
+  std::unique_ptr<RenderWindow> viewWindow;
+  if (cpuRendering)
+  {
+    cpuRenderer = std::make_unique<CpuRenderer>(windowWidth, windowHeight, cpuThreads);
+    cpuRenderer->load(PLYdata, pointStride);
+  }
+  else
+  {
+    viewWindow = std::make_unique<RenderWindow>();
+    viewWindow->load(std::move(PLYdata));
+  }
+  std::cout << "SERVING ON " << serverSocket.string() << std::endl;
+  std::size_t const maxBatch = 16;
+  int const defaultBackgroundIters = backgroundFillIters;
+  int const defaultOcclusionIters = occlusionFillIters;
+  while (!server->isStopping())
+  {
+    std::vector<RenderRequest*> batch = server->waitForBatch(maxBatch, std::chrono::milliseconds(200));
+    if (batch.empty())
+    {
+      continue;
+    }
+    TraceZone zone("batch");
+    bool failed = false;
+    for (std::size_t i = 0; i < batch.size() && !failed; ++i)
+    {
+      RenderRequest& request = *batch[i];
+      backgroundFillIters = request.backgroundIters < 0 ? defaultBackgroundIters : request.backgroundIters;
+      occlusionFillIters = request.occlusionIters < 0 ? defaultOcclusionIters : request.occlusionIters;
+      CameraPose const pose = { request.position, request.front, request.fov };
+      if (cpuRenderer)
       {
-        return;
+        glm::mat4 view;
+        glm::mat4 projection;
+        poseMatrices(pose, view, projection);
+        cpuRenderer->render(view, projection, pose.position, backgroundFillIters, occlusionFillIters, request.pixels);
+      }
+      else if (viewWindow->renderPose(pose))
+      {
+        viewWindow->queueReadback(i);
+      }
+      else
+      {
+        failed = true;
       }
     }
-
-    /* Anti-Aliasing Program */
+    for (std::size_t i = 0; viewWindow && !failed && i < batch.size(); ++i)
     {
-      aaHighProgram = glCreateProgram();
-      glAttachShader(aaHighProgram, aaVertShader);
-      glAttachShader(aaHighProgram, aaFragHighShader);
-      glLinkProgram(aaHighProgram);
-      glUseProgram(aaHighProgram);
-      aaLowProgram = glCreateProgram();
-      glAttachShader(aaLowProgram, aaVertShader);
-      glAttachShader(aaLowProgram, aaFragLowShader);
-      glLinkProgram(aaLowProgram);
-      glUseProgram(aaLowProgram);
+      failed = !viewWindow->collectReadback(i, batch[i]->pixels);
     }
-
-    /* Illustration Effect Vertex Shader */
+    if (failed)
     {
-      const GLchar* illustrateVertText = R"foo(
-#version 330 core
-
-layout (location = 0) in vec2 aPos;
-layout (location = 1) in vec2 aTexCoords;
-
-out vec2 TexCoords;
-
-void main()
-{
-  TexCoords = aTexCoords;
-  gl_Position = vec4(aPos.x, aPos.y, 0.0, 1.0); 
-}
-)foo";
-      illustrateVertShader = glCreateShader(GL_VERTEX_SHADER);
-      glShaderSource(illustrateVertShader, 1, &illustrateVertText, 0);
-      glCompileShader(illustrateVertShader);
-      if (!checkShaderCompile(illustrateVertShader, "ILLUSTRATE VERTEX"))
+      for (RenderRequest* request : batch)
       {
-        return;
+        request->pixels.clear();
       }
     }
-
-    /* Illustration Effect Fragment Shader */
+    server->completeBatch(batch);
+    if (failed)
     {
-      const char* illustrateHighText = R"foo(
-#version 420
-
-out vec4 FragColor;
-in vec2 TexCoords;
-
-layout(binding=0) uniform sampler2D positionTextureIn;
-layout(binding=1) uniform sampler2D normalTextureIn;
-layout(binding=2) uniform sampler2D colorTextureIn;
+      std::cout << "SERVER RENDER FAILED" << std::endl;
+      return 6;
+    }
+  }
+  return 0;
+}
 
-void main()
-{
-float fragPosDepth = texture(positionTextureIn, TexCoords.st).a;
-if(fragPosDepth < 1e-5) discard;
-ivec2 texSize = textureSize(positionTextureIn, 0);
-vec2 stepSize = 1.0/vec2(float(texSize.x), float(texSize.y));
-vec2 offsets[9] = vec2[](
-        vec2(-stepSize.x,  stepSize.y), // top-left
-        vec2( 0.0f,    stepSize.y), // top-center
-        vec2( stepSize.x,  stepSize.y), // top-right
-        vec2(-stepSize.x,  0.0f),   // center-left
-        vec2( 0.0f,    0.0f),   // center-center
-        vec2( stepSize.x,  0.0f),   // center-right
-        vec2(-stepSize.x, -stepSize.y), // bottom-left
-        vec2( 0.0f,   -stepSize.y), // bottom-center
-        vec2( stepSize.x, -stepSize.y)  // bottom-right    
-    );
-float featureFilter[9] = float[](
-        1.0/8.0,1.0/8.0, 1.0/8.0,
-        1.0/8.0, 0.0, 1.0/8.0,
-        1.0/8.0, 1.0/8.0, 1.0/8.0
-    );
-vec3 centerNormal = texture(normalTextureIn, TexCoords.st).xyz;
-float curvature = 0.0;
-for(int i = 0; i < 9; i++)
+int runCompositeWorker(std::vector<float> PLYdata)
 {
-  curvature += featureFilter[i] * dot(texture(normalTextureIn, TexCoords.st + offsets[i]).xyz, centerNormal);
+  RenderWindow viewWindow;
+  viewWindow.load(std::move(PLYdata));
+  // Connecting only once the part is uploaded keeps loading out of the compositor's first frame.
+  std::unique_ptr<CompositeWorker> link;
+  try
+  {
+    link = std::make_unique<CompositeWorker>(workerAddress, workerPartition);
+  }
+  catch (std::exception const& e)
+  {
+    std::cout << "COULD NOT REACH COMPOSITOR" << std::endl;
+    std::cerr << e.what() << std::endl;
+    return 9;
+  }
+  GBufferPlanes planes;
+  CompositeFrame frame;
+  while (link->receiveFrame(frame))
+  {
+    CameraPose const pose = { glm::vec3(frame.position[0], frame.position[1], frame.position[2]), glm::vec3(frame.front[0], frame.front[1], frame.front[2]), frame.fov };
+    auto const renderStart = std::chrono::steady_clock::now();
+    if (!viewWindow.renderPlanes(pose, planes))
+    {
+      std::cout << "WORKER RENDER FAILED" << std::endl;
+      return 6;
+    }
+    float const renderMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - renderStart).count();
+    if (!link->sendPlanes(frame.frame, windowWidth, windowHeight, renderMilliseconds, planes))
+    {
+      break;
+    }
+  }
+  return 0;
 }
-if(curvature > .975) 
+
+// Starts count workers on this machine, each rendering one part of PLYpath for the compositor on port.
+std::vector<int> spawnWorkers(std::filesystem::path const& PLYpath, int port, int count)
 {
-  FragColor = texture(colorTextureIn, TexCoords.st);
+  std::vector<int> workers;
+#ifndef _WIN32
+  std::error_code ec;
+  std::filesystem::path executable = std::filesystem::read_symlink("/proc/self/exe", ec);
+  if (ec)
+  {
+    executable = executablePath;
+  }
+  for (int i = 0; i < count; ++i)
+  {
+    std::vector<std::string> args = { executable.string(), "--width", std::to_string(windowWidth), "--height", std::to_string(windowHeight),
+      "--worker", "127.0.0.1:" + std::to_string(port), "--partition", std::to_string(i) + "/" + std::to_string(count) };
+    if (adaptiveSplats)
+    {
+      args.push_back("--adaptive-splats");
+    }
+    args.push_back(PLYpath.string());
+    std::vector<char*> argv;
+    for (std::string& arg : args)
+    {
+      argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+    pid_t const pid = fork();
+    if (pid == 0)
+    {
+      execv(argv[0], argv.data());
+      _exit(127);
+    }
+    if (pid > 0)
+    {
+      workers.push_back(pid);
+    }
+  }
+#else
+  (void)PLYpath;
+  (void)port;
+  (void)count;
+#endif
+  return workers;
 }
-else
+
+// Waits for the workers, terminating them first when they were never told to stop.
+void reapWorkers(std::vector<int> const& workers, bool terminate)
 {
-  FragColor = vec4(0.0,0.0,0.0,1.0);
-}
+#ifndef _WIN32
+  for (int pid : workers)
+  {
+    if (terminate)
+    {
+      kill(pid, SIGTERM);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+  }
+#else
+  (void)workers;
+  (void)terminate;
+#endif
 }
-)foo";
-      illustrateFragShader = glCreateShader(GL_FRAGMENT_SHADER);
-      glShaderSource(illustrateFragShader, 1, &illustrateHighText, 0);
-      glCompileShader(illustrateFragShader);
-      if (!checkShaderCompile(illustrateFragShader, "ILLUSTRATION FRAGMENT"))
+
+/* Sort-last rendering: workers each draw one part of the cloud and the compositor merges their
+ * point passes by depth, then fills and post-processes the merged G-buffer. With --benchmark
+ * every worker count from 1 to --composite is measured so the report shows how it scales. The
+ * compositor keeps no points; a benchmark orbit is bounded by reading the cloud a part at a time. */
+int runComposite(std::filesystem::path const& PLYpath)
+{
+  std::vector<CameraPose> cameraPath;
+  std::size_t pointCount = 0;
+  if (benchmark)
+  {
+    glm::vec3 lower(std::numeric_limits<float>::max());
+    glm::vec3 upper(-std::numeric_limits<float>::max());
+    try
+    {
+      for (int part = 0; part < compositeWorkers; ++part)
       {
-        return;
+        std::vector<float> const points = readPLY(PLYpath, pointStride, false, cpuThreads, nullptr, part, compositeWorkers);
+        pointCount += points.size() / pointStride;
+        if (cameraPathFile.empty())
+        {
+          boundPoints(points, lower, upper);
+        }
       }
     }
-
-    /* Illustration Effect Program */
+    catch (std::exception const& e)
     {
-      illustrateProgram = glCreateProgram();
-      glAttachShader(illustrateProgram, illustrateVertShader);
-      glAttachShader(illustrateProgram, illustrateFragShader);
-      glLinkProgram(illustrateProgram);
-      glUseProgram(illustrateProgram);
+      std::cout << "ENCOUNTERED ERROR READING PLY FILE " << std::endl;
+      std::cerr << e.what() << std::endl;
+      return 4;
+    }
+    if (cameraPathFile.empty())
+    {
+      cameraPath = generateOrbit(lower, upper, orbitFrames > 0 ? orbitFrames : 360);
+    }
+    else
+    {
+      int const pathStatus = loadCameraPath({}, cameraPath);
+      if (pathStatus != 0)
+      {
+        return pathStatus;
+      }
     }
   }
-  GLFWwindow* setupWindow()
+  std::unique_ptr<VideoWriter> capture;
+  if (!openCapture(capture))
   {
-    glfwSetErrorCallback(error_callback);
-    if (!glfwInit())
+    return 7;
+  }
+  // External workers connect once, so only their full count can be measured.
+  int const firstCount = benchmark && compositePort == 0 ? 1 : compositeWorkers;
+  int const connectTimeout = 300000;
+  RenderWindow viewWindow;
+  if (capture)
+  {
+    viewWindow.enableCapture(*capture);
+  }
+  GpuTimer* timer = benchmark ? viewWindow.enablePassTimer() : nullptr;
+  std::vector<TimingSeries> scaling;
+  for (int workerCount = firstCount; workerCount <= compositeWorkers; ++workerCount)
+  {
+    std::unique_ptr<Compositor> compositor;
+    try
     {
-      return nullptr;
+      compositor = std::make_unique<Compositor>(compositePort, compositePort > 0, windowWidth, windowHeight);
+    }
+    catch (std::exception const& e)
+    {
+      std::cout << "COULD NOT START COMPOSITOR" << std::endl;
+      std::cerr << e.what() << std::endl;
+      return 9;
+    }
+    std::vector<int> workers;
+    if (compositePort == 0)
+    {
+      workers = spawnWorkers(PLYpath, compositor->getPort(), workerCount);
+    }
+    else
+    {
+      std::cout << "WAITING FOR " << workerCount << " WORKERS ON PORT " << compositor->getPort() << std::endl;
+    }
+    try
+    {
+      compositor->acceptWorkers(workerCount, connectTimeout);
+    }
+    catch (std::exception const& e)
+    {
+      std::cout << "COMPOSITING WORKERS DID NOT CONNECT" << std::endl;
+      std::cerr << e.what() << std::endl;
+      compositor.reset();
+      reapWorkers(workers, true);
+      return 9;
+    }
+    viewWindow.setCompositor(compositor.get());
+    bool failed = false;
+    if (!benchmark)
+    {
+      while (viewWindow.render())
+      {
+      }
+      failed = viewWindow.hasFailed();
+    }
+    else
+    {
+      std::string const suffix = "_w" + std::to_string(workerCount);
+      TimingSeries frameTimes = { "frame" + suffix, {} };
+      TimingSeries workerTimes = { "worker_render" + suffix, {} };
+      TimingSeries gatherTimes = { "gather" + suffix, {} };
+      TimingSeries compositeTimes = { "composite" + suffix, {} };
+      int const totalFrames = warmupFrames + (int)cameraPath.size();
+      auto lastFrameEnd = std::chrono::steady_clock::now();
+      for (int frame = 0; frame < totalFrames && !failed; ++frame)
+      {
+        bool const measured = frame >= warmupFrames;
+        // Per-pass GPU times are only kept for the full worker count.
+        timer->setRecording(measured && workerCount == compositeWorkers);
+        CameraPose const& pose = cameraPath[measured ? frame - warmupFrames : frame % cameraPath.size()];
+        failed = !viewWindow.renderPose(pose) || viewWindow.hasFailed();
+        auto const frameEnd = std::chrono::steady_clock::now();
+        if (measured && !failed)
+        {
+          frameTimes.milliseconds.push_back(std::chrono::duration<double, std::milli>(frameEnd - lastFrameEnd).count());
+          // Gathering spans the slowest worker's render and readback plus every transfer.
+          workerTimes.milliseconds.push_back(compositor->getWorkerMilliseconds());
+          gatherTimes.milliseconds.push_back(compositor->getGatherMilliseconds());
+          compositeTimes.milliseconds.push_back(compositor->getCompositeMilliseconds());
+        }
+        lastFrameEnd = frameEnd;
+      }
+      scaling.insert(scaling.end(), { frameTimes, workerTimes, gatherTimes, compositeTimes });
+    }
+    viewWindow.setCompositor(nullptr);
+    compositor.reset();
+    reapWorkers(workers, failed);
+    if (failed)
+    {
+      std::cout << (benchmark ? "BENCHMARK RENDER FAILED" : "COMPOSITED RENDER FAILED") << std::endl;
+      return 6;
     }
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
-    GLFWwindow* window = glfwCreateWindow(windowWidth, windowHeight, "Rosenthal-Linsen-Lars-2008", NULL, NULL);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    glfwMakeContextCurrent(window);
-    gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
-    glfwSwapInterval(1);
-    return window;
   }
-  void smooth()
+  viewWindow.finishCapture();
+  if (!closeCapture(capture))
   {
-    int nextBuffer = currBuffer ^ 1;
-    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer[nextBuffer]);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(smoothProgram);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, positionTexture[currBuffer]);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normalTexture[currBuffer]);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, colorTexture[currBuffer]);
-    glBindVertexArray(fboVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    currBuffer = nextBuffer;
+    return 7;
   }
-  bool failState;
-  GLFWwindow* window;
-  
-  int pointCount;
-  int currBuffer;
-  glm::mat4 model;
-  glm::mat4 view;
-  glm::mat4 projection;
-  glm::vec3 lightPos;
-  GLuint pointVAO;
-  GLuint pointVBO;
-  GLuint pointVertShader;
-  GLuint pointFragShader;
-  GLuint pointProgram;
-  GLuint fboVAO;
-  GLuint fboVBO;
-  GLuint backgroundVertShader;
-  GLuint backgroundFragShader;
-  GLuint backgroundProgram;
-  GLuint occlusionVertShader;
-  GLuint occlusionFragShader;
-  GLuint occlusionProgram;
-  GLuint smoothVertShader;
-  GLuint smoothFragShader;
-  GLuint smoothProgram;
-  GLuint aaVertShader;
-  GLuint aaFragHighShader;
-  GLuint aaFragLowShader;
-  GLuint aaHighProgram;
-  GLuint aaLowProgram;
-  GLuint illustrateVertShader;
-  GLuint illustrateFragShader;
-  GLuint illustrateProgram;
-  GLint pointModelLoc;
-  GLint pointViewLoc;
-  GLint pointProjectionLoc;
-  GLint pointLightPosLoc;
-  GLint pointViewPosLoc;
-  GLuint gBuffer[2];
-  GLuint positionTexture[2];
-  GLuint normalTexture[2];
-  GLuint colorTexture[2];
-  GLuint depthRenderBuffer[2];
-};
+  if (!benchmark)
+  {
+    return 0;
+  }
+  timer->finish();
+  std::vector<TimingSeries> series = timer->getSeries();
+  series.insert(series.end(), scaling.begin(), scaling.end());
+  auto metadata = benchmarkMetadata(PLYpath, pointCount, cameraPath.size());
+  metadata.push_back({ "composite_workers", std::to_string(compositeWorkers) });
+  metadata.push_back({ "composite_external", compositePort > 0 ? "true" : "false" });
+  metadata.push_back({ "composite_threads", std::to_string(std::thread::hardware_concurrency()) });
+  metadata.push_back({ "headless", headless ? "true" : "false" });
+  metadata.push_back({ "adaptive_splats", adaptiveSplats ? "true" : "false" });
+  metadata.push_back({ "deferred_lighting", deferredLighting ? "true" : "false" });
+  metadata.push_back({ "smooth_sigma", std::to_string(smoothSigma) });
+  metadata.push_back({ "fused_post", fusedPost ? "true" : "false" });
+  metadata.push_back({ "renderer", (char const*)glGetString(GL_RENDERER) });
+  metadata.push_back({ "gl_version", (char const*)glGetString(GL_VERSION) });
+  return writeBenchmarkReport(metadata, series);
+}
 
-std::vector<float> readPLY(std::filesystem::path const& PLYpath)
+int main(int argc, char *argv[])
 {
-  if (!std::filesystem::exists(PLYpath))
+  std::filesystem::path PLYpath;
+  executablePath = argv[0];
+  if (!parseArguments(argc, argv, PLYpath))
   {
-    throw std::invalid_argument(PLYpath.string() + " does not exist");
+    displayHelp();
+    return 1;
   }
-  std::ifstream ss(PLYpath, std::ios::binary);
-  if (ss.fail())
+  if (!traceFile.empty())
   {
-    throw std::runtime_error(PLYpath.string() + " failed to open");
+    traceEnabled = true;
+    traceSetThreadName("main");
   }
-  tinyply::PlyFile file;
-  file.parse_header(ss);
-  auto vertices = file.request_properties_from_element("vertex", { "x", "y", "z", "nx", "ny", "nz" });
-  std::shared_ptr<tinyply::PlyData> colors;
-  try
+  std::vector<std::pair<std::filesystem::path, glm::mat4>> sceneObjects;
+  if (!sceneFile.empty())
   {
-    colors = file.request_properties_from_element("vertex", { "red", "green", "blue" });
+    try
+    {
+      sceneObjects = readScene(sceneFile);
+    }
+    catch (std::exception const& e)
+    {
+      std::cout << "BAD SCENE FILE" << std::endl;
+      std::cerr << e.what() << std::endl;
+      return 2;
+    }
   }
-  catch (...)
+  if (!lightFile.empty())
   {
+    try
+    {
+      pointLights = readLights(lightFile);
+    }
+    catch (std::exception const& e)
+    {
+      std::cout << "BAD LIGHT FILE" << std::endl;
+      std::cerr << e.what() << std::endl;
+      return 2;
+    }
   }
-  file.read(ss);
-  if (!vertices)
+  std::vector<float> PLYdata;
+  if (!streamSource.empty())
   {
-    throw std::invalid_argument(PLYpath.string() + " is missing elements required");
+    pointStride = PointStream::pointFloats;
   }
-  pointStride = colors ? 9 : 6;
-  std::vector<float> PLYdata(pointStride*vertices->count);
-  if (colors)
+  // Compositing workers read only their part of the cloud, and the compositor none of it.
+  else if (compositeWorkers == 0)
   {
-    std::vector<float> vertexPosData(6 * vertices->count);
-    std::memcpy(vertexPosData.data(), vertices->buffer.get(), vertices->buffer.size_bytes());
-    std::vector<std::uint8_t> colorData(3 * vertices->count);
-    std::memcpy(colorData.data(), colors->buffer.get(), colors->buffer.size_bytes());
-    for (int i = 0; i < vertices->count; ++i)
+    try
     {
-      PLYdata[i*pointStride] = vertexPosData[i * 6];
-      PLYdata[i*pointStride+1] = vertexPosData[i * 6 +1];
-      PLYdata[i*pointStride +2] = vertexPosData[i * 6 + 2];
-      PLYdata[i*pointStride + 3] = vertexPosData[i * 6 + 3];
-      PLYdata[i*pointStride + 4] = vertexPosData[i * 6 + 4];
-      PLYdata[i*pointStride + 5] = vertexPosData[i * 6 + 5];
-      PLYdata[i*pointStride + 6] = colorData[i * 3] / 255.f;
-      PLYdata[i*pointStride + 7] = colorData[i * 3 + 1] / 255.f;
-      PLYdata[i*pointStride + 8] = colorData[i * 3 + 2] / 255.f;
+      if (!workerAddress.empty())
+      {
+        PLYdata = readPLY(PLYpath, pointStride, !normalEstimation, cpuThreads, &plyDecodeReport, workerPartition, workerPartitions);
+      }
+      else if (sceneObjects.empty())
+      {
+        PLYdata = readPLY(PLYpath, pointStride, !normalEstimation, cpuThreads, &plyDecodeReport);
+      }
+      else
+      {
+        PLYdata = loadScene(sceneObjects, sceneDraws);
+        pointStride = 9;
+      }
+    }
+    catch (std::invalid_argument const& e)
+    {
+      std::cout << "BAD PLY FILE" << std::endl;
+      std::cerr << e.what() << std::endl;
+      return 2;
+    }
+    catch (std::runtime_error const& e)
+    {
+      std::cout << "ENCOUNTERED ERROR READING PLY FILE " << std::endl;
+      std::cerr << e.what() << std::endl;
+      return 3;
+    }
+    catch (std::exception const& e)
+    {
+      std::cout << "ENCOUNTERED ERROR READING PLY FILE " << std::endl;
+      std::cerr << e.what() << std::endl;
+      return 4;
     }
   }
-  else
+  if (shufflePoints)
+  {
+    if (sceneDraws.empty())
+    {
+      stratifyPoints(PLYdata, pointStride, 0, PLYdata.size() / pointStride);
+    }
+    for (SceneDraw const& draw : sceneDraws)
+    {
+      stratifyPoints(PLYdata, pointStride, draw.first, draw.count);
+    }
+  }
+  int status = 0;
+  if (!workerAddress.empty())
   {
-    std::memcpy(PLYdata.data(), vertices->buffer.get(), vertices->buffer.size_bytes());
+    status = runCompositeWorker(std::move(PLYdata));
   }
-  return PLYdata;
-}
-
-void displayHelp()
-{
-  std::cout << "Usage: Rosenthal-Linsen-Lars-2008 \"PLY PATH\"" << std::endl;
-}
-
-int main(int argc, char *argv[])
-{
-  if (argc != 2)
+  else if (compositeWorkers > 0)
   {
-    displayHelp();
-    return 1;
+    status = runComposite(PLYpath);
   }
-  std::vector<float> PLYdata;
-  try
+  else if (validateCpu)
   {
-    PLYdata = readPLY(argv[1]);
+    status = runCpuValidation(std::move(PLYdata));
   }
-  catch (std::invalid_argument const& e)
+  else if (validateDeferred)
   {
-    std::cout << "BAD PLY FILE" << std::endl;
-    std::cerr << e.what() << std::endl;
-    return 2;
+    status = runDeferredValidation(std::move(PLYdata));
   }
-  catch (std::runtime_error const& e)
+  else if (benchmark)
   {
-    std::cout << "ENCOUNTERED ERROR READING PLY FILE " << std::endl;
-    std::cerr << e.what() << std::endl;
-    return 3;
+    status = runBenchmark(PLYpath, std::move(PLYdata));
   }
-  catch (std::exception const& e)
+  else if (!serverSocket.empty())
   {
-    std::cout << "ENCOUNTERED ERROR READING PLY FILE " << std::endl;
-    std::cerr << e.what() << std::endl;
-    return 4;
+    status = runServer(std::move(PLYdata));
   }
-  RenderWindow viewWindow;
-  viewWindow.load(std::move(PLYdata));
-  while (viewWindow.render()){}
-  return 0;
-}
\ No newline at end of file
+  else if (posterWidth > 0)
+  {
+    status = renderPoster(std::move(PLYdata));
+  }
+  else if (headless)
+  {
+    status = renderHeadless(std::move(PLYdata));
+  }
+  else
+  {
+    status = runInteractive(std::move(PLYdata), PLYpath);
+  }
+  if (traceEnabled && traceFrames == 0)
+  {
+    dumpTrace();
+  }
+  return status;
+}
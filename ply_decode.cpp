@@ -0,0 +1,187 @@
+#include "ply_decode.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace
+{
+  std::size_t const chunkPoints = 1 << 12;
+
+  template <typename T>
+  void convert(T const* __restrict values, std::size_t count, double offset, double scale, float* __restrict converted)
+  {
+    if constexpr (std::is_same<T, double>::value)
+    {
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        converted[i] = (float)((values[i] - offset) * scale);
+      }
+    }
+    else
+    {
+      float const floatOffset = (float)offset;
+      float const floatScale = (float)scale;
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        converted[i] = ((float)values[i] - floatOffset) * floatScale;
+      }
+    }
+  }
+
+  template <typename T>
+  void bounds(T const* __restrict values, std::size_t count, double& lower, double& upper)
+  {
+    T low = std::numeric_limits<T>::max();
+    T high = std::numeric_limits<T>::lowest();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      low = std::min(low, values[i]);
+      high = std::max(high, values[i]);
+    }
+    lower = std::min(lower, (double)low);
+    upper = std::max(upper, (double)high);
+  }
+
+  // Calls function with the column's values, first advanced by first points, as a pointer to their type.
+  template <typename Function>
+  void dispatch(PlyColumn const& column, std::size_t first, Function&& function)
+  {
+    switch (column.type)
+    {
+    case PlyScalar::Int8:
+      function((std::int8_t const*)column.values + first);
+      break;
+    case PlyScalar::UInt8:
+      function((std::uint8_t const*)column.values + first);
+      break;
+    case PlyScalar::Int16:
+      function((std::int16_t const*)column.values + first);
+      break;
+    case PlyScalar::UInt16:
+      function((std::uint16_t const*)column.values + first);
+      break;
+    case PlyScalar::Int32:
+      function((std::int32_t const*)column.values + first);
+      break;
+    case PlyScalar::UInt32:
+      function((std::uint32_t const*)column.values + first);
+      break;
+    case PlyScalar::Float32:
+      function((float const*)column.values + first);
+      break;
+    case PlyScalar::Float64:
+      function((double const*)column.values + first);
+      break;
+    }
+  }
+}
+
+char const* plyScalarName(PlyScalar type)
+{
+  switch (type)
+  {
+  case PlyScalar::Int8:
+    return "char";
+  case PlyScalar::UInt8:
+    return "uchar";
+  case PlyScalar::Int16:
+    return "short";
+  case PlyScalar::UInt16:
+    return "ushort";
+  case PlyScalar::Int32:
+    return "int";
+  case PlyScalar::UInt32:
+    return "uint";
+  case PlyScalar::Float32:
+    return "float";
+  case PlyScalar::Float64:
+    return "double";
+  }
+  return "unknown";
+}
+
+std::size_t plyScalarSize(PlyScalar type)
+{
+  switch (type)
+  {
+  case PlyScalar::Int8:
+  case PlyScalar::UInt8:
+    return 1;
+  case PlyScalar::Int16:
+  case PlyScalar::UInt16:
+    return 2;
+  case PlyScalar::Int32:
+  case PlyScalar::UInt32:
+  case PlyScalar::Float32:
+    return 4;
+  case PlyScalar::Float64:
+    return 8;
+  }
+  return 0;
+}
+
+double plyScalarRange(PlyScalar type)
+{
+  switch (type)
+  {
+  case PlyScalar::Int8:
+    return std::numeric_limits<std::int8_t>::max();
+  case PlyScalar::UInt8:
+    return std::numeric_limits<std::uint8_t>::max();
+  case PlyScalar::Int16:
+    return std::numeric_limits<std::int16_t>::max();
+  case PlyScalar::UInt16:
+    return std::numeric_limits<std::uint16_t>::max();
+  case PlyScalar::Int32:
+    return std::numeric_limits<std::int32_t>::max();
+  case PlyScalar::UInt32:
+    return std::numeric_limits<std::uint32_t>::max();
+  default:
+    return 1.;
+  }
+}
+
+void plyColumnBounds(PlyColumn const& column, std::size_t count, ThreadPool& pool, double& lower, double& upper)
+{
+  int const chunkCount = (int)((count + chunkPoints - 1) / chunkPoints);
+  std::vector<double> lowers(pool.getThreadCount(), std::numeric_limits<double>::max());
+  std::vector<double> uppers(pool.getThreadCount(), std::numeric_limits<double>::lowest());
+  pool.parallelFor(chunkCount, [&](int chunk, int worker)
+  {
+    std::size_t const first = chunk * chunkPoints;
+    std::size_t const end = std::min(count, first + chunkPoints);
+    dispatch(column, first, [&](auto values)
+    {
+      bounds(values, end - first, lowers[worker], uppers[worker]);
+    });
+  });
+  lower = *std::min_element(lowers.begin(), lowers.end());
+  upper = *std::max_element(uppers.begin(), uppers.end());
+}
+
+void decodePlyColumns(std::vector<PlyColumn> const& columns, std::size_t count, int stride, ThreadPool& pool, float* points)
+{
+  TraceZone zone("decodePlyColumns");
+  int const chunkCount = (int)((count + chunkPoints - 1) / chunkPoints);
+  std::vector<std::vector<float>> scratch(pool.getThreadCount(), std::vector<float>(chunkPoints));
+  pool.parallelFor(chunkCount, [&](int chunk, int worker)
+  {
+    std::size_t const first = chunk * chunkPoints;
+    std::size_t const end = std::min(count, first + chunkPoints);
+    float* const converted = scratch[worker].data();
+    for (PlyColumn const& column : columns)
+    {
+      dispatch(column, first, [&](auto values)
+      {
+        convert(values, end - first, column.offset, column.scale, converted);
+      });
+      float* const destination = points + first * stride + column.column;
+      for (std::size_t i = 0; i < end - first; ++i)
+      {
+        destination[i * stride] = converted[i];
+      }
+    }
+  });
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "thread_pool.h"
+
+enum class PlyScalar
+{
+  Int8,
+  UInt8,
+  Int16,
+  UInt16,
+  Int32,
+  UInt32,
+  Float32,
+  Float64
+};
+
+/* One decoded PLY property: count contiguous values of type, written to float column of every
+ * point as (value - offset) * scale. The subtraction happens in double for Float64 values, so
+ * large coordinates keep their precision once re-centered. */
+struct PlyColumn
+{
+  PlyScalar type;
+  void const* values;
+  int column;
+  double offset;
+  double scale;
+};
+
+// The PLY spelling of type, e.g. "uchar" or "double".
+char const* plyScalarName(PlyScalar type);
+std::size_t plyScalarSize(PlyScalar type);
+// The largest value of an integer type, which maps to 1 when normalizing colors; 1 for floating point.
+double plyScalarRange(PlyScalar type);
+void plyColumnBounds(PlyColumn const& column, std::size_t count, ThreadPool& pool, double& lower, double& upper);
+/* Converts and interleaves all columns into points, count points of stride floats. Chunks of
+ * points are decoded in parallel; each column is first converted into a contiguous scratch row
+ * by a loop specialized for its type, which the compiler vectorizes, and then stored strided. */
+void decodePlyColumns(std::vector<PlyColumn> const& columns, std::size_t count, int stride, ThreadPool& pool, float* points);
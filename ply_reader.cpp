@@ -0,0 +1,347 @@
+#include "ply_reader.h"
+#include "ply_decode.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include "third-party/tinyply/source/tinyply.h"
+
+namespace
+{
+  PlyScalar plyScalar(tinyply::Type type, std::string const& property)
+  {
+    switch (type)
+    {
+    case tinyply::Type::INT8:
+      return PlyScalar::Int8;
+    case tinyply::Type::UINT8:
+      return PlyScalar::UInt8;
+    case tinyply::Type::INT16:
+      return PlyScalar::Int16;
+    case tinyply::Type::UINT16:
+      return PlyScalar::UInt16;
+    case tinyply::Type::INT32:
+      return PlyScalar::Int32;
+    case tinyply::Type::UINT32:
+      return PlyScalar::UInt32;
+    case tinyply::Type::FLOAT32:
+      return PlyScalar::Float32;
+    case tinyply::Type::FLOAT64:
+      return PlyScalar::Float64;
+    default:
+      throw std::invalid_argument("property " + property + " has an unsupported type");
+    }
+  }
+
+  // A requested vertex property: tinyply's data of every point, or the bytes of the read range alone.
+  struct Property
+  {
+    std::string name;
+    tinyply::Type type;
+    std::size_t offset;
+    std::shared_ptr<tinyply::PlyData> data;
+    std::vector<std::uint8_t> range;
+  };
+
+  std::size_t const blockRecords = 1 << 16;
+}
+
+std::vector<float> readPLY(std::filesystem::path const& PLYpath, int& stride, bool readNormals, int threadCount, PlyDecodeReport* report, int part, int parts)
+{
+  if (!std::filesystem::exists(PLYpath))
+  {
+    throw std::invalid_argument(PLYpath.string() + " does not exist");
+  }
+  std::ifstream ss(PLYpath, std::ios::binary);
+  if (ss.fail())
+  {
+    throw std::runtime_error(PLYpath.string() + " failed to open");
+  }
+  TraceZone zone("readPLY");
+  tinyply::PlyFile file;
+  traceBegin("parse_header");
+  file.parse_header(ss);
+  traceEnd();
+  std::streamoff const dataStart = (std::streamoff)ss.tellg();
+
+  /* Binary little-endian vertices without list properties are records of one size, so a range of
+   * them is read by seeking to it. Anything else goes through tinyply, which reads every point. */
+  std::string header((std::size_t)dataStart, '\0');
+  std::ifstream(PLYpath, std::ios::binary).read(&header[0], dataStart);
+  std::vector<tinyply::PlyElement> const elements = file.get_elements();
+  bool ranged = parts > 1 && file.is_binary_file() && header.find("binary_little_endian") != std::string::npos;
+  std::size_t vertexOffset = 0;
+  std::size_t recordBytes = 0;
+  tinyply::PlyElement const* vertex = nullptr;
+  for (tinyply::PlyElement const& element : elements)
+  {
+    std::size_t bytes = 0;
+    for (tinyply::PlyProperty const& property : element.properties)
+    {
+      ranged = ranged && !property.isList;
+      bytes += property.isList ? 0 : plyScalarSize(plyScalar(property.propertyType, property.name));
+    }
+    if (element.name == "vertex")
+    {
+      vertex = &element;
+      recordBytes = bytes;
+      break;
+    }
+    vertexOffset += element.size * bytes;
+  }
+  ranged = ranged && vertex;
+  std::size_t const total = vertex ? vertex->size : 0;
+  std::size_t const first = total * part / parts;
+  std::size_t const count = total * (part + 1) / parts - first;
+
+  // Properties are requested one at a time since a request must share a single type.
+  std::vector<Property> requested;
+  auto request = [&](std::initializer_list<char const*> names) -> int
+  {
+    for (char const* name : names)
+    {
+      if (ranged)
+      {
+        std::size_t offset = 0;
+        for (tinyply::PlyProperty const& property : vertex->properties)
+        {
+          if (property.name == name)
+          {
+            requested.push_back({ name, property.propertyType, offset, nullptr, {} });
+            return (int)requested.size() - 1;
+          }
+          offset += plyScalarSize(plyScalar(property.propertyType, property.name));
+        }
+        continue;
+      }
+      try
+      {
+        std::shared_ptr<tinyply::PlyData> const data = file.request_properties_from_element("vertex", { name });
+        requested.push_back({ name, data->t, 0, data, {} });
+        return (int)requested.size() - 1;
+      }
+      catch (...)
+      {
+      }
+    }
+    return -1;
+  };
+  char const* const propertyNames[] = { "x", "y", "z", "nx", "ny", "nz" };
+  int const properties = readNormals ? 6 : 3;
+  int vertices[6];
+  for (int i = 0; i < properties; ++i)
+  {
+    vertices[i] = request({ propertyNames[i] });
+  }
+  int colors[3] = { request({ "red", "diffuse_red" }), request({ "green", "diffuse_green" }), request({ "blue", "diffuse_blue" }) };
+  int const intensity = request({ "intensity", "scalar_intensity" });
+  // Calls function with every block of vertex records from begin to end, and the index of its first record.
+  auto forRecords = [&](std::size_t begin, std::size_t end, auto&& function)
+  {
+    std::vector<char> block(blockRecords * recordBytes);
+    ss.clear();
+    ss.seekg(dataStart + (std::streamoff)(vertexOffset + begin * recordBytes));
+    for (std::size_t start = begin; start < end; start += blockRecords)
+    {
+      std::size_t const records = std::min(blockRecords, end - start);
+      if (!ss.read(block.data(), (std::streamsize)(records * recordBytes)))
+      {
+        throw std::runtime_error(PLYpath.string() + " is truncated");
+      }
+      function(block.data(), records, start);
+    }
+  };
+  traceBegin("read");
+  if (ranged)
+  {
+    for (Property& property : requested)
+    {
+      property.range.resize(count * plyScalarSize(plyScalar(property.type, property.name)));
+    }
+    forRecords(first, first + count, [&](char const* block, std::size_t records, std::size_t start)
+    {
+      for (Property& property : requested)
+      {
+        std::size_t const size = plyScalarSize(plyScalar(property.type, property.name));
+        std::uint8_t* const destination = property.range.data() + (start - first) * size;
+        for (std::size_t r = 0; r < records; ++r)
+        {
+          std::memcpy(destination + r * size, block + r * recordBytes + property.offset, size);
+        }
+      }
+    });
+  }
+  else
+  {
+    file.read(ss);
+  }
+  traceEnd();
+  for (int i = 0; i < properties; ++i)
+  {
+    if (vertices[i] < 0)
+    {
+      throw std::invalid_argument(PLYpath.string() + " is missing elements required");
+    }
+  }
+  for (Property const& property : requested)
+  {
+    if (property.data && (property.data->count != total || property.data->isList))
+    {
+      throw std::invalid_argument(PLYpath.string() + " property " + property.name + " is not one scalar per vertex");
+    }
+  }
+  bool const hasColor = colors[0] >= 0 && colors[1] >= 0 && colors[2] >= 0;
+  if (!hasColor && intensity >= 0)
+  {
+    colors[0] = colors[1] = colors[2] = intensity;
+  }
+  stride = hasColor || intensity >= 0 ? 9 : 6;
+
+  ThreadPool pool(threadCount);
+  // The values of the read points, and a column of them.
+  auto values = [&](int index) -> void const*
+  {
+    Property const& property = requested[index];
+    if (!property.data)
+    {
+      return property.range.data();
+    }
+    return property.data->buffer.get() + first * plyScalarSize(plyScalar(property.type, property.name));
+  };
+  /* Bounds of each of a group of properties over every point of the file, so that each part of it
+   * is re-centered and normalized alike. A range is bounded in one pass over the file's records. */
+  auto fileBounds = [&](std::vector<int> const& indices, double* lower, double* upper)
+  {
+    if (!ranged)
+    {
+      for (std::size_t i = 0; i < indices.size(); ++i)
+      {
+        Property const& property = requested[indices[i]];
+        plyColumnBounds({ plyScalar(property.type, property.name), property.data->buffer.get(), 0, 0., 1. }, total, pool, lower[i], upper[i]);
+      }
+      return;
+    }
+    std::fill(lower, lower + indices.size(), std::numeric_limits<double>::max());
+    std::fill(upper, upper + indices.size(), std::numeric_limits<double>::lowest());
+    std::vector<std::uint8_t> scratch(blockRecords * sizeof(double));
+    forRecords(0, total, [&](char const* block, std::size_t records, std::size_t)
+    {
+      for (std::size_t i = 0; i < indices.size(); ++i)
+      {
+        Property const& property = requested[indices[i]];
+        PlyScalar const type = plyScalar(property.type, property.name);
+        std::size_t const size = plyScalarSize(type);
+        for (std::size_t r = 0; r < records; ++r)
+        {
+          std::memcpy(&scratch[r * size], block + r * recordBytes + property.offset, size);
+        }
+        double blockLower = 0.;
+        double blockUpper = 0.;
+        plyColumnBounds({ type, scratch.data(), 0, 0., 1. }, records, pool, blockLower, blockUpper);
+        lower[i] = std::min(lower[i], blockLower);
+        upper[i] = std::max(upper[i], blockUpper);
+      }
+    });
+  };
+  std::vector<PlyColumn> columns;
+  std::string types;
+  // Names the type of a group of properties, or of each one when they differ.
+  auto describe = [&](char const* group, int first, int columnCount)
+  {
+    bool mixed = false;
+    for (int i = first + 1; i < first + columnCount; ++i)
+    {
+      mixed = mixed || columns[i].type != columns[first].type;
+    }
+    std::string type = plyScalarName(columns[first].type);
+    for (int i = first + 1; mixed && i < first + columnCount; ++i)
+    {
+      type = type + "/" + plyScalarName(columns[i].type);
+    }
+    types += (types.empty() ? "" : " ") + std::string(group) + ":" + type;
+  };
+  double origin[3] = {};
+  for (int i = 0; i < properties; ++i)
+  {
+    columns.push_back({ plyScalar(requested[vertices[i]].type, propertyNames[i]), values(vertices[i]), i, 0., 1. });
+  }
+  std::vector<int> doubleAxes;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    if (columns[axis].type == PlyScalar::Float64 && total > 0)
+    {
+      doubleAxes.push_back(axis);
+    }
+  }
+  if (!doubleAxes.empty())
+  {
+    std::vector<int> indices;
+    for (int axis : doubleAxes)
+    {
+      indices.push_back(vertices[axis]);
+    }
+    double lower[3] = {};
+    double upper[3] = {};
+    fileBounds(indices, lower, upper);
+    for (std::size_t i = 0; i < doubleAxes.size(); ++i)
+    {
+      origin[doubleAxes[i]] = (lower[i] + upper[i]) / 2.;
+      columns[doubleAxes[i]].offset = origin[doubleAxes[i]];
+    }
+  }
+  describe("xyz", 0, 3);
+  if (properties == 6)
+  {
+    describe("n", 3, 3);
+  }
+  if (stride == 9)
+  {
+    int const firstColor = (int)columns.size();
+    for (int i = 0; i < 3; ++i)
+    {
+      PlyScalar const type = plyScalar(requested[colors[i]].type, hasColor ? "color" : "intensity");
+      // There is no agreed range of signed colors, and scaling by the maximum would make them negative.
+      if (hasColor && (type == PlyScalar::Int8 || type == PlyScalar::Int16 || type == PlyScalar::Int32))
+      {
+        throw std::invalid_argument(PLYpath.string() + " colors are stored as signed integers");
+      }
+      columns.push_back({ type, values(colors[i]), 6 + i, 0., 1. / plyScalarRange(type) });
+    }
+    // Like float intensities, signed ones have no fixed range and are stretched over their bounds.
+    PlyScalar const intensityType = columns[firstColor].type;
+    bool const unsignedIntensity = intensityType == PlyScalar::UInt8 || intensityType == PlyScalar::UInt16 || intensityType == PlyScalar::UInt32;
+    if (!hasColor && !unsignedIntensity && total > 0)
+    {
+      double lower = 0.;
+      double upper = 0.;
+      fileBounds({ colors[0] }, &lower, &upper);
+      for (int i = firstColor; i < firstColor + 3; ++i)
+      {
+        columns[i].offset = lower;
+        columns[i].scale = upper > lower ? 1. / (upper - lower) : 1.;
+      }
+    }
+    describe(hasColor ? "rgb" : "intensity", firstColor, hasColor ? 3 : 1);
+  }
+
+  auto const decodeStart = std::chrono::steady_clock::now();
+  std::vector<float> PLYdata(stride * count);
+  decodePlyColumns(columns, count, stride, pool, PLYdata.data());
+  double const milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodeStart).count();
+  if (origin[0] != 0. || origin[1] != 0. || origin[2] != 0.)
+  {
+    std::cout << "RECENTERED " << PLYpath.string() << " BY " << std::setprecision(17) << origin[0] << " " << origin[1] << " " << origin[2] << std::setprecision(6) << std::endl;
+  }
+  if (report)
+  {
+    *report = { types, { origin[0], origin[1], origin[2] }, milliseconds, count };
+  }
+  return PLYdata;
+}
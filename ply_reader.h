@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/* How readPLY decoded a file: the type of each property group, e.g. "xyz:double n:float rgb:uchar",
+ * the origin subtracted from double positions and the time spent converting. */
+struct PlyDecodeReport
+{
+  std::string types;
+  double origin[3];
+  double milliseconds;
+  std::size_t points;
+};
+
+/* Reads positions, normals when readNormals is set (otherwise they stay zero), and either colors
+ * or intensity as gray, each property in whatever scalar type the file stores it, decoding on
+ * threadCount threads (0 for one per core). Unsigned integer colors and intensities are normalized
+ * by their type's range, float and signed intensity by its bounds; signed integer colors are
+ * rejected. Double positions are re-centered on their bounding box before the conversion to float,
+ * and report receives the origin that was subtracted. Alpha is not read, since splats are opaque.
+ * Only points [count * part / parts, count * (part + 1) / parts) are returned; binary little-endian
+ * files without list properties read just those records, plus a pass over the positions or
+ * intensity their bounds need. */
+std::vector<float> readPLY(std::filesystem::path const& PLYpath, int& stride, bool readNormals, int threadCount, PlyDecodeReport* report = nullptr, int part = 0, int parts = 1);
@@ -0,0 +1,305 @@
+#include "point_index.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <utility>
+
+namespace
+{
+  std::size_t const chunkPoints = 1 << 14;
+  // Point indices are 32-bit during the build, so no tree needs more levels; traversal stacks are sized for it.
+  int const maxDepth = 32;
+
+  float boxDistanceSquared(glm::vec3 const& lower, glm::vec3 const& upper, glm::vec3 const& point)
+  {
+    float distance = 0.f;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      float const outside = std::max(std::max(lower[axis] - point[axis], point[axis] - upper[axis]), 0.f);
+      distance += outside * outside;
+    }
+    return distance;
+  }
+}
+
+PointIndex::PointIndex(std::vector<float> source, int stride, ThreadPool& pool)
+  : stride(stride),
+  count(source.size() / stride),
+  depth(0)
+{
+  TraceZone zone("buildPointIndex");
+  while (((std::size_t)leafPoints << depth) < count && depth < maxDepth)
+  {
+    ++depth;
+  }
+  boxes.resize(((std::size_t)2 << depth) - 1);
+  if (count == 0)
+  {
+    return;
+  }
+  points = std::move(source);
+  // Splitting moves positions with their index so the median searches do not chase indices through the cloud.
+  std::vector<Entry> order(count);
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    glm::vec3 const point = position(i);
+    order[i] = { { point.x, point.y, point.z }, (std::uint32_t)i };
+  }
+  // The top levels split serially until there are a few subtrees per thread, which then split in parallel.
+  int splitLevels = 0;
+  while ((1 << splitLevels) < 4 * pool.getThreadCount() && splitLevels < depth)
+  {
+    ++splitLevels;
+  }
+  std::vector<Node> subtrees;
+  split(order, { 0, 0, count, 0 }, splitLevels, &subtrees);
+  pool.parallelFor((int)subtrees.size(), [&](int task, int)
+  {
+    split(order, subtrees[task], depth, nullptr);
+  });
+
+  std::vector<float> sorted(points.size());
+  int const chunkCount = (int)((count + chunkPoints - 1) / chunkPoints);
+  pool.parallelFor(chunkCount, [&](int chunk, int)
+  {
+    std::size_t const end = std::min(count, (chunk + 1) * chunkPoints);
+    for (std::size_t i = chunk * chunkPoints; i < end; ++i)
+    {
+      std::copy_n(&points[(std::size_t)order[i].point * stride], stride, &sorted[i * stride]);
+    }
+  });
+  points = std::move(sorted);
+}
+
+void PointIndex::split(std::vector<Entry>& order, Node const& node, int lastLevel, std::vector<Node>* deferred)
+{
+  if (node.level == lastLevel && deferred)
+  {
+    deferred->push_back(node);
+    return;
+  }
+  Box& box = boxes[node.node];
+  box.lower = glm::vec3(std::numeric_limits<float>::max());
+  box.upper = glm::vec3(-std::numeric_limits<float>::max());
+  for (std::size_t i = node.begin; i < node.end; ++i)
+  {
+    glm::vec3 const point(order[i].position[0], order[i].position[1], order[i].position[2]);
+    box.lower = glm::min(box.lower, point);
+    box.upper = glm::max(box.upper, point);
+  }
+  if (node.level == depth)
+  {
+    return;
+  }
+  glm::vec3 const extent = box.upper - box.lower;
+  int const axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+  Node const left = child(node, 0);
+  std::nth_element(order.begin() + node.begin, order.begin() + left.end, order.begin() + node.end, [&](Entry const& a, Entry const& b)
+  {
+    return a.position[axis] < b.position[axis];
+  });
+  split(order, left, lastLevel, deferred);
+  split(order, child(node, 1), lastLevel, deferred);
+}
+
+PointIndex::Node PointIndex::child(Node const& node, int side) const
+{
+  std::size_t const middle = node.begin + (node.end - node.begin) / 2;
+  return side == 0 ? Node{ 2 * node.node + 1, node.begin, middle, node.level + 1 } : Node{ 2 * node.node + 2, middle, node.end, node.level + 1 };
+}
+
+std::vector<float> const& PointIndex::getPoints() const
+{
+  return points;
+}
+
+int PointIndex::getStride() const
+{
+  return stride;
+}
+
+std::size_t PointIndex::getPointCount() const
+{
+  return count;
+}
+
+glm::vec3 PointIndex::position(std::size_t point) const
+{
+  float const* p = &points[point * stride];
+  return glm::vec3(p[0], p[1], p[2]);
+}
+
+std::int64_t PointIndex::pick(glm::vec3 origin, glm::vec3 direction, float tolerance) const
+{
+  std::int64_t best = -1;
+  if (count == 0)
+  {
+    return best;
+  }
+  direction = glm::normalize(direction);
+  float bestAlong = std::numeric_limits<float>::max();
+  Node stack[maxDepth + 2];
+  int top = 0;
+  stack[top++] = { 0, 0, count, 0 };
+  while (top > 0)
+  {
+    Node const node = stack[--top];
+    Box const& box = boxes[node.node];
+    // Bounding sphere against the cone around the ray: conservative, and cheap enough to run per node.
+    glm::vec3 const center = (box.lower + box.upper) * .5f;
+    float const radius = glm::length(box.upper - box.lower) * .5f;
+    glm::vec3 const toCenter = center - origin;
+    float const along = glm::dot(toCenter, direction);
+    float const across = glm::length(toCenter - along * direction);
+    if (along + radius <= 0.f || along - radius > bestAlong || across - radius > tolerance * (along + radius))
+    {
+      continue;
+    }
+    if (node.level == depth)
+    {
+      for (std::size_t i = node.begin; i < node.end; ++i)
+      {
+        glm::vec3 const offset = position(i) - origin;
+        float const pointAlong = glm::dot(offset, direction);
+        float const acrossSquared = glm::dot(offset, offset) - pointAlong * pointAlong;
+        if (pointAlong > 0.f && pointAlong < bestAlong && acrossSquared <= tolerance * tolerance * pointAlong * pointAlong)
+        {
+          bestAlong = pointAlong;
+          best = (std::int64_t)i;
+        }
+      }
+      continue;
+    }
+    // The child nearer along the ray is visited first so that its hits prune the other one.
+    Node const left = child(node, 0);
+    Node const right = child(node, 1);
+    bool const leftFirst = glm::dot((boxes[left.node].lower + boxes[left.node].upper) * .5f - origin, direction)
+      <= glm::dot((boxes[right.node].lower + boxes[right.node].upper) * .5f - origin, direction);
+    stack[top++] = leftFirst ? right : left;
+    stack[top++] = leftFirst ? left : right;
+  }
+  return best;
+}
+
+std::vector<std::size_t> PointIndex::nearest(glm::vec3 point, int k) const
+{
+  std::vector<std::size_t> result;
+  if (count == 0 || k <= 0)
+  {
+    return result;
+  }
+  std::priority_queue<std::pair<float, std::size_t>> found;
+  Node stack[maxDepth + 2];
+  int top = 0;
+  stack[top++] = { 0, 0, count, 0 };
+  while (top > 0)
+  {
+    Node const node = stack[--top];
+    Box const& box = boxes[node.node];
+    if ((int)found.size() == k && boxDistanceSquared(box.lower, box.upper, point) >= found.top().first)
+    {
+      continue;
+    }
+    if (node.level == depth)
+    {
+      for (std::size_t i = node.begin; i < node.end; ++i)
+      {
+        glm::vec3 const offset = position(i) - point;
+        float const distance = glm::dot(offset, offset);
+        if ((int)found.size() < k)
+        {
+          found.push({ distance, i });
+        }
+        else if (distance < found.top().first)
+        {
+          found.pop();
+          found.push({ distance, i });
+        }
+      }
+      continue;
+    }
+    Node const left = child(node, 0);
+    Node const right = child(node, 1);
+    bool const leftFirst = boxDistanceSquared(boxes[left.node].lower, boxes[left.node].upper, point)
+      <= boxDistanceSquared(boxes[right.node].lower, boxes[right.node].upper, point);
+    stack[top++] = leftFirst ? right : left;
+    stack[top++] = leftFirst ? left : right;
+  }
+  result.resize(found.size());
+  for (std::size_t i = result.size(); i > 0; --i)
+  {
+    result[i - 1] = found.top().second;
+    found.pop();
+  }
+  return result;
+}
+
+std::vector<std::size_t> PointIndex::withinRadius(glm::vec3 point, float radius) const
+{
+  std::vector<std::size_t> result;
+  if (count == 0)
+  {
+    return result;
+  }
+  float const radiusSquared = radius * radius;
+  Node stack[maxDepth + 2];
+  int top = 0;
+  stack[top++] = { 0, 0, count, 0 };
+  while (top > 0)
+  {
+    Node const node = stack[--top];
+    Box const& box = boxes[node.node];
+    if (boxDistanceSquared(box.lower, box.upper, point) > radiusSquared)
+    {
+      continue;
+    }
+    if (node.level == depth)
+    {
+      for (std::size_t i = node.begin; i < node.end; ++i)
+      {
+        glm::vec3 const offset = position(i) - point;
+        if (glm::dot(offset, offset) <= radiusSquared)
+        {
+          result.push_back(i);
+        }
+      }
+      continue;
+    }
+    stack[top++] = child(node, 1);
+    stack[top++] = child(node, 0);
+  }
+  return result;
+}
+
+std::vector<PointIndex::Chunk> PointIndex::chunks(std::size_t maxPoints) const
+{
+  std::vector<Chunk> result;
+  if (count == 0)
+  {
+    return result;
+  }
+  // Nodes of a level differ by at most one point, so the root's size halved level times bounds them all.
+  int level = 0;
+  while (level < depth && (count + ((std::size_t)1 << level) - 1) >> level > maxPoints)
+  {
+    ++level;
+  }
+  Node stack[maxDepth + 2];
+  int top = 0;
+  stack[top++] = { 0, 0, count, 0 };
+  while (top > 0)
+  {
+    Node const node = stack[--top];
+    if (node.level == level)
+    {
+      Box const& box = boxes[node.node];
+      result.push_back({ node.begin, node.end - node.begin, box.lower, box.upper });
+      continue;
+    }
+    stack[top++] = child(node, 1);
+    stack[top++] = child(node, 0);
+  }
+  return result;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "third-party/glm/glm/glm.hpp"
+#include "thread_pool.h"
+
+/* Implicit kd-tree for picking and measuring points. Building reorders the points so that every
+ * node covers a contiguous range, halved at the median of its longest axis down to leaves of
+ * leafPoints / 2 to leafPoints points; the tree then only stores a 24 byte bounding box per node,
+ * at most 96 / leafPoints bytes per point. Point indices returned by queries refer to the reordered points. */
+class PointIndex
+{
+public:
+  static int const leafPoints = 64;
+  // A contiguous range of the reordered points and its bounding box.
+  struct Chunk
+  {
+    std::size_t first;
+    std::size_t count;
+    glm::vec3 lower;
+    glm::vec3 upper;
+  };
+  PointIndex(std::vector<float> points, int stride, ThreadPool& pool);
+  std::vector<float> const& getPoints() const;
+  int getStride() const;
+  std::size_t getPointCount() const;
+  glm::vec3 position(std::size_t point) const;
+  // The point closest to origin within tolerance (the tangent of the half angle) of the ray, or -1.
+  std::int64_t pick(glm::vec3 origin, glm::vec3 direction, float tolerance) const;
+  // Up to k points ordered by distance to point.
+  std::vector<std::size_t> nearest(glm::vec3 point, int k) const;
+  std::vector<std::size_t> withinRadius(glm::vec3 point, float radius) const;
+  // The nodes of the shallowest level whose nodes hold at most maxPoints points, in point order.
+  std::vector<Chunk> chunks(std::size_t maxPoints) const;
+private:
+  struct Box
+  {
+    glm::vec3 lower;
+    glm::vec3 upper;
+  };
+  struct Entry
+  {
+    float position[3];
+    std::uint32_t point;
+  };
+  struct Node
+  {
+    std::size_t node;
+    std::size_t begin;
+    std::size_t end;
+    int level;
+  };
+  void split(std::vector<Entry>& order, Node const& node, int lastLevel, std::vector<Node>* deferred);
+  Node child(Node const& node, int side) const;
+  std::vector<float> points;
+  int stride;
+  std::size_t count;
+  int depth;
+  std::vector<Box> boxes;
+};
@@ -0,0 +1,63 @@
+#include "point_order.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include "third-party/glm/glm/glm.hpp"
+
+void stratifyPoints(std::vector<float>& PLYdata, int stride, std::size_t first, std::size_t count)
+{
+  if (count < 2)
+  {
+    return;
+  }
+  TraceZone zone("stratifyPoints");
+  glm::vec3 lower(std::numeric_limits<float>::max());
+  glm::vec3 upper(-std::numeric_limits<float>::max());
+  for (std::size_t i = first; i < first + count; ++i)
+  {
+    glm::vec3 const point(PLYdata[i * stride], PLYdata[i * stride + 1], PLYdata[i * stride + 2]);
+    lower = glm::min(lower, point);
+    upper = glm::max(upper, point);
+  }
+  float const extent = std::max(std::max(upper.x - lower.x, upper.y - lower.y), std::max(upper.z - lower.z, 1e-12f));
+  std::vector<std::pair<std::uint64_t, std::uint32_t>> curve(count);
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    std::uint64_t code = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      float const t = (PLYdata[(first + i) * stride + axis] - lower[axis]) / extent;
+      std::uint64_t const cell = std::min<std::uint64_t>((1 << 21) - 1, (std::uint64_t)(t * (1 << 21)));
+      for (int bit = 0; bit < 21; ++bit)
+      {
+        code |= ((cell >> bit) & 1) << (bit * 3 + axis);
+      }
+    }
+    curve[i] = { code, (std::uint32_t)i };
+  }
+  std::sort(curve.begin(), curve.end());
+  int bits = 0;
+  while (((std::size_t)1 << bits) < count)
+  {
+    ++bits;
+  }
+  std::vector<std::pair<std::uint64_t, std::uint32_t>> order(count);
+  for (std::size_t position = 0; position < count; ++position)
+  {
+    std::uint64_t reversed = 0;
+    for (int bit = 0; bit < bits; ++bit)
+    {
+      reversed |= ((position >> bit) & 1) << (bits - 1 - bit);
+    }
+    order[position] = { reversed, curve[position].second };
+  }
+  std::sort(order.begin(), order.end());
+  std::vector<float> shuffled(count * stride);
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    std::copy_n(PLYdata.begin() + (first + order[i].second) * stride, stride, shuffled.begin() + i * stride);
+  }
+  std::copy(shuffled.begin(), shuffled.end(), PLYdata.begin() + first * stride);
+}
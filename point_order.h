@@ -0,0 +1,9 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+/* Reorders the points of [first, first + count) so that every prefix is a uniform subsample.
+ * Points are sorted along a Morton curve and then taken in bit-reversed order of their curve
+ * position, so a prefix of n points picks about every (count / n)-th point along the curve and
+ * is stratified over cells of every size at once. */
+void stratifyPoints(std::vector<float>& PLYdata, int stride, std::size_t first, std::size_t count);
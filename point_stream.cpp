@@ -0,0 +1,420 @@
+#include "point_stream.h"
+#include "trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  char const packetMagic[4] = { 'R', 'L', 'P', 'S' };
+  std::uint32_t const colorFlag = 1;
+  std::size_t const maxDatagram = 65536;
+  int const pollMilliseconds = 200;
+
+  std::size_t packetSize(StreamPacketHeader const& header)
+  {
+    std::size_t const floats = (header.flags & colorFlag) ? 9 : 6;
+    return sizeof(StreamPacketHeader) + (std::size_t)header.pointCount * floats * sizeof(float);
+  }
+}
+
+PointStream::PointStream(std::string const& source, float* ring, std::size_t segmentPoints)
+  : source(source),
+  ring(ring),
+  segmentPoints(segmentPoints),
+  socketHandle(-1),
+  stopping(false),
+  pointsWritten(0),
+  packets(0),
+  points(0),
+  droppedPackets(0),
+  malformedPackets(0),
+  expectedSequence(0),
+  sequenceStarted(false)
+{
+  for (int segment = 0; segment < segmentCount; ++segment)
+  {
+    segmentStart[segment] = 0;
+    segmentFree[segment] = true;
+  }
+#ifdef _WIN32
+  throw std::runtime_error("point streams need POSIX sockets and pipes");
+#else
+  if (source.rfind("udp:", 0) == 0)
+  {
+    char* end = nullptr;
+    long const port = std::strtol(source.c_str() + 4, &end, 10);
+    if (end == source.c_str() + 4 || *end != '\0' || port < 1 || port > 65535)
+    {
+      throw std::invalid_argument(source + " is not udp:PORT");
+    }
+    socketHandle = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socketHandle < 0)
+    {
+      throw std::runtime_error("could not create socket");
+    }
+    // A large receive buffer absorbs bursts while the decoder waits for a free segment.
+    int const bufferBytes = 8 << 20;
+    setsockopt(socketHandle, SOL_SOCKET, SO_RCVBUF, &bufferBytes, sizeof(bufferBytes));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons((std::uint16_t)port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(socketHandle, (sockaddr const*)&address, sizeof(address)) != 0)
+    {
+      close(socketHandle);
+      throw std::runtime_error("could not bind " + source);
+    }
+    decoder = std::thread(&PointStream::receiveDatagrams, this);
+  }
+  else
+  {
+    struct stat status;
+    if (stat(source.c_str(), &status) != 0)
+    {
+      throw std::invalid_argument(source + " does not exist");
+    }
+    decoder = std::thread(&PointStream::readPipe, this);
+  }
+#endif
+}
+
+PointStream::~PointStream()
+{
+  stopping = true;
+  if (decoder.joinable())
+  {
+    decoder.join();
+  }
+#ifndef _WIN32
+  if (socketHandle >= 0)
+  {
+    close(socketHandle);
+  }
+#endif
+}
+
+std::uint64_t PointStream::getPointsWritten() const
+{
+  return pointsWritten.load(std::memory_order_acquire);
+}
+
+std::uint64_t PointStream::getSegmentStart(int segment) const
+{
+  return segmentStart[segment].load(std::memory_order_acquire);
+}
+
+bool PointStream::isSegmentFree(int segment) const
+{
+  return segmentFree[segment].load(std::memory_order_acquire);
+}
+
+void PointStream::freeSegment(int segment)
+{
+  segmentFree[segment].store(true, std::memory_order_release);
+}
+
+StreamCounters PointStream::getCounters() const
+{
+  return { packets.load(), points.load(), droppedPackets.load(), malformedPackets.load() };
+}
+
+void PointStream::receiveDatagrams()
+{
+#ifndef _WIN32
+  traceSetThreadName("stream");
+  std::vector<std::uint8_t> datagram(maxDatagram);
+  while (!stopping)
+  {
+    pollfd readable = { socketHandle, POLLIN, 0 };
+    if (poll(&readable, 1, pollMilliseconds) <= 0)
+    {
+      continue;
+    }
+    ssize_t const received = recv(socketHandle, datagram.data(), datagram.size(), 0);
+    if (received > 0)
+    {
+      decodePacket(datagram.data(), (std::size_t)received);
+    }
+  }
+#endif
+}
+
+void PointStream::readPipe()
+{
+#ifndef _WIN32
+  traceSetThreadName("stream");
+  std::vector<std::uint8_t> buffer;
+  std::size_t begin = 0;
+  int pipe = -1;
+  bool openFailed = false;
+  while (!stopping)
+  {
+    if (pipe < 0)
+    {
+      // Non-blocking so that waiting for a writer can still notice stopping.
+      pipe = open(source.c_str(), O_RDONLY | O_NONBLOCK);
+      if (pipe < 0)
+      {
+        // A FIFO may be recreated by its writer, so keep trying and report each failure streak once.
+        if (!openFailed)
+        {
+          std::cerr << "POINT STREAM " << source << " COULD NOT BE OPENED, RETRYING: " << std::strerror(errno) << std::endl;
+        }
+        openFailed = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(pollMilliseconds));
+        continue;
+      }
+      openFailed = false;
+    }
+    pollfd readable = { pipe, POLLIN, 0 };
+    if (poll(&readable, 1, pollMilliseconds) <= 0)
+    {
+      continue;
+    }
+    std::size_t const end = buffer.size();
+    buffer.resize(end + maxDatagram);
+    ssize_t const received = read(pipe, buffer.data() + end, maxDatagram);
+    buffer.resize(end + std::max<ssize_t>(received, 0));
+    if (received == 0)
+    {
+      // The writer went away: a FIFO waits for the next one, a regular file is finished.
+      close(pipe);
+      pipe = -1;
+      struct stat status;
+      if (stat(source.c_str(), &status) == 0 && !S_ISFIFO(status.st_mode))
+      {
+        return;
+      }
+      buffer.clear();
+      begin = 0;
+      continue;
+    }
+    while (buffer.size() - begin >= sizeof(StreamPacketHeader))
+    {
+      StreamPacketHeader header;
+      std::memcpy(&header, buffer.data() + begin, sizeof(header));
+      if (std::memcmp(header.magic, packetMagic, sizeof(packetMagic)) != 0 || header.pointCount > segmentPoints)
+      {
+        // Resynchronise on the next magic.
+        ++malformedPackets;
+        std::uint8_t const* next = std::search(buffer.data() + begin + 1, buffer.data() + buffer.size(), packetMagic, packetMagic + 4);
+        begin = std::min((std::size_t)(next - buffer.data()), buffer.size() - 3);
+        continue;
+      }
+      std::size_t const size = packetSize(header);
+      if (buffer.size() - begin < size)
+      {
+        break;
+      }
+      decodePacket(buffer.data() + begin, size);
+      begin += size;
+    }
+    buffer.erase(buffer.begin(), buffer.begin() + begin);
+    begin = 0;
+  }
+  if (pipe >= 0)
+  {
+    close(pipe);
+  }
+#endif
+}
+
+bool PointStream::decodePacket(std::uint8_t const* data, std::size_t size)
+{
+  StreamPacketHeader header;
+  if (size < sizeof(header))
+  {
+    ++malformedPackets;
+    return false;
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, packetMagic, sizeof(packetMagic)) != 0 || header.pointCount > segmentPoints || packetSize(header) != size)
+  {
+    ++malformedPackets;
+    return false;
+  }
+  // Gaps in the sequence are packets lost before they got here; a jump backwards is a restarted sender.
+  if (sequenceStarted && header.sequence != expectedSequence)
+  {
+    std::uint32_t const gap = header.sequence - expectedSequence;
+    if (gap < 0x80000000u)
+    {
+      droppedPackets += gap;
+    }
+  }
+  sequenceStarted = true;
+  expectedSequence = header.sequence + 1;
+  std::uint64_t const first = pointsWritten.load(std::memory_order_relaxed);
+  if (!claimSegments(first, header.pointCount))
+  {
+    ++droppedPackets;
+    return false;
+  }
+  TraceZone zone("decodePacket");
+  bool const hasColor = (header.flags & colorFlag) != 0;
+  std::size_t const inFloats = hasColor ? 9 : 6;
+  std::size_t const capacity = segmentPoints * segmentCount;
+  std::uint8_t const* in = data + sizeof(header);
+  for (std::uint32_t i = 0; i < header.pointCount; ++i)
+  {
+    float* out = ring + ((first + i) % capacity) * pointFloats;
+    std::memcpy(out, in + i * inFloats * sizeof(float), inFloats * sizeof(float));
+    if (!hasColor)
+    {
+      out[6] = .6f;
+      out[7] = .6f;
+      out[8] = .9f;
+    }
+  }
+  pointsWritten.store(first + header.pointCount, std::memory_order_release);
+  ++packets;
+  points += header.pointCount;
+  return true;
+}
+
+bool PointStream::claimSegments(std::uint64_t first, std::uint64_t count)
+{
+  // Every segment boundary crossed starts a segment that must have been released first.
+  std::uint64_t const firstBoundary = (first + segmentPoints - 1) / segmentPoints * segmentPoints;
+  for (std::uint64_t boundary = firstBoundary; boundary < first + count; boundary += segmentPoints)
+  {
+    if (!isSegmentFree((int)(boundary / segmentPoints % segmentCount)))
+    {
+      return false;
+    }
+  }
+  for (std::uint64_t boundary = firstBoundary; boundary < first + count; boundary += segmentPoints)
+  {
+    int const segment = (int)(boundary / segmentPoints % segmentCount);
+    segmentStart[segment].store(boundary, std::memory_order_release);
+    segmentFree[segment].store(false, std::memory_order_release);
+  }
+  return true;
+}
+
+StreamRing::StreamRing(std::string const& source, std::size_t windowPoints)
+  : windowPoints(windowPoints),
+  vao(0),
+  vbo(0),
+  fences{}
+{
+  GLsizeiptr const bytes = (GLsizeiptr)(windowPoints * PointStream::segmentCount * PointStream::pointFloats * sizeof(float));
+  GLbitfield const flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+  float* ring = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags);
+  GLsizei const stride = sizeof(float) * PointStream::pointFloats;
+  for (GLuint attribute = 0; attribute < 3; ++attribute)
+  {
+    glEnableVertexAttribArray(attribute);
+    glVertexAttribPointer(attribute, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(sizeof(float) * 3 * attribute));
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  if (!ring)
+  {
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    throw std::runtime_error("could not map the point stream buffer");
+  }
+  try
+  {
+    stream = std::make_unique<PointStream>(source, ring, windowPoints);
+  }
+  catch (...)
+  {
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    throw;
+  }
+}
+
+StreamRing::~StreamRing()
+{
+  // The decoder writes into the mapping, so it stops before the buffer goes away.
+  stream.reset();
+  for (GLsync fence : fences)
+  {
+    if (fence)
+    {
+      glDeleteSync(fence);
+    }
+  }
+  glDeleteVertexArrays(1, &vao);
+  glDeleteBuffers(1, &vbo);
+}
+
+void StreamRing::draw()
+{
+  std::uint64_t const written = stream->getPointsWritten();
+  std::uint64_t const first = written > windowPoints ? written - windowPoints : 0;
+  for (int segment = 0; segment < PointStream::segmentCount; ++segment)
+  {
+    if (stream->isSegmentFree(segment) || stream->getSegmentStart(segment) + windowPoints > first)
+    {
+      continue;
+    }
+    if (fences[segment])
+    {
+      if (glClientWaitSync(fences[segment], 0, 0) == GL_TIMEOUT_EXPIRED)
+      {
+        continue;
+      }
+      glDeleteSync(fences[segment]);
+      fences[segment] = nullptr;
+    }
+    stream->freeSegment(segment);
+  }
+  if (written == first)
+  {
+    return;
+  }
+  std::uint64_t const capacity = windowPoints * PointStream::segmentCount;
+  GLint const start = (GLint)(first % capacity);
+  GLsizei const count = (GLsizei)(written - first);
+  GLsizei const tail = (GLsizei)std::min<std::uint64_t>(count, capacity - start);
+  glBindVertexArray(vao);
+  glDrawArrays(GL_POINTS, start, tail);
+  if (tail < count)
+  {
+    glDrawArrays(GL_POINTS, 0, count - tail);
+  }
+  glBindVertexArray(0);
+  for (std::uint64_t segment = first / windowPoints; segment <= (written - 1) / windowPoints; ++segment)
+  {
+    GLsync& fence = fences[segment % PointStream::segmentCount];
+    if (fence)
+    {
+      glDeleteSync(fence);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+}
+
+StreamCounters StreamRing::getCounters() const
+{
+  return stream->getCounters();
+}
+
+std::uint64_t StreamRing::getPointsWritten() const
+{
+  return stream->getPointsWritten();
+}
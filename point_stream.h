@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include "build/third-party/glad/include/glad/glad.h"
+
+/* Live point packets. Every packet is a 16-byte little-endian header followed by its points:
+ *   char magic[4] = "RLPS"; uint32 sequence; uint32 pointCount; uint32 flags
+ * then pointCount points of float32 x y z nx ny nz, followed by r g b in [0,1] when flags
+ * bit 0 is set. Over UDP each datagram holds one packet; over a pipe packets follow back to back. */
+struct StreamPacketHeader
+{
+  char magic[4];
+  std::uint32_t sequence;
+  std::uint32_t pointCount;
+  std::uint32_t flags;
+};
+
+struct StreamCounters
+{
+  std::uint64_t packets;
+  std::uint64_t points;
+  std::uint64_t droppedPackets;
+  std::uint64_t malformedPackets;
+};
+
+/* Decodes packets on its own thread into a ring of three segments of segmentPoints points,
+ * nine floats each (position, normal, color). A segment is only written after the render
+ * thread released it with freeSegment; when the next segment is still in use the packet is
+ * dropped, so the GPU never reads points that are being overwritten. */
+class PointStream
+{
+public:
+  static constexpr int segmentCount = 3;
+  static constexpr int pointFloats = 9;
+  // source is "udp:PORT" for datagrams to 127.0.0.1:PORT, otherwise a named pipe or file.
+  PointStream(std::string const& source, float* ring, std::size_t segmentPoints);
+  ~PointStream();
+  PointStream(PointStream const&) = delete;
+  PointStream& operator=(PointStream const&) = delete;
+  std::uint64_t getPointsWritten() const;
+  std::uint64_t getSegmentStart(int segment) const;
+  bool isSegmentFree(int segment) const;
+  void freeSegment(int segment);
+  StreamCounters getCounters() const;
+private:
+  void receiveDatagrams();
+  void readPipe();
+  bool decodePacket(std::uint8_t const* data, std::size_t size);
+  bool claimSegments(std::uint64_t first, std::uint64_t count);
+  std::string source;
+  float* ring;
+  std::size_t segmentPoints;
+  int socketHandle;
+  std::atomic<bool> stopping;
+  std::atomic<std::uint64_t> pointsWritten;
+  std::atomic<std::uint64_t> segmentStart[segmentCount];
+  std::atomic<bool> segmentFree[segmentCount];
+  std::atomic<std::uint64_t> packets;
+  std::atomic<std::uint64_t> points;
+  std::atomic<std::uint64_t> droppedPackets;
+  std::atomic<std::uint64_t> malformedPackets;
+  std::uint32_t expectedSequence;
+  bool sequenceStarted;
+  std::thread decoder;
+};
+
+/* Persistently mapped vertex buffer backing a PointStream. Each frame draws the most recent
+ * segmentPoints points and fences the segments it read; segments that have left the window
+ * are handed back to the decoder once their last fence has signalled. */
+class StreamRing
+{
+public:
+  StreamRing(std::string const& source, std::size_t windowPoints);
+  ~StreamRing();
+  StreamRing(StreamRing const&) = delete;
+  StreamRing& operator=(StreamRing const&) = delete;
+  void draw();
+  StreamCounters getCounters() const;
+  std::uint64_t getPointsWritten() const;
+private:
+  std::size_t windowPoints;
+  GLuint vao;
+  GLuint vbo;
+  GLsync fences[PointStream::segmentCount];
+  std::unique_ptr<PointStream> stream;
+};
@@ -0,0 +1,514 @@
+#include "render_graph.h"
+#include <algorithm>
+
+namespace
+{
+  struct FormatClass
+  {
+    GLenum format;
+    // The storage every image of the format's view class is a view of.
+    GLenum storageFormat;
+    int bytes;
+    bool integer;
+  };
+
+  // Formats of one view class share storage; depth formats can only view themselves.
+  FormatClass const formatClasses[] = {
+    { GL_RGBA8, GL_RGBA8, 4, false },
+    { GL_R32F, GL_RGBA8, 4, false },
+    { GL_R32UI, GL_RGBA8, 4, true },
+    // Drivers pad three-channel texels to four, so RGB16F takes as much memory as RGBA16F.
+    { GL_RGB16F, GL_RGB16F, 8, false },
+    { GL_RGBA16F, GL_RGBA16F, 8, false },
+    { GL_RGBA32F, GL_RGBA32F, 16, false },
+    { GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT24, 4, false },
+    { GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT32F, 4, false } };
+
+  FormatClass formatClass(GLenum format)
+  {
+    for (FormatClass const& entry : formatClasses)
+    {
+      if (entry.format == format)
+      {
+        return entry;
+      }
+    }
+    return { format, format, 4, false };
+  }
+}
+
+RenderGraph::PassBuilder::PassBuilder(RenderGraph& graph, std::size_t pass)
+  : graph(graph),
+  pass(pass)
+{
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(Resource resource)
+{
+  graph.passes[pass].reads.push_back(resource);
+  return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::color(int location, Resource image, bool coversAll)
+{
+  graph.passes[pass].colors.push_back({ location, image, coversAll, false });
+  return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::depth(Resource image, bool coversAll)
+{
+  graph.passes[pass].depth = { 0, image, coversAll, false };
+  return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write(Resource resource)
+{
+  graph.passes[pass].writes.push_back(resource);
+  return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::keep()
+{
+  graph.passes[pass].kept = true;
+  return *this;
+}
+
+RenderGraph::RenderGraph()
+  : width(0),
+  height(0),
+  clearedBytes(0),
+  culledPasses(0),
+  incomplete(false)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+  for (Slot& slot : slots)
+  {
+    releaseSlot(slot);
+  }
+}
+
+void RenderGraph::reset(int frameWidth, int frameHeight)
+{
+  images.clear();
+  passes.clear();
+  width = frameWidth;
+  height = frameHeight;
+}
+
+RenderGraph::Resource RenderGraph::createImage(GLenum format)
+{
+  images.push_back({ Kind::Image, format, 0, { 0.f, 0.f, 0.f, 0.f }, false, -1 });
+  return (Resource)images.size() - 1;
+}
+
+RenderGraph::Resource RenderGraph::importFramebuffer(GLuint framebuffer, float const clearColor[4])
+{
+  images.push_back({ Kind::Framebuffer, GL_NONE, framebuffer, { clearColor[0], clearColor[1], clearColor[2], clearColor[3] }, false, -1 });
+  return (Resource)images.size() - 1;
+}
+
+RenderGraph::Resource RenderGraph::importResource()
+{
+  images.push_back({ Kind::External, GL_NONE, 0, { 0.f, 0.f, 0.f, 0.f }, false, -1 });
+  return (Resource)images.size() - 1;
+}
+
+RenderGraph::PassBuilder RenderGraph::addPass(char const* name, std::function<void()> run)
+{
+  passes.push_back({ name, std::move(run), {}, {}, { 0, -1, true, false }, {}, false, false });
+  return PassBuilder(*this, passes.size() - 1);
+}
+
+void RenderGraph::markOutput(Resource resource)
+{
+  images[resource].output = true;
+}
+
+bool RenderGraph::execute(std::function<void(char const*)> const& begin, std::function<void()> const& end)
+{
+  incomplete = false;
+  cull();
+  allocate();
+  for (Pass const& pass : passes)
+  {
+    if (pass.culled)
+    {
+      continue;
+    }
+    begin(pass.name);
+    if (!bindTargets(pass))
+    {
+      end();
+      break;
+    }
+    pass.run();
+    end();
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  return !incomplete;
+}
+
+GLuint RenderGraph::texture(Resource image)
+{
+  Image const& entry = images[image];
+  if (entry.slot < 0)
+  {
+    return 0;
+  }
+  Slot& slot = slots[entry.slot];
+  if (entry.format == slot.storageFormat)
+  {
+    return slot.storage;
+  }
+  for (View const& view : slot.views)
+  {
+    if (view.format == entry.format)
+    {
+      return view.texture;
+    }
+  }
+  View view = { entry.format, 0 };
+  glGenTextures(1, &view.texture);
+  glTextureView(view.texture, GL_TEXTURE_2D, slot.storage, entry.format, 0, 1, 0, 1);
+  glBindTexture(GL_TEXTURE_2D, view.texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  slot.views.push_back(view);
+  return view.texture;
+}
+
+GLuint RenderGraph::framebuffer(std::vector<Resource> const& colors, Resource depth)
+{
+  std::vector<GLuint> attachments;
+  for (Resource image : colors)
+  {
+    attachments.push_back(image >= 0 ? texture(image) : 0);
+  }
+  attachments.push_back(depth >= 0 ? texture(depth) : 0);
+  for (CachedFramebuffer const& cached : framebuffers)
+  {
+    if (cached.attachments == attachments)
+    {
+      glBindFramebuffer(GL_FRAMEBUFFER, cached.framebuffer);
+      return cached.framebuffer;
+    }
+  }
+  CachedFramebuffer cached = { attachments, 0 };
+  glGenFramebuffers(1, &cached.framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, cached.framebuffer);
+  // Locations without an image get no draw buffer, so the pass leaves them alone.
+  std::vector<GLenum> drawBuffers;
+  for (std::size_t i = 0; i + 1 < attachments.size(); ++i)
+  {
+    if (attachments[i])
+    {
+      glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + (GLenum)i, attachments[i], 0);
+    }
+    drawBuffers.push_back(attachments[i] ? GL_COLOR_ATTACHMENT0 + (GLenum)i : GL_NONE);
+  }
+  if (attachments.back())
+  {
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, attachments.back(), 0);
+  }
+  if (drawBuffers.empty())
+  {
+    glDrawBuffer(GL_NONE);
+  }
+  else
+  {
+    glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+  }
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+  {
+    incomplete = true;
+  }
+  framebuffers.push_back(cached);
+  return cached.framebuffer;
+}
+
+std::size_t RenderGraph::getTextureBytes() const
+{
+  std::size_t bytes = 0;
+  for (Slot const& slot : slots)
+  {
+    bytes += (std::size_t)slot.width * slot.height * formatClass(slot.storageFormat).bytes;
+  }
+  return bytes;
+}
+
+std::size_t RenderGraph::getClearedBytes() const
+{
+  return clearedBytes;
+}
+
+int RenderGraph::getPassCount() const
+{
+  return (int)passes.size();
+}
+
+int RenderGraph::getCulledPasses() const
+{
+  return culledPasses;
+}
+
+/* Liveness backwards from the outputs: a pass runs when it is kept or a later running pass or the
+ * frame's output needs something it writes. Writing every pixel of a target ends the need for its
+ * older contents, reading a resource starts it. */
+void RenderGraph::cull()
+{
+  std::vector<bool> needed(images.size());
+  for (std::size_t i = 0; i < images.size(); ++i)
+  {
+    needed[i] = images[i].output;
+  }
+  culledPasses = 0;
+  for (std::size_t p = passes.size(); p > 0; --p)
+  {
+    Pass& pass = passes[p - 1];
+    bool used = pass.kept || (pass.depth.image >= 0 && needed[pass.depth.image]);
+    for (Target const& target : pass.colors)
+    {
+      used = used || needed[target.image];
+    }
+    for (Resource resource : pass.writes)
+    {
+      used = used || needed[resource];
+    }
+    pass.culled = !used;
+    if (pass.culled)
+    {
+      ++culledPasses;
+      continue;
+    }
+    for (Target const& target : pass.colors)
+    {
+      needed[target.image] = needed[target.image] && !target.coversAll;
+    }
+    if (pass.depth.image >= 0)
+    {
+      needed[pass.depth.image] = needed[pass.depth.image] && !pass.depth.coversAll;
+    }
+    for (Resource resource : pass.reads)
+    {
+      needed[resource] = true;
+    }
+  }
+}
+
+/* Decides the clears and places every image in a slot for the passes from its first to its last
+ * use. Slots are handed out in pass order, so the same graph gets the same slots and framebuffers
+ * every frame; slots the frame did not use are freed. */
+void RenderGraph::allocate()
+{
+  std::vector<std::size_t> first(images.size(), passes.size());
+  std::vector<std::size_t> last(images.size(), 0);
+  std::vector<bool> written(images.size(), false);
+  clearedBytes = 0;
+  for (std::size_t p = 0; p < passes.size(); ++p)
+  {
+    Pass& pass = passes[p];
+    if (pass.culled)
+    {
+      continue;
+    }
+    auto const use = [&](Resource resource)
+    {
+      first[resource] = std::min(first[resource], p);
+      last[resource] = std::max(last[resource], p);
+    };
+    auto const target = [&](Target& target)
+    {
+      use(target.image);
+      target.clear = !written[target.image] && !target.coversAll;
+      written[target.image] = true;
+      if (target.clear && images[target.image].kind == Kind::Image)
+      {
+        clearedBytes += (std::size_t)width * height * formatClass(images[target.image].format).bytes;
+      }
+    };
+    for (Resource resource : pass.reads)
+    {
+      use(resource);
+    }
+    for (Target& color : pass.colors)
+    {
+      target(color);
+    }
+    if (pass.depth.image >= 0)
+    {
+      target(pass.depth);
+    }
+    for (Resource resource : pass.writes)
+    {
+      use(resource);
+      written[resource] = true;
+    }
+  }
+  for (std::size_t i = 0; i < images.size(); ++i)
+  {
+    if (images[i].output)
+    {
+      last[i] = passes.size();
+    }
+  }
+
+  for (Slot& slot : slots)
+  {
+    slot.used = false;
+    slot.busy = false;
+  }
+  for (std::size_t p = 0; p < passes.size(); ++p)
+  {
+    for (std::size_t i = 0; i < images.size(); ++i)
+    {
+      if (images[i].kind == Kind::Image && first[i] == p)
+      {
+        images[i].slot = acquireSlot(images[i].format);
+      }
+    }
+    // Released after the pass, so that no pass reads and writes the same storage.
+    for (std::size_t i = 0; i < images.size(); ++i)
+    {
+      if (images[i].slot >= 0 && last[i] == p)
+      {
+        slots[images[i].slot].busy = false;
+      }
+    }
+  }
+
+  std::vector<int> moved(slots.size(), -1);
+  std::size_t kept = 0;
+  for (std::size_t s = 0; s < slots.size(); ++s)
+  {
+    if (!slots[s].used)
+    {
+      releaseSlot(slots[s]);
+      continue;
+    }
+    moved[s] = (int)kept;
+    if (kept != s)
+    {
+      slots[kept] = std::move(slots[s]);
+    }
+    ++kept;
+  }
+  slots.resize(kept);
+  for (Image& image : images)
+  {
+    if (image.slot >= 0)
+    {
+      image.slot = moved[image.slot];
+    }
+  }
+}
+
+int RenderGraph::acquireSlot(GLenum format)
+{
+  GLenum const storageFormat = formatClass(format).storageFormat;
+  for (std::size_t s = 0; s < slots.size(); ++s)
+  {
+    Slot& slot = slots[s];
+    if (!slot.busy && slot.storageFormat == storageFormat && slot.width == width && slot.height == height)
+    {
+      slot.busy = true;
+      slot.used = true;
+      return (int)s;
+    }
+  }
+  Slot slot = { storageFormat, width, height, 0, {}, true, true };
+  glGenTextures(1, &slot.storage);
+  glBindTexture(GL_TEXTURE_2D, slot.storage);
+  glTexStorage2D(GL_TEXTURE_2D, 1, storageFormat, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  slots.push_back(slot);
+  return (int)slots.size() - 1;
+}
+
+// Deletes the slot's textures and the framebuffers holding any of them.
+void RenderGraph::releaseSlot(Slot& slot)
+{
+  std::vector<GLuint> textures(1, slot.storage);
+  for (View const& view : slot.views)
+  {
+    textures.push_back(view.texture);
+  }
+  framebuffers.erase(std::remove_if(framebuffers.begin(), framebuffers.end(), [&](CachedFramebuffer const& cached)
+  {
+    bool const stale = std::any_of(cached.attachments.begin(), cached.attachments.end(), [&](GLuint attachment)
+    {
+      return std::find(textures.begin(), textures.end(), attachment) != textures.end();
+    });
+    if (stale)
+    {
+      glDeleteFramebuffers(1, &cached.framebuffer);
+    }
+    return stale;
+  }), framebuffers.end());
+  glDeleteTextures((GLsizei)textures.size(), textures.data());
+  slot.storage = 0;
+  slot.views.clear();
+}
+
+bool RenderGraph::bindTargets(Pass const& pass)
+{
+  if (pass.colors.empty() && pass.depth.image < 0)
+  {
+    return true;
+  }
+  // An imported framebuffer is the pass's only target, named as its color or, in a depth-only pass, its depth.
+  Target const& first = pass.colors.empty() ? pass.depth : pass.colors[0];
+  Image const& target = images[first.image];
+  if (target.kind == Kind::Framebuffer)
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    if (first.clear)
+    {
+      glClearColor(target.clearColor[0], target.clearColor[1], target.clearColor[2], target.clearColor[3]);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+    return true;
+  }
+  std::vector<Resource> colors;
+  for (Target const& color : pass.colors)
+  {
+    if ((int)colors.size() <= color.location)
+    {
+      colors.resize(color.location + 1, -1);
+    }
+    colors[color.location] = color.image;
+  }
+  framebuffer(colors, pass.depth.image);
+  if (incomplete)
+  {
+    return false;
+  }
+  float const zero[4] = { 0.f, 0.f, 0.f, 0.f };
+  GLuint const zeroInteger[4] = { 0u, 0u, 0u, 0u };
+  float const farDepth = 1.f;
+  for (Target const& color : pass.colors)
+  {
+    if (!color.clear)
+    {
+      continue;
+    }
+    if (formatClass(images[color.image].format).integer)
+    {
+      glClearBufferuiv(GL_COLOR, color.location, zeroInteger);
+    }
+    else
+    {
+      glClearBufferfv(GL_COLOR, color.location, zero);
+    }
+  }
+  if (pass.depth.image >= 0 && pass.depth.clear)
+  {
+    glClearBufferfv(GL_DEPTH, 0, &farDepth);
+  }
+  return true;
+}
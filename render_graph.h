@@ -0,0 +1,127 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include "build/third-party/glad/include/glad/glad.h"
+
+/* One frame's passes and the images they hand to each other, declared anew every frame. Passes
+ * state what they read and write, and execute() runs them in order, culling those whose results
+ * nothing the frame outputs depends on. Images are transient: each one lives in pooled immutable
+ * storage from its first pass to its last and shares that storage with images whose lifetimes do
+ * not overlap, through a texture view when their formats differ within a view class. A target is
+ * only cleared by the pass that writes it first, and only when that pass leaves pixels unwritten.
+ * Storage, views and framebuffers are kept across frames, so a steady frame creates no GL objects. */
+class RenderGraph
+{
+public:
+  typedef int Resource;
+  class PassBuilder
+  {
+  public:
+    PassBuilder(RenderGraph& graph, std::size_t pass);
+    // Sampled, fetched or otherwise used as input by the pass.
+    PassBuilder& read(Resource resource);
+    // Attached at the fragment output location; coversAll when the pass writes every pixel of it.
+    PassBuilder& color(int location, Resource image, bool coversAll);
+    PassBuilder& depth(Resource image, bool coversAll);
+    // Written without the pass's framebuffer, by a compute shader or an upload, in full and never cleared.
+    PassBuilder& write(Resource resource);
+    // Runs even when nothing in the frame reads its results, for passes whose effects outlast it.
+    PassBuilder& keep();
+  private:
+    RenderGraph& graph;
+    std::size_t pass;
+  };
+  RenderGraph();
+  ~RenderGraph();
+  // Drops the last frame's passes and images; the new frame's images are width x height.
+  void reset(int width, int height);
+  Resource createImage(GLenum format);
+  // A framebuffer owned elsewhere, written only as the pass's whole target; a partial first write clears it to clearColor and depth 1.
+  Resource importFramebuffer(GLuint framebuffer, float const clearColor[4]);
+  // A buffer or any other object passes hand over, tracked only to order and cull them.
+  Resource importResource();
+  PassBuilder addPass(char const* name, std::function<void()> run);
+  // Needed after the frame: its writers are never culled and its storage stays untouched until the next reset.
+  void markOutput(Resource resource);
+  /* Culls, allocates and runs the passes, each with its targets bound and cleared as needed and
+   * between begin and end. False when a target framebuffer is incomplete. */
+  bool execute(std::function<void(char const*)> const& begin, std::function<void()> const& end);
+  // The image's texture, valid during its passes and, for outputs, until the next reset.
+  GLuint texture(Resource image);
+  // Color images by location, and depth or -1; binds the framebuffer, which is cached with its draw buffers set.
+  GLuint framebuffer(std::vector<Resource> const& colors, Resource depth);
+  std::size_t getTextureBytes() const;
+  std::size_t getClearedBytes() const;
+  int getPassCount() const;
+  int getCulledPasses() const;
+private:
+  enum class Kind
+  {
+    Image,
+    Framebuffer,
+    External
+  };
+  struct Image
+  {
+    Kind kind;
+    GLenum format;
+    GLuint framebuffer;
+    float clearColor[4];
+    bool output;
+    int slot;
+  };
+  struct Target
+  {
+    int location;
+    Resource image;
+    bool coversAll;
+    bool clear;
+  };
+  struct Pass
+  {
+    char const* name;
+    std::function<void()> run;
+    std::vector<Resource> reads;
+    std::vector<Target> colors;
+    Target depth;
+    std::vector<Resource> writes;
+    bool kept;
+    bool culled;
+  };
+  struct View
+  {
+    GLenum format;
+    GLuint texture;
+  };
+  // Immutable storage of one view class and size, and the views made of it so far.
+  struct Slot
+  {
+    GLenum storageFormat;
+    int width;
+    int height;
+    GLuint storage;
+    std::vector<View> views;
+    bool used;
+    bool busy;
+  };
+  struct CachedFramebuffer
+  {
+    std::vector<GLuint> attachments;
+    GLuint framebuffer;
+  };
+  void cull();
+  void allocate();
+  int acquireSlot(GLenum format);
+  void releaseSlot(Slot& slot);
+  bool bindTargets(Pass const& pass);
+  std::vector<Image> images;
+  std::vector<Pass> passes;
+  std::vector<Slot> slots;
+  std::vector<CachedFramebuffer> framebuffers;
+  int width;
+  int height;
+  std::size_t clearedBytes;
+  int culledPasses;
+  bool incomplete;
+};
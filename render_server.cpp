@@ -0,0 +1,373 @@
+#include "render_server.h"
+#include "trace.h"
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  enum Series
+  {
+    Latency,
+    QueueWait,
+    BatchRender
+  };
+  // Metrics cover the most recent samples so a long-running server does not grow without bound.
+  std::size_t const sampleWindow = 10000;
+  int const maxFillIters = 64;
+
+  double millisecondsBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+  {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  }
+
+  bool sendAll(int connection, std::string const& data)
+  {
+#ifndef _WIN32
+    std::size_t sent = 0;
+    while (sent < data.size())
+    {
+      ssize_t const n = send(connection, data.data() + sent, data.size() - sent, 0);
+      if (n <= 0)
+      {
+        return false;
+      }
+      sent += (std::size_t)n;
+    }
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  bool parseOption(std::string const& option, RenderRequest& request)
+  {
+    std::size_t const split = option.find('=');
+    if (split == std::string::npos)
+    {
+      return false;
+    }
+    std::string const key = option.substr(0, split);
+    std::string const value = option.substr(split + 1);
+    if (key == "format")
+    {
+      if (value == "png" || value == "raw")
+      {
+        request.format = value == "png" ? ImageWriter::Format::PNG : ImageWriter::Format::RAW;
+        return true;
+      }
+      return false;
+    }
+    int* iters = key == "background" ? &request.backgroundIters : key == "occlusion" ? &request.occlusionIters : nullptr;
+    if (!iters)
+    {
+      return false;
+    }
+    char* end = nullptr;
+    long const parsed = std::strtol(value.c_str(), &end, 10);
+    if (end == value.c_str() || *end != '\0' || parsed < 0 || parsed > maxFillIters)
+    {
+      return false;
+    }
+    *iters = (int)parsed;
+    return true;
+  }
+}
+
+RenderServer::RenderServer(std::filesystem::path const& socketPath, int width, int height)
+  : socketPath(socketPath),
+  width(width),
+  height(height),
+  listenSocket(-1),
+  activeConnections(0),
+  stopping(false),
+  requestCount(0),
+  batchCount(0),
+  maxQueueDepth(0),
+  queueDepthTotal(0),
+  series{ { "latency", {} }, { "queue_wait", {} }, { "batch_render", {} } }
+{
+#ifdef _WIN32
+  throw std::runtime_error("the render server needs Unix domain sockets");
+#else
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  std::string const path = socketPath.string();
+  if (path.size() >= sizeof(address.sun_path))
+  {
+    throw std::runtime_error(path + " is too long for a socket path");
+  }
+  path.copy(address.sun_path, path.size());
+  // A client that disconnects early must not kill the server on the next send.
+  std::signal(SIGPIPE, SIG_IGN);
+  listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenSocket < 0)
+  {
+    throw std::runtime_error("could not create socket");
+  }
+  std::error_code ec;
+  std::filesystem::remove(socketPath, ec);
+  if (bind(listenSocket, (sockaddr const*)&address, sizeof(address)) != 0 || listen(listenSocket, 64) != 0)
+  {
+    close(listenSocket);
+    throw std::runtime_error("could not listen on " + path);
+  }
+  acceptor = std::thread(&RenderServer::acceptLoop, this);
+#endif
+}
+
+RenderServer::~RenderServer()
+{
+  stop();
+  if (acceptor.joinable())
+  {
+    acceptor.join();
+  }
+  std::unique_lock<std::mutex> lock(mutex);
+  connectionClosed.wait(lock, [this] { return activeConnections == 0; });
+#ifndef _WIN32
+  if (listenSocket >= 0)
+  {
+    close(listenSocket);
+    std::error_code ec;
+    std::filesystem::remove(socketPath, ec);
+  }
+#endif
+}
+
+std::vector<RenderRequest*> RenderServer::waitForBatch(std::size_t maxBatch, std::chrono::milliseconds timeout)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  requestQueued.wait_for(lock, timeout, [this] { return stopping || !queued.empty(); });
+  std::vector<RenderRequest*> batch;
+  if (stopping || queued.empty())
+  {
+    return batch;
+  }
+  maxQueueDepth = std::max(maxQueueDepth, queued.size());
+  queueDepthTotal += queued.size();
+  batchStart = std::chrono::steady_clock::now();
+  while (!queued.empty() && batch.size() < maxBatch)
+  {
+    batch.push_back(queued.front());
+    queued.pop_front();
+    addSample(QueueWait, millisecondsBetween(batch.back()->received, batchStart));
+  }
+  return batch;
+}
+
+void RenderServer::completeBatch(std::vector<RenderRequest*> const& batch)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++batchCount;
+    requestCount += batch.size();
+    addSample(BatchRender, millisecondsBetween(batchStart, std::chrono::steady_clock::now()));
+    for (RenderRequest* request : batch)
+    {
+      request->done = true;
+    }
+  }
+  batchCompleted.notify_all();
+}
+
+bool RenderServer::isStopping()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return stopping;
+}
+
+void RenderServer::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    // Requests nobody will render complete without pixels, which their connection reports as an error.
+    for (RenderRequest* request : queued)
+    {
+      request->done = true;
+    }
+    queued.clear();
+#ifndef _WIN32
+    for (int connection : connections)
+    {
+      shutdown(connection, SHUT_RDWR);
+    }
+#endif
+  }
+  requestQueued.notify_all();
+  batchCompleted.notify_all();
+}
+
+void RenderServer::acceptLoop()
+{
+#ifndef _WIN32
+  traceSetThreadName("server");
+  while (!isStopping())
+  {
+    pollfd listening = { listenSocket, POLLIN, 0 };
+    if (poll(&listening, 1, 200) <= 0)
+    {
+      continue;
+    }
+    int const connection = accept(listenSocket, nullptr, nullptr);
+    if (connection < 0)
+    {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping)
+    {
+      close(connection);
+      break;
+    }
+    connections.push_back(connection);
+    ++activeConnections;
+    std::thread(&RenderServer::serveConnection, this, connection).detach();
+  }
+#endif
+}
+
+void RenderServer::serveConnection(int connection)
+{
+#ifndef _WIN32
+  std::string buffer;
+  char chunk[4096];
+  bool open = true;
+  while (open)
+  {
+    ssize_t const received = recv(connection, chunk, sizeof(chunk), 0);
+    if (received <= 0)
+    {
+      break;
+    }
+    buffer.append(chunk, (std::size_t)received);
+    std::size_t lineEnd;
+    while (open && (lineEnd = buffer.find('\n')) != std::string::npos)
+    {
+      std::string line = buffer.substr(0, lineEnd);
+      buffer.erase(0, lineEnd + 1);
+      if (!line.empty() && line.back() == '\r')
+      {
+        line.pop_back();
+      }
+      open = handleRequest(connection, line);
+    }
+  }
+  // Deregister before closing so stop() never shuts down a reused descriptor.
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    connections.erase(std::find(connections.begin(), connections.end(), connection));
+  }
+  close(connection);
+  std::lock_guard<std::mutex> lock(mutex);
+  --activeConnections;
+  connectionClosed.notify_all();
+#endif
+}
+
+bool RenderServer::handleRequest(int connection, std::string const& line)
+{
+  std::istringstream in(line);
+  std::string command;
+  in >> command;
+  if (command == "metrics")
+  {
+    std::string const report = metricsReport();
+    return sendAll(connection, "OK json " + std::to_string(report.size()) + "\n" + report);
+  }
+  if (command == "shutdown")
+  {
+    sendAll(connection, "OK\n");
+    stop();
+    return false;
+  }
+  if (command != "render")
+  {
+    return sendAll(connection, "ERROR unknown request\n");
+  }
+  auto const start = std::chrono::steady_clock::now();
+  RenderRequest request = {};
+  request.backgroundIters = -1;
+  request.occlusionIters = -1;
+  request.format = ImageWriter::Format::PNG;
+  request.received = start;
+  request.done = false;
+  in >> request.position.x >> request.position.y >> request.position.z >> request.front.x >> request.front.y >> request.front.z >> request.fov;
+  if (in.fail() || !(request.fov > 0.f && request.fov < 180.f) || glm::dot(request.front, request.front) == 0.f)
+  {
+    return sendAll(connection, "ERROR expected render px py pz fx fy fz fov [background=N] [occlusion=N] [format=png|raw]\n");
+  }
+  std::string option;
+  while (in >> option)
+  {
+    if (!parseOption(option, request))
+    {
+      return sendAll(connection, "ERROR bad option " + option + "\n");
+    }
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (stopping)
+    {
+      return false;
+    }
+    queued.push_back(&request);
+    requestQueued.notify_one();
+    batchCompleted.wait(lock, [&request] { return request.done; });
+  }
+  if (request.pixels.empty())
+  {
+    sendAll(connection, "ERROR server stopping\n");
+    return false;
+  }
+  std::ostringstream image;
+  {
+    TraceZone zone("encode");
+    writeImage(image, request.format, width, height, request.pixels.data());
+  }
+  std::string const encoded = image.str();
+  std::ostringstream header;
+  header << "OK " << (request.format == ImageWriter::Format::PNG ? "png " : "raw ") << width << " " << height << " " << encoded.size() << "\n";
+  bool const sent = sendAll(connection, header.str()) && sendAll(connection, encoded);
+  std::lock_guard<std::mutex> lock(mutex);
+  addSample(Latency, millisecondsBetween(start, std::chrono::steady_clock::now()));
+  return sent;
+}
+
+std::string RenderServer::metricsReport()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  std::ostringstream report;
+  std::ostringstream meanBatch;
+  std::ostringstream meanDepth;
+  meanBatch << (batchCount > 0 ? (double)requestCount / batchCount : 0.0);
+  meanDepth << (batchCount > 0 ? (double)queueDepthTotal / batchCount : 0.0);
+  writeTimingReport(report, true, {
+    { "requests", std::to_string(requestCount) },
+    { "batches", std::to_string(batchCount) },
+    { "mean_batch_size", meanBatch.str() },
+    { "queue_depth", std::to_string(queued.size()) },
+    { "mean_queue_depth", meanDepth.str() },
+    { "max_queue_depth", std::to_string(maxQueueDepth) },
+    { "connections", std::to_string(activeConnections) } }, series);
+  return report.str();
+}
+
+void RenderServer::addSample(int seriesIndex, double milliseconds)
+{
+  std::vector<double>& samples = series[seriesIndex].milliseconds;
+  if (samples.size() >= 2 * sampleWindow)
+  {
+    samples.erase(samples.begin(), samples.end() - sampleWindow);
+  }
+  samples.push_back(milliseconds);
+}
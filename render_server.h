@@ -0,0 +1,68 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "third-party/glm/glm/glm.hpp"
+#include "gpu_timer.h"
+#include "image_writer.h"
+
+struct RenderRequest
+{
+  glm::vec3 position;
+  glm::vec3 front;
+  float fov;
+  int backgroundIters;
+  int occlusionIters;
+  ImageWriter::Format format;
+  std::vector<std::uint8_t> pixels;
+  std::chrono::steady_clock::time_point received;
+  bool done;
+};
+
+/* Accepts render requests over a Unix domain socket. Every connection has its own thread
+ * that parses request lines, queues them and encodes the finished image; the thread that
+ * owns the GL context takes everything queued so far as one batch, so requests arriving
+ * while a batch renders are coalesced into the next one. */
+class RenderServer
+{
+public:
+  RenderServer(std::filesystem::path const& socketPath, int width, int height);
+  ~RenderServer();
+  RenderServer(RenderServer const&) = delete;
+  RenderServer& operator=(RenderServer const&) = delete;
+  std::vector<RenderRequest*> waitForBatch(std::size_t maxBatch, std::chrono::milliseconds timeout);
+  void completeBatch(std::vector<RenderRequest*> const& batch);
+  bool isStopping();
+  void stop();
+private:
+  void acceptLoop();
+  void serveConnection(int connection);
+  bool handleRequest(int connection, std::string const& line);
+  std::string metricsReport();
+  void addSample(int seriesIndex, double milliseconds);
+  std::filesystem::path socketPath;
+  int width;
+  int height;
+  int listenSocket;
+  std::mutex mutex;
+  std::condition_variable requestQueued;
+  std::condition_variable batchCompleted;
+  std::deque<RenderRequest*> queued;
+  std::condition_variable connectionClosed;
+  std::vector<int> connections;
+  int activeConnections;
+  bool stopping;
+  std::uint64_t requestCount;
+  std::uint64_t batchCount;
+  std::size_t maxQueueDepth;
+  std::size_t queueDepthTotal;
+  std::vector<TimingSeries> series;
+  std::chrono::steady_clock::time_point batchStart;
+  std::thread acceptor;
+};
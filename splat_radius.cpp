@@ -0,0 +1,189 @@
+#include "splat_radius.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  int const neighbourCount = 6;
+  float const radiusScale = .75f;
+  int const cellBits = 21;
+  std::size_t const chunkPoints = 1 << 14;
+  std::size_t const boundsSamples = 1 << 16;
+  float const boundsPercentile = .01f;
+  double const maxCellPoints = 32.;
+  int const maxRefinements = 8;
+
+  // Cell coordinates wrap around at 2^cellBits, so far cells may share a key; that only adds candidates, never loses one.
+  std::uint64_t cellKey(std::int64_t x, std::int64_t y, std::int64_t z)
+  {
+    std::uint64_t const mask = ((std::uint64_t)1 << cellBits) - 1;
+    return (((std::uint64_t)x & mask) << (2 * cellBits)) | (((std::uint64_t)y & mask) << cellBits) | ((std::uint64_t)z & mask);
+  }
+}
+
+void estimateSplatRadii(float const* points, int stride, std::size_t count, ThreadPool& pool, float* radii)
+{
+  if (count < 2)
+  {
+    std::fill(radii, radii + count, 0.f);
+    return;
+  }
+  TraceZone zone("estimateSplatRadii");
+  // The extent is taken between the 1st and 99th percentiles of an even sample, so a few far outliers do not widen the cells.
+  std::size_t const sampleCount = std::min(count, boundsSamples);
+  float lower[3];
+  float extent = 1e-12f;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    std::vector<float> sample(sampleCount);
+    for (std::size_t s = 0; s < sampleCount; ++s)
+    {
+      sample[s] = points[(s * count / sampleCount) * stride + axis];
+    }
+    std::size_t const low = (std::size_t)(boundsPercentile * (sampleCount - 1));
+    std::size_t const high = sampleCount - 1 - low;
+    std::nth_element(sample.begin(), sample.begin() + low, sample.end());
+    lower[axis] = sample[low];
+    std::nth_element(sample.begin(), sample.begin() + high, sample.end());
+    extent = std::max(extent, sample[high] - lower[axis]);
+  }
+  // Points on a surface of this extent are about extent / sqrt(count) apart.
+  double cellSize = 2. * extent / std::sqrt((double)count);
+  auto cellOf = [&](float const* point, int axis)
+  {
+    return (std::int64_t)std::floor((point[axis] - lower[axis]) / cellSize);
+  };
+
+  int const chunkCount = (int)((count + chunkPoints - 1) / chunkPoints);
+  std::vector<std::pair<std::uint64_t, std::uint32_t>> cells(count);
+  /* Volumetric or clustered points crowd far more into a cell than a surface spanning the extent
+   * would, which makes the search quadratic in the cell size. Cells are halved until a point shares
+   * its cell with maxCellPoints others on average; sparse points may then find fewer neighbours. */
+  for (int refinement = 0; ; ++refinement)
+  {
+    pool.parallelFor(chunkCount, [&](int chunk, int)
+    {
+      std::size_t const end = std::min(count, (chunk + 1) * chunkPoints);
+      for (std::size_t i = chunk * chunkPoints; i < end; ++i)
+      {
+        float const* point = points + i * stride;
+        cells[i] = { cellKey(cellOf(point, 0), cellOf(point, 1), cellOf(point, 2)), (std::uint32_t)i };
+      }
+    });
+    std::sort(cells.begin(), cells.end());
+    double crowding = 0.;
+    for (std::size_t first = 0, i = 1; i <= count; ++i)
+    {
+      if (i == count || cells[i].first != cells[first].first)
+      {
+        crowding += (double)(i - first) * (i - first);
+        first = i;
+      }
+    }
+    if (crowding / count <= maxCellPoints || refinement == maxRefinements)
+    {
+      break;
+    }
+    cellSize *= .5;
+  }
+
+  // Non-empty cells are found through an open addressing table of their ranges in cells.
+  std::vector<std::uint64_t> cellKeys;
+  std::vector<std::uint32_t> cellStarts;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    if (i == 0 || cells[i].first != cells[i - 1].first)
+    {
+      cellKeys.push_back(cells[i].first);
+      cellStarts.push_back((std::uint32_t)i);
+    }
+  }
+  cellStarts.push_back((std::uint32_t)count);
+  int tableBits = 1;
+  while (((std::size_t)1 << tableBits) < cellKeys.size() * 2)
+  {
+    ++tableBits;
+  }
+  std::uint64_t const tableMask = ((std::uint64_t)1 << tableBits) - 1;
+  auto slotOf = [&](std::uint64_t key)
+  {
+    return (key * 0x9E3779B97F4A7C15ull) >> (64 - tableBits);
+  };
+  std::vector<std::uint32_t> table(tableMask + 1, 0);
+  for (std::size_t c = 0; c < cellKeys.size(); ++c)
+  {
+    std::uint64_t slot = slotOf(cellKeys[c]);
+    while (table[slot] != 0)
+    {
+      slot = (slot + 1) & tableMask;
+    }
+    table[slot] = (std::uint32_t)c + 1;
+  }
+
+  // Points are visited in cell order so that neighbouring cells stay in cache.
+  pool.parallelFor(chunkCount, [&](int chunk, int)
+  {
+    std::size_t const end = std::min(count, (chunk + 1) * chunkPoints);
+    for (std::size_t sorted = chunk * chunkPoints; sorted < end; ++sorted)
+    {
+      std::size_t const i = cells[sorted].second;
+      float const* point = points + i * stride;
+      std::int64_t const cell[3] = { cellOf(point, 0), cellOf(point, 1), cellOf(point, 2) };
+      // Squared distances of the nearest neighbours so far, ascending.
+      float nearest[neighbourCount];
+      int found = 0;
+      for (std::int64_t x = cell[0] - 1; x <= cell[0] + 1; ++x)
+      {
+        for (std::int64_t y = cell[1] - 1; y <= cell[1] + 1; ++y)
+        {
+          for (std::int64_t z = cell[2] - 1; z <= cell[2] + 1; ++z)
+          {
+            std::uint64_t const key = cellKey(x, y, z);
+            std::uint64_t slot = slotOf(key);
+            while (table[slot] != 0 && cellKeys[table[slot] - 1] != key)
+            {
+              slot = (slot + 1) & tableMask;
+            }
+            if (table[slot] == 0)
+            {
+              continue;
+            }
+            std::uint32_t const c = table[slot] - 1;
+            for (std::uint32_t entry = cellStarts[c]; entry < cellStarts[c + 1]; ++entry)
+            {
+              std::uint32_t const other = cells[entry].second;
+              if (other == i)
+              {
+                continue;
+              }
+              float const dx = points[(std::size_t)other * stride] - point[0];
+              float const dy = points[(std::size_t)other * stride + 1] - point[1];
+              float const dz = points[(std::size_t)other * stride + 2] - point[2];
+              float const distance = dx * dx + dy * dy + dz * dz;
+              if (found == neighbourCount && distance >= nearest[neighbourCount - 1])
+              {
+                continue;
+              }
+              int rank = found < neighbourCount ? found++ : neighbourCount - 1;
+              for (; rank > 0 && nearest[rank - 1] > distance; --rank)
+              {
+                nearest[rank] = nearest[rank - 1];
+              }
+              nearest[rank] = distance;
+            }
+          }
+        }
+      }
+      float sum = 0.f;
+      for (int n = 0; n < found; ++n)
+      {
+        sum += std::sqrt(nearest[n]);
+      }
+      radii[i] = found > 0 ? radiusScale * sum / found : 0.f;
+    }
+  });
+}
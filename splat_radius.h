@@ -0,0 +1,11 @@
+#pragma once
+#include <cstddef>
+#include "thread_pool.h"
+
+/* Estimates a splat radius for each of count points, in the points' own units, from the
+ * spacing to their neighbours. Points are bucketed into a uniform grid with cells about two
+ * surface spacings wide, measured without outliers and halved while cells are crowded; a point's
+ * radius is .75 times the mean distance to the six nearest points found in the surrounding cells,
+ * which makes discs on an even sampling overlap. Points without neighbours nearby get radius 0
+ * and stay one pixel. */
+void estimateSplatRadii(float const* points, int stride, std::size_t count, ThreadPool& pool, float* radii);
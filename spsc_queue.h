@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/* Bounded queue for exactly one producer and one consumer thread. Each side only writes its
+ * own index, so pushing and popping need no locks; a full or empty queue is reported instead
+ * of waited on. */
+template <typename T>
+class SpscQueue
+{
+public:
+  explicit SpscQueue(std::size_t capacity)
+    : slots(capacity + 1),
+    head(0),
+    tail(0)
+  {
+  }
+  SpscQueue(SpscQueue const&) = delete;
+  SpscQueue& operator=(SpscQueue const&) = delete;
+  // Leaves value untouched when the queue is full.
+  bool tryPush(T&& value)
+  {
+    std::size_t const current = tail.load(std::memory_order_relaxed);
+    std::size_t const next = (current + 1) % slots.size();
+    if (next == head.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    slots[current] = std::move(value);
+    tail.store(next, std::memory_order_release);
+    return true;
+  }
+  bool tryPop(T& value)
+  {
+    std::size_t const current = head.load(std::memory_order_relaxed);
+    if (current == tail.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    value = std::move(slots[current]);
+    head.store((current + 1) % slots.size(), std::memory_order_release);
+    return true;
+  }
+private:
+  std::vector<T> slots;
+  std::atomic<std::size_t> head;
+  std::atomic<std::size_t> tail;
+};
@@ -0,0 +1,94 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threadCount)
+  : job(nullptr),
+  jobTasks(0),
+  nextTask(0),
+  activeWorkers(0),
+  generation(0),
+  stopping(false)
+{
+  if (threadCount <= 0)
+  {
+    threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+  }
+  for (int worker = 1; worker < threadCount; ++worker)
+  {
+    workers.emplace_back(&ThreadPool::workerLoop, this, worker);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread& worker : workers)
+  {
+    worker.join();
+  }
+}
+
+int ThreadPool::getThreadCount() const
+{
+  return (int)workers.size() + 1;
+}
+
+void ThreadPool::parallelFor(int taskCount, std::function<void(int task, int worker)> const& task)
+{
+  if (workers.empty() || taskCount <= 1)
+  {
+    for (int i = 0; i < taskCount; ++i)
+    {
+      task(i, 0);
+    }
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job = &task;
+    jobTasks = taskCount;
+    nextTask.store(0);
+    activeWorkers = (int)workers.size();
+    ++generation;
+  }
+  wake.notify_all();
+  runTasks(0);
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [this]() { return activeWorkers == 0; });
+  job = nullptr;
+}
+
+void ThreadPool::runTasks(int worker)
+{
+  for (int i = nextTask.fetch_add(1); i < jobTasks; i = nextTask.fetch_add(1))
+  {
+    (*job)(i, worker);
+  }
+}
+
+void ThreadPool::workerLoop(int worker)
+{
+  std::uint64_t seen = 0;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&]() { return stopping || generation != seen; });
+      if (stopping)
+      {
+        return;
+      }
+      seen = generation;
+    }
+    runTasks(worker);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--activeWorkers == 0)
+    {
+      done.notify_one();
+    }
+  }
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fixed set of worker threads for data-parallel loops. The calling thread takes part as
+ * worker 0, so worker indices range over [0, getThreadCount()) and can index scratch data. */
+class ThreadPool
+{
+public:
+  explicit ThreadPool(int threadCount = 0);
+  ~ThreadPool();
+  ThreadPool(ThreadPool const&) = delete;
+  ThreadPool& operator=(ThreadPool const&) = delete;
+  int getThreadCount() const;
+  void parallelFor(int taskCount, std::function<void(int task, int worker)> const& task);
+private:
+  void runTasks(int worker);
+  void workerLoop(int worker);
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  std::function<void(int, int)> const* job;
+  int jobTasks;
+  std::atomic<int> nextTask;
+  int activeWorkers;
+  std::uint64_t generation;
+  bool stopping;
+};
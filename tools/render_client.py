@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""Test client for Rosenthal-Linsen-Lars-2008 --serve.
+
+Sends render requests for an orbit around a point from several concurrent connections,
+optionally saves the returned images, and prints client-side latencies and the server's
+metrics report.
+"""
+import argparse
+import math
+import os
+import socket
+import threading
+import time
+
+
+def read_line(sock, buffer):
+    while b"\n" not in buffer:
+        chunk = sock.recv(65536)
+        if not chunk:
+            raise ConnectionError("server closed the connection")
+        buffer += chunk
+    line, _, rest = buffer.partition(b"\n")
+    return line.decode(), rest
+
+
+def read_exact(sock, buffer, size):
+    while len(buffer) < size:
+        chunk = sock.recv(max(65536, size - len(buffer)))
+        if not chunk:
+            raise ConnectionError("server closed the connection")
+        buffer += chunk
+    return buffer[:size], buffer[size:]
+
+
+def request(sock, buffer, line):
+    sock.sendall(line.encode() + b"\n")
+    header, buffer = read_line(sock, buffer)
+    fields = header.split()
+    if not fields or fields[0] != "OK":
+        raise RuntimeError(header)
+    payload = b""
+    if len(fields) > 1:
+        payload, buffer = read_exact(sock, buffer, int(fields[-1]))
+    return fields, payload, buffer
+
+
+def orbit_pose(args, index):
+    angle = 2.0 * math.pi * index / args.requests
+    position = (args.center[0] + args.radius * math.sin(angle), args.center[1],
+                args.center[2] + args.radius * math.cos(angle))
+    front = tuple(c - p for c, p in zip(args.center, position))
+    return position + front + (args.fov,)
+
+
+def worker(args, indices, latencies, errors):
+    try:
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+            sock.connect(args.socket)
+            send_requests(args, sock, indices, latencies)
+    except (OSError, RuntimeError) as error:
+        errors.append(str(error))
+
+
+def send_requests(args, sock, indices, latencies):
+    buffer = b""
+    for index in indices:
+        line = "render " + " ".join("%g" % v for v in orbit_pose(args, index))
+        line += " format=" + args.format
+        if args.background is not None:
+            line += " background=%d" % args.background
+        if args.occlusion is not None:
+            line += " occlusion=%d" % args.occlusion
+        start = time.perf_counter()
+        fields, payload, buffer = request(sock, buffer, line)
+        latencies.append((time.perf_counter() - start) * 1000.0)
+        if args.output:
+            name = "view_%05d.%s" % (index, fields[1] if fields[1] == "png" else "rgb")
+            with open(os.path.join(args.output, name), "wb") as image:
+                image.write(payload)
+
+
+def simple_request(path, line):
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.connect(path)
+        _, payload, _ = request(sock, b"", line)
+        return payload.decode()
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0.0
+    rank = max(1, math.ceil(p / 100.0 * len(sorted_values)))
+    return sorted_values[min(len(sorted_values), rank) - 1]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("socket", help="server socket path")
+    parser.add_argument("--requests", type=int, default=64, help="number of render requests")
+    parser.add_argument("--concurrency", type=int, default=8, help="parallel connections")
+    parser.add_argument("--center", type=float, nargs=3, default=(0.5, 0.5, 0.5), help="orbit center")
+    parser.add_argument("--radius", type=float, default=1.5, help="orbit radius")
+    parser.add_argument("--fov", type=float, default=45.0, help="vertical field of view in degrees")
+    parser.add_argument("--format", choices=("png", "raw"), default="png")
+    parser.add_argument("--background", type=int, help="background fill iterations")
+    parser.add_argument("--occlusion", type=int, help="occlusion fill iterations")
+    parser.add_argument("--output", help="directory for the returned images")
+    parser.add_argument("--shutdown", action="store_true", help="stop the server afterwards")
+    args = parser.parse_args()
+    if args.output:
+        os.makedirs(args.output, exist_ok=True)
+
+    latencies = []
+    errors = []
+    threads = []
+    start = time.perf_counter()
+    for t in range(args.concurrency):
+        indices = range(t, args.requests, args.concurrency)
+        threads.append(threading.Thread(target=worker, args=(args, indices, latencies, errors)))
+        threads[-1].start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.perf_counter() - start
+
+    latencies.sort()
+    print("requests %d errors %d in %.3f s (%.1f/s)" % (len(latencies), len(errors), elapsed, len(latencies) / elapsed))
+    print("latency ms mean %.3f p50 %.3f p95 %.3f p99 %.3f" % (
+        sum(latencies) / max(1, len(latencies)), percentile(latencies, 50), percentile(latencies, 95), percentile(latencies, 99)))
+    for error in errors[:5]:
+        print("error:", error)
+    print(simple_request(args.socket, "metrics"))
+    if args.shutdown:
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+            sock.connect(args.socket)
+            sock.sendall(b"shutdown\n")
+            sock.recv(16)
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""Replays points to Rosenthal-Linsen-Lars-2008 --stream.
+
+Sends the vertices of a PLY file, or a synthetic rotating scan line when no file is given,
+as framed packets at a fixed point rate to a UDP port or a named pipe. Every packet is a
+16-byte little-endian header (magic "RLPS", uint32 sequence, uint32 point count, uint32 flags,
+bit 0 set when colors follow) and then float32 x y z nx ny nz [r g b] per point.
+"""
+import argparse
+import math
+import os
+import socket
+import struct
+import sys
+import time
+
+PLY_TYPES = {
+    "char": "b", "int8": "b", "uchar": "B", "uint8": "B", "short": "h", "int16": "h",
+    "ushort": "H", "uint16": "H", "int": "i", "int32": "i", "uint": "I", "uint32": "I",
+    "float": "f", "float32": "f", "double": "d", "float64": "d",
+}
+
+
+def read_ply(path):
+    """Returns (points, has_color) with points as tuples of 6 or 9 floats."""
+    with open(path, "rb") as ply:
+        if ply.readline().strip() != b"ply":
+            raise ValueError(path + " is not a PLY file")
+        fmt = None
+        elements = []
+        while True:
+            line = ply.readline()
+            if not line:
+                raise ValueError(path + " has no end_header")
+            words = line.decode("ascii", "replace").split()
+            if not words:
+                continue
+            if words[0] == "format":
+                fmt = words[1]
+            elif words[0] == "element":
+                elements.append((words[1], int(words[2]), []))
+            elif words[0] == "property" and elements:
+                if words[1] == "list":
+                    elements[-1][2].append((words[4], words[2], words[3]))
+                else:
+                    elements[-1][2].append((words[2], words[1], None))
+            elif words[0] == "end_header":
+                break
+        for name, count, properties in elements:
+            if name == "vertex":
+                rows = read_element(ply, fmt, count, properties)
+                return vertex_points(rows, [p[0] for p in properties])
+            skip_element(ply, fmt, count, properties)
+    raise ValueError(path + " has no vertex element")
+
+
+def read_element(ply, fmt, count, properties):
+    if fmt == "ascii":
+        return [[float(v) for v in ply.readline().split()] for _ in range(count)]
+    if any(p[2] for p in properties):
+        raise ValueError("list properties in vertices are not supported")
+    order = "<" if fmt == "binary_little_endian" else ">"
+    row = struct.Struct(order + "".join(PLY_TYPES[p[1]] for p in properties))
+    data = ply.read(row.size * count)
+    return [list(values) for values in row.iter_unpack(data)]
+
+
+def skip_element(ply, fmt, count, properties):
+    # Elements before the vertices are rare; they are only skipped for ascii files.
+    if fmt != "ascii":
+        raise ValueError("binary elements before the vertices are not supported")
+    for _ in range(count):
+        ply.readline()
+
+
+def vertex_points(rows, names):
+    index = {name: i for i, name in enumerate(names)}
+    for name in ("x", "y", "z", "nx", "ny", "nz"):
+        if name not in index:
+            raise ValueError("vertices need x y z nx ny nz")
+    columns = [index[n] for n in ("x", "y", "z", "nx", "ny", "nz")]
+    has_color = all(n in index for n in ("red", "green", "blue"))
+    if has_color:
+        columns += [index[n] for n in ("red", "green", "blue")]
+    points = []
+    for row in rows:
+        point = [row[c] for c in columns]
+        if has_color:
+            point[6:9] = [v / 255.0 for v in point[6:9]]
+        points.append(tuple(point))
+    return points, has_color
+
+
+def synthetic_points(sweep):
+    """A scan line sweeping around a sphere in front of the default camera."""
+    points = []
+    for i in range(512):
+        theta = math.pi * (i + 0.5) / 512
+        phi = sweep
+        normal = (math.sin(theta) * math.cos(phi), math.cos(theta), math.sin(theta) * math.sin(phi))
+        points.append(tuple(0.5 * n + c for n, c in zip(normal, (0.0, 0.0, -2.0))) + normal)
+    return points
+
+
+def open_sink(args):
+    if args.udp is not None:
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        target = ("127.0.0.1", args.udp)
+        return lambda packet: sock.sendto(packet, target)
+    if not os.path.exists(args.pipe):
+        os.mkfifo(args.pipe)
+    pipe = open(args.pipe, "wb", buffering=0)
+    return pipe.write
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    target = parser.add_mutually_exclusive_group(required=True)
+    target.add_argument("--udp", type=int, metavar="PORT", help="send datagrams to 127.0.0.1:PORT")
+    target.add_argument("--pipe", metavar="PATH", help="write to a named pipe, created if missing")
+    parser.add_argument("ply", nargs="?", help="PLY file to replay, a synthetic scan if omitted")
+    parser.add_argument("--rate", type=float, default=1e6, help="points per second (default 1e6)")
+    parser.add_argument("--packet-points", type=int, default=1024, help="points per packet (default 1024; a UDP datagram holds at most 1819 colored points)")
+    parser.add_argument("--loop", action="store_true", help="replay the file until interrupted")
+    args = parser.parse_args()
+
+    if args.ply:
+        points, has_color = read_ply(args.ply)
+    else:
+        points, has_color = [], False
+    floats = 9 if has_color else 6
+    if args.udp is not None and 16 + args.packet_points * floats * 4 > 65507:
+        parser.error("--packet-points is too large for a UDP datagram")
+    send = open_sink(args)
+    point_format = struct.Struct("<%df" % floats)
+    sequence = 0
+    sent = 0
+    sweep = 0.0
+    start = time.perf_counter()
+    try:
+        while True:
+            if args.ply:
+                chunks = (points[i:i + args.packet_points] for i in range(0, len(points), args.packet_points))
+            else:
+                chunks = [synthetic_points(sweep)]
+                sweep += 0.01
+            for chunk in chunks:
+                packet = b"RLPS" + struct.pack("<III", sequence, len(chunk), 1 if has_color else 0)
+                packet += b"".join(point_format.pack(*point) for point in chunk)
+                send(packet)
+                sequence = (sequence + 1) & 0xFFFFFFFF
+                sent += len(chunk)
+                # Pace against the wall clock so a slow send loop does not drift.
+                delay = start + sent / args.rate - time.perf_counter()
+                if delay > 0:
+                    time.sleep(delay)
+            if args.ply and not args.loop:
+                break
+    except (KeyboardInterrupt, BrokenPipeError):
+        pass
+    elapsed = time.perf_counter() - start
+    print("sent %d points in %d packets, %.0f points/s" % (sent, sequence, sent / max(elapsed, 1e-9)), file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
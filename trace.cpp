@@ -0,0 +1,209 @@
+#include "trace.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+std::atomic<bool> traceEnabled(false);
+
+namespace
+{
+  struct TraceEvent
+  {
+    char const* name;
+    std::int64_t start;
+    std::int64_t end;
+  };
+  // A seqlock slot: sequence is the index of the event it holds plus one, or 0 while it is being written.
+  struct TraceSlot
+  {
+    std::atomic<std::uint64_t> sequence{ 0 };
+    std::atomic<char const*> name{ nullptr };
+    std::atomic<std::int64_t> start{ 0 };
+    std::atomic<std::int64_t> end{ 0 };
+  };
+  struct TraceBuffer
+  {
+    static constexpr std::uint64_t capacity = 1 << 15;
+    int track;
+    std::string name;
+    std::atomic<std::uint64_t> head{ 0 };
+    std::vector<TraceSlot> slots = std::vector<TraceSlot>(capacity);
+  };
+  struct OpenZone
+  {
+    char const* name;
+    std::int64_t start;
+  };
+  std::chrono::steady_clock::time_point const traceEpoch = std::chrono::steady_clock::now();
+  constexpr int maxTracks = 256;
+  std::mutex registryMutex;
+  std::vector<std::unique_ptr<TraceBuffer>> registry;
+  std::atomic<TraceBuffer*> tracks[maxTracks];
+  std::unordered_set<std::string> internedNames;
+
+  TraceBuffer* createBuffer(std::string const& name)
+  {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    if (registry.size() == maxTracks)
+    {
+      return nullptr;
+    }
+    registry.push_back(std::make_unique<TraceBuffer>());
+    TraceBuffer* buffer = registry.back().get();
+    buffer->track = (int)registry.size();
+    buffer->name = name;
+    tracks[buffer->track - 1].store(buffer, std::memory_order_release);
+    return buffer;
+  }
+  TraceBuffer* threadBuffer()
+  {
+    thread_local TraceBuffer* buffer = createBuffer("thread");
+    return buffer;
+  }
+  std::vector<OpenZone>& openZones()
+  {
+    thread_local std::vector<OpenZone> zones;
+    return zones;
+  }
+  void append(TraceBuffer* buffer, TraceEvent const& event)
+  {
+    if (!buffer)
+    {
+      return;
+    }
+    // Single producer per buffer: invalidate the slot, write it and publish it with its new sequence.
+    std::uint64_t const head = buffer->head.load(std::memory_order_relaxed);
+    TraceSlot& slot = buffer->slots[head % TraceBuffer::capacity];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(event.name, std::memory_order_relaxed);
+    slot.start.store(event.start, std::memory_order_relaxed);
+    slot.end.store(event.end, std::memory_order_relaxed);
+    slot.sequence.store(head + 1, std::memory_order_release);
+    buffer->head.store(head + 1, std::memory_order_release);
+  }
+  // Copies event index out of its slot; false when the owning thread has overwritten it meanwhile.
+  bool read(TraceBuffer const& buffer, std::uint64_t index, TraceEvent& event)
+  {
+    TraceSlot const& slot = buffer.slots[index % TraceBuffer::capacity];
+    if (slot.sequence.load(std::memory_order_acquire) != index + 1)
+    {
+      return false;
+    }
+    event.name = slot.name.load(std::memory_order_relaxed);
+    event.start = slot.start.load(std::memory_order_relaxed);
+    event.end = slot.end.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == index + 1;
+  }
+  std::string escapeJSON(std::string const& text)
+  {
+    std::string escaped;
+    for (char c : text)
+    {
+      if (c == '"' || c == '\\')
+      {
+        escaped += '\\';
+      }
+      escaped += c;
+    }
+    return escaped;
+  }
+}
+
+std::int64_t traceNow()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceEpoch).count();
+}
+
+char const* traceIntern(std::string const& name)
+{
+  std::lock_guard<std::mutex> lock(registryMutex);
+  return internedNames.insert(name).first->c_str();
+}
+
+void traceSetThreadName(char const* name)
+{
+  TraceBuffer* buffer = threadBuffer();
+  std::lock_guard<std::mutex> lock(registryMutex);
+  if (buffer)
+  {
+    buffer->name = name;
+  }
+}
+
+int traceCreateTrack(char const* name)
+{
+  TraceBuffer* buffer = createBuffer(name);
+  return buffer ? buffer->track : -1;
+}
+
+void traceRecord(char const* name, std::int64_t start, std::int64_t end, int track)
+{
+  if (track > 0 && track <= maxTracks)
+  {
+    append(tracks[track - 1].load(std::memory_order_acquire), { name, start, end });
+    return;
+  }
+  append(threadBuffer(), { name, start, end });
+}
+
+void traceBegin(char const* name)
+{
+  if (traceEnabled.load(std::memory_order_relaxed))
+  {
+    openZones().push_back({ name, traceNow() });
+  }
+}
+
+void traceEnd()
+{
+  std::vector<OpenZone>& zones = openZones();
+  if (!zones.empty())
+  {
+    traceRecord(zones.back().name, zones.back().start, traceNow());
+    zones.pop_back();
+  }
+}
+
+void writeChromeTrace(std::filesystem::path const& tracePath)
+{
+  std::ofstream out(tracePath);
+  if (out.fail())
+  {
+    throw std::runtime_error(tracePath.string() + " failed to open");
+  }
+  std::lock_guard<std::mutex> lock(registryMutex);
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+  bool first = true;
+  for (auto const& buffer : registry)
+  {
+    out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->track
+      << ",\"args\":{\"name\":\"" << escapeJSON(buffer->name) << "\"}}";
+    first = false;
+    // The owning thread keeps recording; slots it overwrites while they are read are skipped.
+    std::uint64_t const head = buffer->head.load(std::memory_order_acquire);
+    std::uint64_t const begin = head > TraceBuffer::capacity ? head - TraceBuffer::capacity : 0;
+    for (std::uint64_t i = begin; i < head; ++i)
+    {
+      TraceEvent event;
+      if (!read(*buffer, i, event))
+      {
+        continue;
+      }
+      out << ",\n{\"name\":\"" << escapeJSON(event.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->track
+        << ",\"ts\":" << event.start * 1e-3 << ",\"dur\":" << (event.end - event.start) * 1e-3 << "}";
+    }
+  }
+  out << std::endl << "]}" << std::endl;
+  if (out.fail())
+  {
+    throw std::runtime_error(tracePath.string() + " failed to write");
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+/* Lightweight zone tracing. Every thread appends to its own fixed ring of events, so
+ * recording takes no locks; while traceEnabled is false a zone costs one relaxed load. */
+extern std::atomic<bool> traceEnabled;
+
+std::int64_t traceNow();
+char const* traceIntern(std::string const& name);
+void traceSetThreadName(char const* name);
+int traceCreateTrack(char const* name);
+void traceRecord(char const* name, std::int64_t start, std::int64_t end, int track = 0);
+void traceBegin(char const* name);
+void traceEnd();
+void writeChromeTrace(std::filesystem::path const& tracePath);
+
+class TraceZone
+{
+public:
+  explicit TraceZone(char const* name)
+    : name(traceEnabled.load(std::memory_order_relaxed) ? name : nullptr),
+    start(this->name ? traceNow() : 0)
+  {
+  }
+  ~TraceZone()
+  {
+    if (name)
+    {
+      traceRecord(name, start, traceNow());
+    }
+  }
+  TraceZone(TraceZone const&) = delete;
+  TraceZone& operator=(TraceZone const&) = delete;
+private:
+  char const* name;
+  std::int64_t start;
+};